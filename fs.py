@@ -1,11 +1,58 @@
 env = DefaultEnvironment()
+import gzip
+import hashlib
+import os
+import re
+import shutil
 from os.path import join
 from SCons.Script import COMMAND_LINE_TARGETS
 board = env.BoardConfig()
 mcu = board.get("build.mcu", "esp32")
 
+# text files are stored gzip compressed and served as is with Content-Encoding: gzip
+GZIP_EXTENSIONS = (".html", ".css", ".js", ".json", ".ico", ".svg")
+ASSET_REF = re.compile(r"assets/([A-Za-z0-9_.-]+)")
+
+def content_hash(data):
+  return hashlib.sha256(data).hexdigest()[:16]
+
+def prepare_data(src, dst):
+  """
+  Copies the web files from src into dst the way the firmware serves them: literal references to
+  files in assets/ get the file hash appended as ?v= so they can be cached for good, text files
+  are gzip compressed and manifest.txt lists the content hash of every file, sent as its ETag.
+  """
+  files = {}
+  for root, _, names in os.walk(src):
+    for name in names:
+      path = join(root, name)
+      with open(path, "rb") as f:
+        files["/" + os.path.relpath(path, src).replace(os.sep, "/")] = f.read()
+  hashes = {path: content_hash(data) for path, data in files.items() if path.startswith("/assets/")}
+  def versioned(match):
+    path = "/assets/" + match.group(1)
+    return f"{match.group(0)}?v={hashes[path]}" if path in hashes else match.group(0)
+  shutil.rmtree(dst, ignore_errors=True)
+  manifest = []
+  for path, data in sorted(files.items()):
+    if path.endswith((".html", ".css")):
+      data = ASSET_REF.sub(versioned, data.decode()).encode()
+    manifest.append(f"{path} {content_hash(data)}")
+    out = join(dst, path.lstrip("/"))
+    os.makedirs(os.path.dirname(out), exist_ok=True)
+    if path.endswith(GZIP_EXTENSIONS):
+      data = gzip.compress(data, 9, mtime=0)
+      out += ".gz"
+    with open(out, "wb") as f:
+      f.write(data)
+  with open(join(dst, "manifest.txt"), "w") as f:
+    f.write("\n".join(manifest) + "\n")
+
+data_dir = join(env.subst("$BUILD_DIR"), "data")
+prepare_data(env.subst("$PROJECT_DATA_DIR"), data_dir)
+
 target_firm = env.DataToBin(
-    join("$BUILD_DIR", "${ESP32_FS_IMAGE_NAME}"), "$PROJECT_DATA_DIR"
+    join("$BUILD_DIR", "${ESP32_FS_IMAGE_NAME}"), data_dir
 )
 env.NoCache(target_firm)
 AlwaysBuild(target_firm)
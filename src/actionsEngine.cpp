@@ -0,0 +1,91 @@
+#define JSON_NOEXCEPTION 1
+#include "actionsEngine.h"
+#include "espConfig.h"
+#include "eventBus.h"
+#include "pixelAnimator.h"
+
+static const char* TAG = "actionsEngine";
+
+actionsEngine_t actionsEngine;
+
+void actionsEngine_t::timer_cb(void* arg) {
+  actionsEngine.send({ actionCmd_t::TIMER, uint8_t(reinterpret_cast<uintptr_t>(arg)), uint32_t(esp_timer_get_time()) });
+}
+
+void actionsEngine_t::send(const actionCmd_t& cmd) {
+  if (queue == nullptr) return;
+  if (xQueueSend(queue, &cmd, 0) != pdTRUE) {
+    LOG(W, "Actions queue full, dropping action %d", cmd.kind);
+  }
+  xTaskNotifyGive(task);
+}
+
+void actionsEngine_t::feedback(bool success, uint32_t queued, uint16_t tap, uint8_t reader) {
+  uint8_t pin = success ? espConfig::miscConfig.nfcSuccessPin : espConfig::miscConfig.nfcFailPin;
+  if (pin && pin != 255) {
+    LOG(D, "%s LED %d", success ? "SUCCESS" : "FAIL", pin);
+    digitalWrite(pin, success ? espConfig::miscConfig.nfcSuccessHL : espConfig::miscConfig.nfcFailHL);
+    feedbackLatency.add(queued, tap, reader);
+    arm(success ? SUCCESS_LED : FAIL_LED, success ? espConfig::miscConfig.nfcSuccessTime : espConfig::miscConfig.nfcFailTime);
+  }
+  if (espConfig::miscConfig.nfcNeopixelPin && espConfig::miscConfig.nfcNeopixelPin != 255 && pixel) {
+    pixelAnimator.play(success ? pixelAnimator_t::SUCCESS : pixelAnimator_t::FAIL);
+  }
+}
+
+void actionsEngine_t::expire(uint8_t id) {
+  switch (id) {
+  case SUCCESS_LED:
+    if (espConfig::miscConfig.nfcSuccessPin != 255) digitalWrite(espConfig::miscConfig.nfcSuccessPin, !espConfig::miscConfig.nfcSuccessHL);
+    break;
+  case FAIL_LED:
+    if (espConfig::miscConfig.nfcFailPin != 255) digitalWrite(espConfig::miscConfig.nfcFailPin, !espConfig::miscConfig.nfcFailHL);
+    break;
+  }
+}
+
+void actionsEngine_t::task_entry(void* arg) {
+  actionsEngine_t& engine = *static_cast<actionsEngine_t*>(arg);
+  eventBus_t::subscriber_t* sub = eventBus.subscribe();
+  busEvent_t event;
+  actionCmd_t cmd;
+  while (1) {
+    {
+      espConfig::lock_t lock;
+      while (eventBus.next(*sub, event)) {
+        if (event.type == busEvent_t::LOCK_STATE) continue;
+        bool success = event.type == busEvent_t::HOMEKEY_SUCCESS || event.allowed;
+        engine.feedback(success, event.posted, event.tap, event.reader);
+      }
+      while (xQueueReceive(engine.queue, &cmd, 0) == pdTRUE) {
+        switch (cmd.kind) {
+        case actionCmd_t::FEEDBACK:
+          engine.feedback(cmd.arg, cmd.queued);
+          break;
+        case actionCmd_t::TIMER:
+          engine.expire(cmd.arg);
+          break;
+        }
+      }
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+}
+
+void actionsEngine_t::begin() {
+  queue = xQueueCreate(8, sizeof(actionCmd_t));
+  for (uint8_t i = 0; i < TIMERS; i++) {
+    esp_timer_create_args_t args{};
+    args.callback = timer_cb;
+    args.arg = reinterpret_cast<void*>(uintptr_t(i));
+    args.name = "actions";
+    esp_timer_create(&args, &timers[i]);
+  }
+  xTaskCreate(task_entry, "actions_task", 4096, this, 2, &task);
+}
+
+json actionsEngine_t::toJson() const {
+  json result;
+  result["feedback"] = feedbackLatency.toJson();
+  return result;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <Arduino.h>
+#include <HomeKey.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <array>
+#include "tapTrace.h"
+
+/**
+ * Command queued to the actions engine.
+ */
+struct actionCmd_t
+{
+  enum kind_t : uint8_t
+  {
+    FEEDBACK,
+    TIMER
+  };
+  kind_t kind;
+  uint8_t arg; // FEEDBACK: 1 = success, 0 = failure, TIMER: timer ID
+  uint32_t queued;
+};
+
+/**
+ * Single task driving the feedback LEDs and the NeoPixel animations, the lock GPIO action is driven by
+ * `lockStateMachine`.
+ *
+ * The task sleeps until it is notified, either by the event bus or by `send`, so nothing is polled.
+ * Pulses never block it: the GPIO is set right away and an `esp_timer` one-shot posts a TIMER command
+ * back to the queue when it should be reverted. A new pulse on the same output re-triggers its timer,
+ * pulses on different outputs overlap. The time from a feedback being queued to its GPIO write is
+ * tracked.
+ */
+struct actionsEngine_t
+{
+  enum timer_id_t : uint8_t
+  {
+    SUCCESS_LED,
+    FAIL_LED,
+    TIMERS
+  };
+  struct latency_t
+  {
+    uint32_t count = 0;
+    uint64_t total = 0;
+    uint32_t max = 0;
+    void add(uint32_t queued, uint16_t tap = 0, uint8_t reader = tapTrace_t::noReader) {
+      uint32_t elapsed = uint32_t(esp_timer_get_time()) - queued;
+      count++;
+      total += elapsed;
+      max = std::max(max, elapsed);
+      tapTrace.record(tapTrace_t::GPIO, esp_timer_get_time() - elapsed, esp_timer_get_time(), tap, reader);
+    }
+    json toJson() const {
+      json result;
+      result["count"] = count;
+      result["avg_us"] = count ? uint32_t(total / count) : 0;
+      result["max_us"] = max;
+      return result;
+    }
+  };
+  QueueHandle_t queue = nullptr;
+  TaskHandle_t task = nullptr;
+  std::array<esp_timer_handle_t, TIMERS> timers{};
+  latency_t feedbackLatency;
+
+  static void timer_cb(void* arg);
+  void send(const actionCmd_t& cmd);
+  void arm(timer_id_t id, uint32_t ms) {
+    esp_timer_stop(timers[id]);
+    esp_timer_start_once(timers[id], uint64_t(ms) * 1000);
+  }
+  void feedback(bool success, uint32_t queued, uint16_t tap = 0, uint8_t reader = tapTrace_t::noReader);
+  void expire(uint8_t id);
+  static void task_entry(void* arg);
+  void begin();
+  json toJson() const;
+};
+
+extern actionsEngine_t actionsEngine;
@@ -1,3 +1,4 @@
+#pragma once
 enum HK_COLOR
 {
   TAN,
@@ -50,6 +51,16 @@ enum class gpioMomentaryStateStatus : uint8_t
 //MQTT Flags
 #define MQTT_CUSTOM_STATE_ENABLED 0 // Flag to enable the use of custom states and relevant MQTT Topics
 #define MQTT_DISCOVERY true //Enable or disable discovery for home assistant tags functionality, set to true to enable.
+#define MQTT_DISPATCH_MAX_ROUTES 8 // Number of MQTT topic filters the command dispatch table can hold
+#define MQTT_DISPATCH_MAX_MESSAGE 256 // Largest command payload reassembled when the MQTT client delivers it in several chunks (bytes)
+
+// MQTT Offline Journal
+#define MQTT_JOURNAL_RECORDS 128 // Number of tap and state events kept on LittleFS while the broker is unreachable, oldest are overwritten
+#define MQTT_JOURNAL_BATCH 16 // Number of journaled events replayed per batch after reconnecting
+
+// MQTT Binary Payloads
+#define MQTT_BINARY_BATCH 8 // Maximum number of tap events packed into one publish on the binary topic
+#define MQTT_BINARY_BATCH_WINDOW 100 // Time in ms a tap event waits on the binary topic for others to share its publish
 
 // MQTT Topics
 #define MQTT_LWT_TOPIC "status"
@@ -61,6 +72,9 @@ enum class gpioMomentaryStateStatus : uint8_t
 #define MQTT_SET_CURRENT_STATE_TOPIC "homekit/set_current_state" // MQTT Control Topic for the HomeKit lock current state
 #define MQTT_STATE_TOPIC "homekit/state" // MQTT Topic for publishing the HomeKit lock target state
 #define MQTT_PROX_BAT_TOPIC "homekit/set_battery_lvl" // MQTT Topic for publishing the HomeKit lock target state
+#define MQTT_ALLOWLIST_TOPIC "homekey/allowlist" // MQTT Control Topic for bulk loading the UID allowlist
+#define MQTT_DIAG_TOPIC "homekey/diagnostics" // MQTT Topic for publishing the latency of the last tap and the Wi-Fi RSSI
+#define MQTT_HASS_STATUS_TOPIC "homeassistant/status" // Home Assistant birth and will topic, discovery configs are republished when it comes online
 
 // Miscellaneous
 #define HOMEKEY_COLOR TAN
@@ -69,6 +83,13 @@ enum class gpioMomentaryStateStatus : uint8_t
 #define DEVICE_NAME "HK" //Device name
 #define HOMEKEY_ALWAYS_UNLOCK 0 // Flag indicating if a successful Homekey authentication should always set and publish the unlock state
 #define HOMEKEY_ALWAYS_LOCK 0  // Flag indicating if a successful Homekey authentication should always set and publish the lock state
+#define HOMEKEY_AUTH_POOL_SIZE 2 // Number of authentication contexts (reader ephemeral key pairs) generated ahead of time, 0 to disable
+#define HOMEKEY_FLOW_SKIP_FAST_AFTER 2 // Consecutive FAST failures after which an endpoint is considered to need the STANDARD flow
+#define HOMEKEY_FLOW_FAST_PROBE 8 // While FAST is being skipped, retry it every this many taps to relearn
+#define UID_ALLOWLIST_MAX_ENTRIES 10240 // Maximum number of non-HomeKey UIDs in the local allowlist (8 bytes of LittleFS each)
+#define UID_ALLOWLIST_BLOOM_BITS 65536 // Size of the in-RAM Bloom filter in front of the allowlist (bits)
+#define UID_ALLOWLIST_RUN_SIZE 1024 // UIDs sorted in RAM at a time while loading the allowlist, larger lists are merged from LittleFS (8 bytes of RAM each)
+#define UID_ALLOWLIST_LOAD_TIMEOUT 60 // Seconds an unfinished allowlist load may sit idle before another load can take its place
 #define HS_STATUS_LED 255 // HomeSpan Status LED GPIO pin
 #define HS_PIN 255 // GPIO Pin for a Configuration Mode button (more info on https://github.com/HomeSpan/HomeSpan/blob/master/docs/UserGuide.md#device-configuration-mode)
 
@@ -82,6 +103,8 @@ enum class gpioMomentaryStateStatus : uint8_t
 #define NEOPIXEL_FAIL_B 0 // Color value for Blue - Fail HK Auth
 #define NEOPIXEL_SUCCESS_TIME 1000 // GPIO Delay time in ms - Success HK Auth
 #define NEOPIXEL_FAIL_TIME 1000 // GPIO Delay time in ms - Success HK Auth
+#define NEOPIXEL_COUNT 1 // Number of pixels on the NeoPixel strip
+#define NEOPIXEL_IDLE_BREATHE false // Slowly breathe the success color while idle instead of keeping the pixels off
 #define NFC_SUCCESS_PIN 255 // GPIO Pin pulled HIGH or LOW (see NFC_SUCCESS_HL) on success HK Auth
 #define NFC_SUCCESS_HL HIGH // Flag to define if NFC_SUCCESS_PIN should be held High or Low
 #define NFC_SUCCESS_TIME 1000 // How long should NFC_SUCCESS_PIN be held High or Low
@@ -94,7 +117,26 @@ enum class gpioMomentaryStateStatus : uint8_t
 #define GPIO_ACTION_MOMENTARY_STATE static_cast<uint8_t>(gpioMomentaryStateStatus::M_DISABLED)
 #define GPIO_ACTION_MOMENTARY_TIMEOUT 5000
 
+// NFC Polling
+#define NFC_POLL_ECP_TIMEOUT 100 // How long to wait for the PN532 to finish sending the ECP frame (ms)
+#define NFC_POLL_DETECT_TIMEOUT 500 // How long to wait for the PN532 to answer a passive target search (ms)
+#define NFC_POLL_ACTIVE_INTERVAL 10 // Delay between polling cycles while the reader has seen recent activity (ms)
+#define NFC_POLL_IDLE_INTERVAL 200 // Delay between polling cycles while the reader is idle (ms)
+#define NFC_POLL_ACTIVE_WINDOW 60 // How long after the last tap the reader keeps polling aggressively (s)
+#define NFC_REMOVAL_PROBE_INTERVAL 50 // Delay between presence checks while a target is kept in the field after a tap (ms)
+#define NFC_REMOVAL_HOLDOFF 2500 // How long a target left in the field is tracked before polling resumes anyway (ms)
+#define NFC_POLL_MIN_INTERVAL 10 // Lowest polling and removal probe interval accepted from the config, keeps the NFC task from spinning (ms)
+#define NFC_IRQ_PIN 255 // GPIO Pin connected to the PN532 IRQ line, enables interrupt-driven detection (255 = disabled, polling only)
+#define NFC_MAX_READERS 4 // Maximum number of PN532 readers on the shared SPI bus, the first one plus additional ones with their own SS pin
+
 // WebUI
 #define WEB_AUTH_ENABLED false
 #define WEB_AUTH_USERNAME "admin"
-#define WEB_AUTH_PASSWORD "password"
\ No newline at end of file
+#define WEB_AUTH_PASSWORD "password"
+#define WEB_API_MAX_BODY 2048 // Largest JSON body accepted by PATCH /api/config/{mqtt,misc,actions} (bytes)
+#define WEB_API_ISSUERS_PAGE 32 // Maximum number of issuers returned per GET /api/issuers page
+#define WEB_JOBS_QUEUE 4 // Number of web jobs (config saves, reboots, resets) that can wait for the worker task
+#define WEB_JOBS_HISTORY 8 // Number of finished web jobs whose outcome can still be fetched from GET /api/jobs
+#define WEB_EVENTS_BUFFER 16 // Number of frames kept for the /events stream, a client falling further behind is disconnected
+#define WEB_EVENTS_MAX_CLIENTS 4 // Maximum number of simultaneous /events clients
+#define WEB_EVENTS_STATS_INTERVAL 5000 // Interval of the Wi-Fi and heap stats sent on /events (ms)
@@ -0,0 +1,21 @@
+#define JSON_NOEXCEPTION 1
+#include "configRegistry.h"
+#include <HomeSpan.h>
+
+bool config_gpio_valid(int64_t pin, bool output) {
+  return pin == 255 || (output ? GPIO_IS_VALID_OUTPUT_GPIO(pin) : GPIO_IS_VALID_GPIO(pin));
+}
+
+bool config_setup_code_valid(const std::string& code) {
+  return code.size() == 8 && homeSpan.controllerListBegin() == homeSpan.controllerListEnd();
+}
+
+std::vector<const char*> misc_config_restart_reasons(espConfig::misc_config_t before, espConfig::misc_config_t after) {
+  std::vector<const char*> reasons;
+  for (auto&& field : miscConfigFields.fields) {
+    if (field.reboot && !config_field_equal(field, before, after) && std::find(reasons.begin(), reasons.end(), field.reboot) == reasons.end()) {
+      reasons.push_back(field.reboot);
+    }
+  }
+  return reasons;
+}
@@ -0,0 +1,363 @@
+#pragma once
+#include <Arduino.h>
+#include <HomeKey.h>
+#include <array>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "config.h"
+#include "espConfig.h"
+#include "mqttDispatch.h"
+
+/**
+ * A field of the config structs as edited on the web pages and through the REST API. `ref` returns
+ * where the field is stored inside a config of type `T`, `storage` how it is stored. Numbers must
+ * lie within `min` and `max`, `GPIO` fields must also name a pin usable as output (`GPIO_IN` as
+ * input), 255 disabling the pin. A field with a `reboot` reason only takes effect on boot.
+ */
+template <class T>
+struct configField_t
+{
+  enum storage_t : uint8_t { BOOL, U8, U16, INT, STRING, READERS };
+  enum check_t : uint8_t { RANGE, GPIO, GPIO_IN, CODE };
+  const char* section;
+  const char* form;
+  const char* key;
+  storage_t storage;
+  check_t check;
+  int32_t min;
+  int32_t max;
+  void* (*ref)(T&);
+  const char* reboot;
+
+  template <class V>
+  static constexpr storage_t storageOf() {
+    if constexpr (std::is_same_v<V, bool>) return BOOL;
+    else if constexpr (std::is_same_v<V, uint8_t>) return U8;
+    else if constexpr (std::is_same_v<V, uint16_t>) return U16;
+    else if constexpr (std::is_same_v<V, int>) return INT;
+    else if constexpr (std::is_same_v<V, std::string>) return STRING;
+    else {
+      static_assert(std::is_same_v<V, std::vector<std::array<uint8_t, 2>>>, "unsupported config field type");
+      return READERS;
+    }
+  }
+};
+
+/**
+ * Declares the field `member` of `espConfig::T`, `element` selects an entry of a map or array member
+ * and is left empty otherwise. The storage is derived from the member's type.
+ */
+#define CONFIG_FIELD(T, section, form, member, element, check, min, max, reboot) \
+  configField_t<espConfig::T>{ section, form, #member, \
+    configField_t<espConfig::T>::storageOf<std::remove_reference_t<decltype(std::declval<espConfig::T&>().member element)>>(), \
+    configField_t<espConfig::T>::check, min, max, [](espConfig::T& c) -> void* { return &c.member element; }, reboot }
+
+/**
+ * The fields of a config struct with an open addressing index over their form names, built at
+ * compile time so a posted form field is found with a single hash.
+ */
+template <class T, size_t N>
+struct configRegistry_t
+{
+  static constexpr size_t slots = 128;
+  static_assert(N < slots / 2, "grow the index of configRegistry_t");
+  std::array<configField_t<T>, N> fields;
+  std::array<uint8_t, slots> index{};
+
+  constexpr configRegistry_t(const std::array<configField_t<T>, N>& fields) : fields(fields) {
+    for (size_t i = 0; i < N; i++) {
+      size_t slot = mqttDispatch_t::fnv1a(fields[i].form) & (slots - 1);
+      while (index[slot]) slot = (slot + 1) & (slots - 1);
+      index[slot] = i + 1;
+    }
+  }
+
+  const configField_t<T>* find(std::string_view form) const {
+    for (size_t slot = mqttDispatch_t::fnv1a(form) & (slots - 1); index[slot]; slot = (slot + 1) & (slots - 1)) {
+      const configField_t<T>& field = fields[index[slot] - 1];
+      if (form == field.form) return &field;
+    }
+    return nullptr;
+  }
+};
+
+template <class T, class... F>
+constexpr auto config_registry(F... fields) {
+  return configRegistry_t<T, sizeof...(F)>(std::array<configField_t<T>, sizeof...(F)>{ fields... });
+}
+
+inline constexpr auto mqttConfigFields = config_registry<espConfig::mqttConfig_t>(
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-broker", mqttBroker, , RANGE, 0, 0, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-port", mqttPort, , RANGE, 1, 65535, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-clientid", mqttClientId, , RANGE, 0, 0, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-username", mqttUsername, , RANGE, 0, 0, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-password", mqttPassword, , RANGE, 0, 0, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-lwt-topic", lwtTopic, , RANGE, 0, 0, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-hktopic", hkTopic, , RANGE, 0, 0, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-statetopic", lockStateTopic, , RANGE, 0, 0, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-statecmd", lockStateCmd, , RANGE, 0, 0, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-cstatecmd", lockCStateCmd, , RANGE, 0, 0, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-tstatecmd", lockTStateCmd, , RANGE, 0, 0, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-customstate-enable", lockEnableCustomState, , RANGE, 0, 1, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-customstate-topic", lockCustomStateTopic, , RANGE, 0, 0, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-customstate-cmd", lockCustomStateCmd, , RANGE, 0, 0, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-discovery-enable", hassMqttDiscoveryEnabled, , RANGE, 0, 1, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "caction-unlock", customLockActions, ["UNLOCK"], RANGE, 0, 255, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "caction-lock", customLockActions, ["LOCK"], RANGE, 0, 255, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "cstate-unlocking", customLockStates, ["C_UNLOCKING"], RANGE, 0, 255, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "cstate-locking", customLockStates, ["C_LOCKING"], RANGE, 0, 255, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "cstate-locked", customLockStates, ["C_LOCKED"], RANGE, 0, 255, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "cstate-unlocked", customLockStates, ["C_UNLOCKED"], RANGE, 0, 255, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "cstate-jammed", customLockStates, ["C_JAMMED"], RANGE, 0, 255, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "cstate-unknown", customLockStates, ["C_UNKNOWN"], RANGE, 0, 255, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "nfc-tags-ignore-mqtt", nfcTagNoPublish, , RANGE, 0, 1, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-btrprox-cmd-topic", btrLvlCmdTopic, , RANGE, 0, 0, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-allowlist-cmd-topic", allowlistCmdTopic, , RANGE, 0, 0, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-diag-topic", diagTopic, , RANGE, 0, 0, nullptr),
+  CONFIG_FIELD(mqttConfig_t, "mqtt", "mqtt-binary-topic", binaryTopic, , RANGE, 0, 0, nullptr)
+);
+
+inline constexpr auto miscConfigFields = config_registry<espConfig::misc_config_t>(
+  CONFIG_FIELD(misc_config_t, "misc", "device-name", deviceName, , RANGE, 0, 0, "device name"),
+  CONFIG_FIELD(misc_config_t, "misc", "ota-passwd", otaPasswd, , RANGE, 0, 0, "OTA password"),
+  CONFIG_FIELD(misc_config_t, "misc", "hk-setupcode", setupCode, , CODE, 0, 0, nullptr),
+  CONFIG_FIELD(misc_config_t, "misc", "control-pin", controlPin, , GPIO, 0, 255, "HomeSpan pins"),
+  CONFIG_FIELD(misc_config_t, "misc", "led-pin", hsStatusPin, , GPIO, 0, 255, "HomeSpan pins"),
+  CONFIG_FIELD(misc_config_t, "misc", "hk-always-unlock", lockAlwaysUnlock, , RANGE, 0, 1, nullptr),
+  CONFIG_FIELD(misc_config_t, "misc", "hk-always-lock", lockAlwaysLock, , RANGE, 0, 1, nullptr),
+  CONFIG_FIELD(misc_config_t, "misc", "hk-hwfinish", hk_key_color, , RANGE, 0, 3, "HomeKey finish"),
+  CONFIG_FIELD(misc_config_t, "misc", "web-auth-enable", webAuthEnabled, , RANGE, 0, 1, "web authentication"),
+  CONFIG_FIELD(misc_config_t, "misc", "web-auth-username", webUsername, , RANGE, 0, 0, "web authentication"),
+  CONFIG_FIELD(misc_config_t, "misc", "web-auth-password", webPassword, , RANGE, 0, 0, "web authentication"),
+  // the reader tasks own the SPI bus, the IRQ handlers and the authentication contexts
+  CONFIG_FIELD(misc_config_t, "misc", "nfc-ss-gpio-pin", nfcGpioPins, [0], GPIO, 0, 255, "NFC readers"),
+  CONFIG_FIELD(misc_config_t, "misc", "nfc-sck-gpio-pin", nfcGpioPins, [1], GPIO, 0, 255, "NFC readers"),
+  CONFIG_FIELD(misc_config_t, "misc", "nfc-miso-gpio-pin", nfcGpioPins, [2], GPIO, 0, 255, "NFC readers"),
+  CONFIG_FIELD(misc_config_t, "misc", "nfc-mosi-gpio-pin", nfcGpioPins, [3], GPIO, 0, 255, "NFC readers"),
+  CONFIG_FIELD(misc_config_t, "misc", "nfc-irq-gpio-pin", nfcIrqPin, , GPIO_IN, 0, 255, "NFC readers"),
+  CONFIG_FIELD(misc_config_t, "misc", "nfc-extra-readers", nfcExtraReaders, , GPIO_IN, 0, NFC_MAX_READERS - 1, "NFC readers"),
+  CONFIG_FIELD(misc_config_t, "misc", "prox-bat-enable", proxBatEnabled, , RANGE, 0, 1, "battery service"),
+  CONFIG_FIELD(misc_config_t, "misc", "btr-low-threshold", btrLowStatusThreshold, , RANGE, 0, 100, nullptr),
+  CONFIG_FIELD(misc_config_t, "misc", "homekit-dumb-switch-mode", hkDumbSwitchMode, , RANGE, 0, 1, nullptr),
+  CONFIG_FIELD(misc_config_t, "misc", "hk-auth-pool-size", hkAuthPoolSize, , RANGE, 0, 8, "authentication pool size"),
+  CONFIG_FIELD(misc_config_t, "misc", "nfc-ecp-timeout", nfcPollEcpTimeout, , RANGE, 1, 1000, nullptr),
+  CONFIG_FIELD(misc_config_t, "misc", "nfc-detect-timeout", nfcPollDetectTimeout, , RANGE, 1, 1000, nullptr),
+  CONFIG_FIELD(misc_config_t, "misc", "nfc-active-interval", nfcPollActiveInterval, , RANGE, NFC_POLL_MIN_INTERVAL, 5000, nullptr),
+  CONFIG_FIELD(misc_config_t, "misc", "nfc-idle-interval", nfcPollIdleInterval, , RANGE, NFC_POLL_MIN_INTERVAL, 5000, nullptr),
+  CONFIG_FIELD(misc_config_t, "misc", "nfc-active-window", nfcPollActiveWindow, , RANGE, 0, UINT16_MAX, nullptr),
+  CONFIG_FIELD(misc_config_t, "misc", "nfc-removal-interval", nfcRemovalProbeInterval, , RANGE, NFC_POLL_MIN_INTERVAL, 1000, nullptr),
+  CONFIG_FIELD(misc_config_t, "misc", "nfc-removal-holdoff", nfcRemovalHoldoff, , RANGE, 0, 60000, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "nfc-neopixel-pin", nfcNeopixelPin, , GPIO, 0, 255, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "neopixel-s-time", neopixelSuccessTime, , RANGE, 0, UINT16_MAX, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "neopixel-f-time", neopixelFailTime, , RANGE, 0, UINT16_MAX, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "neopixel-count", neopixelCount, , RANGE, 1, 64, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "neopixel-idle-breathe", neopixelIdleBreathe, , RANGE, 0, 1, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "neo-pixel-type", neoPixelType, , RANGE, 0, 5, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "nfc-s-red-pixel", neopixelSuccessColor, [espConfig::misc_config_t::R], RANGE, 0, 255, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "nfc-s-green-pixel", neopixelSuccessColor, [espConfig::misc_config_t::G], RANGE, 0, 255, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "nfc-s-blue-pixel", neopixelSuccessColor, [espConfig::misc_config_t::B], RANGE, 0, 255, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "nfc-f-red-pixel", neopixelFailureColor, [espConfig::misc_config_t::R], RANGE, 0, 255, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "nfc-f-green-pixel", neopixelFailureColor, [espConfig::misc_config_t::G], RANGE, 0, 255, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "nfc-f-blue-pixel", neopixelFailureColor, [espConfig::misc_config_t::B], RANGE, 0, 255, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "nfc-s-pin", nfcSuccessPin, , GPIO, 0, 255, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "nfc-f-pin", nfcFailPin, , GPIO, 0, 255, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "nfc-s-hl", nfcSuccessHL, , RANGE, 0, 1, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "nfc-f-hl", nfcFailHL, , RANGE, 0, 1, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "nfc-s-time", nfcSuccessTime, , RANGE, 0, UINT16_MAX, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "nfc-f-time", nfcFailTime, , RANGE, 0, UINT16_MAX, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "gpio-a-pin", gpioActionPin, , GPIO, 0, 255, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "gpio-a-lock", gpioActionLockState, , RANGE, 0, 1, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "gpio-a-unlock", gpioActionUnlockState, , RANGE, 0, 1, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "homekey-gpio-state", hkGpioControlledState, , RANGE, 0, 1, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "gpio-a-momentary", gpioActionMomentaryEnabled, , RANGE, 0, 3, nullptr),
+  CONFIG_FIELD(misc_config_t, "actions", "gpio-a-mo-timeout", gpioActionMomentaryTimeout, , RANGE, 0, UINT16_MAX, nullptr)
+);
+
+/**
+ * The function `config_gpio_valid` checks a GPIO Pin, 255 disables the pin. With `output` the pin
+ * must be able to drive an output, which input only pins like GPIO 34-39 can't.
+ */
+bool config_gpio_valid(int64_t pin, bool output = true);
+
+/**
+ * The function `config_setup_code_valid` checks a new HomeKit setup code, which can only be changed
+ * while no controller is paired.
+ */
+bool config_setup_code_valid(const std::string& code);
+
+/**
+ * The function `config_field_get` returns the numeric value of `field` in `config`.
+ */
+template <class T>
+int32_t config_field_get(const configField_t<T>& field, T& config) {
+  void* value = field.ref(config);
+  switch (field.storage) {
+    case configField_t<T>::BOOL: return *static_cast<bool*>(value);
+    case configField_t<T>::U8: return *static_cast<uint8_t*>(value);
+    case configField_t<T>::U16: return *static_cast<uint16_t*>(value);
+    case configField_t<T>::INT: return *static_cast<int*>(value);
+    default: return 0;
+  }
+}
+
+/**
+ * The function `config_field_equal` compares `field` between the configs `a` and `b`.
+ */
+template <class T>
+bool config_field_equal(const configField_t<T>& field, T& a, T& b) {
+  switch (field.storage) {
+    case configField_t<T>::STRING: return *static_cast<std::string*>(field.ref(a)) == *static_cast<std::string*>(field.ref(b));
+    case configField_t<T>::READERS: return *static_cast<std::vector<std::array<uint8_t, 2>>*>(field.ref(a)) == *static_cast<std::vector<std::array<uint8_t, 2>>*>(field.ref(b));
+    default: return config_field_get(field, a) == config_field_get(field, b);
+  }
+}
+
+/**
+ * The function `config_field_set` parses the form value `value` into `field` of `config`. Numbers
+ * outside the field's range are rejected before they are stored, so they can not wrap.
+ */
+template <class T>
+bool config_field_set(const configField_t<T>& field, T& config, std::string_view value, std::string& error) {
+  void* ref = field.ref(config);
+  if (field.storage == configField_t<T>::STRING) {
+    *static_cast<std::string*>(ref) = value;
+    return true;
+  }
+  if (field.storage == configField_t<T>::READERS) {
+    // a comma separated list of SS:IRQ pairs, the IRQ pin being optional
+    auto& readers = *static_cast<std::vector<std::array<uint8_t, 2>>*>(ref);
+    readers.clear();
+    while (!value.empty()) {
+      std::string_view item = value.substr(0, value.find(','));
+      value.remove_prefix(std::min(value.size(), item.size() + 1));
+      if (item.empty()) continue;
+      size_t sep = item.find(':');
+      int ss = mqtt_parse_int(item.substr(0, sep));
+      int irq = sep == std::string_view::npos ? 255 : mqtt_parse_int(item.substr(sep + 1));
+      if (ss < 0 || ss > 254 || irq < 0 || irq > 255) {
+        error = std::string(item) + " is not a valid reader, expected SS:IRQ with valid GPIO Pins";
+        return false;
+      }
+      readers.push_back({ uint8_t(ss), uint8_t(irq) });
+    }
+    return true;
+  }
+  int32_t number = 0;
+  auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), number);
+  if (ec != std::errc() || end != value.data() + value.size() || number < field.min || number > field.max) {
+    error = std::string(value) + " is not valid for " + field.key + ", expected " + std::to_string(field.min) + " to " + std::to_string(field.max);
+    return false;
+  }
+  switch (field.storage) {
+    case configField_t<T>::BOOL: *static_cast<bool*>(ref) = number; break;
+    case configField_t<T>::U8: *static_cast<uint8_t*>(ref) = number; break;
+    case configField_t<T>::U16: *static_cast<uint16_t*>(ref) = number; break;
+    default: *static_cast<int*>(ref) = number; break;
+  }
+  return true;
+}
+
+/**
+ * The function `config_clamp` pulls the numeric fields of a config loaded from NVS back into their
+ * range, a config saved before a field got its current limits could hold a value the forms reject.
+ */
+template <class T, size_t N>
+void config_clamp(const configRegistry_t<T, N>& registry, T& config) {
+  const char* TAG = "config_clamp";
+  for (auto&& field : registry.fields) {
+    if (field.check != configField_t<T>::RANGE || field.storage == configField_t<T>::STRING || field.storage == configField_t<T>::READERS) continue;
+    int32_t value = config_field_get(field, config);
+    int32_t clamped = std::clamp(value, field.min, field.max);
+    if (clamped == value) continue;
+    LOG(W, "%s=%d is out of range, using %d", field.key, value, clamped);
+    std::string error;
+    config_field_set(field, config, std::to_string(clamped), error);
+  }
+}
+
+/**
+ * The function `config_field_check` validates the value of `field` in `config`.
+ */
+template <class T>
+bool config_field_check(const configField_t<T>& field, T& config, std::string& error) {
+  if (field.storage == configField_t<T>::READERS) {
+    auto& readers = *static_cast<std::vector<std::array<uint8_t, 2>>*>(field.ref(config));
+    if (readers.size() > size_t(field.max)) {
+      error = "At most " + std::to_string(field.max) + " additional readers are supported";
+      return false;
+    }
+    for (auto&& reader : readers) {
+      if (reader[0] == 255 || !config_gpio_valid(reader[0], false) || !config_gpio_valid(reader[1], false)) {
+        error = std::to_string(reader[0]) + ":" + std::to_string(reader[1]) + " is not a valid reader, expected SS:IRQ with valid GPIO Pins";
+        return false;
+      }
+    }
+    return true;
+  }
+  if (field.check == configField_t<T>::CODE) {
+    std::string& code = *static_cast<std::string*>(field.ref(config));
+    if (!config_setup_code_valid(code)) {
+      error = "The setup code needs 8 digits and can only be changed while unpaired";
+      return false;
+    }
+    return true;
+  }
+  if (field.storage == configField_t<T>::STRING) {
+    return true;
+  }
+  int32_t value = config_field_get(field, config);
+  if (value < field.min || value > field.max) {
+    error = std::to_string(value) + " is not valid for " + field.key + ", expected " + std::to_string(field.min) + " to " + std::to_string(field.max);
+    return false;
+  }
+  if (field.check != configField_t<T>::RANGE && !config_gpio_valid(value, field.check == configField_t<T>::GPIO)) {
+    error = std::to_string(value) + " is not a valid GPIO Pin";
+    return false;
+  }
+  return true;
+}
+
+/**
+ * The function `config_check_changes` validates the fields of `registry` whose value in `next`
+ * differs from `current`, fields left as they are were accepted before.
+ */
+template <class T, size_t N>
+bool config_check_changes(const configRegistry_t<T, N>& registry, T& next, T& current, std::string& error) {
+  for (auto&& field : registry.fields) {
+    if (!config_field_equal(field, next, current) && !config_field_check(field, next, error)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * The function `config_schema_json` describes the fields of `registry` for the REST API, grouped by
+ * section.
+ */
+template <class T, size_t N>
+void config_schema_json(const configRegistry_t<T, N>& registry, json& schema) {
+  static constexpr const char* storageNames[] = { "bool", "number", "number", "number", "string", "readers" };
+  static constexpr const char* checkNames[] = { nullptr, "gpio", "gpio-input", "setup-code" };
+  for (auto&& field : registry.fields) {
+    json entry;
+    entry["form"] = field.form;
+    entry["key"] = field.key;
+    entry["type"] = field.check == configField_t<T>::RANGE ? storageNames[field.storage] : checkNames[field.check];
+    if (field.storage != configField_t<T>::STRING) {
+      entry["min"] = field.min;
+      entry["max"] = field.max;
+    }
+    entry["reboot"] = field.reboot ? json(field.reboot) : json(nullptr);
+    schema[field.section].push_back(entry);
+  }
+}
+
+/**
+ * The function `misc_config_restart_reasons` lists the settings that differ between `before` and
+ * `after` and only take effect on boot, everything else is read live by the tasks using it.
+ */
+std::vector<const char*> misc_config_restart_reasons(espConfig::misc_config_t before, espConfig::misc_config_t after);
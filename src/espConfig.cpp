@@ -0,0 +1,19 @@
+#define JSON_NOEXCEPTION 1
+#include "espConfig.h"
+
+nvs_handle savedData;
+
+std::string platform_create_id_string(void) {
+  uint8_t mac[6];
+  char id_string[32];
+  esp_read_mac(mac, ESP_MAC_WIFI_STA);
+  sprintf(id_string, "ESP32_%02x%02X%02X", mac[3], mac[4], mac[5]);
+  return std::string(id_string);
+}
+
+namespace espConfig
+{
+  mqttConfig_t mqttData;
+  misc_config_t miscConfig;
+  SemaphoreHandle_t mutex = xSemaphoreCreateRecursiveMutex();
+};
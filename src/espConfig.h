@@ -0,0 +1,148 @@
+#pragma once
+#include <Arduino.h>
+#include <HomeKey.h>
+#include <nvs.h>
+#include <array>
+#include <map>
+#include "config.h"
+
+/* Handle on the `SAVED_DATA` NVS namespace: the saved configs, the discovery hash and a legacy `READERDATA` blob */
+extern nvs_handle savedData;
+
+/**
+ * The function `platform_create_id_string` returns the device ID made of the last three bytes of the
+ * station MAC address, used as default MQTT client ID and topic prefix.
+ */
+std::string platform_create_id_string(void);
+
+namespace espConfig
+{
+  struct mqttConfig_t
+  {
+    mqttConfig_t() {
+      std::string id = platform_create_id_string();
+      mqttClientId = id;
+      lwtTopic.append(id).append("/" MQTT_LWT_TOPIC);
+      hkTopic.append(id).append("/" MQTT_AUTH_TOPIC);
+      lockStateTopic.append(id).append("/" MQTT_STATE_TOPIC);
+      lockStateCmd.append(id).append("/" MQTT_SET_STATE_TOPIC);
+      lockCStateCmd.append(id).append("/" MQTT_SET_CURRENT_STATE_TOPIC);
+      lockTStateCmd.append(id).append("/" MQTT_SET_TARGET_STATE_TOPIC);
+      lockCustomStateTopic.append(id).append("/" MQTT_CUSTOM_STATE_TOPIC);
+      lockCustomStateCmd.append(id).append("/" MQTT_CUSTOM_STATE_CTRL_TOPIC);
+      btrLvlCmdTopic.append(id).append("/" MQTT_PROX_BAT_TOPIC);
+      allowlistCmdTopic.append(id).append("/" MQTT_ALLOWLIST_TOPIC);
+      diagTopic.append(id).append("/" MQTT_DIAG_TOPIC);
+    }
+    /* MQTT Broker */
+    std::string mqttBroker = MQTT_HOST;
+    uint16_t mqttPort = MQTT_PORT;
+    std::string mqttUsername = MQTT_USERNAME;
+    std::string mqttPassword = MQTT_PASSWORD;
+    std::string mqttClientId;
+    /* MQTT Topics */
+    std::string lwtTopic;
+    std::string hkTopic;
+    std::string lockStateTopic;
+    std::string lockStateCmd;
+    std::string lockCStateCmd;
+    std::string lockTStateCmd;
+    std::string btrLvlCmdTopic;
+    std::string allowlistCmdTopic;
+    std::string diagTopic;
+    std::string binaryTopic;
+    /* MQTT Custom State */
+    std::string lockCustomStateTopic;
+    std::string lockCustomStateCmd;
+    /* Flags */
+    bool lockEnableCustomState = MQTT_CUSTOM_STATE_ENABLED;
+    bool hassMqttDiscoveryEnabled = MQTT_DISCOVERY;
+    bool nfcTagNoPublish = false;
+    std::map<std::string, int> customLockStates = { {"C_LOCKED", C_LOCKED}, {"C_UNLOCKING", C_UNLOCKING}, {"C_UNLOCKED", C_UNLOCKED}, {"C_LOCKING", C_LOCKING}, {"C_JAMMED", C_JAMMED}, {"C_UNKNOWN", C_UNKNOWN} };
+    std::map<std::string, int> customLockActions = { {"UNLOCK", UNLOCK}, {"LOCK", LOCK} };
+    NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(espConfig::mqttConfig_t, mqttBroker, mqttPort, mqttUsername, mqttPassword, mqttClientId, lwtTopic, hkTopic, lockStateTopic, lockStateCmd, lockCStateCmd, lockTStateCmd, lockCustomStateTopic, lockCustomStateCmd, lockEnableCustomState, hassMqttDiscoveryEnabled, customLockStates, customLockActions, nfcTagNoPublish, btrLvlCmdTopic, allowlistCmdTopic, diagTopic, binaryTopic)
+  };
+  extern mqttConfig_t mqttData;
+
+  struct misc_config_t
+  {
+    enum colorMap
+    {
+      R,
+      G,
+      B
+    };
+    std::string deviceName = DEVICE_NAME;
+    std::string otaPasswd = OTA_PWD;
+    uint8_t hk_key_color = HOMEKEY_COLOR;
+    std::string setupCode = SETUP_CODE;
+    bool lockAlwaysUnlock = HOMEKEY_ALWAYS_UNLOCK;
+    bool lockAlwaysLock = HOMEKEY_ALWAYS_LOCK;
+    uint8_t controlPin = HS_PIN;
+    uint8_t hsStatusPin = HS_STATUS_LED;
+    uint8_t nfcNeopixelPin = NFC_NEOPIXEL_PIN;
+    uint8_t neoPixelType = 5;
+    std::map<colorMap, int> neopixelSuccessColor = { {R, NEOPIXEL_SUCCESS_R}, {G, NEOPIXEL_SUCCESS_G}, {B, NEOPIXEL_SUCCESS_B} };
+    std::map<colorMap, int> neopixelFailureColor = { {R, NEOPIXEL_FAIL_R}, {G, NEOPIXEL_FAIL_G}, {B, NEOPIXEL_FAIL_B} };
+    uint16_t neopixelSuccessTime = NEOPIXEL_SUCCESS_TIME;
+    uint16_t neopixelFailTime = NEOPIXEL_FAIL_TIME;
+    uint8_t neopixelCount = NEOPIXEL_COUNT;
+    bool neopixelIdleBreathe = NEOPIXEL_IDLE_BREATHE;
+    uint8_t nfcSuccessPin = NFC_SUCCESS_PIN;
+    uint16_t nfcSuccessTime = NFC_SUCCESS_TIME;
+    bool nfcSuccessHL = NFC_SUCCESS_HL;
+    uint8_t nfcFailPin = NFC_FAIL_PIN;
+    uint16_t nfcFailTime = NFC_FAIL_TIME;
+    bool nfcFailHL = NFC_FAIL_HL;
+    uint8_t gpioActionPin = GPIO_ACTION_PIN;
+    bool gpioActionLockState = GPIO_ACTION_LOCK_STATE;
+    bool gpioActionUnlockState = GPIO_ACTION_UNLOCK_STATE;
+    uint8_t gpioActionMomentaryEnabled = GPIO_ACTION_MOMENTARY_STATE;
+    bool hkGpioControlledState = true;
+    uint16_t gpioActionMomentaryTimeout = GPIO_ACTION_MOMENTARY_TIMEOUT;
+    bool webAuthEnabled = WEB_AUTH_ENABLED;
+    std::string webUsername = WEB_AUTH_USERNAME;
+    std::string webPassword = WEB_AUTH_PASSWORD;
+    std::array<uint8_t, 4> nfcGpioPins{SS, SCK, MISO, MOSI};
+    uint8_t nfcIrqPin = NFC_IRQ_PIN;
+    uint8_t btrLowStatusThreshold = 10;
+    bool proxBatEnabled = false;
+    bool hkDumbSwitchMode = false;
+    uint8_t hkAuthPoolSize = HOMEKEY_AUTH_POOL_SIZE;
+    uint16_t nfcPollEcpTimeout = NFC_POLL_ECP_TIMEOUT;
+    uint16_t nfcPollDetectTimeout = NFC_POLL_DETECT_TIMEOUT;
+    uint16_t nfcPollActiveInterval = NFC_POLL_ACTIVE_INTERVAL;
+    uint16_t nfcPollIdleInterval = NFC_POLL_IDLE_INTERVAL;
+    uint16_t nfcPollActiveWindow = NFC_POLL_ACTIVE_WINDOW;
+    uint16_t nfcRemovalProbeInterval = NFC_REMOVAL_PROBE_INTERVAL;
+    uint16_t nfcRemovalHoldoff = NFC_REMOVAL_HOLDOFF;
+    std::vector<std::array<uint8_t, 2>> nfcExtraReaders;
+    NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(misc_config_t, deviceName, otaPasswd, hk_key_color, setupCode, lockAlwaysUnlock, lockAlwaysLock, controlPin, hsStatusPin, nfcSuccessPin, nfcSuccessTime, nfcNeopixelPin, neopixelSuccessColor, neopixelFailureColor, neopixelSuccessTime, neopixelFailTime, nfcSuccessHL, nfcFailPin, nfcFailTime, nfcFailHL, gpioActionPin, gpioActionLockState, gpioActionUnlockState, gpioActionMomentaryEnabled, gpioActionMomentaryTimeout, webAuthEnabled, webUsername, webPassword, nfcGpioPins, btrLowStatusThreshold, proxBatEnabled, hkDumbSwitchMode, nfcPollEcpTimeout, nfcPollDetectTimeout, nfcPollActiveInterval, nfcPollIdleInterval, nfcPollActiveWindow, nfcIrqPin, nfcRemovalProbeInterval, nfcRemovalHoldoff, hkAuthPoolSize, nfcExtraReaders, neopixelCount, neopixelIdleBreathe, neoPixelType, hkGpioControlledState)
+  };
+  extern misc_config_t miscConfig;
+
+  /**
+   * Guards `mqttData` and `miscConfig`. After boot only `web_jobs` replaces them, with `mutex` held,
+   * every other task holds a `lock_t` while it reads them. Recursive so helpers can take it again.
+   */
+  extern SemaphoreHandle_t mutex;
+  struct lock_t
+  {
+    lock_t() { xSemaphoreTakeRecursive(mutex, portMAX_DELAY); }
+    ~lock_t() { xSemaphoreGiveRecursive(mutex); }
+    lock_t(const lock_t&) = delete;
+    lock_t& operator=(const lock_t&) = delete;
+  };
+  /* Reads a single field of `miscConfig` under `mutex` */
+  template <class V>
+  V misc(V misc_config_t::* field) {
+    lock_t lock;
+    return miscConfig.*field;
+  }
+  /* Reads a single field of `mqttData` under `mutex` */
+  template <class V>
+  V mqtt(V mqttConfig_t::* field) {
+    lock_t lock;
+    return mqttData.*field;
+  }
+};
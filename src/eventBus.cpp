@@ -0,0 +1,17 @@
+#include "eventBus.h"
+
+eventBus_t eventBus;
+
+eventBus_t::subscriber_t* eventBus_t::subscribe() {
+  uint8_t i = subscriberCount.fetch_add(1);
+  if (i >= maxSubscribers) return nullptr;
+  subscribers[i].cursor = head.load();
+  subscribers[i].task = xTaskGetCurrentTaskHandle();
+  return &subscribers[i];
+}
+
+void eventBus_t::wait(subscriber_t& sub, busEvent_t& event) {
+  while (!next(sub, event)) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+}
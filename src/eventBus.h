@@ -0,0 +1,112 @@
+#pragma once
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <array>
+#include <atomic>
+
+/**
+ * Fixed-size event posted on the event bus, either a tap outcome from a reader task or a lock state
+ * change to be published.
+ */
+struct busEvent_t
+{
+  enum type_t : uint8_t
+  {
+    HOMEKEY_SUCCESS,
+    HOMEKEY_FAIL,
+    TAG,
+    LOCK_STATE
+  };
+  type_t type;
+  uint8_t reader = 0;
+  uint8_t idLen = 0;
+  int8_t lockState = -1;
+  int16_t customState = -1;
+  uint16_t tap = 0;
+  std::array<uint8_t, 8> issuerId{};
+  std::array<uint8_t, 10> id{}; // endpoint ID for HomeKey taps, UID for other tags
+  std::array<uint8_t, 2> atqa{};
+  uint8_t sak = 0;
+  bool allowed = false; // TAG events only, the UID is on the local allowlist
+  uint32_t posted = 0; // lower 32 bits of esp_timer_get_time() when the event was posted
+  uint32_t detected = 0; // tap events only, lower 32 bits of esp_timer_get_time() when the target was detected
+};
+
+/**
+ * Broadcast ring buffer between the reader tasks and the tasks acting on their results. Posting never
+ * blocks or allocates: a producer claims a slot with an atomic increment, writes the event and
+ * publishes it by storing the slot sequence number, then notifies the subscriber tasks. Every
+ * subscriber reads the ring at its own cursor; a subscriber that falls more than a full ring behind
+ * skips the overwritten events and counts them as dropped instead of holding back the producers.
+ */
+struct eventBus_t
+{
+  static constexpr size_t capacity = 16;
+  static constexpr size_t maxSubscribers = 4;
+  struct slot_t
+  {
+    std::atomic<uint32_t> seq{ 0 };
+    busEvent_t event;
+  };
+  struct subscriber_t
+  {
+    TaskHandle_t task = nullptr;
+    uint32_t cursor = 0;
+    std::atomic<uint32_t> dropped{ 0 };
+  };
+  std::array<slot_t, capacity> slots;
+  std::array<subscriber_t, maxSubscribers> subscribers;
+  std::atomic<uint32_t> head{ 0 };
+  std::atomic<uint8_t> subscriberCount{ 0 };
+
+  /* Registers the calling task, it will only see events posted from now on */
+  subscriber_t* subscribe();
+  void post(const busEvent_t& event) {
+    uint32_t ticket = head.fetch_add(1);
+    slot_t& slot = slots[ticket % capacity];
+    // the fence keeps the event writes after the cleared seq, a reader seeing them also sees the 0
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.event = event;
+    slot.event.posted = esp_timer_get_time();
+    slot.seq.store(ticket + 1, std::memory_order_release);
+    uint8_t count = std::min<uint8_t>(subscriberCount.load(), maxSubscribers);
+    for (uint8_t i = 0; i < count; i++) {
+      if (subscribers[i].task != nullptr) xTaskNotifyGive(subscribers[i].task);
+    }
+  }
+  /* Copies the next event for `sub` into `event`, returns false once the subscriber is caught up */
+  bool next(subscriber_t& sub, busEvent_t& event) {
+    while (1) {
+      uint32_t end = head.load(std::memory_order_acquire);
+      if (sub.cursor == end) return false;
+      if (end - sub.cursor > capacity) {
+        sub.dropped += end - sub.cursor - capacity;
+        sub.cursor = end - capacity;
+      }
+      slot_t& slot = slots[sub.cursor % capacity];
+      uint32_t seq = slot.seq.load(std::memory_order_acquire);
+      if (seq == 0 || seq - 1 < sub.cursor) {
+        // claimed but not written yet
+        return false;
+      }
+      if (seq - 1 == sub.cursor) {
+        event = slot.event;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) == seq) {
+          sub.cursor++;
+          return true;
+        }
+      }
+      // overwritten while reading, the loop above resynchronizes the cursor
+      sub.dropped++;
+      sub.cursor++;
+    }
+  }
+  /* Blocks until the next event is available */
+  void wait(subscriber_t& sub, busEvent_t& event);
+};
+
+extern eventBus_t eventBus;
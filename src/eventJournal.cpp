@@ -0,0 +1,58 @@
+#define JSON_NOEXCEPTION 1
+#include "eventJournal.h"
+#include <HomeKey.h>
+
+static const char* TAG = "eventJournal";
+
+eventJournal_t eventJournal;
+
+void eventJournal_t::begin() {
+  bool created = !LittleFS.exists(path);
+  if (created) {
+    File f = LittleFS.open(path, "w", true);
+    header_t header{ magic, 1, 0 };
+    header.crc = crc(header);
+    f.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+    record_t empty{};
+    for (size_t i = 0; i < MQTT_JOURNAL_RECORDS; i++) {
+      f.write(reinterpret_cast<const uint8_t*>(&empty), sizeof(empty));
+    }
+    f.close();
+  }
+  file = LittleFS.open(path, "r+");
+  if (!file) {
+    LOG(E, "Could not open the MQTT journal");
+    return;
+  }
+  header_t header;
+  file.seek(0);
+  bool headerValid = file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) == sizeof(header) && header.magic == magic && header.crc == crc(header);
+  uint32_t last = 0;
+  record_t record;
+  for (size_t i = 0; i < MQTT_JOURNAL_RECORDS; i++) {
+    if (file.read(reinterpret_cast<uint8_t*>(&record), sizeof(record)) != sizeof(record)) break;
+    if (record.seq != 0 && record.crc == crc(record) && record.seq > last) last = record.seq;
+  }
+  head = last + 1;
+  tail = headerValid ? std::min(header.tail, head) : head;
+  if (head - tail > MQTT_JOURNAL_RECORDS) tail = head - MQTT_JOURNAL_RECORDS;
+  LOG(I, "MQTT journal: %d events pending", head - tail);
+}
+
+void eventJournal_t::append(const busEvent_t& event) {
+  if (!file) return;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  record_t record{};
+  record.seq = head;
+  record.event = event;
+  record.crc = crc(record);
+  file.seek(offset(head));
+  file.write(reinterpret_cast<const uint8_t*>(&record), sizeof(record));
+  file.flush();
+  head++;
+  if (head - tail > MQTT_JOURNAL_RECORDS) {
+    tail = head - MQTT_JOURNAL_RECORDS;
+    lost++;
+  }
+  xSemaphoreGive(mutex);
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <esp_rom_crc.h>
+#include <freertos/semphr.h>
+#include "config.h"
+#include "eventBus.h"
+
+/**
+ * Append-only journal of the bus events that couldn't be published while the broker was unreachable,
+ * replayed in order once MQTT reconnects.
+ *
+ * The journal is a LittleFS file allocated once at its full size: a header holding the sequence number
+ * of the next record to replay, followed by `MQTT_JOURNAL_RECORDS` fixed 64 byte records used as a
+ * ring. Every record carries its sequence number and a CRC32, so the write position is found again on
+ * boot by scanning for the highest valid sequence number. An append overwrites a single record in
+ * place, the file never grows and a write never costs more than rewriting one LittleFS block. Appends
+ * happen on the MQTT bus task and never on a reader task.
+ */
+struct eventJournal_t
+{
+  static constexpr const char* path = "/journal.bin";
+  static constexpr uint32_t magic = 0x4C4E524A;
+  struct header_t
+  {
+    uint32_t magic;
+    uint32_t tail;
+    uint32_t crc;
+  };
+  struct record_t
+  {
+    uint32_t seq;
+    busEvent_t event;
+    uint8_t reserved[64 - 2 * sizeof(uint32_t) - sizeof(busEvent_t)];
+    uint32_t crc;
+  };
+  static_assert(sizeof(record_t) == 64, "journal records must stay 64 bytes");
+  File file;
+  SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+  uint32_t head = 1;
+  uint32_t tail = 1;
+  std::atomic<uint32_t> lost{ 0 };
+
+  template <typename T>
+  static uint32_t crc(const T& data) {
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(&data), offsetof(T, crc));
+  }
+  static size_t offset(uint32_t seq) {
+    return sizeof(header_t) + (seq % MQTT_JOURNAL_RECORDS) * sizeof(record_t);
+  }
+  void begin();
+  bool pending() {
+    return file && head != tail;
+  }
+  void append(const busEvent_t& event);
+  /**
+   * Hands up to `batch` records to `publish` in order, stopping at the first one it fails to publish,
+   * then persists the new replay position.
+   */
+  template <typename F>
+  size_t replay(size_t batch, F&& publish) {
+    if (!file) return 0;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    size_t count = 0;
+    record_t record;
+    while (count < batch && tail != head) {
+      file.seek(offset(tail));
+      bool valid = file.read(reinterpret_cast<uint8_t*>(&record), sizeof(record)) == sizeof(record) && record.seq == tail && record.crc == crc(record);
+      if (valid && !publish(record.event, record.seq)) break;
+      tail++;
+      count++;
+    }
+    header_t header{ magic, tail, 0 };
+    header.crc = crc(header);
+    file.seek(0);
+    file.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+    file.flush();
+    xSemaphoreGive(mutex);
+    return count;
+  }
+};
+
+extern eventJournal_t eventJournal;
@@ -0,0 +1,124 @@
+#define JSON_NOEXCEPTION 1
+#include "hassDiscovery.h"
+#include <HAP.h>
+#include <WiFi.h>
+#include <esp_ota_ops.h>
+#include <esp_rom_crc.h>
+#include "espConfig.h"
+
+static const char* TAG = "hassDiscovery";
+
+hassDiscovery_t hassDiscovery;
+
+void hassDiscovery_t::add(const char* component, const char* object, json& payload) {
+  std::string topic;
+  topic.append("homeassistant/").append(component).append("/").append(espConfig::mqttData.mqttClientId).append("/").append(object).append("/config");
+  entries.push_back({ topic, payload.dump() });
+}
+
+void hassDiscovery_t::render() {
+  entries.clear();
+  if (!espConfig::mqttData.hassMqttDiscoveryEnabled) return;
+  const esp_app_desc_t* app_desc = esp_ota_get_app_description();
+  std::string app_version = app_desc->version;
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  char macStr[18] = { 0 };
+  sprintf(macStr, "%02X%02X%02X%02X", mac[0], mac[1], mac[2], mac[3]);
+  std::string serialNumber = "HK-";
+  serialNumber.append(macStr);
+  json device;
+  device["name"] = espConfig::miscConfig.deviceName.c_str();
+  char identifier[18];
+  sprintf(identifier, "%.2s%.2s%.2s%.2s%.2s%.2s", HAPClient::accessory.ID, HAPClient::accessory.ID + 3, HAPClient::accessory.ID + 6, HAPClient::accessory.ID + 9, HAPClient::accessory.ID + 12, HAPClient::accessory.ID + 15);
+  std::string id = identifier;
+  device["identifiers"].push_back(id);
+  device["identifiers"].push_back(serialNumber);
+  device["manufacturer"] = "rednblkx";
+  device["model"] = "HomeKey-ESP32";
+  device["sw_version"] = app_version.c_str();
+  device["serial_number"] = serialNumber;
+  json payload;
+  if (!espConfig::mqttData.nfcTagNoPublish) {
+    payload["topic"] = espConfig::mqttData.hkTopic.c_str();
+    payload["value_template"] = "{{ value_json.uid }}";
+    payload["device"] = device;
+    add("tag", "rfid", payload);
+  }
+  payload = json();
+  payload["topic"] = espConfig::mqttData.hkTopic;
+  payload["value_template"] = "{{ value_json.issuerId }}";
+  payload["device"] = device;
+  add("tag", "hkIssuer", payload);
+  payload = json();
+  payload["topic"] = espConfig::mqttData.hkTopic;
+  payload["value_template"] = "{{ value_json.endpointId }}";
+  payload["device"] = device;
+  add("tag", "hkEndpoint", payload);
+  payload = json();
+  payload["name"] = "Lock";
+  payload["state_topic"] = espConfig::mqttData.lockStateTopic.c_str();
+  payload["command_topic"] = espConfig::mqttData.lockStateCmd.c_str();
+  payload["payload_lock"] = "1";
+  payload["payload_unlock"] = "0";
+  payload["state_locked"] = "1";
+  payload["state_unlocked"] = "0";
+  payload["state_unlocking"] = "4";
+  payload["state_locking"] = "5";
+  payload["state_jammed"] = "2";
+  payload["availability_topic"] = espConfig::mqttData.lwtTopic.c_str();
+  payload["unique_id"] = id;
+  payload["device"] = device;
+  payload["retain"] = "false";
+  add("lock", "lock", payload);
+  if (!espConfig::mqttData.diagTopic.empty()) {
+    payload = json();
+    payload["name"] = "Tap latency";
+    payload["state_topic"] = espConfig::mqttData.diagTopic;
+    payload["value_template"] = "{{ value_json.latency_ms }}";
+    payload["unit_of_measurement"] = "ms";
+    payload["device_class"] = "duration";
+    payload["entity_category"] = "diagnostic";
+    payload["availability_topic"] = espConfig::mqttData.lwtTopic.c_str();
+    payload["unique_id"] = id + "_tap_latency";
+    payload["device"] = device;
+    add("sensor", "tapLatency", payload);
+    payload = json();
+    payload["name"] = "RSSI";
+    payload["state_topic"] = espConfig::mqttData.diagTopic;
+    payload["value_template"] = "{{ value_json.rssi }}";
+    payload["unit_of_measurement"] = "dBm";
+    payload["device_class"] = "signal_strength";
+    payload["entity_category"] = "diagnostic";
+    payload["availability_topic"] = espConfig::mqttData.lwtTopic.c_str();
+    payload["unique_id"] = id + "_rssi";
+    payload["device"] = device;
+    add("sensor", "rssi", payload);
+  }
+  // the retained configs live on the broker, a different broker needs them published again
+  hash = esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(espConfig::mqttData.mqttBroker.data()), espConfig::mqttData.mqttBroker.size());
+  hash = esp_rom_crc32_le(hash, reinterpret_cast<const uint8_t*>(&espConfig::mqttData.mqttPort), sizeof(espConfig::mqttData.mqttPort));
+  for (auto&& entry : entries) {
+    hash = esp_rom_crc32_le(hash, reinterpret_cast<const uint8_t*>(entry.topic.data()), entry.topic.size());
+    hash = esp_rom_crc32_le(hash, reinterpret_cast<const uint8_t*>(entry.payload.data()), entry.payload.size());
+  }
+  LOG(D, "Rendered %d discovery configs, hash %08lx", entries.size(), hash);
+}
+
+void hassDiscovery_t::publish(esp_mqtt_client_handle_t client, bool force) {
+  if (entries.empty()) return;
+  uint32_t published = 0;
+  if (!force && nvs_get_u32(savedData, "HASSHASH", &published) == ESP_OK && published == hash) {
+    LOG(D, "MQTT discovery unchanged, not publishing");
+    return;
+  }
+  bool ok = true;
+  for (auto&& entry : entries) {
+    ok &= esp_mqtt_client_publish(client, entry.topic.c_str(), entry.payload.data(), entry.payload.size(), 1, true) >= 0;
+  }
+  if (ok && published != hash) {
+    nvs_set_u32(savedData, "HASSHASH", hash);
+    nvs_commit(savedData);
+  }
+  LOG(D, "MQTT PUBLISHED DISCOVERY");
+}
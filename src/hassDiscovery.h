@@ -0,0 +1,33 @@
+#pragma once
+#include <Arduino.h>
+#include <HomeKey.h>
+#include <mqtt_client.h>
+#include <string>
+#include <vector>
+
+/**
+ * Home Assistant discovery configs, rendered once from the configuration and kept as ready-to-send
+ * topic and payload buffers. A CRC of everything that ends up on the broker is kept in NVS, so a
+ * reconnect with an unchanged config leaves the retained configs alone. They are republished when
+ * Home Assistant announces itself on `homeassistant/status`, since it may have lost them.
+ */
+struct hassDiscovery_t
+{
+  struct entry_t
+  {
+    std::string topic;
+    std::string payload;
+  };
+  std::vector<entry_t> entries;
+  uint32_t hash = 0;
+
+  void add(const char* component, const char* object, json& payload);
+  void render();
+  /**
+   * Publishes the discovery configs unless the broker already holds this exact set, `force`
+   * publishes them regardless.
+   */
+  void publish(esp_mqtt_client_handle_t client, bool force);
+};
+
+extern hassDiscovery_t hassDiscovery;
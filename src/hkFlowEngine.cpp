@@ -0,0 +1,110 @@
+#define JSON_NOEXCEPTION 1
+#include "hkFlowEngine.h"
+#include "hkIndex.h"
+#include <utils.h>
+
+hkFlowEngine_t hkFlowEngine;
+
+void hkFlowEngine_t::sync() {
+  xSemaphoreTake(hkIndex.mutex, portMAX_DELAY);
+  uint32_t generation = hkIndex.generation;
+  uint16_t endpoints = hkIndex.endpoints;
+  xSemaphoreGive(hkIndex.mutex);
+  if (generation == indexGeneration) return;
+  indexGeneration = generation;
+  std::vector<outcome_t> next(endpoints);
+  for (auto&& outcome : outcomes) {
+    if (outcome.lastTap == 0) continue;
+    uint16_t ordinal = hkIndex.endpointOrdinal(outcome.key);
+    if (ordinal < next.size()) next[ordinal] = outcome;
+  }
+  outcomes.swap(next);
+  updateSkipping();
+}
+
+void hkFlowEngine_t::updateSkipping() {
+  bool seen = false;
+  skippingFast = true;
+  for (auto&& outcome : outcomes) {
+    if (outcome.lastTap == 0) continue;
+    seen = true;
+    if (outcome.fastFailures < HOMEKEY_FLOW_SKIP_FAST_AFTER) skippingFast = false;
+  }
+  skippingFast &= seen;
+}
+
+KeyFlow hkFlowEngine_t::startFlow(KeyFlow floor) {
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  sync();
+  taps++;
+  KeyFlow flow = floor;
+  if (floor == kFlowFAST && skippingFast) {
+    if (++skippedSinceProbe < HOMEKEY_FLOW_FAST_PROBE) {
+      flow = kFlowSTANDARD;
+      fastSkipped++;
+    } else skippedSinceProbe = 0;
+  }
+  xSemaphoreGive(mutex);
+  return flow;
+}
+
+void hkFlowEngine_t::attempt(KeyFlow flow, bool success, int64_t duration) {
+  if (flow > kFlowATTESTATION) return;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  flows[flow].attempts++;
+  if (success) flows[flow].successes++;
+  flows[flow].totalTime += duration;
+  xSemaphoreGive(mutex);
+}
+
+void hkFlowEngine_t::outcome(const std::vector<uint8_t>& endpointId, KeyFlow flow, bool fastFailed, bool escalated) {
+  uint64_t key = hkIndex_t::makeKey(endpointId.data(), endpointId.size());
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  sync();
+  if (escalated) escalations++;
+  uint16_t ordinal = hkIndex.endpointOrdinal(key);
+  if (ordinal < outcomes.size()) {
+    outcome_t& record = outcomes[ordinal];
+    record.key = key;
+    record.lastTap = taps;
+    record.lastFlow = flow;
+    if (escalated) record.escalations++;
+    if (flow == kFlowFAST) {
+      record.fastFailures = 0;
+    } else if (fastFailed) {
+      record.fastFailures++;
+    }
+    updateSkipping();
+  }
+  xSemaphoreGive(mutex);
+}
+
+json hkFlowEngine_t::toJson() {
+  static constexpr std::array<const char*, kFlowATTESTATION + 1> flowNames = { "fast", "standard", "attestation" };
+  json result;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  sync();
+  result["taps"] = taps;
+  result["escalations"] = escalations;
+  result["fastSkipped"] = fastSkipped;
+  result["skippingFast"] = skippingFast;
+  for (size_t i = 0; i < flows.size(); i++) {
+    json flow;
+    flow["attempts"] = flows[i].attempts;
+    flow["successes"] = flows[i].successes;
+    flow["avgTime"] = flows[i].attempts ? uint32_t(flows[i].totalTime / flows[i].attempts / 1000) : 0;
+    result["flows"][flowNames[i]] = flow;
+  }
+  result["endpoints"] = json::array();
+  for (auto&& outcome : outcomes) {
+    if (outcome.lastTap == 0) continue;
+    json endpoint;
+    endpoint["id"] = utils::bufToHexString((const uint8_t*)&outcome.key, sizeof(outcome.key), true);
+    endpoint["lastFlow"] = outcome.lastFlow <= kFlowATTESTATION ? flowNames[outcome.lastFlow] : "none";
+    endpoint["fastFailures"] = outcome.fastFailures;
+    endpoint["escalations"] = outcome.escalations;
+    result["endpoints"].push_back(endpoint);
+  }
+  xSemaphoreGive(mutex);
+  return result;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <Arduino.h>
+#include <HomeKey.h>
+#include <freertos/semphr.h>
+#include <array>
+#include <vector>
+#include "config.h"
+
+/**
+ * Picks the flow a tap starts with and keeps track of how each flow performs. Taps start with the FAST
+ * flow and escalate to STANDARD and then ATTESTATION within the same field presence when a flow fails.
+ *
+ * Outcomes are kept per enrolled endpoint, in a vector indexed by the endpoint numbers of `hkIndex` and
+ * remapped by key whenever the index is rebuilt. The starting flow can't be picked per endpoint though:
+ * `HKAuthenticationContext::authenticate` only identifies the endpoint as the result of a flow (FAST by
+ * matching the cryptogram against every persistent key, STANDARD by the signature), nothing in the
+ * transaction names the endpoint before the flow is chosen. So FAST is skipped while every endpoint
+ * seen so far has been failing it, with a FAST probe every `HOMEKEY_FLOW_FAST_PROBE` taps so recovered
+ * endpoints are picked up again.
+ *
+ * The flow set with the `F` serial command is used as the lowest flow a tap may start with.
+ */
+struct hkFlowEngine_t
+{
+  struct outcome_t
+  {
+    uint64_t key = 0;
+    uint32_t lastTap = 0;
+    uint16_t fastFailures = 0;
+    uint16_t escalations = 0;
+    KeyFlow lastFlow = kFlowFailed;
+  };
+  struct counters_t
+  {
+    uint32_t attempts = 0;
+    uint32_t successes = 0;
+    uint64_t totalTime = 0;
+  };
+  std::vector<outcome_t> outcomes;
+  uint32_t indexGeneration = 0;
+  std::array<counters_t, kFlowATTESTATION + 1> flows{};
+  uint32_t taps = 0;
+  uint32_t escalations = 0;
+  uint32_t fastSkipped = 0;
+  bool skippingFast = false;
+  uint32_t skippedSinceProbe = 0;
+  SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+
+  /* Moves the outcomes to the current endpoint numbers of `hkIndex`, dropping removed endpoints */
+  void sync();
+  void updateSkipping();
+  KeyFlow startFlow(KeyFlow floor);
+  void attempt(KeyFlow flow, bool success, int64_t duration);
+  /* Records which flow identified the endpoint and whether FAST failed before it */
+  void outcome(const std::vector<uint8_t>& endpointId, KeyFlow flow, bool fastFailed, bool escalated);
+  json toJson();
+};
+
+extern hkFlowEngine_t hkFlowEngine;
@@ -0,0 +1,67 @@
+#define JSON_NOEXCEPTION 1
+#include "hkIndex.h"
+
+static const char* TAG = "hkIndex";
+
+hkIndex_t hkIndex;
+
+void hkIndex_t::rebuild(const readerData_t& data) {
+  size_t count = data.issuers.size();
+  for (auto&& issuer : data.issuers) {
+    count += issuer.endpoints.size();
+  }
+  // keep the load factor at or below 50%
+  uint8_t bits = 4;
+  while ((size_t(1) << bits) < count * 2) bits++;
+  std::vector<entry_t> newTable(size_t(1) << bits);
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  shift = 64 - bits;
+  uint16_t ordinal = 0;
+  for (size_t i = 0; i < data.issuers.size(); i++) {
+    auto&& issuer = data.issuers[i];
+    insert(newTable, makeKey(issuer.issuer_id.data(), issuer.issuer_id.size()), i, NONE);
+    for (size_t j = 0; j < issuer.endpoints.size(); j++) {
+      auto&& endpoint = issuer.endpoints[j];
+      insert(newTable, makeKey(endpoint.endpoint_id.data(), endpoint.endpoint_id.size()), i, j, ordinal++);
+    }
+  }
+  table.swap(newTable);
+  endpoints = ordinal;
+  generation++;
+  xSemaphoreGive(mutex);
+  LOG(D, "Issuer index rebuilt: %d entries, %d slots", count, table.size());
+}
+
+hkIssuer_t* hkIndex_t::findIssuer(readerData_t& data, const uint8_t* id, size_t len) {
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  const entry_t* e = find(makeKey(id, len), false);
+  hkIssuer_t* issuer = nullptr;
+  if (e && e->issuer < data.issuers.size() && std::equal(data.issuers[e->issuer].issuer_id.begin(), data.issuers[e->issuer].issuer_id.end(), id)) {
+    issuer = &data.issuers[e->issuer];
+  }
+  xSemaphoreGive(mutex);
+  return issuer;
+}
+
+hkEndpoint_t* hkIndex_t::findEndpoint(readerData_t& data, const uint8_t* id, size_t len, hkIssuer_t** issuerOut) {
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  const entry_t* e = find(makeKey(id, len), true);
+  hkEndpoint_t* endpoint = nullptr;
+  if (e && e->issuer < data.issuers.size() && e->endpoint < data.issuers[e->issuer].endpoints.size()) {
+    auto&& candidate = data.issuers[e->issuer].endpoints[e->endpoint];
+    if (std::equal(candidate.endpoint_id.begin(), candidate.endpoint_id.end(), id)) {
+      endpoint = &candidate;
+      if (issuerOut) *issuerOut = &data.issuers[e->issuer];
+    }
+  }
+  xSemaphoreGive(mutex);
+  return endpoint;
+}
+
+uint16_t hkIndex_t::endpointOrdinal(uint64_t key) {
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  const entry_t* e = find(key, true);
+  uint16_t ordinal = e ? e->ordinal : NONE;
+  xSemaphoreGive(mutex);
+  return ordinal;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <Arduino.h>
+#include <HomeKey.h>
+#include <freertos/semphr.h>
+
+/**
+ * In-RAM index over `readerData.issuers` so issuers and endpoints can be found by ID without scanning
+ * the nested vectors. Entries are fixed-size and stored in an open-addressed table (linear probing)
+ * keyed by the first 8 bytes of the ID, the table is rebuilt from `readerData` whenever issuers or
+ * endpoints are added or removed. Endpoints are also numbered densely from 0 in `readerData` order, so
+ * per-endpoint state elsewhere can live in a vector sized to the enrolled endpoints; `generation`
+ * changes with every rebuild as the numbers may change with it.
+ */
+struct hkIndex_t
+{
+  static constexpr uint16_t NONE = 0xFFFF;
+  struct entry_t
+  {
+    uint64_t key;
+    uint16_t issuer = NONE;
+    uint16_t endpoint = NONE;
+    uint16_t ordinal = NONE;
+  };
+  std::vector<entry_t> table;
+  uint8_t shift = 64;
+  uint16_t endpoints = 0;
+  uint32_t generation = 0;
+  SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+
+  static uint64_t makeKey(const uint8_t* id, size_t len) {
+    uint64_t key = 0;
+    memcpy(&key, id, std::min(len, sizeof(key)));
+    return key;
+  }
+  size_t slot(uint64_t key) const {
+    return (key * 0x9E3779B97F4A7C15ull) >> shift;
+  }
+  void insert(std::vector<entry_t>& t, uint64_t key, uint16_t issuer, uint16_t endpoint, uint16_t ordinal = NONE) const {
+    size_t mask = t.size() - 1;
+    size_t i = slot(key);
+    while (t[i].issuer != NONE) {
+      i = (i + 1) & mask;
+    }
+    t[i] = { key, issuer, endpoint, ordinal };
+  }
+  const entry_t* find(uint64_t key, bool endpoint) const {
+    if (table.empty()) return nullptr;
+    size_t mask = table.size() - 1;
+    for (size_t i = slot(key); table[i].issuer != NONE; i = (i + 1) & mask) {
+      if (table[i].key == key && (table[i].endpoint != NONE) == endpoint) {
+        return &table[i];
+      }
+    }
+    return nullptr;
+  }
+  void rebuild(const readerData_t& data);
+  hkIssuer_t* findIssuer(readerData_t& data, const uint8_t* id, size_t len);
+  hkEndpoint_t* findEndpoint(readerData_t& data, const uint8_t* id, size_t len, hkIssuer_t** issuerOut = nullptr);
+  /* Returns the number of the endpoint whose ID starts with `key`, NONE if it isn't enrolled */
+  uint16_t endpointOrdinal(uint64_t key);
+};
+
+extern hkIndex_t hkIndex;
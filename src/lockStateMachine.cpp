@@ -0,0 +1,249 @@
+#define JSON_NOEXCEPTION 1
+#include "lockStateMachine.h"
+#include "espConfig.h"
+
+static const char* TAG = "lockStateMachine";
+
+SpanCharacteristic* lockCurrentState;
+SpanCharacteristic* lockTargetState;
+lockStateMachine_t lockStateMachine;
+
+void lockStateMachine_t::timer_cb(void* arg) {
+  lockStateMachine.send({ lockCmd_t::RELOCK, 0, uint32_t(esp_timer_get_time()) });
+}
+
+void lockStateMachine_t::send(const lockCmd_t& cmd) {
+  if (queue == nullptr) return;
+  if (xQueueSend(queue, &cmd, 0) != pdTRUE) {
+    LOG(W, "Lock queue full, dropping command %d", cmd.kind);
+  }
+  xTaskNotifyGive(task);
+}
+
+void lockStateMachine_t::drive(int lockState, uint32_t queued, uint16_t tap, uint8_t reader) {
+  if (espConfig::miscConfig.gpioActionPin == 255) return;
+  digitalWrite(espConfig::miscConfig.gpioActionPin, lockState == lockStates::UNLOCKED ? espConfig::miscConfig.gpioActionUnlockState : espConfig::miscConfig.gpioActionLockState);
+  gpioLatency.add(queued, tap, reader);
+}
+
+void lockStateMachine_t::armRelock(uint8_t source) {
+  if (!(static_cast<uint8_t>(espConfig::miscConfig.gpioActionMomentaryEnabled) & source)) return;
+  esp_timer_stop(relockTimer);
+  esp_timer_start_once(relockTimer, uint64_t(espConfig::miscConfig.gpioActionMomentaryTimeout) * 1000);
+}
+
+void lockStateMachine_t::customAction(int lockState) {
+  if (!espConfig::mqttData.lockEnableCustomState) return;
+  if (lockState == lockStates::UNLOCKED) {
+    customState = customActions[0];
+  } else if (lockState == lockStates::LOCKED) {
+    customState = customActions[1];
+  }
+}
+
+void lockStateMachine_t::onTap(const busEvent_t& event) {
+  reader = event.reader;
+  tap = event.tap;
+  bool gpioDriven = espConfig::miscConfig.gpioActionPin != 255 && espConfig::miscConfig.hkGpioControlledState;
+  bool applies;
+  int next;
+  if (espConfig::miscConfig.lockAlwaysUnlock) {
+    next = lockStates::UNLOCKED;
+    applies = true;
+  } else if (espConfig::miscConfig.lockAlwaysLock) {
+    next = lockStates::LOCKED;
+    applies = espConfig::miscConfig.gpioActionPin == 255 || espConfig::miscConfig.hkGpioControlledState;
+  } else {
+    if (current != lockStates::UNLOCKED && current != lockStates::LOCKED) return;
+    next = current == lockStates::UNLOCKED ? lockStates::LOCKED : lockStates::UNLOCKED;
+    // without a GPIO the lock reports its new state back over MQTT
+    applies = gpioDriven;
+  }
+  customAction(next);
+  if (!applies) return;
+  LOG(D, "HomeKey tap, lock state %d -> %d", current, next);
+  target = next;
+  if (gpioDriven) drive(next, event.posted, event.tap, event.reader);
+  settle(next);
+  if (gpioDriven && next == lockStates::UNLOCKED) armRelock(gpioLockAction::HOMEKEY);
+}
+
+void lockStateMachine_t::apply(const lockCmd_t& cmd) {
+  switch (cmd.kind) {
+  case lockCmd_t::HOMEKIT:
+    LOG(I, "New LockState=%d, Current LockState=%d", cmd.arg, current);
+    esp_timer_stop(relockTimer);
+    target = cmd.arg;
+    // the controller already holds the new target, no need to echo it back
+    hkTarget = cmd.arg;
+    hkPendingTarget = -1;
+    if (espConfig::miscConfig.gpioActionPin != 255) {
+      drive(target, cmd.queued);
+      settle(target);
+      if (target == lockStates::UNLOCKED) armRelock(gpioLockAction::HOMEKIT);
+    } else if (espConfig::miscConfig.hkDumbSwitchMode) {
+      settle(target);
+    } else {
+      transition();
+    }
+    customAction(target);
+    break;
+  case lockCmd_t::SET:
+    if (cmd.arg == lockStates::UNLOCKED || cmd.arg == lockStates::LOCKED) {
+      target = cmd.arg;
+      drive(target, cmd.queued);
+      settle(target);
+      customAction(target);
+    } else if (cmd.arg == lockStates::JAMMED || cmd.arg == lockStates::UNKNOWN) {
+      settle(cmd.arg);
+    } else LOG(D, "Update state failed! Recv value not valid");
+    break;
+  case lockCmd_t::TARGET:
+    if (cmd.arg == lockStates::UNLOCKED || cmd.arg == lockStates::LOCKED) {
+      target = cmd.arg;
+      transition();
+    }
+    break;
+  case lockCmd_t::CURRENT:
+    if (cmd.arg == lockStates::UNLOCKED || cmd.arg == lockStates::LOCKED || cmd.arg == lockStates::JAMMED || cmd.arg == lockStates::UNKNOWN) {
+      settle(cmd.arg);
+    }
+    break;
+  case lockCmd_t::CUSTOM: {
+    uint8_t i = std::find(customStates.begin(), customStates.end(), cmd.arg) - customStates.begin();
+    switch (i) {
+    case C_UNLOCKING:
+      target = lockStates::UNLOCKED;
+      transition();
+      break;
+    case C_LOCKING:
+      target = lockStates::LOCKED;
+      transition();
+      break;
+    case C_UNLOCKED:
+      drive(lockStates::UNLOCKED, cmd.queued);
+      settle(lockStates::UNLOCKED);
+      break;
+    case C_LOCKED:
+      drive(lockStates::LOCKED, cmd.queued);
+      settle(lockStates::LOCKED);
+      break;
+    case C_JAMMED:
+      settle(lockStates::JAMMED);
+      break;
+    case C_UNKNOWN:
+      settle(lockStates::UNKNOWN);
+      break;
+    default:
+      LOG(D, "Update state failed! Recv value not valid");
+      break;
+    }
+    break;
+  }
+  case lockCmd_t::RELOAD:
+    loadCustomStates();
+    break;
+  case lockCmd_t::RELOCK:
+    if (espConfig::miscConfig.gpioActionPin == 255) break;
+    target = lockStates::LOCKED;
+    drive(lockStates::LOCKED, cmd.queued);
+    settle(lockStates::LOCKED);
+    break;
+  }
+}
+
+void lockStateMachine_t::flush() {
+  flushes++;
+  if (target != hkTarget) {
+    hkPendingTarget = target;
+    hkTarget = target;
+    hkNotifies++;
+  }
+  if (current != hkCurrent) {
+    hkPendingCurrent = current;
+    hkCurrent = current;
+    hkNotifies++;
+  }
+  busEvent_t event{ .type = busEvent_t::LOCK_STATE, .reader = reader };
+  event.tap = tap;
+  if (state != -1 && state != published) {
+    event.lockState = state;
+    published = state;
+  }
+  event.customState = customState;
+  customState = -1;
+  if (event.lockState != -1 || event.customState != -1) {
+    mqttPublishes++;
+    eventBus.post(event);
+  }
+}
+
+void lockStateMachine_t::syncHomeKit() {
+  int value = hkPendingTarget.exchange(-1);
+  if (value != -1) lockTargetState->setVal(value);
+  value = hkPendingCurrent.exchange(-1);
+  if (value != -1) lockCurrentState->setVal(value);
+}
+
+void lockStateMachine_t::task_entry(void* arg) {
+  lockStateMachine_t& machine = *static_cast<lockStateMachine_t*>(arg);
+  eventBus_t::subscriber_t* sub = eventBus.subscribe();
+  busEvent_t event;
+  lockCmd_t cmd;
+  while (1) {
+    {
+      espConfig::lock_t lock;
+      bool dirty = false;
+      while (eventBus.next(*sub, event)) {
+        if (event.type != busEvent_t::HOMEKEY_SUCCESS && !event.allowed) continue;
+        machine.onTap(event);
+        machine.commands++;
+        dirty = true;
+      }
+      while (xQueueReceive(machine.queue, &cmd, 0) == pdTRUE) {
+        machine.apply(cmd);
+        machine.commands++;
+        dirty = true;
+      }
+      if (dirty) machine.flush();
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+}
+
+void lockStateMachine_t::loadCustomStates() {
+  // looked up without inserting, the config is only read here
+  auto get = [](const std::map<std::string, int>& map, const char* key) {
+    auto it = map.find(key);
+    return it == map.end() ? 0 : it->second;
+  };
+  auto&& states = espConfig::mqttData.customLockStates;
+  auto&& actions = espConfig::mqttData.customLockActions;
+  customStates = { get(states, "C_UNLOCKING"), get(states, "C_LOCKING"), get(states, "C_UNLOCKED"),
+                   get(states, "C_LOCKED"), get(states, "C_JAMMED"), get(states, "C_UNKNOWN") };
+  customActions = { get(actions, "UNLOCK"), get(actions, "LOCK") };
+}
+
+void lockStateMachine_t::begin() {
+  loadCustomStates();
+  current = lockCurrentState->getVal();
+  target = lockTargetState->getVal();
+  hkCurrent = current;
+  hkTarget = target;
+  queue = xQueueCreate(16, sizeof(lockCmd_t));
+  esp_timer_create_args_t args{};
+  args.callback = timer_cb;
+  args.name = "relock";
+  esp_timer_create(&args, &relockTimer);
+  xTaskCreate(task_entry, "lock_task", 4096, this, 2, &task);
+}
+
+json lockStateMachine_t::toJson() const {
+  json result;
+  result["gpio"] = gpioLatency.toJson();
+  result["commands"] = commands;
+  result["flushes"] = flushes;
+  result["homekitNotifies"] = hkNotifies;
+  result["mqttPublishes"] = mqttPublishes;
+  return result;
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <Arduino.h>
+#include <HomeKey.h>
+#include <HomeSpan.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <array>
+#include <atomic>
+#include "config.h"
+#include "actionsEngine.h"
+#include "eventBus.h"
+
+/**
+ * Sources that can trigger the momentary relock, as bits of `gpioActionMomentaryEnabled`.
+ */
+struct gpioLockAction
+{
+  enum
+  {
+    HOMEKIT = 1,
+    HOMEKEY = 2,
+    OTHER = 3
+  };
+  uint8_t source;
+  uint8_t action;
+};
+
+// the LockMechanism characteristics, set up with the HomeKit accessory
+extern SpanCharacteristic* lockCurrentState;
+extern SpanCharacteristic* lockTargetState;
+
+/**
+ * Command queued to the lock state machine.
+ */
+struct lockCmd_t
+{
+  enum kind_t : uint8_t
+  {
+    HOMEKIT, // LockTargetState written by a controller, arg: target state
+    SET,     // MQTT set state command, arg: lockStates
+    TARGET,  // MQTT set target state command, arg: lockStates
+    CURRENT, // MQTT set current state command, arg: lockStates
+    CUSTOM,  // MQTT custom state command, arg: received custom state
+    RELOCK,  // momentary relock timer expired
+    RELOAD   // MQTT configuration changed, reload the custom states
+  };
+  kind_t kind;
+  int16_t arg;
+  uint32_t queued;
+};
+
+/**
+ * Owner of the lock state. HomeKey taps arrive over the event bus, HomeKit and MQTT commands over
+ * `queue`, and only `lock_task` touches the lock state and the action GPIO.
+ * Commands are applied in batches: after the queue is drained HomeKit is notified only for the
+ * characteristics that changed and a single LOCK_STATE event is posted for MQTT, so a flood of
+ * commands ends up as one notification and one publish of the last state. The characteristics
+ * themselves are set by `syncHomeKit` from `LockMechanism::loop`, as HomeSpan expects `setVal` from
+ * its own loop.
+ */
+struct lockStateMachine_t
+{
+  QueueHandle_t queue = nullptr;
+  TaskHandle_t task = nullptr;
+  esp_timer_handle_t relockTimer = nullptr;
+  actionsEngine_t::latency_t gpioLatency;
+  int current = lockStates::UNKNOWN;
+  int target = lockStates::LOCKED;
+  int16_t state = -1;      // lock state to publish on MQTT
+  int16_t customState = -1; // custom action to publish on MQTT, -1 if none
+  int hkCurrent = -1;
+  int hkTarget = -1;
+  // values `flush` left for `syncHomeKit`, -1 if none
+  std::atomic<int> hkPendingCurrent{ -1 };
+  std::atomic<int> hkPendingTarget{ -1 };
+  int16_t published = -1;
+  uint8_t reader = 0;
+  uint32_t tap = 0;
+  uint32_t commands = 0;
+  uint32_t flushes = 0;
+  uint32_t hkNotifies = 0;
+  uint32_t mqttPublishes = 0;
+  // flat copies of the configured custom states and actions, looked up on every MQTT custom state command
+  enum custom_t : uint8_t
+  {
+    C_UNLOCKING,
+    C_LOCKING,
+    C_UNLOCKED,
+    C_LOCKED,
+    C_JAMMED,
+    C_UNKNOWN,
+    CUSTOM_STATES
+  };
+  std::array<int, CUSTOM_STATES> customStates{};
+  std::array<int, 2> customActions{}; // UNLOCK, LOCK
+
+  static void timer_cb(void* arg);
+  void send(const lockCmd_t& cmd);
+  void drive(int lockState, uint32_t queued, uint16_t tap = 0, uint8_t reader = tapTrace_t::noReader);
+  void armRelock(uint8_t source);
+  void customAction(int lockState);
+  void transition() {
+    state = target == lockStates::UNLOCKED ? lockStates::UNLOCKING : lockStates::LOCKING;
+  }
+  void settle(int lockState) {
+    current = lockState;
+    state = lockState;
+  }
+  void onTap(const busEvent_t& event);
+  void apply(const lockCmd_t& cmd);
+  void flush();
+  /* Sets the characteristics `flush` changed, called from the HomeSpan loop */
+  void syncHomeKit();
+  static void task_entry(void* arg);
+  void loadCustomStates();
+  void begin();
+  json toJson() const;
+};
+
+extern lockStateMachine_t lockStateMachine;
@@ -2,6 +2,8 @@
 #include <hkAuthContext.h>
 #include <HomeKey.h>
 #include <array>
+#include <charconv>
+#include <string_view>
 #include <utils.h>
 #include <HomeSpan.h>
 #include <PN532_SPI.h>
@@ -13,154 +15,44 @@
 #include <LittleFS.h>
 #include <HK_HomeKit.h>
 #include "config.h"
+#include "espConfig.h"
+#include "hkIndex.h"
+#include "tapTrace.h"
+#include "eventBus.h"
+#include "eventJournal.h"
+#include "uidAllowlist.h"
+#include "readerStore.h"
+#include "hkFlowEngine.h"
+#include "mqttDispatch.h"
+#include "configRegistry.h"
+#include "hassDiscovery.h"
+#include "tapPayload.h"
+#include "pixelAnimator.h"
+#include "actionsEngine.h"
+#include "lockStateMachine.h"
+#include "webEvents.h"
+#include "webJobs.h"
+#include "nfcReader.h"
 #include <mqtt_client.h>
 #include <esp_ota_ops.h>
 #include <esp_task.h>
+#include <esp_timer.h>
+#include <esp_rom_crc.h>
 #include <pins_arduino.h>
 #include <src/extras/Pixel.h>
 
 const char* TAG = "MAIN";
 
 AsyncWebServer webServer(80);
-PN532_SPI *pn532spi;
-PN532 *nfc;
-QueueHandle_t gpio_led_handle = nullptr;
-QueueHandle_t neopixel_handle = nullptr;
-QueueHandle_t gpio_lock_handle = nullptr;
-TaskHandle_t gpio_led_task_handle = nullptr;
-TaskHandle_t neopixel_task_handle = nullptr;
-TaskHandle_t gpio_lock_task_handle = nullptr;
-
-nvs_handle savedData;
-readerData_t readerData;
-uint8_t ecpData[18] = { 0x6A, 0x2, 0xCB, 0x2, 0x6, 0x2, 0x11, 0x0 };
+
 const std::array<std::array<uint8_t, 6>, 4> hk_color_vals = { {{0x01,0x04,0xce,0xd5,0xda,0x00}, {0x01,0x04,0xaa,0xd6,0xec,0x00}, {0x01,0x04,0xe3,0xe3,0xe3,0x00}, {0x01,0x04,0x00,0x00,0x00,0x00}} };
 const std::array<const uint8_t*, 6> pixelTypeMap = { PixelType::RGB, PixelType::RBG, PixelType::BRG, PixelType::BGR, PixelType::GBR, PixelType::GRB };
-struct gpioLockAction
-{
-  enum
-  {
-    HOMEKIT = 1,
-    HOMEKEY = 2,
-    OTHER = 3
-  };
-  uint8_t source;
-  uint8_t action;
-};
-
-std::string platform_create_id_string(void) {
-  uint8_t mac[6];
-  char id_string[32];
-  esp_read_mac(mac, ESP_MAC_WIFI_STA);
-  sprintf(id_string, "ESP32_%02x%02X%02X", mac[3], mac[4], mac[5]);
-  return std::string(id_string);
-}
-
-namespace espConfig
-{
-  struct mqttConfig_t
-  {
-    mqttConfig_t() {
-      std::string id = platform_create_id_string();
-      mqttClientId = id;
-      lwtTopic.append(id).append("/" MQTT_LWT_TOPIC);
-      hkTopic.append(id).append("/" MQTT_AUTH_TOPIC);
-      lockStateTopic.append(id).append("/" MQTT_STATE_TOPIC);
-      lockStateCmd.append(id).append("/" MQTT_SET_STATE_TOPIC);
-      lockCStateCmd.append(id).append("/" MQTT_SET_CURRENT_STATE_TOPIC);
-      lockTStateCmd.append(id).append("/" MQTT_SET_TARGET_STATE_TOPIC);
-      lockCustomStateTopic.append(id).append("/" MQTT_CUSTOM_STATE_TOPIC);
-      lockCustomStateCmd.append(id).append("/" MQTT_CUSTOM_STATE_CTRL_TOPIC);
-      btrLvlCmdTopic.append(id).append("/" MQTT_PROX_BAT_TOPIC);
-    }
-    /* MQTT Broker */
-    std::string mqttBroker = MQTT_HOST;
-    uint16_t mqttPort = MQTT_PORT;
-    std::string mqttUsername = MQTT_USERNAME;
-    std::string mqttPassword = MQTT_PASSWORD;
-    std::string mqttClientId;
-    /* MQTT Topics */
-    std::string lwtTopic;
-    std::string hkTopic;
-    std::string lockStateTopic;
-    std::string lockStateCmd;
-    std::string lockCStateCmd;
-    std::string lockTStateCmd;
-    std::string btrLvlCmdTopic;
-    /* MQTT Custom State */
-    std::string lockCustomStateTopic;
-    std::string lockCustomStateCmd;
-    /* Flags */
-    bool lockEnableCustomState = MQTT_CUSTOM_STATE_ENABLED;
-    bool hassMqttDiscoveryEnabled = MQTT_DISCOVERY;
-    bool nfcTagNoPublish = false;
-    std::map<std::string, int> customLockStates = { {"C_LOCKED", C_LOCKED}, {"C_UNLOCKING", C_UNLOCKING}, {"C_UNLOCKED", C_UNLOCKED}, {"C_LOCKING", C_LOCKING}, {"C_JAMMED", C_JAMMED}, {"C_UNKNOWN", C_UNKNOWN} };
-    std::map<std::string, int> customLockActions = { {"UNLOCK", UNLOCK}, {"LOCK", LOCK} };
-    NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(espConfig::mqttConfig_t, mqttBroker, mqttPort, mqttUsername, mqttPassword, mqttClientId, lwtTopic, hkTopic, lockStateTopic, lockStateCmd, lockCStateCmd, lockTStateCmd, lockCustomStateTopic, lockCustomStateCmd, lockEnableCustomState, hassMqttDiscoveryEnabled, customLockStates, customLockActions, nfcTagNoPublish, btrLvlCmdTopic)
-  } mqttData;
-
-  struct misc_config_t
-  {
-    enum colorMap
-    {
-      R,
-      G,
-      B
-    };
-    std::string deviceName = DEVICE_NAME;
-    std::string otaPasswd = OTA_PWD;
-    uint8_t hk_key_color = HOMEKEY_COLOR;
-    std::string setupCode = SETUP_CODE;
-    bool lockAlwaysUnlock = HOMEKEY_ALWAYS_UNLOCK;
-    bool lockAlwaysLock = HOMEKEY_ALWAYS_LOCK;
-    uint8_t controlPin = HS_PIN;
-    uint8_t hsStatusPin = HS_STATUS_LED;
-    uint8_t nfcNeopixelPin = NFC_NEOPIXEL_PIN;
-    uint8_t neoPixelType = 5;
-    std::map<colorMap, int> neopixelSuccessColor = { {R, NEOPIXEL_SUCCESS_R}, {G, NEOPIXEL_SUCCESS_G}, {B, NEOPIXEL_SUCCESS_B} };
-    std::map<colorMap, int> neopixelFailureColor = { {R, NEOPIXEL_FAIL_R}, {G, NEOPIXEL_FAIL_G}, {B, NEOPIXEL_FAIL_B} };
-    uint16_t neopixelSuccessTime = NEOPIXEL_SUCCESS_TIME;
-    uint16_t neopixelFailTime = NEOPIXEL_FAIL_TIME;
-    uint8_t nfcSuccessPin = NFC_SUCCESS_PIN;
-    uint16_t nfcSuccessTime = NFC_SUCCESS_TIME;
-    bool nfcSuccessHL = NFC_SUCCESS_HL;
-    uint8_t nfcFailPin = NFC_FAIL_PIN;
-    uint16_t nfcFailTime = NFC_FAIL_TIME;
-    bool nfcFailHL = NFC_FAIL_HL;
-    uint8_t gpioActionPin = GPIO_ACTION_PIN;
-    bool gpioActionLockState = GPIO_ACTION_LOCK_STATE;
-    bool gpioActionUnlockState = GPIO_ACTION_UNLOCK_STATE;
-    uint8_t gpioActionMomentaryEnabled = GPIO_ACTION_MOMENTARY_STATE;
-    bool hkGpioControlledState = true;
-    uint16_t gpioActionMomentaryTimeout = GPIO_ACTION_MOMENTARY_TIMEOUT;
-    bool webAuthEnabled = WEB_AUTH_ENABLED;
-    std::string webUsername = WEB_AUTH_USERNAME;
-    std::string webPassword = WEB_AUTH_PASSWORD;
-    std::array<uint8_t, 4> nfcGpioPins{SS, SCK, MISO, MOSI};
-    uint8_t btrLowStatusThreshold = 10;
-    bool proxBatEnabled = false;
-    bool hkDumbSwitchMode = false;
-    NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(misc_config_t, deviceName, otaPasswd, hk_key_color, setupCode, lockAlwaysUnlock, lockAlwaysLock, controlPin, hsStatusPin, nfcSuccessPin, nfcSuccessTime, nfcNeopixelPin, neopixelSuccessColor, neopixelFailureColor, neopixelSuccessTime, neopixelFailTime, nfcSuccessHL, nfcFailPin, nfcFailTime, nfcFailHL, gpioActionPin, gpioActionLockState, gpioActionUnlockState, gpioActionMomentaryEnabled, gpioActionMomentaryTimeout, webAuthEnabled, webUsername, webPassword, nfcGpioPins, btrLowStatusThreshold, proxBatEnabled, hkDumbSwitchMode)
-  } miscConfig;
-};
 
-KeyFlow hkFlow = KeyFlow::kFlowFAST;
-SpanCharacteristic* lockCurrentState;
-SpanCharacteristic* lockTargetState;
 SpanCharacteristic* statusLowBtr;
 SpanCharacteristic* btrLevel;
 esp_mqtt_client_handle_t client = nullptr;
-
-std::unique_ptr<Pixel> pixel;
-
-bool save_to_nvs() {
-  std::vector<uint8_t> serialized = nlohmann::json::to_msgpack(readerData);
-  esp_err_t set_nvs = nvs_set_blob(savedData, "READERDATA", serialized.data(), serialized.size());
-  esp_err_t commit_nvs = nvs_commit(savedData);
-  LOG(D, "NVS SET STATUS: %s", esp_err_to_name(set_nvs));
-  LOG(D, "NVS COMMIT STATUS: %s", esp_err_to_name(commit_nvs));
-  return !set_nvs && !commit_nvs;
-}
+std::atomic<bool> mqttConnected{ false };
+TaskHandle_t bus_mqtt_task_handle = nullptr;
 
 struct PhysicalLockBattery : Service::BatteryService
 {
@@ -188,163 +80,6 @@ struct LockManagement : Service::LockManagement
 
 }; // end LockManagement
 
-// Function to calculate CRC16
-void crc16a(unsigned char* data, unsigned int size, unsigned char* result) {
-  unsigned short w_crc = 0x6363;
-
-  for (unsigned int i = 0; i < size; ++i) {
-    unsigned char byte = data[i];
-    byte = (byte ^ (w_crc & 0x00FF));
-    byte = ((byte ^ (byte << 4)) & 0xFF);
-    w_crc = ((w_crc >> 8) ^ (byte << 8) ^ (byte << 3) ^ (byte >> 4)) & 0xFFFF;
-  }
-
-  result[0] = static_cast<unsigned char>(w_crc & 0xFF);
-  result[1] = static_cast<unsigned char>((w_crc >> 8) & 0xFF);
-}
-
-// Function to append CRC16 to data
-void with_crc16(unsigned char* data, unsigned int size, unsigned char* result) {
-  crc16a(data, size, result);
-}
-
-
-void gpio_task(void* arg) {
-  gpioLockAction status;
-  while (1) {
-    if (gpio_lock_handle != nullptr) {
-      status = {};
-      if (uxQueueMessagesWaiting(gpio_lock_handle) > 0) {
-        xQueueReceive(gpio_lock_handle, &status, 0);
-        LOG(D, "Got something in queue - source = %d action = %d", status.source, status.action);
-        if (status.action == 0) {
-          LOG(D, "%d - %d - %d -%d", espConfig::miscConfig.gpioActionPin, espConfig::miscConfig.gpioActionMomentaryEnabled, espConfig::miscConfig.lockAlwaysUnlock, espConfig::miscConfig.lockAlwaysLock);
-          if (espConfig::miscConfig.lockAlwaysUnlock && status.source != gpioLockAction::HOMEKIT) {
-            lockTargetState->setVal(lockStates::UNLOCKED);
-            digitalWrite(espConfig::miscConfig.gpioActionPin, espConfig::miscConfig.gpioActionUnlockState);
-            lockCurrentState->setVal(lockStates::UNLOCKED);
-            if (client != nullptr) {
-              esp_mqtt_client_publish(client, espConfig::mqttData.lockStateTopic.c_str(), std::to_string(lockStates::UNLOCKED).c_str(), 1, 0, false);
-            } else LOG(W, "MQTT Client not initialized, cannot publish message");
-
-            if (static_cast<uint8_t>(espConfig::miscConfig.gpioActionMomentaryEnabled) & status.source) {
-              delay(espConfig::miscConfig.gpioActionMomentaryTimeout);
-              lockTargetState->setVal(lockStates::LOCKED);
-              digitalWrite(espConfig::miscConfig.gpioActionPin, espConfig::miscConfig.gpioActionLockState);
-              lockCurrentState->setVal(lockStates::LOCKED);
-              if (client != nullptr) {
-                esp_mqtt_client_publish(client, espConfig::mqttData.lockStateTopic.c_str(), std::to_string(lockStates::LOCKED).c_str(), 1, 0, false);
-              } else LOG(W, "MQTT Client not initialized, cannot publish message");
-            }
-          } else if (espConfig::miscConfig.lockAlwaysLock && status.source != gpioLockAction::HOMEKIT) {
-            lockTargetState->setVal(lockStates::LOCKED);
-            digitalWrite(espConfig::miscConfig.gpioActionPin, espConfig::miscConfig.gpioActionLockState);
-            lockCurrentState->setVal(lockStates::LOCKED);
-            if (client != nullptr) {
-              esp_mqtt_client_publish(client, espConfig::mqttData.lockStateTopic.c_str(), std::to_string(lockStates::LOCKED).c_str(), 1, 0, false);
-            } else LOG(W, "MQTT Client not initialized, cannot publish message");
-          } else {
-            int currentState = lockCurrentState->getVal();
-            if (status.source != gpioLockAction::HOMEKIT) {
-              lockTargetState->setVal(!currentState);
-            }
-            digitalWrite(espConfig::miscConfig.gpioActionPin, currentState == lockStates::UNLOCKED ? espConfig::miscConfig.gpioActionLockState : espConfig::miscConfig.gpioActionUnlockState);
-            lockCurrentState->setVal(!currentState);
-            if (client != nullptr) {
-              esp_mqtt_client_publish(client, espConfig::mqttData.lockStateTopic.c_str(), std::to_string(lockCurrentState->getNewVal()).c_str(), 1, 0, false);
-            } else LOG(W, "MQTT Client not initialized, cannot publish message");
-            if ((static_cast<uint8_t>(espConfig::miscConfig.gpioActionMomentaryEnabled) & status.source) && currentState == lockStates::LOCKED) {
-              delay(espConfig::miscConfig.gpioActionMomentaryTimeout);
-              lockTargetState->setVal(currentState);
-              digitalWrite(espConfig::miscConfig.gpioActionPin, espConfig::miscConfig.gpioActionLockState);
-              lockCurrentState->setVal(currentState);
-              if (client != nullptr) {
-                esp_mqtt_client_publish(client, espConfig::mqttData.lockStateTopic.c_str(), std::to_string(lockCurrentState->getNewVal()).c_str(), 1, 0, false);
-              } else LOG(W, "MQTT Client not initialized, cannot publish message");
-            }
-          }
-        } else if (status.action == 2) {
-          vTaskDelete(NULL);
-          return;
-        }
-      }
-    }
-    vTaskDelay(100 / portTICK_PERIOD_MS);
-  }
-}
-
-void neopixel_task(void* arg) {
-  uint8_t status = 0;
-  while (1) {
-    if (neopixel_handle != nullptr) {
-      status = 0;
-      if (uxQueueMessagesWaiting(neopixel_handle) > 0) {
-        xQueueReceive(neopixel_handle, &status, 0);
-        LOG(D, "Got something in queue %d", status);
-        switch (status) {
-        case 0:
-          if (espConfig::miscConfig.nfcNeopixelPin && espConfig::miscConfig.nfcNeopixelPin != 255) {
-            LOG(D, "SUCCESS PIXEL %d:%d,%d,%d", espConfig::miscConfig.nfcNeopixelPin, espConfig::miscConfig.neopixelFailureColor[espConfig::misc_config_t::colorMap::R], espConfig::miscConfig.neopixelFailureColor[espConfig::misc_config_t::colorMap::G], espConfig::miscConfig.neopixelFailureColor[espConfig::misc_config_t::colorMap::B]);
-            pixel->set(pixel->RGB(espConfig::miscConfig.neopixelFailureColor[espConfig::misc_config_t::colorMap::R], espConfig::miscConfig.neopixelFailureColor[espConfig::misc_config_t::colorMap::G], espConfig::miscConfig.neopixelFailureColor[espConfig::misc_config_t::colorMap::B]));
-            delay(espConfig::miscConfig.neopixelFailTime);
-            pixel->off();
-          }
-          break;
-        case 1:
-          if (espConfig::miscConfig.nfcNeopixelPin && espConfig::miscConfig.nfcNeopixelPin != 255) {
-            LOG(D, "FAIL PIXEL %d:%d,%d,%d", espConfig::miscConfig.nfcNeopixelPin, espConfig::miscConfig.neopixelSuccessColor[espConfig::misc_config_t::colorMap::R], espConfig::miscConfig.neopixelSuccessColor[espConfig::misc_config_t::colorMap::G], espConfig::miscConfig.neopixelSuccessColor[espConfig::misc_config_t::colorMap::B]);
-            pixel->set(pixel->RGB(espConfig::miscConfig.neopixelSuccessColor[espConfig::misc_config_t::colorMap::R], espConfig::miscConfig.neopixelSuccessColor[espConfig::misc_config_t::colorMap::G], espConfig::miscConfig.neopixelSuccessColor[espConfig::misc_config_t::colorMap::B]));
-            delay(espConfig::miscConfig.neopixelSuccessTime);
-            pixel->off();
-          }
-          break;
-        default:
-          vTaskDelete(NULL);
-          return;
-          break;
-        }
-      }
-    }
-    vTaskDelay(100 / portTICK_PERIOD_MS);
-  }
-}
-void nfc_gpio_task(void* arg) {
-  uint8_t status = 0;
-  while (1) {
-    if (gpio_led_handle != nullptr) {
-      status = 0;
-      if (uxQueueMessagesWaiting(gpio_led_handle) > 0) {
-        xQueueReceive(gpio_led_handle, &status, 0);
-        LOG(D, "Got something in queue %d", status);
-        switch (status) {
-        case 0:
-          if (espConfig::miscConfig.nfcFailPin && espConfig::miscConfig.nfcFailPin != 255) {
-            LOG(D, "FAIL LED %d:%d", espConfig::miscConfig.nfcFailPin, espConfig::miscConfig.nfcFailHL);
-            digitalWrite(espConfig::miscConfig.nfcFailPin, espConfig::miscConfig.nfcFailHL);
-            delay(espConfig::miscConfig.nfcFailTime);
-            digitalWrite(espConfig::miscConfig.nfcFailPin, !espConfig::miscConfig.nfcFailHL);
-          }
-          break;
-        case 1:
-          if (espConfig::miscConfig.nfcSuccessPin && espConfig::miscConfig.nfcSuccessPin != 255) {
-            LOG(D, "SUCCESS LED %d:%d", espConfig::miscConfig.nfcSuccessPin, espConfig::miscConfig.nfcSuccessHL);
-            digitalWrite(espConfig::miscConfig.nfcSuccessPin, espConfig::miscConfig.nfcSuccessHL);
-            delay(espConfig::miscConfig.nfcSuccessTime);
-            digitalWrite(espConfig::miscConfig.nfcSuccessPin, !espConfig::miscConfig.nfcSuccessHL);
-          }
-          break;
-        default:
-          LOG(I, "STOP");
-          vTaskDelete(NULL);
-          return;
-          break;
-        }
-      }
-    }
-    vTaskDelay(100 / portTICK_PERIOD_MS);
-  }
-}
-
 struct LockMechanism : Service::LockMechanism
 {
   const char* TAG = "LockMechanism";
@@ -365,34 +100,13 @@ struct LockMechanism : Service::LockMechanism
   } // end constructor
 
   boolean update() {
-    int targetState = lockTargetState->getNewVal();
-    LOG(I, "New LockState=%d, Current LockState=%d", targetState, lockCurrentState->getVal());
-    if (espConfig::miscConfig.gpioActionPin != 255) {
-      const gpioLockAction gpioAction{ .source = gpioLockAction::HOMEKIT, .action = 0 };
-      xQueueSend(gpio_lock_handle, &gpioAction, 0);
-    } else if (espConfig::miscConfig.hkDumbSwitchMode) {
-      lockCurrentState->setVal(targetState);
-    }
-    int currentState = lockCurrentState->getNewVal();
-    if (client != nullptr) {
-      if (espConfig::miscConfig.gpioActionPin == 255) {
-        if (targetState != currentState) {
-          esp_mqtt_client_publish(client, espConfig::mqttData.lockStateTopic.c_str(), targetState == lockStates::UNLOCKED ? std::to_string(lockStates::UNLOCKING).c_str() : std::to_string(lockStates::LOCKING).c_str(), 1, 1, true);
-        } else {
-          esp_mqtt_client_publish(client, espConfig::mqttData.lockStateTopic.c_str(), std::to_string(currentState).c_str(), 1, 1, true);
-        }
-      }
-      if (espConfig::mqttData.lockEnableCustomState) {
-        if (targetState == lockStates::UNLOCKED) {
-          esp_mqtt_client_publish(client, espConfig::mqttData.lockCustomStateTopic.c_str(), std::to_string(espConfig::mqttData.customLockActions["UNLOCK"]).c_str(), 0, 0, false);
-        } else if (targetState == lockStates::LOCKED) {
-          esp_mqtt_client_publish(client, espConfig::mqttData.lockCustomStateTopic.c_str(), std::to_string(espConfig::mqttData.customLockActions["LOCK"]).c_str(), 0, 0, false);
-        }
-      }
-    } else LOG(W, "MQTT Client not initialized, cannot publish message");
-
+    lockStateMachine.send({ lockCmd_t::HOMEKIT, int16_t(lockTargetState->getNewVal()), uint32_t(esp_timer_get_time()) });
     return (true);
   }
+
+  void loop() {
+    lockStateMachine.syncHomeKit();
+  }
 };
 
 struct NFCAccess : Service::NFCAccess
@@ -425,12 +139,19 @@ struct NFCAccess : Service::NFCAccess
       return false;
     LOG(D, "Decoded data: %s", utils::bufToHexString(tlvData.data(), tlvData.size()).c_str());
     LOG(D, "Decoded data length: %d", tlvData.size());
-    HK_HomeKit hkCtx(readerData, savedData, "READERDATA", tlvData);
+    xSemaphoreTake(readerDataMutex, portMAX_DELAY);
+    HK_HomeKit hkCtx(readerData, readerDataSink, "READERDATA", tlvData);
     std::vector<uint8_t> result = hkCtx.processResult();
+    hkIndex.rebuild(readerData);
+    for (auto&& reader : nfcReaders) {
+      reader->authPool.flush();
+    }
     if (readerData.reader_gid.size() > 0) {
       memcpy(ecpData + 8, readerData.reader_gid.data(), readerData.reader_gid.size());
       with_crc16(ecpData, 16, ecpData + 16);
     }
+    xSemaphoreGive(readerDataMutex);
+    readerStore.save();
     TLV8 res(NULL, 0);
     res.unpack(result.data(), result.size());
     nfcControlPoint->setTLV(res, false);
@@ -439,19 +160,20 @@ struct NFCAccess : Service::NFCAccess
 
 };
 
-void deleteReaderData(const char* buf = "") {
-  esp_err_t erase_nvs = nvs_erase_key(savedData, "READERDATA");
-  esp_err_t commit_nvs = nvs_commit(savedData);
+void deleteReaderData(const char* buf) {
+  readerStore.clear();
+  xSemaphoreTake(readerDataMutex, portMAX_DELAY);
   readerData.issuers.clear();
   readerData.reader_gid.clear();
   readerData.reader_id.clear();
   readerData.reader_pk.clear();
   readerData.reader_pk_x.clear();
   readerData.reader_sk.clear();
-  LOG(D, "*** NVS W STATUS");
-  LOG(D, "ERASE: %s", esp_err_to_name(erase_nvs));
-  LOG(D, "COMMIT: %s", esp_err_to_name(commit_nvs));
-  LOG(D, "*** NVS W STATUS");
+  hkIndex.rebuild(readerData);
+  for (auto&& reader : nfcReaders) {
+    reader->authPool.flush();
+  }
+  xSemaphoreGive(readerDataMutex);
 }
 
 void pairCallback() {
@@ -459,26 +181,24 @@ void pairCallback() {
     deleteReaderData(NULL);
     return;
   }
+  xSemaphoreTake(readerDataMutex, portMAX_DELAY);
   for (auto it = homeSpan.controllerListBegin(); it != homeSpan.controllerListEnd(); ++it) {
     std::vector<uint8_t> id = utils::getHashIdentifier(it->getLTPK(), 32, true);
     LOG(D, "Found allocated controller - Hash: %s", utils::bufToHexString(id.data(), 8).c_str());
-    hkIssuer_t* foundIssuer = nullptr;
-    for (auto&& issuer : readerData.issuers) {
-      if (std::equal(issuer.issuer_id.begin(), issuer.issuer_id.end(), id.begin())) {
-        LOG(D, "Issuer %s already added, skipping", utils::bufToHexString(issuer.issuer_id.data(), issuer.issuer_id.size()).c_str());
-        foundIssuer = &issuer;
-        break;
-      }
-    }
-    if (foundIssuer == nullptr) {
+    hkIssuer_t* foundIssuer = hkIndex.findIssuer(readerData, id.data(), 8);
+    if (foundIssuer != nullptr) {
+      LOG(D, "Issuer %s already added, skipping", utils::bufToHexString(foundIssuer->issuer_id.data(), foundIssuer->issuer_id.size()).c_str());
+    } else {
       LOG(D, "Adding new issuer - ID: %s", utils::bufToHexString(id.data(), 8).c_str());
       hkIssuer_t newIssuer;
       newIssuer.issuer_id = std::vector<uint8_t>{ id.begin(), id.begin() + 8 };
       newIssuer.issuer_pk.insert(newIssuer.issuer_pk.begin(), it->getLTPK(), it->getLTPK() + 32);
       readerData.issuers.emplace_back(newIssuer);
+      hkIndex.rebuild(readerData);
     }
   }
-  save_to_nvs();
+  xSemaphoreGive(readerDataMutex);
+  readerStore.save();
 }
 
 void setFlow(const char* buf) {
@@ -539,6 +259,17 @@ void setLogLevel(const char* buf) {
   esp_log_level_set("actions-config", level);
   esp_log_level_set("misc-config", level);
   esp_log_level_set("mqttconfig", level);
+  esp_log_level_set("hkIndex", level);
+  esp_log_level_set("eventJournal", level);
+  esp_log_level_set("uidAllowlist", level);
+  esp_log_level_set("readerStore", level);
+  esp_log_level_set("mqttDispatch", level);
+  esp_log_level_set("hassDiscovery", level);
+  esp_log_level_set("actionsEngine", level);
+  esp_log_level_set("lockStateMachine", level);
+  esp_log_level_set("webEvents", level);
+  esp_log_level_set("webJobs", level);
+  esp_log_level_set("nfcReader", level);
 }
 
 void print_issuers(const char* buf) {
@@ -551,8 +282,8 @@ void print_issuers(const char* buf) {
 }
 
 /**
- * The function `set_custom_state_handler` translate the custom states to their HomeKit counterpart
- * updating the state of the lock and publishes the new state to the `MQTT_STATE_TOPIC` MQTT topic.
+ * The function `set_custom_state_handler` hands a received custom state to the lock state machine,
+ * which translates it to its HomeKit counterpart and publishes the new state to the `MQTT_STATE_TOPIC` MQTT topic.
  *
  * @param client The `client` parameter in the `set_custom_state_handler` function is of type
  * `esp_mqtt_client_handle_t`, which is a handle to the MQTT client object for this event. This
@@ -561,195 +292,108 @@ void print_issuers(const char* buf) {
  *  received custom state value
  */
 void set_custom_state_handler(esp_mqtt_client_handle_t client, int state) {
-  if (espConfig::mqttData.customLockStates["C_UNLOCKING"] == state) {
-    lockTargetState->setVal(lockStates::UNLOCKED);
-    esp_mqtt_client_publish(client, espConfig::mqttData.lockStateTopic.c_str(), std::to_string(lockStates::UNLOCKING).c_str(), 0, 1, true);
-    return;
-  } else if (espConfig::mqttData.customLockStates["C_LOCKING"] == state) {
-    lockTargetState->setVal(lockStates::LOCKED);
-    esp_mqtt_client_publish(client, espConfig::mqttData.lockStateTopic.c_str(), std::to_string(lockStates::LOCKING).c_str(), 0, 1, true);
-    return;
-  } else if (espConfig::mqttData.customLockStates["C_UNLOCKED"] == state) {
-    if (espConfig::miscConfig.gpioActionPin != 255) {
-      digitalWrite(espConfig::miscConfig.gpioActionPin, espConfig::miscConfig.gpioActionUnlockState);
-    }
-    lockCurrentState->setVal(lockStates::UNLOCKED);
-    esp_mqtt_client_publish(client, espConfig::mqttData.lockStateTopic.c_str(), std::to_string(lockStates::UNLOCKED).c_str(), 0, 1, true);
-    return;
-  } else if (espConfig::mqttData.customLockStates["C_LOCKED"] == state) {
-    if (espConfig::miscConfig.gpioActionPin != 255) {
-      digitalWrite(espConfig::miscConfig.gpioActionPin, espConfig::miscConfig.gpioActionLockState);
-    }
-    lockCurrentState->setVal(lockStates::LOCKED);
-    esp_mqtt_client_publish(client, espConfig::mqttData.lockStateTopic.c_str(), std::to_string(lockStates::LOCKED).c_str(), 0, 1, true);
-    return;
-  } else if (espConfig::mqttData.customLockStates["C_JAMMED"] == state) {
-    lockCurrentState->setVal(lockStates::JAMMED);
-    esp_mqtt_client_publish(client, espConfig::mqttData.lockStateTopic.c_str(), std::to_string(lockStates::JAMMED).c_str(), 0, 1, true);
-    return;
-  } else if (espConfig::mqttData.customLockStates["C_UNKNOWN"] == state) {
-    lockCurrentState->setVal(lockStates::UNKNOWN);
-    esp_mqtt_client_publish(client, espConfig::mqttData.lockStateTopic.c_str(), std::to_string(lockStates::UNKNOWN).c_str(), 0, 1, true);
-    return;
-  }
-  LOG(D, "Update state failed! Recv value not valid");
+  lockStateMachine.send({ lockCmd_t::CUSTOM, int16_t(state), uint32_t(esp_timer_get_time()) });
 }
 
 void set_state_handler(esp_mqtt_client_handle_t client, int state) {
-  switch (state) {
-  case lockStates::UNLOCKED:
-    if (espConfig::miscConfig.gpioActionPin != 255) {
-      digitalWrite(espConfig::miscConfig.gpioActionPin, espConfig::miscConfig.gpioActionUnlockState);
-    }
-    lockTargetState->setVal(state);
-    lockCurrentState->setVal(state);
-    esp_mqtt_client_publish(client, espConfig::mqttData.lockStateTopic.c_str(), std::to_string(lockStates::UNLOCKED).c_str(), 0, 1, true);
-    if (espConfig::mqttData.lockEnableCustomState) {
-      esp_mqtt_client_publish(client, espConfig::mqttData.lockCustomStateTopic.c_str(), std::to_string(espConfig::mqttData.customLockActions["UNLOCK"]).c_str(), 0, 0, false);
-    }
-    break;
-  case lockStates::LOCKED:
-    if (espConfig::miscConfig.gpioActionPin != 255) {
-      digitalWrite(espConfig::miscConfig.gpioActionPin, espConfig::miscConfig.gpioActionLockState);
-    }
-    lockTargetState->setVal(state);
-    lockCurrentState->setVal(state);
-    esp_mqtt_client_publish(client, espConfig::mqttData.lockStateTopic.c_str(), std::to_string(lockStates::LOCKED).c_str(), 0, 1, true);
-    if (espConfig::mqttData.lockEnableCustomState) {
-      esp_mqtt_client_publish(client, espConfig::mqttData.lockCustomStateTopic.c_str(), std::to_string(espConfig::mqttData.customLockActions["LOCK"]).c_str(), 0, 0, false);
-    }
-    break;
-  case lockStates::JAMMED:
-  case lockStates::UNKNOWN:
-    lockCurrentState->setVal(state);
-    esp_mqtt_client_publish(client, espConfig::mqttData.lockStateTopic.c_str(), std::to_string(state).c_str(), 0, 1, true);
-    break;
-  default:
-    LOG(D, "Update state failed! Recv value not valid");
-    break;
-  }
+  lockStateMachine.send({ lockCmd_t::SET, int16_t(state), uint32_t(esp_timer_get_time()) });
 }
 
 void mqtt_connected_event(void* event_handler_arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
   esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
   esp_mqtt_client_handle_t client = event->client;
-  const esp_app_desc_t* app_desc = esp_ota_get_app_description();
-  std::string app_version = app_desc->version;
-  uint8_t mac[6];
-  WiFi.macAddress(mac);
-  char macStr[18] = { 0 };
-  sprintf(macStr, "%02X%02X%02X%02X", mac[0], mac[1], mac[2], mac[3]);
-  std::string serialNumber = "HK-";
-  serialNumber.append(macStr);
   LOG(I, "MQTT connected");
-  if (espConfig::mqttData.hassMqttDiscoveryEnabled) {
-    json payload;
-    payload["topic"] = espConfig::mqttData.hkTopic.c_str();
-    payload["value_template"] = "{{ value_json.uid }}";
-    json device;
-    device["name"] = espConfig::miscConfig.deviceName.c_str();
-    char identifier[18];
-    sprintf(identifier, "%.2s%.2s%.2s%.2s%.2s%.2s", HAPClient::accessory.ID, HAPClient::accessory.ID + 3, HAPClient::accessory.ID + 6, HAPClient::accessory.ID + 9, HAPClient::accessory.ID + 12, HAPClient::accessory.ID + 15);
-    std::string id = identifier;
-    device["identifiers"].push_back(id);
-    device["identifiers"].push_back(serialNumber);
-    device["manufacturer"] = "rednblkx";
-    device["model"] = "HomeKey-ESP32";
-    device["sw_version"] = app_version.c_str();
-    device["serial_number"] = serialNumber;
-    payload["device"] = device;
-    std::string bufferpub = payload.dump();
-    std::string rfidTopic;
-    rfidTopic.append("homeassistant/tag/").append(espConfig::mqttData.mqttClientId).append("/rfid/config");
-    if (!espConfig::mqttData.nfcTagNoPublish) {
-      esp_mqtt_client_publish(client, rfidTopic.c_str(), bufferpub.c_str(), bufferpub.length(), 1, true);
-    }
-    payload = json();
-    payload["topic"] = espConfig::mqttData.hkTopic;
-    payload["value_template"] = "{{ value_json.issuerId }}";
-    payload["device"] = device;
-    bufferpub = payload.dump();
-    std::string issuerTopic;
-    issuerTopic.append("homeassistant/tag/").append(espConfig::mqttData.mqttClientId).append("/hkIssuer/config");
-    esp_mqtt_client_publish(client, issuerTopic.c_str(), bufferpub.c_str(), bufferpub.length(), 1, true);
-    payload = json();
-    payload["topic"] = espConfig::mqttData.hkTopic;
-    payload["value_template"] = "{{ value_json.endpointId }}";
-    payload["device"] = device;
-    bufferpub = payload.dump();
-    std::string endpointTopic;
-    endpointTopic.append("homeassistant/tag/").append(espConfig::mqttData.mqttClientId).append("/hkEndpoint/config");
-    esp_mqtt_client_publish(client, endpointTopic.c_str(), bufferpub.c_str(), bufferpub.length(), 1, true);
-    payload = json();
-    payload["name"] = "Lock";
-    payload["state_topic"] = espConfig::mqttData.lockStateTopic.c_str();
-    payload["command_topic"] = espConfig::mqttData.lockStateCmd.c_str();
-    payload["payload_lock"] = "1";
-    payload["payload_unlock"] = "0";
-    payload["state_locked"] = "1";
-    payload["state_unlocked"] = "0";
-    payload["state_unlocking"] = "4";
-    payload["state_locking"] = "5";
-    payload["state_jammed"] = "2";
-    payload["availability_topic"] = espConfig::mqttData.lwtTopic.c_str();
-    payload["unique_id"] = id;
-    payload["device"] = device;
-    payload["retain"] = "false";
-    bufferpub = payload.dump();
-    std::string lockConfigTopic;
-    lockConfigTopic.append("homeassistant/lock/").append(espConfig::mqttData.mqttClientId.c_str()).append("/lock/config");
-    esp_mqtt_client_publish(client, lockConfigTopic.c_str(), bufferpub.c_str(), bufferpub.length(), 1, true);
-    LOG(D, "MQTT PUBLISHED DISCOVERY");
+  espConfig::lock_t lock;
+  mqttConnected = true;
+  pixelAnimator.offline = false;
+  if (bus_mqtt_task_handle != nullptr) {
+    xTaskNotifyGive(bus_mqtt_task_handle);
   }
   esp_mqtt_client_publish(client, espConfig::mqttData.lwtTopic.c_str(), "online", 6, 1, true);
-  if (espConfig::mqttData.lockEnableCustomState) {
-    esp_mqtt_client_subscribe(client, espConfig::mqttData.lockCustomStateCmd.c_str(), 0);
-  }
-  if (espConfig::miscConfig.proxBatEnabled) {
-    esp_mqtt_client_subscribe(client, espConfig::mqttData.btrLvlCmdTopic.c_str(), 0);
-  }
-  esp_mqtt_client_subscribe(client, espConfig::mqttData.lockStateCmd.c_str(), 0);
-  esp_mqtt_client_subscribe(client, espConfig::mqttData.lockCStateCmd.c_str(), 0);
-  esp_mqtt_client_subscribe(client, espConfig::mqttData.lockTStateCmd.c_str(), 0);
+  mqttDispatch.subscribe(client);
+  hassDiscovery.publish(client, false);
 }
 
 void mqtt_data_handler(void* event_handler_arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
-  ESP_LOGD(TAG, "Event dispatched from callback type=%d", event_id);
   esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
-  esp_mqtt_client_handle_t client = event->client;
-  std::string topic(event->topic, event->topic + event->topic_len);
-  std::string data(event->data, event->data + event->data_len);
-  LOG(D, "Received message in topic \"%s\": %s", topic.c_str(), data.c_str());
-  int state = atoi(data.c_str());
-  if (!strcmp(espConfig::mqttData.lockCustomStateCmd.c_str(), topic.c_str())) {
-    set_custom_state_handler(client, state);
-  } else if (!strcmp(espConfig::mqttData.lockStateCmd.c_str(), topic.c_str())) {
-    set_state_handler(client, state);
-  } else if (!strcmp(espConfig::mqttData.lockTStateCmd.c_str(), topic.c_str())) {
-    if (state == lockStates::UNLOCKED || state == lockStates::LOCKED) {
-      lockTargetState->setVal(state);
-      esp_mqtt_client_publish(client, espConfig::mqttData.lockStateTopic.c_str(), state == lockStates::UNLOCKED ? std::to_string(lockStates::UNLOCKING).c_str() : std::to_string(lockStates::LOCKING).c_str(), 0, 1, true);
-    }
-  } else if (!strcmp(espConfig::mqttData.lockCStateCmd.c_str(), topic.c_str())) {
-    if (state == lockStates::UNLOCKED || state == lockStates::LOCKED || state == lockStates::JAMMED || state == lockStates::UNKNOWN) {
-      lockCurrentState->setVal(state);
-      esp_mqtt_client_publish(client, espConfig::mqttData.lockStateTopic.c_str(), std::to_string(lockCurrentState->getVal()).c_str(), 0, 1, true);
-    }
-  } else if (!strcmp(espConfig::mqttData.btrLvlCmdTopic.c_str(), topic.c_str())) {
-    btrLevel->setVal(state);
-    if (state <= espConfig::miscConfig.btrLowStatusThreshold) {
-      statusLowBtr->setVal(1);
+  std::string_view topic(event->topic, event->topic_len);
+  std::string_view data(event->data, event->data_len);
+  LOG(D, "Received message in topic \"%.*s\": %.*s", int(topic.size()), topic.data(), int(data.size()), data.data());
+  espConfig::lock_t lock;
+  mqttDispatch.dispatch(event->client, topic, data, event->current_data_offset, event->total_data_len);
+}
+
+/**
+ * The function `mqtt_routes_build` fills the MQTT dispatch table from the configured command topics.
+ */
+void mqtt_routes_build() {
+  mqttDispatch.clear();
+  if (espConfig::mqttData.hassMqttDiscoveryEnabled) {
+    mqttDispatch.add(MQTT_HASS_STATUS_TOPIC, 0, [](esp_mqtt_client_handle_t client, std::string_view topic, std::string_view data) {
+      if (data == "online") hassDiscovery.publish(client, true);
+    });
+  }
+  if (espConfig::mqttData.lockEnableCustomState) {
+    mqttDispatch.add(espConfig::mqttData.lockCustomStateCmd, 0, [](esp_mqtt_client_handle_t client, std::string_view topic, std::string_view data) {
+      set_custom_state_handler(client, mqtt_parse_int(data));
+    });
+  }
+  if (espConfig::miscConfig.proxBatEnabled) {
+    mqttDispatch.add(espConfig::mqttData.btrLvlCmdTopic, 0, [](esp_mqtt_client_handle_t client, std::string_view topic, std::string_view data) {
+      int state = mqtt_parse_int(data);
+      btrLevel->setVal(state);
+      if (state <= espConfig::miscConfig.btrLowStatusThreshold) {
+        statusLowBtr->setVal(1);
+      } else {
+        statusLowBtr->setVal(0);
+      }
+    });
+  }
+  mqttDispatch.add(espConfig::mqttData.lockStateCmd, 0, [](esp_mqtt_client_handle_t client, std::string_view topic, std::string_view data) {
+    set_state_handler(client, mqtt_parse_int(data));
+  });
+  mqttDispatch.add(espConfig::mqttData.lockCStateCmd, 0, [](esp_mqtt_client_handle_t client, std::string_view topic, std::string_view data) {
+    lockStateMachine.send({ lockCmd_t::CURRENT, int16_t(mqtt_parse_int(data)), uint32_t(esp_timer_get_time()) });
+  });
+  mqttDispatch.add(espConfig::mqttData.lockTStateCmd, 0, [](esp_mqtt_client_handle_t client, std::string_view topic, std::string_view data) {
+    lockStateMachine.send({ lockCmd_t::TARGET, int16_t(mqtt_parse_int(data)), uint32_t(esp_timer_get_time()) });
+  });
+  mqttDispatch.addStream(espConfig::mqttData.allowlistCmdTopic, 1, [](esp_mqtt_client_handle_t client, std::string_view data, size_t offset, size_t total) {
+    // "begin", any number of messages with one UID per line, then "commit"; a message may arrive in chunks
+    static uint32_t load = 0;
+    bool whole = offset == 0 && data.size() == total;
+    if (whole && data == "begin") {
+      uidAllowlist.stageAbort(load);
+      load = uidAllowlist.stageBegin();
+      if (!load) LOG(W, "Another allowlist load is in progress, ignoring this one");
+    } else if (whole && data == "commit") {
+      uidAllowlist.stageCommit(load);
+      load = 0;
     } else {
-      statusLowBtr->setVal(0);
+      uidAllowlist.stageText(load, data.data(), data.size());
+      // the last line of a message ends with the message, not with the chunk
+      if (offset + data.size() == total) uidAllowlist.stageText(load, "\n", 1);
     }
-  }
+  });
+}
+
+void mqtt_disconnected_event(void* event_handler_arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
+  LOG(W, "MQTT disconnected, journaling events until reconnected");
+  mqttConnected = false;
+  pixelAnimator.offline = true;
 }
 
 /**
- * The function `mqtt_app_start` initializes and starts an MQTT client with specified configuration
- * parameters.
+ * The function `mqtt_broker_valid` checks the configured broker looks like an IPv4 address or host that can be connected to.
  */
-static void mqtt_app_start(void) {
+bool mqtt_broker_valid() {
+  return espConfig::mqttData.mqttBroker.size() >= 7 && espConfig::mqttData.mqttBroker.size() <= 16 && !std::equal(espConfig::mqttData.mqttBroker.begin(), espConfig::mqttData.mqttBroker.end(), "0.0.0.0");
+}
+
+/**
+ * The function `mqtt_app_config` fills the MQTT client configuration from `espConfig::mqttData`.
+ */
+static esp_mqtt_client_config_t mqtt_app_config() {
   esp_mqtt_client_config_t mqtt_cfg = { };
   mqtt_cfg.host = espConfig::mqttData.mqttBroker.c_str();
   mqtt_cfg.port = espConfig::mqttData.mqttPort;
@@ -761,12 +405,87 @@ static void mqtt_app_start(void) {
   mqtt_cfg.lwt_qos = 1;
   mqtt_cfg.lwt_retain = 1;
   mqtt_cfg.lwt_msg_len = 7;
+  return mqtt_cfg;
+}
+
+/**
+ * The function `mqtt_app_start` initializes and starts an MQTT client with specified configuration
+ * parameters.
+ */
+static void mqtt_app_start(void) {
+  esp_mqtt_client_config_t mqtt_cfg = mqtt_app_config();
   client = esp_mqtt_client_init(&mqtt_cfg);
+  pixelAnimator.offline = true;
+  hassDiscovery.render();
+  mqtt_routes_build();
   esp_mqtt_client_register_event(client, MQTT_EVENT_CONNECTED, mqtt_connected_event, client);
+  esp_mqtt_client_register_event(client, MQTT_EVENT_DISCONNECTED, mqtt_disconnected_event, client);
   esp_mqtt_client_register_event(client, MQTT_EVENT_DATA, mqtt_data_handler, client);
   esp_mqtt_client_start(client);
 }
 
+/**
+ * The function `mqtt_app_reload` applies a changed MQTT configuration without restarting the device.
+ * The client is stopped, reconfigured and started again, the dispatch table and discovery configs are
+ * rebuilt and the connected event subscribes to the new topics. Events keep going to the journal
+ * while the client is down.
+ *
+ * @param previous The configuration the client is currently running with
+ */
+static void mqtt_app_reload(const espConfig::mqttConfig_t& previous) {
+  const char* TAG = "mqtt_app_reload";
+  lockStateMachine.send({ lockCmd_t::RELOAD, 0, uint32_t(esp_timer_get_time()) });
+  if (client == nullptr) {
+    if (mqtt_broker_valid() && WiFi.isConnected()) {
+      mqtt_app_start();
+    }
+    return;
+  }
+  if (mqttConnected && previous.lwtTopic != espConfig::mqttData.lwtTopic) {
+    // the broker only sends the will on the topic it was registered with
+    esp_mqtt_client_publish(client, previous.lwtTopic.c_str(), "offline", 7, 0, true);
+  }
+  esp_mqtt_client_stop(client);
+  mqttConnected = false;
+  pixelAnimator.offline = true;
+  if (!mqtt_broker_valid()) {
+    LOG(W, "MQTT broker not valid, client stays stopped");
+    return;
+  }
+  esp_mqtt_client_config_t mqtt_cfg = mqtt_app_config();
+  esp_mqtt_set_config(client, &mqtt_cfg);
+  hassDiscovery.render();
+  mqtt_routes_build();
+  esp_mqtt_client_start(client);
+  LOG(I, "MQTT client restarted with the new configuration");
+}
+
+/**
+ * The function `config_form_apply` stores the fields of `section` posted with `request` into
+ * `config`. Every field is parsed and validated first, on failure `error` describes the rejected
+ * value and `config` is left as it was. Unknown form fields are ignored.
+ */
+template <class T, size_t N>
+bool config_form_apply(AsyncWebServerRequest* request, const configRegistry_t<T, N>& registry, const char* section, T& config, std::string& error) {
+  const char* TAG = "config_form_apply";
+  T next = config;
+  int params = request->params();
+  for (int i = 0; i < params; i++) {
+    AsyncWebParameter* p = request->getParam(i);
+    LOG(V, "POST[%s]: %s\n", p->name().c_str(), p->value().c_str());
+    const configField_t<T>* field = registry.find(p->name().c_str());
+    if (!field || strcmp(field->section, section)) continue;
+    if (!config_field_set(*field, next, std::string_view(p->value().c_str(), p->value().length()), error)) {
+      return false;
+    }
+  }
+  if (!config_check_changes(registry, next, config, error)) {
+    return false;
+  }
+  config = next;
+  return true;
+}
+
 void notFound(AsyncWebServerRequest* request) {
   request->send(404, "text/plain", "Not found");
 }
@@ -802,561 +521,489 @@ void listDir(fs::FS& fs, const char* dirname, uint8_t levels) {
   }
 }
 
-String miscHtmlProcess(const String& var) {
-  if (var == "DEVICENAME") {
-    return String(espConfig::miscConfig.deviceName.c_str());
-  } else if (var == "OTAPASSWD") {
-    return String(espConfig::miscConfig.otaPasswd.c_str());
-  } else if (var == "HKSETUPCODE") {
-    return String(espConfig::miscConfig.setupCode.c_str());
-  } else if (var == "CONTROLPIN") {
-    return String(espConfig::miscConfig.controlPin);
-  } else if (var == "LEDPIN") {
-    return String(espConfig::miscConfig.hsStatusPin);
-  } else if (var == "ALWAYSUNLOCK") {
-    return String(espConfig::miscConfig.lockAlwaysUnlock);
-  } else if (var == "ALWAYSLOCK") {
-    return String(espConfig::miscConfig.lockAlwaysLock);
-  } else if (var == "HWFINISH") {
-    return String(espConfig::miscConfig.hk_key_color);
-  } else if (var == "WEBENABLE") {
-    return String(espConfig::miscConfig.webAuthEnabled);
-  } else if (var == "WEBUSERNAME") {
-    return String(espConfig::miscConfig.webUsername.c_str());
-  } else if (var == "WEBPASSWORD") {
-    return String(espConfig::miscConfig.webPassword.c_str());
-  } else if (var == "NFCSSGPIOPIN") {
-    return String(espConfig::miscConfig.nfcGpioPins[0]);
-  } else if (var == "NFCSCKGPIOPIN") {
-    return String(espConfig::miscConfig.nfcGpioPins[1]);
-  } else if (var == "NFCMISOGPIOPIN") {
-    return String(espConfig::miscConfig.nfcGpioPins[2]);
-  } else if (var == "NFCMOSIGPIOPIN") {
-    return String(espConfig::miscConfig.nfcGpioPins[3]);
-  } else if (var == "BTRLOWTHRESHOLD") {
-    return String(espConfig::miscConfig.btrLowStatusThreshold);
-  } else if (var == "PROXBATENABLE") {
-    return String(espConfig::miscConfig.proxBatEnabled);
-  } else if (var == "DUMBSWITCHMODE") {
-    return String(espConfig::miscConfig.hkDumbSwitchMode);
+bool headersFix(AsyncWebServerRequest* request) { request->addInterestingHeader("ANY"); return true; };
+/**
+ * Content hashes of the web files, loaded from `/manifest.txt` written by fs.py. Text files are
+ * stored gzip compressed as `<path>.gz` and served as is with `Content-Encoding: gzip`.
+ */
+std::map<std::string, std::string> webAssetHashes;
+
+/**
+ * The function `web_send_asset` serves a file from LittleFS with its content hash as ETag, answering
+ * a matching `If-None-Match` with 304. Requests for the hashed URL, carrying the hash as `v`
+ * parameter, may be cached for a year; anything else is revalidated on every use.
+ */
+void web_send_asset(AsyncWebServerRequest* request, const std::string& path) {
+  String contentType;
+  if (path.size() > 5 && path.compare(path.size() - 5, 5, ".webp") == 0) {
+    contentType = "image/webp";
   }
-  return String();
+  auto asset = webAssetHashes.find(path);
+  if (asset == webAssetHashes.end()) {
+    // file system image built without fs.py
+    request->send(LittleFS, path.c_str(), contentType);
+    return;
+  }
+  String etag = String("\"") + asset->second.c_str() + "\"";
+  bool versioned = request->hasParam("v") && request->getParam("v")->value() == asset->second.c_str();
+  const char* cacheControl = versioned ? "public, max-age=31536000, immutable" : "no-cache";
+  AsyncWebServerResponse* response;
+  if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+    response = request->beginResponse(304);
+  } else {
+    response = request->beginResponse(LittleFS, path.c_str(), contentType);
+  }
+  response->addHeader("ETag", etag);
+  response->addHeader("Cache-Control", cacheControl);
+  request->send(response);
 }
 
-String hkInfoHtmlProcess(const String& var) {
-  if (var == "READERGID") {
-    return String(utils::bufToHexString(readerData.reader_gid.data(), readerData.reader_gid.size(), true).c_str());
-  } else if (var == "READERID") {
-    return String(utils::bufToHexString(readerData.reader_id.data(), readerData.reader_id.size(), true).c_str());
-  } else if (var == "ISSUERSNO") {
-    return String(readerData.issuers.size());
-  } else if (var == "ISSUERSLIST") {
-    String result = "";
-    for (auto&& issuer : readerData.issuers) {
-      char issuerBuff[21 + 8];
-      result += "<li>";
-      snprintf(issuerBuff, sizeof(issuerBuff), "Issuer ID: %s", utils::bufToHexString(issuer.issuer_id.data(), issuer.issuer_id.size(), true).c_str());
-      result += issuerBuff;
-      result += "</li>\n";
-      result += "\t\t<ul>";
-      for (auto&& endpoint : issuer.endpoints) {
-        char endBuff[23 + 6];
-        result += "\n\t\t\t<li>";
-        snprintf(endBuff, sizeof(endBuff), "Endpoint ID: %s", utils::bufToHexString(endpoint.endpoint_id.data(), endpoint.endpoint_id.size(), true).c_str());
-        result += endBuff;
-        result += "</li>\n";
-      }
-      result += "\t\t</ul>";
+/**
+ * The function `web_asset_handler` creates a GET handler serving `path` for `uri`, a `uri` ending
+ * in `*` serves the file with the same path as the request instead.
+ */
+AsyncCallbackWebHandler* web_asset_handler(const char* uri, const char* path) {
+  auto handler = new AsyncCallbackWebHandler();
+  handler->setUri(uri);
+  handler->setMethod(HTTP_GET);
+  handler->setFilter(headersFix);
+  std::string file = path;
+  handler->onRequest([file](AsyncWebServerRequest* request) {
+    web_send_asset(request, file.empty() ? request->url().c_str() : file);
+  });
+  webServer.addHandler(handler);
+  return handler;
+}
+
+/**
+ * The function `mqtt_config_save` writes `espConfig::mqttData` to NVS.
+ */
+void mqtt_config_save() {
+  const char* TAG = "mqtt_config_save";
+  json json_mqtt_config = espConfig::mqttData;
+  std::vector<uint8_t> string_mqtt = json::to_msgpack(json_mqtt_config);
+  esp_err_t set_nvs = nvs_set_blob(savedData, "MQTTDATA", string_mqtt.data(), string_mqtt.size());
+  esp_err_t commit_nvs = nvs_commit(savedData);
+  LOG(V, "SET_STATUS: %s", esp_err_to_name(set_nvs));
+  LOG(V, "COMMIT_STATUS: %s", esp_err_to_name(commit_nvs));
+}
+
+/**
+ * The function `mqtt_config_apply` reconnects the MQTT client when `espConfig::mqttData` differs
+ * from `previous`, returning whether anything changed.
+ */
+bool mqtt_config_apply(const espConfig::mqttConfig_t& previous) {
+  if (json(previous) == json(espConfig::mqttData)) {
+    return false;
+  }
+  if (espConfig::mqttData.nfcTagNoPublish && !previous.nfcTagNoPublish) {
+    std::string rfidTopic;
+    rfidTopic.append("homeassistant/tag/").append(previous.mqttClientId).append("/rfid/config");
+    esp_mqtt_client_publish(client, rfidTopic.c_str(), "", 0, 0, false);
+  }
+  mqtt_app_reload(previous);
+  return true;
+}
+
+/**
+ * The function `misc_config_save` writes `espConfig::miscConfig` to NVS.
+ */
+void misc_config_save() {
+  const char* TAG = "misc_config_save";
+  json json_misc_config = espConfig::miscConfig;
+  std::vector<uint8_t> misc_buf = nlohmann::json::to_msgpack(json_misc_config);
+  esp_err_t set_nvs = nvs_set_blob(savedData, "MISCDATA", misc_buf.data(), misc_buf.size());
+  esp_err_t commit_nvs = nvs_commit(savedData);
+  LOG(V, "SET_STATUS: %s", esp_err_to_name(set_nvs));
+  LOG(V, "COMMIT_STATUS: %s", esp_err_to_name(commit_nvs));
+}
+
+/**
+ * The function `misc_config_apply` applies the settings of the misc page that take effect without
+ * a restart, `previous` being the config before the change.
+ */
+void misc_config_apply(const espConfig::misc_config_t& previous) {
+  if (previous.setupCode != espConfig::miscConfig.setupCode) {
+    homeSpan.setPairingCode(espConfig::miscConfig.setupCode.c_str());
+  }
+  if (statusLowBtr && btrLevel) {
+    statusLowBtr->setVal(btrLevel->getVal() <= espConfig::miscConfig.btrLowStatusThreshold ? 1 : 0);
+  }
+}
+
+/**
+ * The function `actions_config_apply` configures the GPIO and NeoPixel outputs of the actions page
+ * for the current config, the pixel animator picks up the rest on its next frame.
+ */
+void actions_config_apply() {
+  for (uint8_t pin : { espConfig::miscConfig.nfcSuccessPin, espConfig::miscConfig.nfcFailPin, espConfig::miscConfig.gpioActionPin }) {
+    if (pin != 255) {
+      pinMode(pin, OUTPUT);
     }
-    return result;
   }
-  return "";
+  if (espConfig::miscConfig.nfcNeopixelPin != 255 && !pixel) {
+    pixel = std::make_unique<Pixel>(espConfig::miscConfig.nfcNeopixelPin, pixelTypeMap[espConfig::miscConfig.neoPixelType]);
+    pixelAnimator.begin();
+  }
+  if (pixel) {
+    pixel->setPixelType(pixelTypeMap[espConfig::miscConfig.neoPixelType]);
+  }
+  pixelAnimator.rebuildPending = true;
+}
+
+/**
+ * The function `api_config_fields` returns the fields of `config` that belong to the REST config
+ * section `section` as JSON object.
+ */
+json api_config_fields(const std::string& section, const espConfig::mqttConfig_t& config) {
+  return config;
 }
 
-String mqttHtmlProcess(const String& var) {
-  if (var == "MQTTBROKER") {
-    return String(espConfig::mqttData.mqttBroker.c_str());
-  } else if (var == "MQTTPORT") {
-    return String(espConfig::mqttData.mqttPort);
-  } else if (var == "MQTTCLIENTID") {
-    return String(espConfig::mqttData.mqttClientId.c_str());
-  } else if (var == "MQTTUSERNAME") {
-    return String(espConfig::mqttData.mqttUsername.c_str());
-  } else if (var == "MQTTPASSWORD") {
-    return String(espConfig::mqttData.mqttPassword.c_str());
-  } else if (var == "MQTTLWTTOPIC") {
-    return String(espConfig::mqttData.lwtTopic.c_str());
-  } else if (var == "HKTOPIC") {
-    return String(espConfig::mqttData.hkTopic.c_str());
-  } else if (var == "STATETOPIC") {
-    return String(espConfig::mqttData.lockStateTopic.c_str());
-  } else if (var == "STATECMD") {
-    return String(espConfig::mqttData.lockStateCmd.c_str());
-  } else if (var == "CSTATECMD") {
-    return String(espConfig::mqttData.lockCStateCmd.c_str());
-  } else if (var == "TSTATECMD") {
-    return String(espConfig::mqttData.lockTStateCmd.c_str());
-  } else if (var == "CUSTOMSTATE_ENABLED") {
-    return String(espConfig::mqttData.lockEnableCustomState);
-  } else if (var == "CUSTOMSTATETOPIC") {
-    return String(espConfig::mqttData.lockCustomStateTopic.c_str());
-  } else if (var == "CUSTOMSTATECMD") {
-    return String(espConfig::mqttData.lockCustomStateCmd.c_str());
-  } else if (var == "DISCOVERY_ENABLED") {
-    return String(espConfig::mqttData.hassMqttDiscoveryEnabled);
-  } else if (var == "CACTIONUNLOCK") {
-    return String(espConfig::mqttData.customLockActions["UNLOCK"]);
-  } else if (var == "CACTIONLOCK") {
-    return String(espConfig::mqttData.customLockActions["LOCK"]);
-  } else if (var == "CSTATEUNLOCKING") {
-    return String(espConfig::mqttData.customLockStates["C_UNLOCKING"]);
-  } else if (var == "CSTATELOCKING") {
-    return String(espConfig::mqttData.customLockStates["C_LOCKING"]);
-  } else if (var == "CSTATEUNLOCKED") {
-    return String(espConfig::mqttData.customLockStates["C_UNLOCKED"]);
-  } else if (var == "CSTATELOCKED") {
-    return String(espConfig::mqttData.customLockStates["C_LOCKED"]);
-  } else if (var == "CSTATEJAMMED") {
-    return String(espConfig::mqttData.customLockStates["C_JAMMED"]);
-  } else if (var == "CSTATEUNKNOWN") {
-    return String(espConfig::mqttData.customLockStates["C_UNKNOWN"]);
-  } else if (var == "NFCTAGSNOPUBLISH") {
-    return String(espConfig::mqttData.nfcTagNoPublish);
-  } else if (var == "BTRLEVELCMD") {
-    return String(espConfig::mqttData.btrLvlCmdTopic.c_str());
+json api_config_fields(const std::string& section, const espConfig::misc_config_t& config) {
+  json misc = config;
+  json result = json::object();
+  for (auto it = misc.begin(); it != misc.end(); ++it) {
+    auto field = std::find_if(miscConfigFields.fields.begin(), miscConfigFields.fields.end(), [&](auto&& field) { return it.key() == field.key; });
+    if (field != miscConfigFields.fields.end() && field->section == section) {
+      result[it.key()] = it.value();
+    }
   }
-  return "";
+  return result;
 }
 
-String indexProcess(const String& var) {
-  if (var == "VERSION") {
-    const esp_app_desc_t* app_desc = esp_ota_get_app_description();
-    std::string app_version = app_desc->version;
-    return String(app_version.c_str());
+/**
+ * The function `api_config_section` returns the fields of the REST config section `section`
+ * ("mqtt", "misc" or "actions") as currently applied, or null for an unknown section.
+ */
+json api_config_section(const std::string& section) {
+  espConfig::lock_t lock;
+  if (section == "mqtt") {
+    return api_config_fields(section, espConfig::mqttData);
+  }
+  if (section != "misc" && section != "actions") {
+    return nullptr;
   }
-  return "";
+  return api_config_fields(section, espConfig::miscConfig);
 }
 
-String actionsProcess(const String& var) {
-  if (var == "NFCNEOPIXELPIN") {
-    return String(espConfig::miscConfig.nfcNeopixelPin);
-  } else if (var == "NFC1PIN") {
-    return String(espConfig::miscConfig.nfcSuccessPin);
-  } else if (var == "NFC2PIN") {
-    return String(espConfig::miscConfig.nfcFailPin);
-  } else if (var == "NFC1HL") {
-    return String(espConfig::miscConfig.nfcSuccessHL);
-  } else if (var == "NFC2HL") {
-    return String(espConfig::miscConfig.nfcFailHL);
-  } else if (var == "NFC1TIME") {
-    return String(espConfig::miscConfig.nfcSuccessTime);
-  } else if (var == "NFC2TIME") {
-    return String(espConfig::miscConfig.nfcFailTime);
-  } else if (var == "GPIOAPIN") {
-    return String(espConfig::miscConfig.gpioActionPin);
-  } else if (var == "GPIOALOCK") {
-    return String(espConfig::miscConfig.gpioActionLockState);
-  } else if (var == "GPIOAUNLOCK") {
-    return String(espConfig::miscConfig.gpioActionUnlockState);
-  } else if (var == "GPIOAMOEN") {
-    return String(espConfig::miscConfig.gpioActionMomentaryEnabled);
-  } else if (var == "GPIOAMOTIME") {
-    return String(espConfig::miscConfig.gpioActionMomentaryTimeout);
-  } else if (var == "NEOSTIME") {
-    return String(espConfig::miscConfig.neopixelSuccessTime);
-  } else if (var == "NEOFTIME") {
-    return String(espConfig::miscConfig.neopixelFailTime);
-  } else if (var == "NEOPIXELTYPE") {
-    return String(espConfig::miscConfig.neoPixelType);
-  } else if (var == "SREDPIXELVAL") {
-    return String(espConfig::miscConfig.neopixelSuccessColor[espConfig::misc_config_t::colorMap::R]);
-  } else if (var == "SGREENPIXELVAL") {
-    return String(espConfig::miscConfig.neopixelSuccessColor[espConfig::misc_config_t::colorMap::G]);
-  } else if (var == "SBLUEPIXELVAL") {
-    return String(espConfig::miscConfig.neopixelSuccessColor[espConfig::misc_config_t::colorMap::B]);
-  } else if (var == "FREDPIXELVAL") {
-    return String(espConfig::miscConfig.neopixelFailureColor[espConfig::misc_config_t::colorMap::R]);
-  } else if (var == "FGREENPIXELVAL") {
-    return String(espConfig::miscConfig.neopixelFailureColor[espConfig::misc_config_t::colorMap::G]);
-  } else if (var == "FBLUEPIXELVAL") {
-    return String(espConfig::miscConfig.neopixelFailureColor[espConfig::misc_config_t::colorMap::B]);
-  } else if (var == "HKGPIOCONTROLSTATE") {
-    return String(espConfig::miscConfig.hkGpioControlledState);
+/**
+ * The function `api_json_compatible` checks that `value` has the shape of the current config value
+ * `field`, so converting the patched JSON back into the config structs can not fail. Numbers have
+ * to be integers that fit the 16 bit fields, arrays keep their length and objects their keys.
+ */
+bool api_json_compatible(const json& field, const json& value) {
+  if (field.is_number()) {
+    return value.is_number_integer() && value.get<int64_t>() >= 0 && value.get<int64_t>() <= UINT16_MAX;
   }
-  return "";
+  if (field.type() != value.type()) {
+    return false;
+  }
+  if (field.is_array()) {
+    if (field.size() != value.size()) return false;
+    for (size_t i = 0; i < field.size(); i++) {
+      if (!api_json_compatible(field[i], value[i])) return false;
+    }
+  } else if (field.is_object()) {
+    for (auto it = value.begin(); it != value.end(); ++it) {
+      if (!field.contains(it.key()) || !api_json_compatible(field[it.key()], it.value())) return false;
+    }
+  }
+  return true;
 }
-bool headersFix(AsyncWebServerRequest* request) { request->addInterestingHeader("ANY"); return true; };
+
+/**
+ * The function `api_config_patch` merges the JSON object `patch` into the config section `section`
+ * of `current`. All fields are validated before anything is changed, on failure `error` names the
+ * rejected field and `current` is left as it was. Nested objects are merged, everything else replaced.
+ */
+template <class T, size_t N>
+bool api_config_patch(const configRegistry_t<T, N>& registry, const std::string& section, T& current, const json& patch, std::string& error) {
+  json fields = api_config_fields(section, current);
+  json config = current;
+  for (auto it = patch.begin(); it != patch.end(); ++it) {
+    const std::string& key = it.key();
+    const json& value = it.value();
+    if (!fields.contains(key)) {
+      error = "unknown field " + key;
+      return false;
+    }
+    // the extra readers start out empty, their shape is checked here and the pins by the registry
+    bool readers = key == "nfcExtraReaders" && value.is_array() && std::all_of(value.begin(), value.end(), [](const json& reader) {
+      return reader.is_array() && reader.size() == 2 && api_json_compatible(json(0), reader[0]) && api_json_compatible(json(0), reader[1]);
+    });
+    if (!readers && !api_json_compatible(fields[key], value)) {
+      error = "invalid value for " + key;
+      return false;
+    }
+    if (value.is_object()) {
+      config[key].merge_patch(value);
+    } else {
+      config[key] = value;
+    }
+  }
+  // a field narrower than 16 bit wraps on conversion, that shows when serializing it again
+  auto fits = [&](const json& stored) {
+    for (auto it = patch.begin(); it != patch.end(); ++it) {
+      if (stored[it.key()] != config[it.key()]) {
+        error = "value out of range for " + it.key();
+        return false;
+      }
+    }
+    return true;
+  };
+  auto next = config.get<T>();
+  if (!fits(json(next)) || !config_check_changes(registry, next, current, error)) return false;
+  current = next;
+  return true;
+}
+
+/**
+ * The function `api_send_json` replies with `payload` as uncached JSON.
+ */
+void api_send_json(AsyncWebServerRequest* request, int code, const json& payload) {
+  std::string body = payload.dump();
+  AsyncWebServerResponse* response = request->beginResponse(code, "application/json", body.c_str());
+  response->addHeader("Cache-Control", "no-store");
+  request->send(response);
+}
+
+/**
+ * The function `web_job_reply` queues a job of `kind` and answers 202 with its ID, or 503 when
+ * the queue is full. `result` is sent along with the job ID, which is returned, 0 if none was queued.
+ */
+uint16_t web_job_reply(AsyncWebServerRequest* request, webJobs_t::job_t::kind_t kind, json result = json::object()) {
+  uint16_t id = webJobs.post(kind);
+  if (!id) {
+    api_send_json(request, 503, { {"error", "Busy, try again"} });
+    return 0;
+  }
+  result["job"] = id;
+  result["state"] = webJobs_t::stateNames[webJobs_t::status_t::QUEUED];
+  api_send_json(request, 202, result);
+  return id;
+}
+
 void setupWeb() {
-  auto infoHandle = new AsyncStaticWebHandler("/info", LittleFS, "/routes/info.html", NULL);
-  webServer.addHandler(infoHandle);
-  infoHandle->setTemplateProcessor(hkInfoHtmlProcess).setFilter(headersFix);
-  auto mqttHandle = new AsyncStaticWebHandler("/mqtt", LittleFS, "/routes/mqtt.html", NULL);
-  webServer.addHandler(mqttHandle);
-  mqttHandle->setTemplateProcessor(mqttHtmlProcess).setFilter(headersFix);
-  auto miscHandle = new AsyncStaticWebHandler("/misc", LittleFS, "/routes/misc.html", NULL);
-  webServer.addHandler(miscHandle);
-  miscHandle->setTemplateProcessor(miscHtmlProcess).setFilter(headersFix);
-  auto actionsHandle = new AsyncStaticWebHandler("/actions", LittleFS, "/routes/actions.html", NULL);
-  webServer.addHandler(actionsHandle);
-  actionsHandle->setTemplateProcessor(actionsProcess).setFilter(headersFix);
-  auto assetsHandle = new AsyncStaticWebHandler("/assets", LittleFS, "/assets/", NULL);
-  webServer.addHandler(assetsHandle);
-  actionsHandle->setFilter(headersFix);
-  AsyncCallbackWebHandler* rootHandle = new AsyncCallbackWebHandler();
-  webServer.addHandler(rootHandle);
-  rootHandle->setUri("/");
-  rootHandle->setMethod(HTTP_GET);
-  rootHandle->onRequest([](AsyncWebServerRequest* req) {
-    req->send(LittleFS, "/index.html", "text/html", false, indexProcess);
-  });
+  File manifest = LittleFS.open("/manifest.txt", "r");
+  while (manifest && manifest.available()) {
+    String line = manifest.readStringUntil('\n');
+    int sep = line.indexOf(' ');
+    if (sep > 0) {
+      webAssetHashes[line.substring(0, sep).c_str()] = line.substring(sep + 1).c_str();
+    }
+  }
+  if (manifest) manifest.close();
+  auto infoHandle = web_asset_handler("/info", "/routes/info.html");
+  auto mqttHandle = web_asset_handler("/mqtt", "/routes/mqtt.html");
+  auto miscHandle = web_asset_handler("/misc", "/routes/misc.html");
+  auto actionsHandle = web_asset_handler("/actions", "/routes/actions.html");
+  auto assetsHandle = web_asset_handler("/assets/*", "");
+  auto rootHandle = web_asset_handler("/", "/index.html");
+  auto apiInfoHandle = new AsyncCallbackWebHandler();
+  apiInfoHandle->setUri("/api/info");
+  apiInfoHandle->setMethod(HTTP_GET);
+  apiInfoHandle->onRequest([](AsyncWebServerRequest* request) {
+    json info;
+    info["version"] = esp_ota_get_app_description()->version;
+    xSemaphoreTake(readerDataMutex, portMAX_DELAY);
+    info["readerGid"] = utils::bufToHexString(readerData.reader_gid.data(), readerData.reader_gid.size(), true);
+    info["readerId"] = utils::bufToHexString(readerData.reader_id.data(), readerData.reader_id.size(), true);
+    info["issuers"] = readerData.issuers.size();
+    xSemaphoreGive(readerDataMutex);
+    api_send_json(request, 200, info);
+    });
+  webServer.addHandler(apiInfoHandle);
+  auto apiIssuersHandle = new AsyncCallbackWebHandler();
+  apiIssuersHandle->setUri("/api/issuers");
+  apiIssuersHandle->setMethod(HTTP_GET);
+  apiIssuersHandle->onRequest([](AsyncWebServerRequest* request) {
+    size_t offset = request->hasParam("offset") ? std::max<long>(request->getParam("offset")->value().toInt(), 0) : 0;
+    size_t limit = request->hasParam("limit") ? std::clamp<long>(request->getParam("limit")->value().toInt(), 1, WEB_API_ISSUERS_PAGE) : WEB_API_ISSUERS_PAGE;
+    AsyncResponseStream* response = request->beginResponseStream("application/json");
+    response->addHeader("Cache-Control", "no-store");
+    xSemaphoreTake(readerDataMutex, portMAX_DELAY);
+    size_t total = readerData.issuers.size();
+    response->printf("{\"total\":%u,\"offset\":%u,\"issuers\":[", total, offset);
+    for (size_t i = offset; i < total && i < offset + limit; i++) {
+      auto&& issuer = readerData.issuers[i];
+      response->printf("%s{\"issuerId\":\"%s\",\"endpoints\":[", i > offset ? "," : "", utils::bufToHexString(issuer.issuer_id.data(), issuer.issuer_id.size(), true).c_str());
+      for (size_t j = 0; j < issuer.endpoints.size(); j++) {
+        auto&& endpoint = issuer.endpoints[j];
+        response->printf("%s\"%s\"", j ? "," : "", utils::bufToHexString(endpoint.endpoint_id.data(), endpoint.endpoint_id.size(), true).c_str());
+      }
+      response->print("]}");
+    }
+    xSemaphoreGive(readerDataMutex);
+    response->print("]}");
+    request->send(response);
+    });
+  webServer.addHandler(apiIssuersHandle);
+  auto apiConfigHandle = new AsyncCallbackWebHandler();
+  apiConfigHandle->setUri("/api/config/*");
+  apiConfigHandle->setMethod(HTTP_GET | HTTP_PATCH);
+  apiConfigHandle->onBody([](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    // the body is collected in the request's temporary buffer, freed together with the request
+    if (total > WEB_API_MAX_BODY) return;
+    if (index == 0) request->_tempObject = calloc(total + 1, 1);
+    if (request->_tempObject) memcpy(static_cast<uint8_t*>(request->_tempObject) + index, data, len);
+    });
+  apiConfigHandle->onRequest([](AsyncWebServerRequest* request) {
+    std::string section = request->url().substring(strlen("/api/config/")).c_str();
+    json fields = api_config_section(section);
+    if (fields.is_null()) {
+      api_send_json(request, 404, { {"error", "unknown config section"} });
+      return;
+    }
+    if (request->method() == HTTP_GET) {
+      api_send_json(request, 200, fields);
+      return;
+    }
+    if (!request->_tempObject) {
+      api_send_json(request, 400, { {"error", "expected a JSON object of at most " + std::to_string(WEB_API_MAX_BODY) + " bytes"} });
+      return;
+    }
+    json patch = json::parse(static_cast<const char*>(request->_tempObject), nullptr, false);
+    if (patch.is_discarded() || !patch.is_object()) {
+      api_send_json(request, 400, { {"error", "expected a JSON object"} });
+      return;
+    }
+    std::string error;
+    json result;
+    result["restart"] = json::array();
+    bool accepted;
+    if (section == "mqtt") {
+      accepted = webJobs.stage(webJobs.mqttStaged, espConfig::mqttData, [&](espConfig::mqttConfig_t& config) {
+        if (!api_config_patch(mqttConfigFields, section, config, patch, error)) return false;
+        result["config"] = api_config_fields(section, config);
+        return true;
+        });
+    } else {
+      accepted = webJobs.stage(webJobs.miscStaged, espConfig::miscConfig, [&](espConfig::misc_config_t& config) {
+        espConfig::misc_config_t previous = config;
+        if (!api_config_patch(miscConfigFields, section, config, patch, error)) return false;
+        if (section == "misc") {
+          for (const char* reason : misc_config_restart_reasons(previous, config)) {
+            result["restart"].push_back(reason);
+          }
+        }
+        result["config"] = api_config_fields(section, config);
+        return true;
+        });
+    }
+    if (!accepted) {
+      api_send_json(request, 400, { {"error", error} });
+      return;
+    }
+    web_job_reply(request, section == "mqtt" ? webJobs_t::job_t::MQTT_CONFIG : section == "misc" ? webJobs_t::job_t::MISC_CONFIG : webJobs_t::job_t::ACTIONS_CONFIG, result);
+    });
+  webServer.addHandler(apiConfigHandle);
+  auto apiSchemaHandle = new AsyncCallbackWebHandler();
+  apiSchemaHandle->setUri("/api/schema");
+  apiSchemaHandle->setMethod(HTTP_GET);
+  apiSchemaHandle->onRequest([](AsyncWebServerRequest* request) {
+    json schema;
+    config_schema_json(mqttConfigFields, schema);
+    config_schema_json(miscConfigFields, schema);
+    api_send_json(request, 200, schema);
+    });
+  webServer.addHandler(apiSchemaHandle);
+  auto apiJobsHandle = new AsyncCallbackWebHandler();
+  apiJobsHandle->setUri("/api/jobs");
+  apiJobsHandle->setMethod(HTTP_GET);
+  apiJobsHandle->onRequest([](AsyncWebServerRequest* request) {
+    json status;
+    if (!request->hasParam("id") || !webJobs.status(request->getParam("id")->value().toInt(), status)) {
+      api_send_json(request, 404, { {"error", "unknown job"} });
+      return;
+    }
+    api_send_json(request, 200, status);
+    });
+  webServer.addHandler(apiJobsHandle);
+  auto eventsHandle = new AsyncCallbackWebHandler();
+  eventsHandle->setUri("/events");
+  eventsHandle->setMethod(HTTP_GET);
+  eventsHandle->onRequest([](AsyncWebServerRequest* request) {
+    if (webEvents.clients >= WEB_EVENTS_MAX_CLIENTS) {
+      request->send(503, "text/plain", "Too many event clients");
+      return;
+    }
+    auto stream = std::make_shared<webEvents_t::stream_t>(webEvents);
+    AsyncWebServerResponse* response = request->beginChunkedResponse("text/event-stream", [stream](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+      if (index == 0) {
+        // how soon to reconnect after the stream ends, and the lock state to start from
+        int len = snprintf(reinterpret_cast<char*>(buffer), maxLen, "retry: 2000\nevent: lock\ndata: {\"state\":%d,\"customState\":-1}\n\n", lockStateMachine.published);
+        return len > 0 && size_t(len) < maxLen ? len : RESPONSE_TRY_AGAIN;
+      }
+      return stream->events.fill(*stream, buffer, maxLen);
+      });
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+    });
+  webServer.addHandler(eventsHandle);
   auto mqttConfigHandle = new AsyncCallbackWebHandler();
   mqttConfigHandle->setUri("/mqttconfig");
   mqttConfigHandle->setMethod(HTTP_POST);
   mqttConfigHandle->onRequest([](AsyncWebServerRequest* request) {
-    const char* TAG = "mqttconfig";
-    int params = request->params();
-    for (int i = 0; i < params; i++) {
-      AsyncWebParameter* p = request->getParam(i);
-      LOG(V, "POST[%s]: %s\n", p->name().c_str(), p->value().c_str());
-      if (!strcmp(p->name().c_str(), "mqtt-broker")) {
-        espConfig::mqttData.mqttBroker = p->value().c_str();
-      } else if (!strcmp(p->name().c_str(), "mqtt-port")) {
-        int port = atoi(p->value().c_str());
-        if (port > 0 && port < 65535) {
-          espConfig::mqttData.mqttPort = port;
-        }
-      } else if (!strcmp(p->name().c_str(), "mqtt-clientid")) {
-        espConfig::mqttData.mqttClientId = p->value().c_str();
-      } else if (!strcmp(p->name().c_str(), "mqtt-username")) {
-        espConfig::mqttData.mqttUsername = p->value().c_str();
-      } else if (!strcmp(p->name().c_str(), "mqtt-password")) {
-        espConfig::mqttData.mqttPassword = p->value().c_str();
-      } else if (!strcmp(p->name().c_str(), "mqtt-lwt-topic")) {
-        espConfig::mqttData.lwtTopic = p->value().c_str();
-      } else if (!strcmp(p->name().c_str(), "mqtt-hktopic")) {
-        espConfig::mqttData.hkTopic = p->value().c_str();
-      } else if (!strcmp(p->name().c_str(), "mqtt-statetopic")) {
-        espConfig::mqttData.lockStateTopic = p->value().c_str();
-      } else if (!strcmp(p->name().c_str(), "mqtt-statecmd")) {
-        espConfig::mqttData.lockStateCmd = p->value().c_str();
-      } else if (!strcmp(p->name().c_str(), "mqtt-cstatecmd")) {
-        espConfig::mqttData.lockCStateCmd = p->value().c_str();
-      } else if (!strcmp(p->name().c_str(), "mqtt-tstatecmd")) {
-        espConfig::mqttData.lockTStateCmd = p->value().c_str();
-      } else if (!strcmp(p->name().c_str(), "mqtt-customstate-enable")) {
-        espConfig::mqttData.lockEnableCustomState = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "mqtt-customstate-topic")) {
-        espConfig::mqttData.lockCustomStateTopic = p->value().c_str();
-      } else if (!strcmp(p->name().c_str(), "mqtt-customstate-cmd")) {
-        espConfig::mqttData.lockCustomStateCmd = p->value().c_str();
-      } else if (!strcmp(p->name().c_str(), "mqtt-discovery-enable")) {
-        espConfig::mqttData.hassMqttDiscoveryEnabled = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "caction-unlock")) {
-        espConfig::mqttData.customLockActions["UNLOCK"] = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "caction-lock")) {
-        espConfig::mqttData.customLockActions["LOCK"] = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "cstate-unlocking")) {
-        espConfig::mqttData.customLockStates["C_UNLOCKING"] = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "cstate-locking")) {
-        espConfig::mqttData.customLockStates["C_LOCKING"] = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "cstate-locked")) {
-        espConfig::mqttData.customLockStates["C_LOCKED"] = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "cstate-unlocked")) {
-        espConfig::mqttData.customLockStates["C_UNLOCKED"] = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "cstate-jammed")) {
-        espConfig::mqttData.customLockStates["C_JAMMED"] = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "cstate-unknown")) {
-        espConfig::mqttData.customLockStates["C_UNKNOWN"] = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "nfc-tags-ignore-mqtt")) {
-        espConfig::mqttData.nfcTagNoPublish = p->value().toInt();
-        if (espConfig::mqttData.nfcTagNoPublish) {
-          std::string rfidTopic;
-          rfidTopic.append("homeassistant/tag/").append(espConfig::mqttData.mqttClientId).append("/rfid/config");
-          esp_mqtt_client_publish(client, rfidTopic.c_str(), "", 0, 0, false);
-        }
-      } else if (!strcmp(p->name().c_str(), "mqtt-btrprox-cmd-topic")) {
-        espConfig::mqttData.btrLvlCmdTopic = p->value().c_str();
-      }
+    std::string error;
+    bool accepted = webJobs.stage(webJobs.mqttStaged, espConfig::mqttData, [&](espConfig::mqttConfig_t& config) {
+      return config_form_apply(request, mqttConfigFields, "mqtt", config, error);
+      });
+    if (!accepted) {
+      request->send(200, "text/plain", error.c_str());
+      return;
     }
-    json json_mqtt_config = espConfig::mqttData;
-    std::vector<uint8_t> string_mqtt = json::to_msgpack(json_mqtt_config);
-    esp_err_t set_nvs = nvs_set_blob(savedData, "MQTTDATA", string_mqtt.data(), string_mqtt.size());
-    esp_err_t commit_nvs = nvs_commit(savedData);
-    LOG(V, "SET_STATUS: %s", esp_err_to_name(set_nvs));
-    LOG(V, "COMMIT_STATUS: %s", esp_err_to_name(commit_nvs));
-
-    request->send(200, "text/plain", "Config Saved, Restarting...");
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
-    ESP.restart();
+    web_job_reply(request, webJobs_t::job_t::MQTT_CONFIG);
     });
   webServer.addHandler(mqttConfigHandle);
   auto miscConfigHandle = new AsyncCallbackWebHandler();
   miscConfigHandle->setUri("/misc-config");
   miscConfigHandle->setMethod(HTTP_POST);
   miscConfigHandle->onRequest([](AsyncWebServerRequest* request) {
-    const char* TAG = "misc-config";
-    int params = request->params();
-    for (int i = 0; i < params; i++) {
-      AsyncWebParameter* p = request->getParam(i);
-      LOG(V, "POST[%s]: %s\n", p->name().c_str(), p->value().c_str());
-      if (!strcmp(p->name().c_str(), "device-name")) {
-        espConfig::miscConfig.deviceName = p->value().c_str();
-      } else if (!strcmp(p->name().c_str(), "ota-passwd")) {
-        espConfig::miscConfig.otaPasswd = p->value().c_str();
-      } else if (!strcmp(p->name().c_str(), "hk-setupcode")) {
-        if (strcmp(espConfig::miscConfig.setupCode.c_str(), p->value().c_str()) && p->value().length() == 8) {
-          if (homeSpan.controllerListBegin() == homeSpan.controllerListEnd()) {
-            homeSpan.setPairingCode(p->value().c_str());
-            espConfig::miscConfig.setupCode = p->value().c_str();
-          }
-        }
-      } else if (!strcmp(p->name().c_str(), "control-pin")) {
-        if (!GPIO_IS_VALID_GPIO(p->value().toInt()) && !GPIO_IS_VALID_OUTPUT_GPIO(p->value().toInt()) && p->value().toInt() != 255) {
-          std::string msg = p->value().c_str();
-          msg.append(" is not a valid GPIO Pin");
-          request->send(200, "text/plain", msg.c_str());
-          return;
-        }
-        espConfig::miscConfig.controlPin = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "led-pin")) {
-        if (!GPIO_IS_VALID_GPIO(p->value().toInt()) && !GPIO_IS_VALID_OUTPUT_GPIO(p->value().toInt()) && p->value().toInt() != 255) {
-          std::string msg = p->value().c_str();
-          msg.append(" is not a valid GPIO Pin");
-          request->send(200, "text/plain", msg.c_str());
-          return;
-        }
-        espConfig::miscConfig.hsStatusPin = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "hk-always-unlock")) {
-        espConfig::miscConfig.lockAlwaysUnlock = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "hk-always-lock")) {
-        espConfig::miscConfig.lockAlwaysLock = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "hk-hwfinish")) {
-        espConfig::miscConfig.hk_key_color = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "web-auth-enable")) {
-        espConfig::miscConfig.webAuthEnabled = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "web-auth-username")) {
-        espConfig::miscConfig.webUsername = p->value().c_str();
-      } else if (!strcmp(p->name().c_str(), "web-auth-password")) {
-        espConfig::miscConfig.webPassword = p->value().c_str();
-      } else if (!strcmp(p->name().c_str(), "nfc-ss-gpio-pin")) {
-        if (!GPIO_IS_VALID_GPIO(p->value().toInt()) && !GPIO_IS_VALID_OUTPUT_GPIO(p->value().toInt()) && p->value().toInt() != 255) {
-          std::string msg = p->value().c_str();
-          msg.append(" is not a valid GPIO Pin");
-          request->send(200, "text/plain", msg.c_str());
-          return;
-        }
-        espConfig::miscConfig.nfcGpioPins[0] = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "nfc-sck-gpio-pin")) {
-        if (!GPIO_IS_VALID_GPIO(p->value().toInt()) && !GPIO_IS_VALID_OUTPUT_GPIO(p->value().toInt()) && p->value().toInt() != 255) {
-          std::string msg = p->value().c_str();
-          msg.append(" is not a valid GPIO Pin");
-          request->send(200, "text/plain", msg.c_str());
-          return;
-        }
-        espConfig::miscConfig.nfcGpioPins[1] = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "nfc-miso-gpio-pin")) {
-        if (!GPIO_IS_VALID_GPIO(p->value().toInt()) && !GPIO_IS_VALID_OUTPUT_GPIO(p->value().toInt()) && p->value().toInt() != 255) {
-          std::string msg = p->value().c_str();
-          msg.append(" is not a valid GPIO Pin");
-          request->send(200, "text/plain", msg.c_str());
-          return;
-        }
-        espConfig::miscConfig.nfcGpioPins[2] = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "nfc-mosi-gpio-pin")) {
-        if (!GPIO_IS_VALID_GPIO(p->value().toInt()) && !GPIO_IS_VALID_OUTPUT_GPIO(p->value().toInt()) && p->value().toInt() != 255) {
-          std::string msg = p->value().c_str();
-          msg.append(" is not a valid GPIO Pin");
-          request->send(200, "text/plain", msg.c_str());
-          return;
-        }
-        espConfig::miscConfig.nfcGpioPins[3] = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "prox-bat-enable")) {
-        espConfig::miscConfig.proxBatEnabled = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "btr-low-threshold")) {
-        espConfig::miscConfig.btrLowStatusThreshold = p->value().toInt();
-        if (statusLowBtr && btrLevel) {
-          if (btrLevel->getVal() <= espConfig::miscConfig.btrLowStatusThreshold) {
-            statusLowBtr->setVal(1);
-          } else {
-            statusLowBtr->setVal(0);
-          }
-        }
-      } else if (!strcmp(p->name().c_str(), "homekit-dumb-switch-mode")) {
-        espConfig::miscConfig.hkDumbSwitchMode = p->value().toInt();
-      }
+    std::string error;
+    bool accepted = webJobs.stage(webJobs.miscStaged, espConfig::miscConfig, [&](espConfig::misc_config_t& config) {
+      return config_form_apply(request, miscConfigFields, "misc", config, error);
+      });
+    if (!accepted) {
+      request->send(200, "text/plain", error.c_str());
+      return;
     }
-    json json_misc_config = espConfig::miscConfig;
-    std::vector<uint8_t> misc_buf = nlohmann::json::to_msgpack(json_misc_config);
-    esp_err_t set_nvs = nvs_set_blob(savedData, "MISCDATA", misc_buf.data(), misc_buf.size());
-    esp_err_t commit_nvs = nvs_commit(savedData);
-    LOG(V, "SET_STATUS: %s", esp_err_to_name(set_nvs));
-    LOG(V, "COMMIT_STATUS: %s", esp_err_to_name(commit_nvs));
-
-    request->send(200, "text/plain", "Config Saved, Restarting...");
-    delay(1000);
-    ESP.restart();
+    web_job_reply(request, webJobs_t::job_t::MISC_CONFIG);
     });
   webServer.addHandler(miscConfigHandle);
   auto actionsConfigHandle = new AsyncCallbackWebHandler();
   actionsConfigHandle->setUri("/actions-config");
   actionsConfigHandle->setMethod(HTTP_POST);
   actionsConfigHandle->onRequest([](AsyncWebServerRequest* request) {
-    const char* TAG = "actions-config";
-    int params = request->params();
-    for (int i = 0; i < params; i++) {
-      AsyncWebParameter* p = request->getParam(i);
-      LOG(V, "POST[%s]: %s\n", p->name().c_str(), p->value().c_str());
-      if (!strcmp(p->name().c_str(), "nfc-neopixel-pin")) {
-        if (!GPIO_IS_VALID_GPIO(p->value().toInt()) && !GPIO_IS_VALID_OUTPUT_GPIO(p->value().toInt()) && p->value().toInt() != 255) {
-          std::string msg = p->value().c_str();
-          msg.append(" is not a valid GPIO Pin");
-          request->send(200, "text/plain", msg.c_str());
-          return;
-        }
-        if (espConfig::miscConfig.nfcNeopixelPin == 255 && p->value().toInt() != 255 && neopixel_task_handle == nullptr) {
-          xTaskCreate(neopixel_task, "neopixel_task", 4096, NULL, 2, &neopixel_task_handle);
-          if (!pixel) {
-            pixel = std::make_unique<Pixel>(p->value().toInt(), PixelType::GRB);
-          }
-        } else if (espConfig::miscConfig.nfcNeopixelPin != 255 && p->value().toInt() == 255 && neopixel_task_handle != nullptr) {
-          uint8_t status = 2;
-          xQueueSend(neopixel_handle, &status, 0);
-          neopixel_task_handle = nullptr;
-        }
-        espConfig::miscConfig.nfcNeopixelPin = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "neopixel-s-time")) {
-        espConfig::miscConfig.neopixelSuccessTime = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "neopixel-f-time")) {
-        espConfig::miscConfig.neopixelFailTime = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "neo-pixel-type")) {
-        espConfig::miscConfig.neoPixelType = p->value().toInt();
-        if (pixel) {
-          pixel->setPixelType(pixelTypeMap[espConfig::miscConfig.neoPixelType]);
-        }
-      } else if (!strcmp(p->name().c_str(), "nfc-s-red-pixel")) {
-        espConfig::miscConfig.neopixelSuccessColor[espConfig::misc_config_t::colorMap::R] = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "nfc-s-green-pixel")) {
-        espConfig::miscConfig.neopixelSuccessColor[espConfig::misc_config_t::colorMap::G] = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "nfc-s-blue-pixel")) {
-        espConfig::miscConfig.neopixelSuccessColor[espConfig::misc_config_t::colorMap::B] = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "nfc-f-red-pixel")) {
-        espConfig::miscConfig.neopixelFailureColor[espConfig::misc_config_t::colorMap::R] = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "nfc-f-green-pixel")) {
-        espConfig::miscConfig.neopixelFailureColor[espConfig::misc_config_t::colorMap::G] = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "nfc-f-blue-pixel")) {
-        espConfig::miscConfig.neopixelFailureColor[espConfig::misc_config_t::colorMap::B] = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "nfc-s-pin")) {
-        if (!GPIO_IS_VALID_GPIO(p->value().toInt()) && !GPIO_IS_VALID_OUTPUT_GPIO(p->value().toInt()) && p->value().toInt() != 255) {
-          std::string msg = p->value().c_str();
-          msg.append(" is not a valid GPIO Pin");
-          request->send(200, "text/plain", msg.c_str());
-          return;
-        }
-        if (espConfig::miscConfig.nfcSuccessPin == 255 && p->value().toInt() != 255 && gpio_led_task_handle == nullptr) {
-          pinMode(p->value().toInt(), OUTPUT);
-          xTaskCreate(nfc_gpio_task, "nfc_gpio_task", 4096, NULL, 2, &gpio_led_task_handle);
-        } else if (espConfig::miscConfig.nfcSuccessPin != 255 && p->value().toInt() == 255 && gpio_led_task_handle != nullptr) {
-          if (espConfig::miscConfig.nfcFailPin == 255) {
-            uint8_t status = 2;
-            xQueueSend(gpio_led_handle, &status, 0);
-            gpio_led_task_handle = nullptr;
-          }
-        } else if(p->value().toInt() != 255) {
-          pinMode(p->value().toInt(), OUTPUT);
-        }
-        espConfig::miscConfig.nfcSuccessPin = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "nfc-f-pin")) {
-        if (!GPIO_IS_VALID_GPIO(p->value().toInt()) && !GPIO_IS_VALID_OUTPUT_GPIO(p->value().toInt()) && p->value().toInt() != 255) {
-          std::string msg = p->value().c_str();
-          msg.append(" is not a valid GPIO Pin");
-          request->send(200, "text/plain", msg.c_str());
-          return;
-        }
-        if (espConfig::miscConfig.nfcFailPin == 255 && p->value().toInt() != 255 && gpio_led_task_handle == nullptr) {
-          pinMode(p->value().toInt(), OUTPUT);
-          xTaskCreate(nfc_gpio_task, "nfc_gpio_task", 4096, NULL, 2, &gpio_led_task_handle);
-        } else if (espConfig::miscConfig.nfcFailPin != 255 && p->value().toInt() == 255 && gpio_led_task_handle != nullptr) {
-          if (espConfig::miscConfig.nfcSuccessPin == 255) {
-            uint8_t status = 2;
-            xQueueSend(gpio_led_handle, &status, 0);
-            gpio_led_task_handle = nullptr;
-          }
-        } else if(p->value().toInt() != 255) {
-          pinMode(p->value().toInt(), OUTPUT);
-        }
-        espConfig::miscConfig.nfcFailPin = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "nfc-s-hl")) {
-        espConfig::miscConfig.nfcSuccessHL = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "nfc-f-hl")) {
-        espConfig::miscConfig.nfcFailHL = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "nfc-s-time")) {
-        espConfig::miscConfig.nfcSuccessTime = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "nfc-f-time")) {
-        espConfig::miscConfig.nfcFailTime = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "gpio-a-pin")) {
-        if (!GPIO_IS_VALID_GPIO(p->value().toInt()) && !GPIO_IS_VALID_OUTPUT_GPIO(p->value().toInt()) && p->value().toInt() != 255) {
-          std::string msg = p->value().c_str();
-          msg.append(" is not a valid GPIO Pin");
-          request->send(200, "text/plain", msg.c_str());
-          return;
-        }
-        if (espConfig::miscConfig.gpioActionPin == 255 && p->value().toInt() != 255 && gpio_lock_task_handle == nullptr) {
-          pinMode(p->value().toInt(), OUTPUT);
-          xTaskCreate(gpio_task, "gpio_task", 4096, NULL, 2, &gpio_lock_task_handle);
-        } else if (espConfig::miscConfig.gpioActionPin != 255 && p->value().toInt() == 255 && gpio_lock_task_handle != nullptr) {
-          gpioLockAction status{ .source = gpioLockAction::OTHER, .action = 2 };
-          xQueueSend(gpio_lock_handle, &status, 0);
-          gpio_lock_task_handle = nullptr;
-        }
-        espConfig::miscConfig.gpioActionPin = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "gpio-a-lock")) {
-        espConfig::miscConfig.gpioActionLockState = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "homekey-gpio-state")) {
-        espConfig::miscConfig.hkGpioControlledState = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "gpio-a-unlock")) {
-        espConfig::miscConfig.gpioActionUnlockState = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "gpio-a-momentary")) {
-        espConfig::miscConfig.gpioActionMomentaryEnabled = p->value().toInt();
-      } else if (!strcmp(p->name().c_str(), "gpio-a-mo-timeout")) {
-        espConfig::miscConfig.gpioActionMomentaryTimeout = p->value().toInt();
-      }
+    std::string error;
+    bool accepted = webJobs.stage(webJobs.miscStaged, espConfig::miscConfig, [&](espConfig::misc_config_t& config) {
+      return config_form_apply(request, miscConfigFields, "actions", config, error);
+      });
+    if (!accepted) {
+      request->send(200, "text/plain", error.c_str());
+      return;
     }
-    json json_misc_config = espConfig::miscConfig;
-    std::vector<uint8_t> misc_buf = nlohmann::json::to_msgpack(json_misc_config);
-    esp_err_t set_nvs = nvs_set_blob(savedData, "MISCDATA", misc_buf.data(), misc_buf.size());
-    esp_err_t commit_nvs = nvs_commit(savedData);
-    LOG(V, "SET_STATUS: %s", esp_err_to_name(set_nvs));
-    LOG(V, "COMMIT_STATUS: %s", esp_err_to_name(commit_nvs));
-
-    request->send(200, "text/plain", "Configuration applied!");
+    web_job_reply(request, webJobs_t::job_t::ACTIONS_CONFIG);
     });
   webServer.addHandler(actionsConfigHandle);
   auto rebootDeviceHandle = new AsyncCallbackWebHandler();
   rebootDeviceHandle->setUri("/reboot_device");
   rebootDeviceHandle->setMethod(HTTP_GET);
   rebootDeviceHandle->onRequest([](AsyncWebServerRequest* request) {
-    request->send(200, "text/plain", "Rebooting the device...");
-    delay(1000);
-    ESP.restart();
+    web_job_reply(request, webJobs_t::job_t::REBOOT);
     });
   webServer.addHandler(rebootDeviceHandle);
   auto resetHkHandle = new AsyncCallbackWebHandler();
   resetHkHandle->setUri("/reset_hk_pair");
   resetHkHandle->setMethod(HTTP_GET);
   resetHkHandle->onRequest([](AsyncWebServerRequest* request) {
-    request->send(200, "text/plain", "Erasing HomeKit pairings and restarting...");
-    delay(1000);
-    deleteReaderData();
-    homeSpan.processSerialCommand("H");
+    web_job_reply(request, webJobs_t::job_t::RESET_HOMEKIT);
     });
   webServer.addHandler(resetHkHandle);
   auto resetWifiHandle = new AsyncCallbackWebHandler();
   resetWifiHandle->setUri("/reset_wifi_cred");
   resetWifiHandle->setMethod(HTTP_GET);
   resetWifiHandle->onRequest([](AsyncWebServerRequest* request) {
-    request->send(200, "text/plain", "Erasing WiFi credentials and restarting, AP will start on boot...");
-    delay(1000);
-    homeSpan.processSerialCommand("X");
+    web_job_reply(request, webJobs_t::job_t::RESET_WIFI);
     });
   webServer.addHandler(resetWifiHandle);
   auto getWifiRssi = new AsyncCallbackWebHandler();
@@ -1367,6 +1014,98 @@ void setupWeb() {
     request->send(200, "text/plain", rssi_val.c_str());
     });
   webServer.addHandler(getWifiRssi);
+  auto getNfcStats = new AsyncCallbackWebHandler();
+  getNfcStats->setUri("/get_nfc_stats");
+  getNfcStats->setMethod(HTTP_GET);
+  getNfcStats->onRequest([](AsyncWebServerRequest* request) {
+    json statsJson;
+    statsJson["readers"] = json::array();
+    for (auto&& reader : nfcReaders) {
+      json readerJson = reader->scheduler.toJson(esp_timer_get_time());
+      readerJson["id"] = reader->id;
+      readerJson["authPool"]["hits"] = reader->authPool.hits.load();
+      readerJson["authPool"]["misses"] = reader->authPool.misses.load();
+      statsJson["readers"].push_back(readerJson);
+    }
+    statsJson["authPoolSize"] = espConfig::misc(&espConfig::misc_config_t::hkAuthPoolSize);
+    uint8_t subscribers = std::min<uint8_t>(eventBus.subscriberCount.load(), eventBus_t::maxSubscribers);
+    for (uint8_t i = 0; i < subscribers; i++) {
+      statsJson["eventBusDropped"].push_back(eventBus.subscribers[i].dropped.load());
+    }
+    statsJson["actions"] = actionsEngine.toJson();
+    statsJson["lock"] = lockStateMachine.toJson();
+    statsJson["mqttDispatch"] = mqttDispatch.toJson();
+    statsJson["journal"]["pending"] = eventJournal.head - eventJournal.tail;
+    statsJson["journal"]["lost"] = eventJournal.lost.load();
+    statsJson["flowEngine"] = hkFlowEngine.toJson();
+    statsJson["events"]["clients"] = webEvents.clients.load();
+    statsJson["events"]["dropped"] = webEvents.dropped.load();
+    statsJson["readerStore"] = readerStore.toJson();
+    std::string stats = statsJson.dump();
+    request->send(200, "application/json", stats.c_str());
+    });
+  webServer.addHandler(getNfcStats);
+  auto getTapTrace = new AsyncCallbackWebHandler();
+  getTapTrace->setUri("/get_tap_trace");
+  getTapTrace->setMethod(HTTP_GET);
+  getTapTrace->onRequest([](AsyncWebServerRequest* request) {
+    auto spans = std::make_unique<std::array<tapTrace_t::span_t, tapTrace_t::capacity>>();
+    size_t count = tapTrace.snapshot(*spans);
+    AsyncResponseStream* response = request->beginResponseStream("application/json");
+    response->addHeader("Content-Disposition", "attachment; filename=\"tap-trace.json\"");
+    response->print("{\"traceEvents\":[");
+    for (size_t i = 0; i < count; i++) {
+      auto&& span = (*spans)[i];
+      // one lane per reader, lane 0 for spans outside a tap
+      unsigned lane = span.reader == tapTrace_t::noReader ? 0 : span.reader + 1;
+      response->printf("%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%u,\"pid\":1,\"tid\":%u,\"args\":{\"tap\":%u}}", i ? "," : "", tapTrace_t::phaseNames[span.phase], span.start, span.duration, lane, span.tap);
+    }
+    response->print("],\"displayTimeUnit\":\"ms\"}");
+    request->send(response);
+    });
+  webServer.addHandler(getTapTrace);
+  auto getTapTraceSummary = new AsyncCallbackWebHandler();
+  getTapTraceSummary->setUri("/get_tap_trace_summary");
+  getTapTraceSummary->setMethod(HTTP_GET);
+  getTapTraceSummary->onRequest([](AsyncWebServerRequest* request) {
+    std::string summary = tapTrace.summary().dump();
+    request->send(200, "application/json", summary.c_str());
+    });
+  webServer.addHandler(getTapTraceSummary);
+  auto allowlistHandle = new AsyncCallbackWebHandler();
+  allowlistHandle->setUri("/allowlist");
+  allowlistHandle->setMethod(HTTP_GET | HTTP_POST);
+  allowlistHandle->onBody([](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    // the load ID rides along with the request, the body is only staged here and merged by a web job
+    if (index == 0) {
+      uint32_t load = uidAllowlist.stageBegin();
+      if (load) request->_tempObject = malloc(sizeof(load));
+      if (request->_tempObject) memcpy(request->_tempObject, &load, sizeof(load));
+      else uidAllowlist.stageAbort(load);
+    }
+    if (request->_tempObject) uidAllowlist.stageText(*static_cast<uint32_t*>(request->_tempObject), reinterpret_cast<const char*>(data), len);
+    });
+  allowlistHandle->onRequest([](AsyncWebServerRequest* request) {
+    json result;
+    result["count"] = uidAllowlist.count;
+    result["rejected"] = uidAllowlist.rejected;
+    result["max"] = UID_ALLOWLIST_MAX_ENTRIES;
+    if (request->method() != HTTP_POST) {
+      api_send_json(request, 200, result);
+      return;
+    }
+    // an empty body clears the list
+    uint32_t load = request->_tempObject ? *static_cast<uint32_t*>(request->_tempObject) : request->contentLength() == 0 ? uidAllowlist.stageBegin() : 0;
+    if (!load) {
+      api_send_json(request, 409, { {"error", "Another allowlist load is in progress"} });
+      return;
+    }
+    xSemaphoreTake(webJobs.mutex, portMAX_DELAY);
+    webJobs.allowlistLoad = load;
+    xSemaphoreGive(webJobs.mutex);
+    if (!web_job_reply(request, webJobs_t::job_t::ALLOWLIST, result)) uidAllowlist.stageAbort(load);
+    });
+  webServer.addHandler(allowlistHandle);
   if (espConfig::miscConfig.webAuthEnabled) {
     LOG(I, "Web Authentication Enabled");
     infoHandle->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
@@ -1375,11 +1114,21 @@ void setupWeb() {
     actionsHandle->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
     assetsHandle->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
     rootHandle->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
+    apiInfoHandle->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
+    apiIssuersHandle->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
+    apiConfigHandle->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
+    apiSchemaHandle->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
+    apiJobsHandle->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
+    eventsHandle->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
     mqttConfigHandle->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
     miscConfigHandle->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
     actionsConfigHandle->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
     resetHkHandle->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
     resetWifiHandle->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
+    allowlistHandle->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
+    getNfcStats->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
+    getTapTrace->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
+    getTapTraceSummary->setAuthentication(espConfig::miscConfig.webUsername.c_str(), espConfig::miscConfig.webPassword.c_str());
   }
   webServer.onNotFound(notFound);
   webServer.begin();
@@ -1392,200 +1141,105 @@ void mqttConfigReset(const char* buf) {
 }
 
 void wifiCallback() {
-  if (espConfig::mqttData.mqttBroker.size() >= 7 && espConfig::mqttData.mqttBroker.size() <= 16 && !std::equal(espConfig::mqttData.mqttBroker.begin(), espConfig::mqttData.mqttBroker.end(), "0.0.0.0")) {
+  espConfig::lock_t lock;
+  if (mqtt_broker_valid()) {
     mqtt_app_start();
   }
   setupWeb();
 }
 
-void mqtt_publish(std::string topic, std::string payload, uint8_t qos, bool retain) {
+int mqtt_publish(std::string topic, std::string payload, uint8_t qos, bool retain) {
+  traceScope_t span(tapTrace_t::MQTT);
   if (client != nullptr) {
-    esp_mqtt_client_publish(client, topic.c_str(), payload.c_str(), payload.length(), 0, retain);
+    return esp_mqtt_client_publish(client, topic.c_str(), payload.c_str(), payload.length(), qos, retain);
   } else LOG(W, "MQTT Client not initialized, cannot publish message");
+  return -1;
 }
 
-std::string hex_representation(const std::vector<uint8_t>& v) {
-  std::string hex_tmp;
-  for (auto x : v) {
-    std::ostringstream oss;
-    oss << std::hex << std::uppercase << std::setw(2) << std::setfill('0') << (unsigned)x;
-    hex_tmp += oss.str();
+/**
+ * The function `bus_mqtt_publish` serializes a tap or lock state event and publishes it over MQTT.
+ * Events replayed from the journal carry their journal sequence number in `seq`, live events pass 0.
+ *
+ * @return `false` if the event could not be handed to the MQTT client
+ */
+bool bus_mqtt_publish(const busEvent_t& event, uint32_t seq) {
+  if (event.type == busEvent_t::LOCK_STATE) {
+    if (event.lockState != -1 && mqtt_publish(espConfig::mqttData.lockStateTopic, std::to_string(event.lockState), 1, true) < 0) {
+      return false;
+    }
+    if (event.customState != -1 && mqtt_publish(espConfig::mqttData.lockCustomStateTopic, std::to_string(event.customState), 0, false) < 0) {
+      return false;
+    }
+    return true;
+  }
+  if (event.type == busEvent_t::HOMEKEY_FAIL || (event.type == busEvent_t::TAG && espConfig::mqttData.nfcTagNoPublish)) return true;
+  json payload = tap_event_json(event, seq);
+  std::string payloadStr = payload.dump();
+  // replayed events are sent with QoS 1 so the outbox retries them if the connection drops again
+  if (mqtt_publish(espConfig::mqttData.hkTopic, payloadStr, seq != 0 ? 1 : 0, false) < 0) {
+    return false;
+  }
+  if (!espConfig::mqttData.binaryTopic.empty()) {
+    tapBatch.add(event, seq);
   }
-  return hex_tmp;
+  if (seq == 0 && event.detected != 0 && !espConfig::mqttData.diagTopic.empty()) {
+    json diag;
+    diag["latency_ms"] = (event.posted - event.detected) / 1000;
+    diag["rssi"] = WiFi.RSSI();
+    diag["nfcReader"] = event.reader;
+    mqtt_publish(espConfig::mqttData.diagTopic, diag.dump(), 0, false);
+  }
+  return true;
 }
 
-void nfc_thread_entry(void* arg) {
-  nfc->begin();
-
-  uint32_t versiondata = nfc->getFirmwareVersion();
-  if (!versiondata) {
-    ESP_LOGE("NFC_SETUP", "Didn't find PN53x board");
-  } else {
-    unsigned int model = (versiondata >> 24) & 0xFF;
-    ESP_LOGI("NFC_SETUP", "Found chip PN5%x", model);
-    int maj = (versiondata >> 16) & 0xFF;
-    int min = (versiondata >> 8) & 0xFF;
-    ESP_LOGI("NFC_SETUP", "Firmware ver. %d.%d", maj, min);
-    nfc->SAMConfig();
-    nfc->setRFField(0x02, 0x01);
-    nfc->setPassiveActivationRetries(0);
-    ESP_LOGI("NFC_SETUP", "Waiting for an ISO14443A card");
-  }
-  memcpy(ecpData + 8, readerData.reader_gid.data(), readerData.reader_gid.size());
-  with_crc16(ecpData, 16, ecpData + 16);
+/**
+ * The function `bus_mqtt_task` publishes tap and lock state events over MQTT. While the broker is
+ * unreachable the events go to the journal instead, which is replayed in batches once connected.
+ * Tap events for the binary topic are held back until the batch is full or its window has passed.
+ */
+void bus_mqtt_task(void* arg) {
+  eventBus_t::subscriber_t* sub = eventBus.subscribe();
+  busEvent_t event;
   while (1) {
-    uint8_t res[4];
-    uint16_t resLen = 4;
-    nfc->writeRegister(0x633d, 0, true);
-    nfc->inCommunicateThru(ecpData, sizeof(ecpData), res, &resLen, 100, true);
-    uint8_t uid[16];
-    uint8_t uidLen = 0;
-    uint8_t atqa[2];
-    uint8_t sak[1];
-    bool passiveTarget = nfc->readPassiveTargetID(PN532_MIFARE_ISO14443A, uid, &uidLen, atqa, sak, 500, true, true);
-    if (passiveTarget) {
-      nfc->setPassiveActivationRetries(5);
-      LOG(D, "ATQA: %02x", atqa[0]);
-      LOG(D, "SAK: %02x", sak[0]);
-      ESP_LOG_BUFFER_HEX_LEVEL(TAG, uid, (size_t)uidLen, ESP_LOG_VERBOSE);
-      LOG(I, "*** PASSIVE TARGET DETECTED ***");
-      auto startTime = std::chrono::high_resolution_clock::now();
-      uint8_t data[13] = { 0x00, 0xA4, 0x04, 0x00, 0x07, 0xA0, 0x00, 0x00, 0x08, 0x58, 0x01, 0x01, 0x0 };
-      uint8_t selectCmdRes[9];
-      uint16_t selectCmdResLength = 9;
-      LOG(I, "Requesting supported HomeKey versions");
-      LOG(D, "SELECT HomeKey Applet, APDU: ");
-      ESP_LOG_BUFFER_HEX_LEVEL(TAG, data, sizeof(data), ESP_LOG_VERBOSE);
-      bool status = nfc->inDataExchange(data, sizeof(data), selectCmdRes, &selectCmdResLength);
-      LOG(D, "SELECT HomeKey Applet, Response");
-      ESP_LOG_BUFFER_HEX_LEVEL(TAG, selectCmdRes, selectCmdResLength, ESP_LOG_VERBOSE);
-      if (status && selectCmdRes[selectCmdResLength - 2] == 0x90 && selectCmdRes[selectCmdResLength - 1] == 0x00) {
-        LOG(D, "*** SELECT HOMEKEY APPLET SUCCESSFUL ***");
-        LOG(D, "Reader Private Key: %s", utils::bufToHexString(readerData.reader_pk.data(), readerData.reader_pk.size()).c_str());
-        HKAuthenticationContext authCtx(*nfc, readerData, savedData);
-        auto authResult = authCtx.authenticate(hkFlow);
-        if (std::get<2>(authResult) != kFlowFailed) {
-          bool status = true;
-          if (espConfig::miscConfig.nfcSuccessPin != 255) {
-            xQueueSend(gpio_led_handle, &status, 0);
-          }
-          if (espConfig::miscConfig.nfcNeopixelPin != 255) {
-            xQueueSend(neopixel_handle, &status, 0);
-          }
-          if (espConfig::miscConfig.gpioActionPin != 255 && espConfig::miscConfig.hkGpioControlledState) {
-            const gpioLockAction action{ .source = gpioLockAction::HOMEKEY, .action = 0 };
-            xQueueSend(gpio_lock_handle, &action, 0);
-          }
-          json payload;
-          payload["issuerId"] = hex_representation(std::get<0>(authResult));
-          payload["endpointId"] = hex_representation(std::get<1>(authResult));
-          payload["readerId"] = hex_representation(readerData.reader_id);
-          payload["homekey"] = true;
-          std::string payloadStr = payload.dump();
-          mqtt_publish(espConfig::mqttData.hkTopic, payloadStr, 0, false);
-          if (espConfig::miscConfig.lockAlwaysUnlock) {
-            if (espConfig::miscConfig.gpioActionPin == 255 || !espConfig::miscConfig.hkGpioControlledState) {
-              lockCurrentState->setVal(lockStates::UNLOCKED);
-              lockTargetState->setVal(lockStates::UNLOCKED);
-              mqtt_publish(espConfig::mqttData.lockStateTopic, std::to_string(lockStates::UNLOCKED), 1, true);
-            }
-            if (espConfig::mqttData.lockEnableCustomState) {
-              mqtt_publish(espConfig::mqttData.lockCustomStateTopic, std::to_string(espConfig::mqttData.customLockActions["UNLOCK"]), 0, false);
-            }
-          } else if (espConfig::miscConfig.lockAlwaysLock) {
-            if (espConfig::miscConfig.gpioActionPin == 255 || espConfig::miscConfig.hkGpioControlledState) {
-              lockCurrentState->setVal(lockStates::LOCKED);
-              lockTargetState->setVal(lockStates::LOCKED);
-              mqtt_publish(espConfig::mqttData.lockStateTopic, std::to_string(lockStates::LOCKED), 1, true);
-            }
-            if (espConfig::mqttData.lockEnableCustomState) {
-              mqtt_publish(espConfig::mqttData.lockCustomStateTopic, std::to_string(espConfig::mqttData.customLockActions["LOCK"]), 0, false);
-            }
-          } else {
-            int currentState = lockCurrentState->getVal();
-            if (espConfig::mqttData.lockEnableCustomState) {
-              if (currentState == lockStates::UNLOCKED) {
-                mqtt_publish(espConfig::mqttData.lockCustomStateTopic, std::to_string(espConfig::mqttData.customLockActions["LOCK"]), 0, false);
-              } else if (currentState == lockStates::LOCKED) {
-                mqtt_publish(espConfig::mqttData.lockCustomStateTopic, std::to_string(espConfig::mqttData.customLockActions["UNLOCK"]), 0, false);
-              }
-            }
-          }
-
-          auto stopTime = std::chrono::high_resolution_clock::now();
-          LOG(I, "Total Time (detection->auth->gpio->mqtt): %lli ms", std::chrono::duration_cast<std::chrono::milliseconds>(stopTime - startTime).count());
-        } else {
-          bool status = false;
-          if (espConfig::miscConfig.nfcFailPin != 255) {
-            xQueueSend(gpio_led_handle, &status, 0);
-          }
-          if (espConfig::miscConfig.nfcNeopixelPin != 255) {
-            xQueueSend(neopixel_handle, &status, 0);
-          }
-          LOG(W, "We got status FlowFailed, mqtt untouched!");
-        }
-        nfc->setRFField(0x02, 0x01);
-      } else if(!espConfig::mqttData.nfcTagNoPublish) {
-        LOG(W, "Invalid Response, probably not Homekey, publishing target's UID");
-        bool status = false;
-        if (espConfig::miscConfig.nfcFailPin != 255) {
-          xQueueSend(gpio_led_handle, &status, 0);
-        }
-        if (espConfig::miscConfig.nfcNeopixelPin != 255) {
-          xQueueSend(neopixel_handle, &status, 0);
+    size_t replayed = 0;
+    {
+      // the topics are read throughout
+      espConfig::lock_t lock;
+      while (eventBus.next(*sub, event)) {
+        if (client == nullptr) continue;
+        if (!mqttConnected || !bus_mqtt_publish(event, 0)) {
+          eventJournal.append(event);
         }
-        json payload;
-        payload["atqa"] = hex_representation(std::vector<uint8_t>(atqa, atqa + 2));
-        payload["sak"] = hex_representation(std::vector<uint8_t>(sak, sak + 1));
-        payload["uid"] = hex_representation(std::vector<uint8_t>(uid, uid + uidLen));
-        payload["homekey"] = false;
-        std::string payload_dump = payload.dump();
-        if (client != nullptr) {
-          esp_mqtt_client_publish(client, espConfig::mqttData.hkTopic.c_str(), payload_dump.c_str(), 0, 0, false);
-        } else LOG(W, "MQTT Client not initialized, cannot publish message");
       }
-      vTaskDelay(50 / portTICK_PERIOD_MS);
-      nfc->inRelease();
-      int counter = 50;
-      bool deviceStillInField = nfc->readPassiveTargetID(PN532_MIFARE_ISO14443A, uid, &uidLen);
-      LOG(D, "Target still present: %d", deviceStillInField);
-      while (deviceStillInField) {
-        if (counter == 0) break;
-        vTaskDelay(50 / portTICK_PERIOD_MS);
-        nfc->inRelease();
-        deviceStillInField = nfc->readPassiveTargetID(PN532_MIFARE_ISO14443A, uid, &uidLen);
-        --counter;
-        LOG(D, "Target still present: %d Counter=%d", deviceStillInField, counter);
+      if (tapBatch.pending() && tapBatch.remaining(esp_timer_get_time()) == 0) {
+        uint8_t qos = tapBatch.replayed ? 1 : 0;
+        std::vector<uint8_t> packed = tapBatch.flush();
+        // the binary topic is a copy of the JSON one, a batch that can't be sent is not journaled again
+        mqtt_publish(espConfig::mqttData.binaryTopic, std::string(packed.begin(), packed.end()), qos, false);
+      }
+      if (mqttConnected && eventJournal.pending()) {
+        replayed = eventJournal.replay(MQTT_JOURNAL_BATCH, [](const busEvent_t& event, uint32_t seq) { return mqttConnected && bus_mqtt_publish(event, seq); });
+        LOG(D, "Replayed %d journaled events", replayed);
       }
-      nfc->inRelease();
-      nfc->setPassiveActivationRetries(0);
     }
-    vTaskDelay(50 / portTICK_PERIOD_MS);
+    if (replayed > 0) {
+      // let the MQTT task drain the outbox before the next batch
+      vTaskDelay(pdMS_TO_TICKS(50));
+      continue;
+    }
+    ulTaskNotifyTake(pdTRUE, tapBatch.pending() ? pdMS_TO_TICKS(tapBatch.remaining(esp_timer_get_time())) + 1 : portMAX_DELAY);
   }
-  vTaskDelete(NULL);
 }
 
 void setup() {
   Serial.begin(115200);
   const esp_app_desc_t* app_desc = esp_ota_get_app_description();
   std::string app_version = app_desc->version;
-  gpio_led_handle = xQueueCreate(2, sizeof(uint8_t));
-  neopixel_handle = xQueueCreate(2, sizeof(uint8_t));
-  gpio_lock_handle = xQueueCreate(2, sizeof(gpioLockAction));
   size_t len;
   const char* TAG = "SETUP";
   nvs_open("SAVED_DATA", NVS_READWRITE, &savedData);
-  if (!nvs_get_blob(savedData, "READERDATA", NULL, &len)) {
-    std::vector<uint8_t> savedBuf(len);
-    nvs_get_blob(savedData, "READERDATA", savedBuf.data(), &len);
-    LOG(D, "NVS READERDATA LENGTH: %d", len);
-    ESP_LOG_BUFFER_HEX_LEVEL(TAG, savedBuf.data(), savedBuf.size(), ESP_LOG_VERBOSE);
-    nlohmann::json data = nlohmann::json::from_msgpack(savedBuf);
-    if (!data.is_discarded()) {
-      data.get_to<readerData_t>(readerData);
-      LOG(I, "Reader Data loaded from NVS");
-    }
-  }
+  readerStore.begin();
+  hkIndex.rebuild(readerData);
   if (!nvs_get_blob(savedData, "MQTTDATA", NULL, &len)) {
     std::vector<uint8_t> dataBuf(len);
     nvs_get_blob(savedData, "MQTTDATA", dataBuf.data(), &len);
@@ -1631,9 +1285,13 @@ void setup() {
         LOG(I, "Misc Config loaded from NVS");
       }
     }
+    config_clamp(miscConfigFields, espConfig::miscConfig);
+  }
+  nfcReaders.emplace_back(std::make_unique<nfcReader_t>(0, espConfig::miscConfig.nfcGpioPins[0], espConfig::miscConfig.nfcIrqPin));
+  for (auto&& extraReader : espConfig::miscConfig.nfcExtraReaders) {
+    if (nfcReaders.size() >= NFC_MAX_READERS) break;
+    nfcReaders.emplace_back(std::make_unique<nfcReader_t>(nfcReaders.size(), extraReader[0], extraReader[1]));
   }
-  pn532spi = new PN532_SPI(espConfig::miscConfig.nfcGpioPins[0], espConfig::miscConfig.nfcGpioPins[1], espConfig::miscConfig.nfcGpioPins[2], espConfig::miscConfig.nfcGpioPins[3]);
-  nfc = new PN532(*pn532spi);
   if (espConfig::miscConfig.nfcSuccessPin && espConfig::miscConfig.nfcSuccessPin != 255) {
     pinMode(espConfig::miscConfig.nfcSuccessPin, OUTPUT);
     digitalWrite(espConfig::miscConfig.nfcSuccessPin, !espConfig::miscConfig.nfcSuccessHL);
@@ -1681,7 +1339,8 @@ void setup() {
     for (auto&& issuer : readerData.issuers) {
       issuer.endpoints.clear();
     }
-    save_to_nvs();
+    hkIndex.rebuild(readerData);
+    readerStore.save();
     });
   new SpanUserCommand('N', "Btr status low", [](const char* arg) {
     const char* TAG = "BTR_LOW";
@@ -1729,15 +1388,22 @@ void setup() {
   homeSpan.setWifiCallback(wifiCallback);
   if (espConfig::miscConfig.nfcNeopixelPin != 255) {
     pixel = std::make_unique<Pixel>(espConfig::miscConfig.nfcNeopixelPin, pixelTypeMap[espConfig::miscConfig.neoPixelType]);
-    xTaskCreate(neopixel_task, "neopixel_task", 4096, NULL, 2, &neopixel_task_handle);
-  }
-  if (espConfig::miscConfig.nfcSuccessPin != 255 || espConfig::miscConfig.nfcFailPin != 255) {
-    xTaskCreate(nfc_gpio_task, "nfc_gpio_task", 4096, NULL, 2, &gpio_led_task_handle);
+    pixelAnimator.begin();
   }
-  if (espConfig::miscConfig.gpioActionPin != 255) {
-    xTaskCreate(gpio_task, "gpio_task", 4096, NULL, 2, &gpio_lock_task_handle);
+  actionsEngine.begin();
+  webJobs.begin();
+  webEvents.begin();
+  memcpy(ecpData + 8, readerData.reader_gid.data(), readerData.reader_gid.size());
+  with_crc16(ecpData, 16, ecpData + 16);
+  lockStateMachine.begin();
+  eventJournal.begin();
+  uidAllowlist.begin();
+  xTaskCreate(bus_mqtt_task, "bus_mqtt", 6144, NULL, 1, &bus_mqtt_task_handle);
+  for (auto&& reader : nfcReaders) {
+    reader->authPool.begin(reader->pn532, reader->workingData);
+    std::string taskName = "nfc_task_" + std::to_string(reader->id);
+    xTaskCreate(nfc_thread_entry, taskName.c_str(), 8192, reader.get(), 1, &reader->task);
   }
-  xTaskCreate(nfc_thread_entry, "nfc_task", 8192, NULL, 1, NULL);
 }
 
 //////////////////////////////////////
@@ -0,0 +1,86 @@
+#define JSON_NOEXCEPTION 1
+#include "mqttDispatch.h"
+#include <charconv>
+#include <esp_timer.h>
+
+static const char* TAG = "mqttDispatch";
+
+mqttDispatch_t mqttDispatch;
+
+void mqttDispatch_t::add(const std::string& filter, uint8_t qos, handler_t handler) {
+  if (filter.empty()) return;
+  if (count >= routes.size()) {
+    LOG(E, "MQTT dispatch table full, not routing %s", filter.c_str());
+    return;
+  }
+  routes[count++] = { filter, fnv1a(filter), filter.find_first_of("+#") != std::string::npos, qos, handler, nullptr };
+}
+
+void mqttDispatch_t::addStream(const std::string& filter, uint8_t qos, streamHandler_t handler) {
+  uint8_t before = count;
+  add(filter, qos, nullptr);
+  if (count > before) routes[count - 1].stream = handler;
+}
+
+void mqttDispatch_t::subscribe(esp_mqtt_client_handle_t client) {
+  for (uint8_t i = 0; i < count; i++) {
+    esp_mqtt_client_subscribe(client, routes[i].filter.c_str(), routes[i].qos);
+  }
+}
+
+bool mqttDispatch_t::dispatch(esp_mqtt_client_handle_t client, std::string_view topic, std::string_view data, size_t offset, size_t total) {
+  int64_t start = esp_timer_get_time();
+  total = std::max(total, offset + data.size());
+  bool last = offset + data.size() == total;
+  if (offset == 0) {
+    uint32_t hash = fnv1a(topic);
+    current = nullptr;
+    pending.clear();
+    for (uint8_t i = 0; i < count && current == nullptr; i++) {
+      const route_t& route = routes[i];
+      if (route.wildcard ? match(route.filter, topic) : route.hash == hash && route.filter == topic) {
+        current = &route;
+      }
+    }
+    messages++;
+    if (current == nullptr) unmatched++;
+    if (current != nullptr && !last) currentTopic.assign(topic);
+  }
+  const route_t* route = current;
+  if (route == nullptr) {
+    // chunks of an unmatched message, or of one that started before the table was rebuilt
+  } else if (route->stream != nullptr) {
+    route->stream(client, data, offset, total);
+  } else if (offset == 0 && last) {
+    route->handler(client, topic, data);
+  } else if (total > MQTT_DISPATCH_MAX_MESSAGE) {
+    if (offset == 0) LOG(W, "Dropping %u byte message on %s", total, currentTopic.c_str());
+  } else {
+    pending.append(data);
+    if (last) route->handler(client, currentTopic, pending);
+  }
+  if (last) {
+    current = nullptr;
+    pending.clear();
+  }
+  uint32_t elapsed = esp_timer_get_time() - start;
+  totalUs += elapsed;
+  maxUs = std::max(maxUs, elapsed);
+  return route != nullptr;
+}
+
+json mqttDispatch_t::toJson() const {
+  json result;
+  result["routes"] = count;
+  result["messages"] = messages.load();
+  result["unmatched"] = unmatched.load();
+  result["avg_us"] = messages ? uint32_t(totalUs / messages) : 0;
+  result["max_us"] = maxUs;
+  return result;
+}
+
+int mqtt_parse_int(std::string_view data) {
+  int value = 0;
+  std::from_chars(data.data(), data.data() + data.size(), value);
+  return value;
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <Arduino.h>
+#include <HomeKey.h>
+#include <mqtt_client.h>
+#include <array>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include "config.h"
+
+/**
+ * Table of the subscribed MQTT topic filters and their handlers. It is built once from the configured
+ * topics and each incoming message is matched with views over the event buffers, with no copies.
+ * Exact filters are compared by their FNV-1a hash and length first, filters containing `+` or `#`
+ * are matched level by level, so prefix subscriptions like `homekey/ext/#` can be routed as well.
+ * The table keeps its own copy of the filters and is only rebuilt while the client is stopped.
+ *
+ * Messages larger than the client buffer arrive as several `MQTT_EVENT_DATA` events and only the first
+ * one carries the topic, later chunks go to the route the first one matched. Routes added with `add`
+ * get the whole message, reassembled up to `MQTT_DISPATCH_MAX_MESSAGE` bytes; routes added with
+ * `addStream` get every chunk as it arrives, with its offset and the length of the whole message.
+ */
+struct mqttDispatch_t
+{
+  using handler_t = void (*)(esp_mqtt_client_handle_t client, std::string_view topic, std::string_view data);
+  using streamHandler_t = void (*)(esp_mqtt_client_handle_t client, std::string_view data, size_t offset, size_t total);
+  struct route_t
+  {
+    std::string filter;
+    uint32_t hash;
+    bool wildcard;
+    uint8_t qos;
+    handler_t handler;
+    streamHandler_t stream;
+  };
+  std::array<route_t, MQTT_DISPATCH_MAX_ROUTES> routes{};
+  uint8_t count = 0;
+  const route_t* current = nullptr; // route of the message whose chunks are arriving
+  std::string currentTopic;
+  std::string pending; // chunks received so far of a message for an `add` route
+  std::atomic<uint32_t> messages = 0;
+  std::atomic<uint32_t> unmatched = 0;
+  uint64_t totalUs = 0;
+  uint32_t maxUs = 0;
+
+  static constexpr uint32_t fnv1a(std::string_view str) {
+    uint32_t hash = 2166136261u;
+    for (char c : str) {
+      hash = (hash ^ uint8_t(c)) * 16777619u;
+    }
+    return hash;
+  }
+  /**
+   * Matches `topic` against a filter with MQTT wildcard semantics, `+` matches one level and a
+   * trailing `#` matches the parent level and everything below it.
+   */
+  static bool match(std::string_view filter, std::string_view topic) {
+    size_t f = 0, t = 0;
+    while (f < filter.size()) {
+      if (filter[f] == '#') return true;
+      if (filter[f] == '+') {
+        while (t < topic.size() && topic[t] != '/') t++;
+        f++;
+        continue;
+      }
+      if (t >= topic.size()) {
+        // "a/#" also matches "a"
+        return filter.substr(f) == "/#";
+      }
+      if (filter[f] != topic[t]) return false;
+      f++;
+      t++;
+    }
+    return t == topic.size();
+  }
+  void clear() {
+    count = 0;
+    current = nullptr;
+  }
+  void add(const std::string& filter, uint8_t qos, handler_t handler);
+  void addStream(const std::string& filter, uint8_t qos, streamHandler_t handler);
+  void subscribe(esp_mqtt_client_handle_t client);
+  /**
+   * Routes one `MQTT_EVENT_DATA` event, `offset` and `total` are its `current_data_offset` and
+   * `total_data_len`. Returns whether the message it belongs to has a route.
+   */
+  bool dispatch(esp_mqtt_client_handle_t client, std::string_view topic, std::string_view data, size_t offset = 0, size_t total = 0);
+  json toJson() const;
+};
+
+extern mqttDispatch_t mqttDispatch;
+
+/**
+ * The function `mqtt_parse_int` parses a decimal MQTT payload without copying it, an invalid payload yields 0.
+ */
+int mqtt_parse_int(std::string_view data);
@@ -0,0 +1,425 @@
+#define JSON_NOEXCEPTION 1
+#include "nfcReader.h"
+#include <utils.h>
+#include "eventBus.h"
+#include "hkFlowEngine.h"
+#include "hkIndex.h"
+#include "pixelAnimator.h"
+#include "readerStore.h"
+#include "tapTrace.h"
+#include "uidAllowlist.h"
+
+static const char* TAG = "nfcReader";
+
+uint8_t ecpData[18] = { 0x6A, 0x2, 0xCB, 0x2, 0x6, 0x2, 0x11, 0x0 };
+KeyFlow hkFlow = KeyFlow::kFlowFAST;
+SemaphoreHandle_t nfcSharedSpi_t::busMutex = xSemaphoreCreateMutex();
+std::vector<std::unique_ptr<nfcReader_t>> nfcReaders;
+
+void crc16a(unsigned char* data, unsigned int size, unsigned char* result) {
+  unsigned short w_crc = 0x6363;
+
+  for (unsigned int i = 0; i < size; ++i) {
+    unsigned char byte = data[i];
+    byte = (byte ^ (w_crc & 0x00FF));
+    byte = ((byte ^ (byte << 4)) & 0xFF);
+    w_crc = ((w_crc >> 8) ^ (byte << 8) ^ (byte << 3) ^ (byte >> 4)) & 0xFFFF;
+  }
+
+  result[0] = static_cast<unsigned char>(w_crc & 0xFF);
+  result[1] = static_cast<unsigned char>((w_crc >> 8) & 0xFF);
+}
+
+void with_crc16(unsigned char* data, unsigned int size, unsigned char* result) {
+  crc16a(data, size, result);
+}
+
+json nfcPollScheduler_t::toJson(int64_t now) const {
+  json stats;
+  stats["profile"] = profile(now) == ACTIVE ? "active" : "idle";
+  stats["cycles"]["active"] = cycles[ACTIVE];
+  stats["cycles"]["idle"] = cycles[IDLE];
+  for (size_t i = 0; i < histogram.size(); i++) {
+    json bucket;
+    if (i < bucketBounds.size()) bucket["lt_ms"] = bucketBounds[i];
+    else bucket["ge_ms"] = bucketBounds.back();
+    bucket["count"] = histogram[i];
+    stats["detectLatency"].push_back(bucket);
+  }
+  return stats;
+}
+
+void hkAuthPool_t::refill_task(void* arg) {
+  hkAuthPool_t* pool = static_cast<hkAuthPool_t*>(arg);
+  while (1) {
+    UBaseType_t pending = uxQueueMessagesWaiting(pool->queue);
+    entry_t entry;
+    for (UBaseType_t i = 0; i < pending && xQueueReceive(pool->queue, &entry, 0) == pdTRUE; i++) {
+      if (entry.generation != pool->generation.load() || xQueueSend(pool->queue, &entry, 0) != pdTRUE) {
+        delete entry.ctx;
+      }
+    }
+    while (uxQueueMessagesWaiting(pool->queue) < espConfig::miscConfig.hkAuthPoolSize) {
+      entry_t entry{ nullptr, pool->generation.load() };
+      xSemaphoreTake(readerDataMutex, portMAX_DELAY);
+      entry.ctx = new HKAuthenticationContext(*pool->reader, *pool->data, readerDataSink);
+      xSemaphoreGive(readerDataMutex);
+      if (xQueueSend(pool->queue, &entry, 0) != pdTRUE) {
+        delete entry.ctx;
+        break;
+      }
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+}
+
+void hkAuthPool_t::begin(PN532& nfc, readerData_t& readerData) {
+  reader = &nfc;
+  data = &readerData;
+  if (espConfig::miscConfig.hkAuthPoolSize == 0) return;
+  queue = xQueueCreate(espConfig::miscConfig.hkAuthPoolSize, sizeof(entry_t));
+  xTaskCreate(refill_task, "hk_auth_pool", 4096, this, 0, &task);
+}
+
+std::unique_ptr<HKAuthenticationContext> hkAuthPool_t::take() {
+  entry_t entry;
+  while (queue != nullptr && xQueueReceive(queue, &entry, 0) == pdTRUE) {
+    if (entry.generation == generation.load()) {
+      hits++;
+      xTaskNotifyGive(task);
+      return std::unique_ptr<HKAuthenticationContext>(entry.ctx);
+    }
+    delete entry.ctx;
+  }
+  // without a pool every context is built on demand, that's not a miss
+  if (queue != nullptr) misses++;
+  if (task != nullptr) {
+    xTaskNotifyGive(task);
+  }
+  xSemaphoreTake(readerDataMutex, portMAX_DELAY);
+  auto ctx = std::make_unique<HKAuthenticationContext>(*reader, *data, readerDataSink);
+  xSemaphoreGive(readerDataMutex);
+  return ctx;
+}
+
+void hkAuthPool_t::flush() {
+  generation++;
+  if (task != nullptr) {
+    xTaskNotifyGive(task);
+  }
+}
+
+
+
+bool nfcPresenceTracker_t::attentionRequest() {
+  // Diagnose, NumTst = 0x06 (Attention Request Test or ISO/IEC14443-4 card presence detection)
+  uint8_t cmd[2] = { 0x00, 0x06 };
+  uint8_t res[4];
+  if (spi.writeCommand(cmd, sizeof(cmd))) {
+    return false;
+  }
+  return spi.readResponse(res, sizeof(res), reselectTimeout) > 0 && res[0] == 0x00;
+}
+
+bool nfcPresenceTracker_t::reselect() {
+  uint8_t uid[16];
+  uint8_t uidLen = 0;
+  uint8_t atqa[2];
+  uint8_t sak[1];
+  reader.inRelease();
+  return reader.readPassiveTargetID(PN532_MIFARE_ISO14443A, uid, &uidLen, atqa, sak, reselectTimeout, true, true);
+}
+
+bool nfcPresenceTracker_t::targetPresent() {
+  if (probe == ATTENTION_REQUEST) {
+    bool present = attentionRequest();
+    if (present || probed) {
+      probed = true;
+      return present;
+    }
+    LOG(D, "Target didn't answer the attention request, falling back to re-selection");
+    probe = RESELECT;
+  }
+  probed = true;
+  return reselect();
+}
+
+nfcPresenceTracker_t::state_t nfcPresenceTracker_t::track() {
+  int64_t start = esp_timer_get_time();
+  while (state != REMOVED) {
+    vTaskDelay(espConfig::misc(&espConfig::misc_config_t::nfcRemovalProbeInterval) / portTICK_PERIOD_MS);
+    bool present = targetPresent();
+    state = present ? PRESENT : (state == PRESENT ? MISSED : REMOVED);
+    LOG(D, "Target still present: %d State=%d", present, state);
+    if (state != REMOVED && esp_timer_get_time() - start >= int64_t(espConfig::misc(&espConfig::misc_config_t::nfcRemovalHoldoff)) * 1000) {
+      state = HOLDOFF_EXPIRED;
+      break;
+    }
+  }
+  reader.inRelease();
+  return state;
+}
+
+void IRAM_ATTR nfc_irq_isr(void* arg) {
+  BaseType_t higherPriorityTaskWoken = pdFALSE;
+  vTaskNotifyGiveFromISR(static_cast<TaskHandle_t>(arg), &higherPriorityTaskWoken);
+  portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+void nfc_send_ecp(PN532& reader) {
+  uint8_t res[4];
+  uint16_t resLen = 4;
+  reader.writeRegister(0x633d, 0, true);
+  reader.inCommunicateThru(ecpData, sizeof(ecpData), res, &resLen, espConfig::misc(&espConfig::misc_config_t::nfcPollEcpTimeout), true);
+}
+
+bool nfc_detect_target_irq(PN532& reader, PN532_SPI& spi, uint8_t irqPin, uint8_t* uid, uint8_t* uidLen, uint8_t* atqa, uint8_t* sak, uint16_t waitMs, tapTimings_t& timings) {
+  nfc_send_ecp(reader);
+  timings.ecpSent = esp_timer_get_time();
+  uint8_t polls = std::clamp(waitMs / 150, 1, 0xFE);
+  // InAutoPoll, PollNr, Period (x150ms), Type = Generic passive 106 kbps (ISO/IEC14443-4A, Mifare and DEP)
+  uint8_t cmd[4] = { 0x60, polls, 0x01, 0x00 };
+  if (spi.writeCommand(cmd, sizeof(cmd))) {
+    return false;
+  }
+  // the ACK frame also raises the IRQ line, drop that notification and only sleep if the response isn't already there
+  ulTaskNotifyTake(pdTRUE, 0);
+  if (digitalRead(irqPin) == HIGH) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(polls * 150 + 100));
+  }
+  uint8_t res[64];
+  int16_t resLen = spi.readResponse(res, sizeof(res), 50);
+  // NbTg, Type, Length, Tg, SENS_RES(2), SEL_RES, NFCIDLength, NFCID
+  if (resLen < 8 || res[0] < 1 || res[7] > 10 || resLen < 8 + res[7]) {
+    return false;
+  }
+  atqa[0] = res[4];
+  atqa[1] = res[5];
+  sak[0] = res[6];
+  *uidLen = res[7];
+  memcpy(uid, res + 8, res[7]);
+  return true;
+}
+
+bool nfc_detect_target(PN532& reader, uint8_t* uid, uint8_t* uidLen, uint8_t* atqa, uint8_t* sak, tapTimings_t& timings) {
+  nfc_send_ecp(reader);
+  timings.ecpSent = esp_timer_get_time();
+  return reader.readPassiveTargetID(PN532_MIFARE_ISO14443A, uid, uidLen, atqa, sak, espConfig::misc(&espConfig::misc_config_t::nfcPollDetectTimeout), true, true);
+}
+
+bool nfc_select_homekey(PN532& reader) {
+  uint8_t data[13] = { 0x00, 0xA4, 0x04, 0x00, 0x07, 0xA0, 0x00, 0x00, 0x08, 0x58, 0x01, 0x01, 0x0 };
+  uint8_t selectCmdRes[9];
+  uint16_t selectCmdResLength = 9;
+  LOG(I, "Requesting supported HomeKey versions");
+  LOG(D, "SELECT HomeKey Applet, APDU: ");
+  ESP_LOG_BUFFER_HEX_LEVEL(TAG, data, sizeof(data), ESP_LOG_VERBOSE);
+  bool status = reader.inDataExchange(data, sizeof(data), selectCmdRes, &selectCmdResLength);
+  LOG(D, "SELECT HomeKey Applet, Response");
+  ESP_LOG_BUFFER_HEX_LEVEL(TAG, selectCmdRes, selectCmdResLength, ESP_LOG_VERBOSE);
+  return status && selectCmdResLength >= 2 && selectCmdRes[selectCmdResLength - 2] == 0x90 && selectCmdRes[selectCmdResLength - 1] == 0x00;
+}
+
+void hk_auth_success(const tapTimings_t& timings, const std::vector<uint8_t>& issuerId, const std::vector<uint8_t>& endpointId) {
+  busEvent_t event{ .type = busEvent_t::HOMEKEY_SUCCESS, .reader = timings.reader };
+  event.tap = timings.tap;
+  event.detected = timings.detected;
+  std::copy_n(issuerId.begin(), std::min(issuerId.size(), event.issuerId.size()), event.issuerId.begin());
+  event.idLen = std::min(endpointId.size(), event.id.size());
+  std::copy_n(endpointId.begin(), event.idLen, event.id.begin());
+  eventBus.post(event);
+}
+
+void nfc_feedback_fail(const tapTimings_t& timings) {
+  busEvent_t event{ .type = busEvent_t::HOMEKEY_FAIL, .reader = timings.reader };
+  event.tap = timings.tap;
+  eventBus.post(event);
+}
+
+void nfc_publish_tag(const tapTimings_t& timings, const uint8_t* uid, uint8_t uidLen, const uint8_t* atqa, const uint8_t* sak, bool allowed) {
+  busEvent_t event{ .type = busEvent_t::TAG, .reader = timings.reader };
+  event.detected = timings.detected;
+  event.allowed = allowed;
+  event.tap = timings.tap;
+  event.idLen = std::min<uint8_t>(uidLen, event.id.size());
+  memcpy(event.id.data(), uid, event.idLen);
+  memcpy(event.atqa.data(), atqa, 2);
+  event.sak = sak[0];
+  eventBus.post(event);
+}
+
+/**
+ * Copies the endpoint a successful flow updated (counter, persistent key) or enrolled from `working` into
+ * `readerData`, call with `readerDataMutex` held. Endpoints removed from `readerData` during the tap stay
+ * removed, an enrolled endpoint is only added if its issuer still exists.
+ */
+static void nfc_apply_auth(const readerData_t& working, const std::vector<uint8_t>& issuerId, const std::vector<uint8_t>& endpointId) {
+  const hkEndpoint_t* updated = nullptr;
+  for (auto&& issuer : working.issuers) {
+    if (issuer.issuer_id != issuerId) continue;
+    for (auto&& endpoint : issuer.endpoints) {
+      if (endpoint.endpoint_id == endpointId) updated = &endpoint;
+    }
+  }
+  if (updated == nullptr) return;
+  for (auto&& issuer : readerData.issuers) {
+    if (issuer.issuer_id != issuerId) continue;
+    for (auto&& endpoint : issuer.endpoints) {
+      if (endpoint.endpoint_id == endpointId) {
+        endpoint = *updated;
+        return;
+      }
+    }
+    issuer.endpoints.push_back(*updated);
+    return;
+  }
+}
+
+void nfc_process_target(nfcReader_t& nfcReader, const uint8_t* uid, uint8_t uidLen, const uint8_t* atqa, const uint8_t* sak, tapTimings_t& timings) {
+  PN532& reader = nfcReader.pn532;
+  bool selected = nfc_select_homekey(reader);
+  timings.selected = esp_timer_get_time();
+  tapTrace.record(tapTrace_t::SELECT, timings.detected, timings.selected, timings.tap, timings.reader);
+  if (selected) {
+    LOG(D, "*** SELECT HOMEKEY APPLET SUCCESSFUL ***");
+    xSemaphoreTake(readerDataMutex, portMAX_DELAY);
+    nfcReader.workingData = readerData;
+    xSemaphoreGive(readerDataMutex);
+    LOG(D, "Reader Private Key: %s", utils::bufToHexString(nfcReader.workingData.reader_pk.data(), nfcReader.workingData.reader_pk.size()).c_str());
+    KeyFlow flow = hkFlowEngine.startFlow(hkFlow);
+    bool fastFailed = false;
+    bool escalated = false;
+    int64_t attemptStart = timings.selected;
+    std::tuple<std::vector<uint8_t>, std::vector<uint8_t>, KeyFlow> authResult;
+    while (1) {
+      std::unique_ptr<HKAuthenticationContext> authCtx = nfcReader.authPool.take();
+      timings.authReady = esp_timer_get_time();
+      authResult = authCtx->authenticate(flow);
+      timings.authenticated = esp_timer_get_time();
+      tapTrace.record(tapTrace_t::AUTH_CTX, attemptStart, timings.authReady, timings.tap, timings.reader);
+      tapTrace.record(tapTrace_t::AUTH, timings.authReady, timings.authenticated, timings.tap, timings.reader);
+      bool success = std::get<2>(authResult) != kFlowFailed;
+      hkFlowEngine.attempt(flow, success, timings.authenticated - timings.authReady);
+      if (success || flow >= kFlowATTESTATION) break;
+      if (flow == kFlowFAST) fastFailed = true;
+      flow = KeyFlow(flow + 1);
+      LOG(I, "Flow failed, escalating to %s", flow == kFlowSTANDARD ? "STANDARD" : "ATTESTATION");
+      // the failed flow left the applet in an undefined state, start over with a new transaction
+      if (!nfc_select_homekey(reader)) {
+        LOG(W, "Target lost before escalating");
+        break;
+      }
+      escalated = true;
+      attemptStart = esp_timer_get_time();
+    }
+    if (std::get<2>(authResult) != kFlowFailed) {
+      auto&& endpointId = std::get<1>(authResult);
+      xSemaphoreTake(readerDataMutex, portMAX_DELAY);
+      nfc_apply_auth(nfcReader.workingData, std::get<0>(authResult), endpointId);
+      if (hkIndex.findEndpoint(readerData, endpointId.data(), endpointId.size()) == nullptr) {
+        // the attestation flow enrolls endpoints that weren't known yet
+        hkIndex.rebuild(readerData);
+      }
+      xSemaphoreGive(readerDataMutex);
+      readerStore.save(&std::get<0>(authResult), timings.tap, timings.reader);
+      hkFlowEngine.outcome(endpointId, std::get<2>(authResult), fastFailed, escalated);
+      hk_auth_success(timings, std::get<0>(authResult), std::get<1>(authResult));
+      timings.dispatched = esp_timer_get_time();
+      tapTrace.record(tapTrace_t::DISPATCH, timings.authenticated, timings.dispatched, timings.tap, timings.reader);
+      tapTrace.record(tapTrace_t::TAP, timings.detected, timings.dispatched, timings.tap, timings.reader);
+      LOG(I, "Total Time (detection->auth->event posted): %lli ms", (timings.dispatched - timings.detected) / 1000);
+      LOG(I, "Tap stages (ms): detect=%lli select=%lli auth=%lli dispatch=%lli", (timings.detected - timings.cycleStart) / 1000, (timings.selected - timings.detected) / 1000, (timings.authenticated - timings.selected) / 1000, (timings.dispatched - timings.authenticated) / 1000);
+    } else {
+      nfc_feedback_fail(timings);
+      LOG(W, "We got status FlowFailed, mqtt untouched!");
+    }
+    reader.setRFField(0x02, 0x01);
+  } else {
+    bool allowed = uidAllowlist.contains(uid, uidLen);
+    if (allowed) {
+      LOG(I, "Not a HomeKey, UID is on the allowlist");
+    } else {
+      LOG(W, "Invalid Response, probably not Homekey, publishing target's UID");
+    }
+    if (allowed || !espConfig::mqtt(&espConfig::mqttConfig_t::nfcTagNoPublish)) {
+      nfc_publish_tag(timings, uid, uidLen, atqa, sak, allowed);
+    }
+  }
+}
+
+bool nfc_reader_setup(nfcReader_t& nfcReader) {
+  PN532* nfc = &nfcReader.pn532;
+  nfc->begin();
+
+  uint32_t versiondata = nfc->getFirmwareVersion();
+  if (!versiondata) {
+    ESP_LOGE("NFC_SETUP", "Reader %d: Didn't find PN53x board", nfcReader.id);
+  } else {
+    unsigned int model = (versiondata >> 24) & 0xFF;
+    ESP_LOGI("NFC_SETUP", "Reader %d: Found chip PN5%x", nfcReader.id, model);
+    int maj = (versiondata >> 16) & 0xFF;
+    int min = (versiondata >> 8) & 0xFF;
+    ESP_LOGI("NFC_SETUP", "Firmware ver. %d.%d", maj, min);
+    nfc->SAMConfig();
+    nfc->setRFField(0x02, 0x01);
+    nfc->setPassiveActivationRetries(0);
+    ESP_LOGI("NFC_SETUP", "Waiting for an ISO14443A card");
+  }
+  bool irqMode = nfcReader.irqPin != 255 && versiondata;
+  if (irqMode) {
+    pinMode(nfcReader.irqPin, INPUT_PULLUP);
+    attachInterruptArg(nfcReader.irqPin, nfc_irq_isr, xTaskGetCurrentTaskHandle(), FALLING);
+    ESP_LOGI("NFC_SETUP", "Reader %d: IRQ detection enabled on GPIO %d", nfcReader.id, nfcReader.irqPin);
+  }
+  return irqMode;
+}
+
+bool nfc_poll_cycle(nfcReader_t& nfcReader, bool irqMode) {
+  PN532* nfc = &nfcReader.pn532;
+  bool rearm = false;
+  uint8_t uid[16];
+  uint8_t uidLen = 0;
+  uint8_t atqa[2];
+  uint8_t sak[1];
+  tapTimings_t timings;
+  timings.reader = nfcReader.id;
+  timings.cycleStart = esp_timer_get_time();
+  int64_t previousAttempt = nfcReader.scheduler.attempt(timings.cycleStart);
+  bool passiveTarget;
+  if (irqMode) {
+    passiveTarget = nfc_detect_target_irq(*nfc, nfcReader.spi, nfcReader.irqPin, uid, &uidLen, atqa, sak, nfcReader.scheduler.interval(timings.cycleStart), timings);
+  } else {
+    passiveTarget = nfc_detect_target(*nfc, uid, &uidLen, atqa, sak, timings);
+  }
+  if (passiveTarget) {
+    timings.detected = esp_timer_get_time();
+    nfcReader.scheduler.detected(previousAttempt, timings.detected);
+    pixelAnimator.play(pixelAnimator_t::PROCESSING);
+    timings.tap = tapTrace.beginTap();
+    tapTrace.record(tapTrace_t::ECP, timings.cycleStart, timings.ecpSent, timings.tap, timings.reader);
+    tapTrace.record(tapTrace_t::DETECT, timings.ecpSent, timings.detected, timings.tap, timings.reader);
+    nfc->setPassiveActivationRetries(5);
+    LOG(D, "ATQA: %02x", atqa[0]);
+    LOG(D, "SAK: %02x", sak[0]);
+    ESP_LOG_BUFFER_HEX_LEVEL(TAG, uid, (size_t)uidLen, ESP_LOG_VERBOSE);
+    LOG(I, "*** PASSIVE TARGET DETECTED (reader %d) ***", nfcReader.id);
+    nfc_process_target(nfcReader, uid, uidLen, atqa, sak, timings);
+    nfcPresenceTracker_t presence(*nfc, nfcReader.spi, sak[0]);
+    rearm = presence.track() == nfcPresenceTracker_t::REMOVED;
+    nfc->setPassiveActivationRetries(0);
+    nfcReader.scheduler.detected(0, esp_timer_get_time());
+  }
+  return rearm;
+}
+
+void nfc_thread_entry(void* arg) {
+  nfcReader_t& nfcReader = *static_cast<nfcReader_t*>(arg);
+  bool irqMode = nfc_reader_setup(nfcReader);
+  while (1) {
+    bool rearm = nfc_poll_cycle(nfcReader, irqMode);
+    if (!irqMode && !rearm) {
+      vTaskDelay(nfcReader.scheduler.interval(esp_timer_get_time()) / portTICK_PERIOD_MS);
+    }
+  }
+  vTaskDelete(NULL);
+}
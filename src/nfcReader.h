@@ -0,0 +1,315 @@
+#pragma once
+#include <Arduino.h>
+#include <HomeKey.h>
+#include <hkAuthContext.h>
+#include <PN532.h>
+#include <PN532_SPI.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "config.h"
+#include "espConfig.h"
+
+// ECP frame sent before every target search, the reader group identifier and CRC are filled in from the reader data
+extern uint8_t ecpData[18];
+// lowest flow a HomeKey tap starts with, set with the `F` serial command
+extern KeyFlow hkFlow;
+
+// Function to calculate CRC16
+void crc16a(unsigned char* data, unsigned int size, unsigned char* result);
+
+// Function to append CRC16 to data
+void with_crc16(unsigned char* data, unsigned int size, unsigned char* result);
+
+/**
+ * Drives the duty cycle of the NFC polling loop. Right after a tap the reader polls with the active
+ * interval so the next person is picked up quickly, once `nfcPollActiveWindow` seconds pass without
+ * activity it falls back to the idle interval to keep SPI and RF traffic down.
+ *
+ * It also keeps a histogram of the detection latency, measured as the time between the start of the
+ * previous detection attempt and the moment the target was found, which is the worst case a target
+ * arriving right after that attempt would have waited.
+ */
+struct nfcPollScheduler_t
+{
+  enum profile_t
+  {
+    ACTIVE,
+    IDLE
+  };
+  static constexpr std::array<uint16_t, 7> bucketBounds = { 50, 100, 200, 300, 500, 750, 1000 };
+  std::array<uint32_t, bucketBounds.size() + 1> histogram{};
+  std::array<uint32_t, 2> cycles{};
+  int64_t lastActivity = INT64_MIN / 2;
+  int64_t lastAttempt = 0;
+
+  profile_t profile(int64_t now) const {
+    return (now - lastActivity) < int64_t(espConfig::misc(&espConfig::misc_config_t::nfcPollActiveWindow)) * 1000000 ? ACTIVE : IDLE;
+  }
+  uint16_t interval(int64_t now) const {
+    return espConfig::misc(profile(now) == ACTIVE ? &espConfig::misc_config_t::nfcPollActiveInterval : &espConfig::misc_config_t::nfcPollIdleInterval);
+  }
+  /* Marks the start of a detection attempt, returns the start of the previous one */
+  int64_t attempt(int64_t now) {
+    int64_t previous = lastAttempt;
+    lastAttempt = now;
+    cycles[profile(now)]++;
+    return previous;
+  }
+  void detected(int64_t previousAttempt, int64_t now) {
+    if (previousAttempt > 0) {
+      uint32_t latency = (now - previousAttempt) / 1000;
+      size_t i = 0;
+      while (i < bucketBounds.size() && latency >= bucketBounds[i]) i++;
+      histogram[i]++;
+    }
+    lastActivity = now;
+  }
+  json toJson(int64_t now) const;
+};
+
+/**
+ * Pool of authentication contexts created ahead of time. Creating an `HKAuthenticationContext`
+ * generates the reader ephemeral key pair and transaction identifier, which otherwise happens while
+ * the phone is waiting in the field. A low priority task keeps the pool filled between taps and the
+ * NFC task takes a ready context without blocking, falling back to creating one inline when the pool
+ * is empty. Every context is handed out once and deleted after use, so a key pair is never reused.
+ *
+ * Contexts are tagged with a generation that is bumped whenever the reader keys change, contexts from
+ * an older generation are discarded instead of being handed out. They are bound to the working copy of
+ * the reader data of their reader (`nfcReader_t::workingData`), not to `readerData` itself.
+ */
+struct hkAuthPool_t
+{
+  struct entry_t
+  {
+    HKAuthenticationContext* ctx;
+    uint32_t generation;
+  };
+  PN532* reader = nullptr;
+  readerData_t* data = nullptr;
+  QueueHandle_t queue = nullptr;
+  TaskHandle_t task = nullptr;
+  std::atomic<uint32_t> generation{ 0 };
+  std::atomic<uint32_t> hits{ 0 };
+  std::atomic<uint32_t> misses{ 0 };
+
+  static void refill_task(void* arg);
+  void begin(PN532& nfc, readerData_t& data);
+  /* Returns a fresh context, the caller owns it */
+  std::unique_ptr<HKAuthenticationContext> take();
+  /* Invalidates every pooled context, called when the reader keys change */
+  void flush();
+};
+
+/**
+ * PN532 interface for readers sharing one SPI bus, each with its own SS pin. Every transfer happens with
+ * the bus mutex held, while waiting for a response the bus is only held for 1ms at a time so a reader
+ * waiting on a slow target doesn't keep the others off the bus. FreeRTOS hands a mutex to waiting tasks
+ * of the same priority in FIFO order, so reader tasks take turns.
+ */
+struct nfcSharedSpi_t : public PN532_SPI
+{
+  static SemaphoreHandle_t busMutex;
+  using PN532_SPI::PN532_SPI;
+
+  void begin() override {
+    xSemaphoreTake(busMutex, portMAX_DELAY);
+    PN532_SPI::begin();
+    xSemaphoreGive(busMutex);
+  }
+  void wakeup() override {
+    xSemaphoreTake(busMutex, portMAX_DELAY);
+    PN532_SPI::wakeup();
+    xSemaphoreGive(busMutex);
+  }
+  int8_t writeCommand(const uint8_t* header, uint8_t hlen, const uint8_t* body = 0, uint8_t blen = 0, bool ignore_log = false) override {
+    xSemaphoreTake(busMutex, portMAX_DELAY);
+    int8_t result = PN532_SPI::writeCommand(header, hlen, body, blen, ignore_log);
+    xSemaphoreGive(busMutex);
+    return result;
+  }
+  int16_t readResponse(uint8_t buf[], uint8_t len, uint16_t timeout = 1000, bool ignore_log = false) override {
+    int64_t deadline = esp_timer_get_time() + int64_t(timeout) * 1000;
+    while (1) {
+      xSemaphoreTake(busMutex, portMAX_DELAY);
+      // times out before clocking anything out if the PN532 isn't ready yet
+      int16_t result = PN532_SPI::readResponse(buf, len, 1, ignore_log);
+      xSemaphoreGive(busMutex);
+      if (result != PN532_TIMEOUT || (timeout != 0 && esp_timer_get_time() >= deadline)) {
+        return result;
+      }
+      vTaskDelay(1);
+    }
+  }
+};
+
+/**
+ * One PN532 and everything that belongs to it: the SPI interface, the polling task and its schedule,
+ * and the pool of authentication contexts bound to it. All readers share `readerData`, the issuer index
+ * and the action queues.
+ *
+ * The HomeKey library reads and updates the reader data it was given during the whole APDU exchange.
+ * Its contexts get `workingData` instead, a copy refreshed from `readerData` when a tap starts; the
+ * endpoint a successful flow updated or enrolled is copied back afterwards. `readerDataMutex` is only
+ * held for those two copies, never across RF traffic, and `workingData` is only written with it held.
+ */
+struct nfcReader_t
+{
+  uint8_t id;
+  uint8_t irqPin;
+  nfcSharedSpi_t spi;
+  PN532 pn532;
+  nfcPollScheduler_t scheduler;
+  hkAuthPool_t authPool;
+  readerData_t workingData;
+  TaskHandle_t task = nullptr;
+
+  nfcReader_t(uint8_t id, uint8_t ssPin, uint8_t irqPin) : id(id), irqPin(irqPin), spi(ssPin, espConfig::miscConfig.nfcGpioPins[1], espConfig::miscConfig.nfcGpioPins[2], espConfig::miscConfig.nfcGpioPins[3]), pn532(spi) {}
+};
+extern std::vector<std::unique_ptr<nfcReader_t>> nfcReaders;
+
+/**
+ * Timestamps (in microseconds, from `esp_timer_get_time`) taken at the boundaries of a tap, used to
+ * break the total tap latency down per stage.
+ */
+struct tapTimings_t
+{
+  uint16_t tap = 0;   // from `tapTrace_t::beginTap`, 0 until a target is detected
+  uint8_t reader = 0; // ID of the reader the tap happened on
+  int64_t cycleStart = 0;
+  int64_t ecpSent = 0;
+  int64_t detected = 0;
+  int64_t selected = 0;
+  int64_t authReady = 0;
+  int64_t authenticated = 0;
+  int64_t dispatched = 0;
+};
+
+/**
+ * Tracks a target that stays in the field after a tap so it isn't processed twice, while handing the
+ * reader back to the polling loop as soon as the field is empty.
+ *
+ * ISO14443-4 targets (phones, watches) are probed with the PN532 Diagnose "attention request" test,
+ * which is a single frame exchanged with the already active target. Other targets, or ISO14443-4
+ * targets that don't answer the very first attention request, are probed by releasing and
+ * re-selecting them with a short timeout. Two misses in a row mark the target as removed so a single
+ * lost frame doesn't end the tracking early.
+ */
+struct nfcPresenceTracker_t
+{
+  enum state_t
+  {
+    PRESENT,
+    MISSED,
+    REMOVED,
+    HOLDOFF_EXPIRED
+  };
+  enum probe_t
+  {
+    ATTENTION_REQUEST,
+    RESELECT
+  };
+  static constexpr uint16_t reselectTimeout = 100;
+  PN532& reader;
+  PN532_SPI& spi;
+  probe_t probe;
+  state_t state = PRESENT;
+  bool probed = false;
+
+  nfcPresenceTracker_t(PN532& reader, PN532_SPI& spi, uint8_t sak) : reader(reader), spi(spi), probe(sak & 0x20 ? ATTENTION_REQUEST : RESELECT) {}
+
+  bool attentionRequest();
+  bool reselect();
+  bool targetPresent();
+  state_t track();
+};
+
+/**
+ * ISR for the PN532 IRQ line, the PN532 pulls it low once a response is ready to be read. Wakes up the
+ * NFC task passed in `arg` which is sleeping in `nfc_detect_target_irq`.
+ */
+void nfc_irq_isr(void* arg);
+
+/**
+ * The function `nfc_send_ecp` broadcasts the Enhanced Contactless Polling frame so iPhones and Apple
+ * Watches in Express Mode wake up and answer the following target search.
+ */
+void nfc_send_ecp(PN532& reader);
+
+/**
+ * The function `nfc_detect_target_irq` is the interrupt-driven counterpart of `nfc_detect_target`.
+ * After the ECP frame, the PN532 is armed with InAutoPoll so it keeps searching for a target on its
+ * own while the task sleeps on a notification raised by `nfc_irq_isr`. The PN532 answers either when
+ * a target has been activated or when all the polls are done, at which point the ECP frame is sent
+ * again and the PN532 re-armed.
+ *
+ * @param waitMs how long the PN532 should search before giving up, rounded to its 150ms polling period
+ */
+bool nfc_detect_target_irq(PN532& reader, PN532_SPI& spi, uint8_t irqPin, uint8_t* uid, uint8_t* uidLen, uint8_t* atqa, uint8_t* sak, uint16_t waitMs, tapTimings_t& timings);
+
+/**
+ * The function `nfc_detect_target` runs one polling cycle, broadcasting the ECP frame and then looking
+ * for an ISO14443A target in the field.
+ *
+ * @return `true` if a target was found, in which case `uid`, `uidLen`, `atqa` and `sak` are filled in
+ */
+bool nfc_detect_target(PN532& reader, uint8_t* uid, uint8_t* uidLen, uint8_t* atqa, uint8_t* sak, tapTimings_t& timings);
+
+/**
+ * The function `nfc_select_homekey` sends the SELECT APDU for the HomeKey applet to the target in the field.
+ *
+ * @return `true` if the target answered with 90 00
+ */
+bool nfc_select_homekey(PN532& reader);
+
+/**
+ * The function `hk_auth_success` posts a successful HomeKey authentication on the event bus, the
+ * feedback GPIOs, lock action, MQTT and HomeKit lock state are handled by the bus subscribers.
+ */
+void hk_auth_success(const tapTimings_t& timings, const std::vector<uint8_t>& issuerId, const std::vector<uint8_t>& endpointId);
+
+/**
+ * The function `nfc_feedback_fail` posts a failed HomeKey tap on the event bus.
+ */
+void nfc_feedback_fail(const tapTimings_t& timings);
+
+/**
+ * The function `nfc_publish_tag` posts the UID, ATQA and SAK of a target that is not a HomeKey on the event bus,
+ * `allowed` tells the subscribers the UID is on the local allowlist and should be treated like a HomeKey.
+ */
+void nfc_publish_tag(const tapTimings_t& timings, const uint8_t* uid, uint8_t uidLen, const uint8_t* atqa, const uint8_t* sak, bool allowed);
+
+/**
+ * The function `nfc_process_target` handles a detected target: HomeKey targets go through the
+ * authentication flow, anything else gets its UID published.
+ */
+void nfc_process_target(nfcReader_t& nfcReader, const uint8_t* uid, uint8_t uidLen, const uint8_t* atqa, const uint8_t* sak, tapTimings_t& timings);
+
+/**
+ * The function `nfc_reader_setup` initializes the PN532 of `nfcReader` and attaches its IRQ line, must
+ * be called from the reader's own task as the ISR notifies the calling task.
+ *
+ * @return `true` if targets are detected through the IRQ line, `false` if the reader is polled
+ */
+bool nfc_reader_setup(nfcReader_t& nfcReader);
+
+/**
+ * The function `nfc_poll_cycle` runs one detection attempt on `nfcReader` and processes the target
+ * if one was found, only returning once it left the field or the removal holdoff expired.
+ *
+ * @return `true` if a target was processed and removed, the next attempt can start right away
+ */
+bool nfc_poll_cycle(nfcReader_t& nfcReader, bool irqMode);
+
+/**
+ * The function `nfc_thread_entry` is the task of one reader, looping over `nfc_poll_cycle` with the
+ * interval of its poll scheduler.
+ */
+void nfc_thread_entry(void* arg);
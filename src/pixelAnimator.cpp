@@ -0,0 +1,90 @@
+#define JSON_NOEXCEPTION 1
+#include "pixelAnimator.h"
+
+std::unique_ptr<Pixel> pixel;
+pixelAnimator_t pixelAnimator;
+
+void pixelAnimator_t::addFrame(animation_t& animation, uint32_t ms, const std::function<Pixel::Color(uint8_t)>& color) {
+  for (uint8_t i = 0; i < count; i++) animation.colors.push_back(color(i));
+  animation.holds.push_back(std::max<uint32_t>(1, ms / tickMs));
+}
+
+void pixelAnimator_t::rebuild() {
+  espConfig::lock_t lock;
+  auto&& success = espConfig::miscConfig.neopixelSuccessColor;
+  auto&& failure = espConfig::miscConfig.neopixelFailureColor;
+  count = std::max<uint8_t>(1, espConfig::miscConfig.neopixelCount);
+  for (auto&& animation : animations) animation = animation_t{};
+  addFrame(animations[OFF], 1000, [](uint8_t) { return Pixel::RGB(0, 0, 0); });
+  animations[OFF].loop = true;
+  // one breath every ~3s, between 2% and 25% brightness
+  for (int i = 0; i < 3000 / int(tickMs); i++) {
+    uint32_t level = 5 + (59 * (1 - cosf(2 * M_PI * i * tickMs / 3000)) / 2);
+    addFrame(animations[IDLE], tickMs, [&](uint8_t) { return scaled(success, level); });
+  }
+  animations[IDLE].loop = true;
+  addFrame(animations[OFFLINE], 200, [&](uint8_t) { return scaled(failure, 64); });
+  addFrame(animations[OFFLINE], 1800, [](uint8_t) { return Pixel::RGB(0, 0, 0); });
+  animations[OFFLINE].loop = true;
+  // a single lit pixel running along the strip for up to 2s, pulsing when there is only one pixel
+  for (int i = 0; i < 2000 / int(tickMs); i++) {
+    uint8_t lit = (i / 2) % count;
+    uint32_t level = count > 1 ? 128 : (i % 10 < 5 ? 128 : 32);
+    addFrame(animations[PROCESSING], tickMs, [&](uint8_t p) { return p == lit ? scaled(success, level) : Pixel::RGB(0, 0, 0); });
+  }
+  addFrame(animations[SUCCESS], espConfig::miscConfig.neopixelSuccessTime, [&](uint8_t) { return scaled(success, 255); });
+  // three blinks within the configured fail time
+  uint32_t blink = std::max<uint32_t>(tickMs, espConfig::miscConfig.neopixelFailTime / 6);
+  for (int i = 0; i < 3; i++) {
+    addFrame(animations[FAIL], blink, [&](uint8_t) { return scaled(failure, 255); });
+    addFrame(animations[FAIL], blink, [](uint8_t) { return Pixel::RGB(0, 0, 0); });
+  }
+}
+
+void pixelAnimator_t::task_entry(void* arg) {
+  pixelAnimator_t& animator = *static_cast<pixelAnimator_t*>(arg);
+  pattern_t current = NONE;
+  size_t frame = 0;
+  uint16_t remaining = 0;
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (animator.rebuildPending.exchange(false)) {
+      animator.rebuild();
+      current = NONE;
+    }
+    bool push = false;
+    uint8_t requested = animator.requested.exchange(NONE);
+    pattern_t target = animator.base();
+    if (requested != NONE) {
+      current = pattern_t(requested);
+      frame = 0;
+      push = true;
+    } else if (current == NONE || (current < PROCESSING && current != target)) {
+      current = target;
+      frame = 0;
+      push = true;
+    } else if (--remaining == 0) {
+      push = true;
+      if (++frame == animator.animations[current].frames()) {
+        frame = 0;
+        if (!animator.animations[current].loop) current = target;
+      }
+    }
+    if (push) {
+      auto&& animation = animator.animations[current];
+      remaining = animation.holds[frame];
+      if (pixel) pixel->set(&animation.colors[frame * animator.count], animator.count);
+    }
+  }
+}
+
+void pixelAnimator_t::begin() {
+  if (task != nullptr) return;
+  xTaskCreate(task_entry, "pixel_task", 3072, this, 2, &task);
+  esp_timer_create_args_t args{};
+  args.callback = timer_cb;
+  args.arg = this;
+  args.name = "pixel";
+  esp_timer_create(&args, &timer);
+  esp_timer_start_periodic(timer, tickMs * 1000);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <src/extras/Pixel.h>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+#include "espConfig.h"
+
+// the NeoPixel strip, created once `nfcNeopixelPin` is set
+extern std::unique_ptr<Pixel> pixel;
+
+/**
+ * NeoPixel animations. Every pattern is computed once into a list of frames, each frame holding the
+ * color of every pixel on the strip and how many ticks it stays on, so playing a pattern never does
+ * any color math. A periodic `esp_timer` wakes a small task every tick which only pushes a frame
+ * through HomeSpan's RMT driver when it changes. `play` just stores the requested pattern, so the NFC
+ * and actions tasks never wait on the LEDs.
+ *
+ * One-shot patterns (processing, success, fail) fall back to the base pattern once they are done:
+ * a slow blink while MQTT is configured but disconnected, otherwise the idle breathe or off. The MQTT
+ * code keeps `offline` up to date.
+ */
+struct pixelAnimator_t
+{
+  enum pattern_t : uint8_t
+  {
+    OFF,
+    IDLE,
+    OFFLINE,
+    PROCESSING,
+    SUCCESS,
+    FAIL,
+    PATTERNS,
+    NONE = 0xFF
+  };
+  static constexpr uint32_t tickMs = 40;
+  struct animation_t
+  {
+    std::vector<Pixel::Color> colors;
+    std::vector<uint16_t> holds;
+    bool loop = false;
+    size_t frames() const { return holds.size(); }
+  };
+  std::array<animation_t, PATTERNS> animations;
+  std::atomic<uint8_t> requested{ NONE };
+  std::atomic<bool> rebuildPending{ true };
+  std::atomic<bool> offline{ false };
+  TaskHandle_t task = nullptr;
+  esp_timer_handle_t timer = nullptr;
+  uint8_t count = 1;
+
+  static Pixel::Color scaled(const std::map<espConfig::misc_config_t::colorMap, int>& color, uint32_t level) {
+    return Pixel::RGB(color.at(espConfig::misc_config_t::colorMap::R) * level / 255, color.at(espConfig::misc_config_t::colorMap::G) * level / 255, color.at(espConfig::misc_config_t::colorMap::B) * level / 255);
+  }
+  void addFrame(animation_t& animation, uint32_t ms, const std::function<Pixel::Color(uint8_t)>& color);
+  void rebuild();
+  pattern_t base() const {
+    if (offline) return OFFLINE;
+    return espConfig::misc(&espConfig::misc_config_t::neopixelIdleBreathe) ? IDLE : OFF;
+  }
+  void play(pattern_t pattern) {
+    requested = pattern;
+  }
+  static void timer_cb(void* arg) {
+    xTaskNotifyGive(static_cast<pixelAnimator_t*>(arg)->task);
+  }
+  static void task_entry(void* arg);
+  void begin();
+};
+
+extern pixelAnimator_t pixelAnimator;
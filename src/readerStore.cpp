@@ -0,0 +1,212 @@
+#define JSON_NOEXCEPTION 1
+#include "readerStore.h"
+#include <esp_rom_crc.h>
+#include "espConfig.h"
+
+static const char* TAG = "readerStore";
+
+nvs_handle readerDataSink;
+readerData_t readerData;
+SemaphoreHandle_t readerDataMutex = xSemaphoreCreateMutex();
+readerStore_t readerStore;
+
+uint16_t readerStore_t::slotFor(const std::vector<uint8_t>& key, std::map<std::vector<uint8_t>, uint16_t>& previous, std::map<std::vector<uint8_t>, uint16_t>& current, bool& allocated) {
+  auto it = previous.find(key);
+  if (it != previous.end()) {
+    current[key] = it->second;
+    previous.erase(it);
+    return current[key];
+  }
+  uint16_t slot;
+  do {
+    slot = nextSlot++;
+  } while (slotUsed(slot, previous) || slotUsed(slot, current));
+  current[key] = slot;
+  allocated = true;
+  return slot;
+}
+
+bool readerStore_t::write(const std::string& key, const std::vector<uint8_t>& data) {
+  uint32_t crc = esp_rom_crc32_le(0, data.data(), data.size());
+  auto it = stored.find(key);
+  if (it != stored.end() && it->second == crc) return true;
+  esp_err_t set_nvs = nvs_set_blob(handle, key.c_str(), data.data(), data.size());
+  if (set_nvs != ESP_OK) {
+    LOG(E, "Could not write record %s: %s", key.c_str(), esp_err_to_name(set_nvs));
+    stored.erase(key);
+    return false;
+  }
+  stored[key] = crc;
+  recordsWritten++;
+  bytesWritten += data.size();
+  return true;
+}
+
+void readerStore_t::erase(const std::string& key) {
+  nvs_erase_key(handle, key.c_str());
+  stored.erase(key);
+}
+
+bool readerStore_t::read(const std::string& key, nlohmann::json& data) {
+  size_t len;
+  if (nvs_get_blob(handle, key.c_str(), NULL, &len) != ESP_OK) return false;
+  std::vector<uint8_t> buf(len);
+  nvs_get_blob(handle, key.c_str(), buf.data(), &len);
+  data = nlohmann::json::from_msgpack(buf, true, false);
+  if (data.is_discarded()) return false;
+  stored[key] = esp_rom_crc32_le(0, buf.data(), buf.size());
+  return true;
+}
+
+bool readerStore_t::save(const std::vector<uint8_t>* issuerId, uint16_t tap, uint8_t reader) {
+  traceScope_t span(tapTrace_t::NVS, tap, reader);
+  int64_t start = esp_timer_get_time();
+  bool ok = true;
+  bool allocated = false;
+  std::map<std::vector<uint8_t>, uint16_t> issuersNow;
+  std::map<std::vector<uint8_t>, uint16_t> endpointsNow;
+  nlohmann::json manifest;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  xSemaphoreTake(readerDataMutex, portMAX_DELAY);
+  manifest["next"] = nextSlot;
+  manifest["issuers"] = nlohmann::json::array();
+  if (issuerId == nullptr) {
+    nlohmann::json reader = { {"reader_sk", readerData.reader_sk}, {"reader_pk", readerData.reader_pk}, {"reader_pk_x", readerData.reader_pk_x}, {"reader_gid", readerData.reader_gid}, {"reader_id", readerData.reader_id} };
+    ok &= write("reader", nlohmann::json::to_msgpack(reader));
+  }
+  for (auto&& issuer : readerData.issuers) {
+    bool selected = issuerId == nullptr || *issuerId == issuer.issuer_id;
+    bool fresh = false;
+    uint16_t slot = slotFor(issuer.issuer_id, issuerSlots, issuersNow, fresh);
+    allocated |= fresh;
+    if (selected || fresh) {
+      nlohmann::json record = { {"issuer_id", issuer.issuer_id}, {"issuer_pk", issuer.issuer_pk}, {"issuer_pk_x", issuer.issuer_pk_x} };
+      ok &= write("i" + std::to_string(slot), nlohmann::json::to_msgpack(record));
+    }
+    nlohmann::json endpoints = nlohmann::json::array();
+    for (auto&& endpoint : issuer.endpoints) {
+      fresh = false;
+      uint16_t endpointSlot = slotFor(endpointKey(issuer, endpoint), endpointSlots, endpointsNow, fresh);
+      allocated |= fresh;
+      if (selected || fresh) {
+        ok &= write("e" + std::to_string(endpointSlot), nlohmann::json::to_msgpack(nlohmann::json(endpoint)));
+      }
+      endpoints.push_back(endpointSlot);
+    }
+    manifest["issuers"].push_back({ slot, endpoints });
+  }
+  xSemaphoreGive(readerDataMutex);
+  bool removed = !issuerSlots.empty() || !endpointSlots.empty();
+  for (auto&& entry : issuerSlots) {
+    erase("i" + std::to_string(entry.second));
+  }
+  for (auto&& entry : endpointSlots) {
+    erase("e" + std::to_string(entry.second));
+  }
+  issuerSlots.swap(issuersNow);
+  endpointSlots.swap(endpointsNow);
+  if (allocated || removed || stored.count("manifest") == 0) {
+    manifest["next"] = nextSlot;
+    ok &= write("manifest", nlohmann::json::to_msgpack(manifest));
+  }
+  esp_err_t commit_nvs = nvs_commit(handle);
+  purgeLibrary();
+  xSemaphoreGive(mutex);
+  LOG(D, "NVS COMMIT STATUS: %s", esp_err_to_name(commit_nvs));
+  uint32_t elapsed = esp_timer_get_time() - start;
+  saves++;
+  lastSaveUs = elapsed;
+  if (elapsed > maxSaveUs) maxSaveUs = elapsed;
+  return ok && commit_nvs == ESP_OK;
+}
+
+void readerStore_t::purgeLibrary() {
+  size_t len;
+  if (nvs_get_blob(readerDataSink, "READERDATA", NULL, &len) != ESP_OK) return;
+  LOG(V, "Purging the library's READERDATA blob (%d bytes)", len);
+  nvs_erase_all(readerDataSink);
+  nvs_commit(readerDataSink);
+}
+
+bool readerStore_t::loadShards() {
+  nlohmann::json manifest;
+  nlohmann::json data;
+  if (!read("manifest", manifest)) return false;
+  if (!read("reader", data)) {
+    LOG(E, "Reader record missing, ignoring the stored reader data");
+    return false;
+  }
+  nextSlot = manifest.value("next", 0);
+  data["issuers"] = nlohmann::json::array();
+  for (auto&& entry : manifest["issuers"]) {
+    uint16_t slot = entry.at(0);
+    nlohmann::json issuer;
+    if (!read("i" + std::to_string(slot), issuer)) {
+      LOG(E, "Issuer record i%d missing, skipping", slot);
+      continue;
+    }
+    std::vector<uint8_t> issuerKey = issuer.at("issuer_id");
+    issuerSlots[issuerKey] = slot;
+    issuer["endpoints"] = nlohmann::json::array();
+    for (uint16_t endpointSlot : entry.at(1)) {
+      nlohmann::json endpoint;
+      if (!read("e" + std::to_string(endpointSlot), endpoint)) {
+        LOG(E, "Endpoint record e%d missing, skipping", endpointSlot);
+        continue;
+      }
+      std::vector<uint8_t> endpointKey(issuerKey);
+      for (uint8_t byte : endpoint.at("endpoint_id")) endpointKey.push_back(byte);
+      endpointSlots[endpointKey] = endpointSlot;
+      issuer["endpoints"].push_back(endpoint);
+    }
+    data["issuers"].push_back(issuer);
+  }
+  data.get_to<readerData_t>(readerData);
+  return true;
+}
+
+void readerStore_t::begin() {
+  nvs_open("HK_READER", NVS_READWRITE, &handle);
+  nvs_open("HK_LIBRARY", NVS_READWRITE, &readerDataSink);
+  // a blob the library wrote right before a reset, the records were saved before it anyway
+  purgeLibrary();
+  if (loadShards()) {
+    LOG(I, "Reader Data loaded from NVS: %d issuers", readerData.issuers.size());
+    return;
+  }
+  size_t len;
+  if (nvs_get_blob(savedData, "READERDATA", NULL, &len) != ESP_OK) return;
+  std::vector<uint8_t> savedBuf(len);
+  nvs_get_blob(savedData, "READERDATA", savedBuf.data(), &len);
+  LOG(D, "NVS READERDATA LENGTH: %d", len);
+  nlohmann::json data = nlohmann::json::from_msgpack(savedBuf, true, false);
+  if (data.is_discarded()) return;
+  data.get_to<readerData_t>(readerData);
+  if (save()) {
+    nvs_erase_key(savedData, "READERDATA");
+    nvs_commit(savedData);
+    LOG(I, "Reader Data migrated from the READERDATA blob: %d issuers", readerData.issuers.size());
+  } else {
+    LOG(E, "Could not migrate the READERDATA blob, keeping it");
+  }
+}
+
+void readerStore_t::clear() {
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  esp_err_t erase_nvs = nvs_erase_all(handle);
+  esp_err_t commit_nvs = nvs_commit(handle);
+  LOG(D, "ERASE: %s", esp_err_to_name(erase_nvs));
+  LOG(D, "COMMIT: %s", esp_err_to_name(commit_nvs));
+  nvs_erase_key(savedData, "READERDATA");
+  nvs_commit(savedData);
+  purgeLibrary();
+  issuerSlots.clear();
+  endpointSlots.clear();
+  stored.clear();
+  nextSlot = 0;
+  xSemaphoreGive(mutex);
+}
+
+json readerStore_t::toJson() {
+  return { {"saves", saves.load()}, {"records", recordsWritten.load()}, {"bytes", bytesWritten.load()}, {"lastSaveUs", lastSaveUs.load()}, {"maxSaveUs", maxSaveUs.load()} };
+}
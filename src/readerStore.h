@@ -0,0 +1,88 @@
+#pragma once
+#include <Arduino.h>
+#include <HomeKey.h>
+#include <nvs.h>
+#include <freertos/semphr.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "tapTrace.h"
+
+// handle given to the HomeKey library, the blobs it stores through it are purged, see `readerStore_t`
+extern nvs_handle readerDataSink;
+extern readerData_t readerData;
+// held while `readerData` is read or modified by a reader task or the HomeKit callbacks
+extern SemaphoreHandle_t readerDataMutex;
+
+/**
+ * Reader data persisted as one NVS record per item instead of a single blob, so an enrollment or a
+ * tap only rewrites the records it touched. Records live in their own namespace:
+ *   - `reader`    reader keys and identifiers
+ *   - `i<slot>`   an issuer without its endpoints
+ *   - `e<slot>`   one endpoint
+ *   - `manifest`  issuer slots in order, each with the slots of its endpoints
+ * Slots are allocated once per issuer/endpoint and kept for its lifetime, so adding or removing one
+ * doesn't shift the others. The CRC of every record as stored is kept in memory and records are only
+ * written when their encoding changed, the manifest itself is only rewritten when the set of issuers or
+ * endpoints changes.
+ *
+ * The HomeKey library writes the whole reader data under `READERDATA` on its own. It is handed
+ * `readerDataSink`, a handle on the throwaway `HK_LIBRARY` namespace nothing is ever read from, and
+ * `purgeLibrary` erases what it wrote there. Persistence goes through `save`, which is called explicitly
+ * after every change the library makes: enrollment via `NFCAccess::update` and each successful
+ * authentication. A `READERDATA` blob left in `SAVED_DATA` by an older firmware is migrated on boot and
+ * erased afterwards.
+ */
+struct readerStore_t
+{
+  nvs_handle handle;
+  SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+  uint16_t nextSlot = 0;
+  std::map<std::vector<uint8_t>, uint16_t> issuerSlots;
+  std::map<std::vector<uint8_t>, uint16_t> endpointSlots;
+  std::map<std::string, uint32_t> stored;
+  std::atomic<uint32_t> saves{ 0 };
+  std::atomic<uint32_t> recordsWritten{ 0 };
+  std::atomic<uint32_t> bytesWritten{ 0 };
+  std::atomic<uint32_t> lastSaveUs{ 0 };
+  std::atomic<uint32_t> maxSaveUs{ 0 };
+
+  static std::vector<uint8_t> endpointKey(const hkIssuer_t& issuer, const hkEndpoint_t& endpoint) {
+    std::vector<uint8_t> key(issuer.issuer_id);
+    key.insert(key.end(), endpoint.endpoint_id.begin(), endpoint.endpoint_id.end());
+    return key;
+  }
+  bool slotUsed(uint16_t slot, const std::map<std::vector<uint8_t>, uint16_t>& slots) {
+    for (auto&& entry : slots) {
+      if (entry.second == slot) return true;
+    }
+    return false;
+  }
+  /* Returns the slot of `key`, carried over from `previous` or newly allocated */
+  uint16_t slotFor(const std::vector<uint8_t>& key, std::map<std::vector<uint8_t>, uint16_t>& previous, std::map<std::vector<uint8_t>, uint16_t>& current, bool& allocated);
+  bool write(const std::string& key, const std::vector<uint8_t>& data);
+  void erase(const std::string& key);
+  bool read(const std::string& key, nlohmann::json& data);
+  /**
+   * Persists `readerData`. With `issuerId` set only the records of that issuer and records without a
+   * slot yet are encoded and compared, which is all a tap can change. `tap` and `reader` tag the trace
+   * span of a save made for a tap.
+   */
+  bool save(const std::vector<uint8_t>* issuerId = nullptr, uint16_t tap = 0, uint8_t reader = tapTrace_t::noReader);
+  /**
+   * Erases the `HK_LIBRARY` namespace if the library left its blob there, so it never holds more than
+   * the one copy written since the last save. Called by `save`, `begin` and `clear`.
+   */
+  void purgeLibrary();
+  /* Rebuilds `readerData` from the records listed in the manifest */
+  bool loadShards();
+  void begin();
+  /**
+   * Erases every record, the caller clears `readerData`. A `READERDATA` blob whose migration failed is
+   * erased too, otherwise the next boot would migrate the deleted reader data back.
+   */
+  void clear();
+  json toJson();
+};
+
+extern readerStore_t readerStore;
@@ -0,0 +1,72 @@
+#define JSON_NOEXCEPTION 1
+#include "tapPayload.h"
+#include "readerStore.h"
+
+tapBatch_t tapBatch;
+
+std::string hex_representation(const uint8_t* data, size_t len) {
+  static constexpr char digits[] = "0123456789ABCDEF";
+  std::string hex_tmp(len * 2, '0');
+  for (size_t i = 0; i < len; i++) {
+    hex_tmp[i * 2] = digits[data[i] >> 4];
+    hex_tmp[i * 2 + 1] = digits[data[i] & 0x0F];
+  }
+  return hex_tmp;
+}
+
+std::string hex_representation(const std::vector<uint8_t>& v) {
+  return hex_representation(v.data(), v.size());
+}
+
+json tap_event_json(const busEvent_t& event, uint32_t seq) {
+  json payload;
+  if (event.type == busEvent_t::HOMEKEY_SUCCESS) {
+    payload["issuerId"] = hex_representation(event.issuerId.data(), event.issuerId.size());
+    payload["endpointId"] = hex_representation(event.id.data(), event.idLen);
+    payload["readerId"] = hex_representation(readerData.reader_id);
+    payload["homekey"] = true;
+  } else {
+    payload["atqa"] = hex_representation(event.atqa.data(), event.atqa.size());
+    payload["sak"] = hex_representation(&event.sak, 1);
+    payload["uid"] = hex_representation(event.id.data(), event.idLen);
+    payload["allowed"] = event.allowed;
+    payload["homekey"] = false;
+  }
+  payload["nfcReader"] = event.reader;
+  if (seq != 0) {
+    payload["replayed"] = true;
+    payload["seq"] = seq;
+  }
+  return payload;
+}
+
+void tapBatch_t::add(const busEvent_t& event, uint32_t seq) {
+  if (events.empty()) first = esp_timer_get_time();
+  json entry = json::array();
+  entry.push_back(event.type);
+  entry.push_back(event.reader);
+  entry.push_back(event.tap);
+  entry.push_back(seq);
+  entry.push_back(json::binary(std::vector<uint8_t>(event.id.begin(), event.id.begin() + event.idLen)));
+  if (event.type == busEvent_t::HOMEKEY_SUCCESS) {
+    entry.push_back(json::binary(std::vector<uint8_t>(event.issuerId.begin(), event.issuerId.end())));
+  } else {
+    entry.push_back(nullptr);
+  }
+  entry.push_back(json::binary(std::vector<uint8_t>(event.atqa.begin(), event.atqa.end())));
+  entry.push_back(event.sak);
+  entry.push_back(event.allowed);
+  events.push_back(std::move(entry));
+  replayed |= seq != 0;
+}
+
+std::vector<uint8_t> tapBatch_t::flush() {
+  json payload;
+  payload["v"] = version;
+  payload["r"] = json::binary(readerData.reader_id);
+  payload["e"] = std::move(events);
+  std::vector<uint8_t> packed = json::to_msgpack(payload);
+  events = json::array();
+  replayed = false;
+  return packed;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <Arduino.h>
+#include <HomeKey.h>
+#include <esp_timer.h>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "eventBus.h"
+
+/**
+ * The function `hex_representation` formats `len` bytes as uppercase hex, two digits per byte.
+ */
+std::string hex_representation(const uint8_t* data, size_t len);
+std::string hex_representation(const std::vector<uint8_t>& v);
+
+/**
+ * The function `tap_event_json` builds the payload published on the `hkTopic` for a HomeKey or tag
+ * event. `seq` is the journal sequence number of a replayed event, 0 for live events.
+ */
+json tap_event_json(const busEvent_t& event, uint32_t seq);
+
+/**
+ * Tap events for the optional binary topic, encoded with msgpack. Events arriving close together are
+ * sent as one publish, a map holding the schema version `v`, the reader ID `r` and `e`, one array per
+ * event: `[type, nfcReader, tap, seq, id, issuerId, atqa, sak, allowed]`. `type` is 0 for HomeKey and
+ * 2 for other tags, `id` is the endpoint ID or the UID, `issuerId` is nil for tags, `seq` is 0 for
+ * live events and the journal sequence number for replayed ones.
+ */
+struct tapBatch_t
+{
+  static constexpr uint8_t version = 1;
+  json events = json::array();
+  int64_t first = 0;
+  bool replayed = false;
+
+  void add(const busEvent_t& event, uint32_t seq);
+  bool pending() const {
+    return !events.empty();
+  }
+  /* Time left in ms before the batch has to go out */
+  uint32_t remaining(int64_t now) const {
+    if (events.size() >= MQTT_BINARY_BATCH) return 0;
+    int64_t left = first + int64_t(MQTT_BINARY_BATCH_WINDOW) * 1000 - now;
+    return left > 0 ? left / 1000 : 0;
+  }
+  /* Encodes the batch and starts a new one, the caller publishes the returned bytes */
+  std::vector<uint8_t> flush();
+};
+
+extern tapBatch_t tapBatch;
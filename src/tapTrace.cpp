@@ -0,0 +1,27 @@
+#define JSON_NOEXCEPTION 1
+#include "tapTrace.h"
+
+tapTrace_t tapTrace;
+
+json tapTrace_t::summary() const {
+  auto copy = std::make_unique<std::array<span_t, capacity>>();
+  size_t count = snapshot(*copy);
+  std::array<uint32_t, capacity> durations;
+  json result;
+  for (uint8_t phase = 0; phase < PHASES; phase++) {
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+      if ((*copy)[i].phase == phase) durations[n++] = (*copy)[i].duration;
+    }
+    if (n == 0) continue;
+    std::sort(durations.begin(), durations.begin() + n);
+    json stats;
+    stats["count"] = n;
+    stats["p50_us"] = durations[(n - 1) * 50 / 100];
+    stats["p95_us"] = durations[(n - 1) * 95 / 100];
+    stats["p99_us"] = durations[(n - 1) * 99 / 100];
+    stats["max_us"] = durations[n - 1];
+    result[phaseNames[phase]] = stats;
+  }
+  return result;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <Arduino.h>
+#include <HomeKey.h>
+#include <esp_timer.h>
+#include <array>
+#include <atomic>
+
+/**
+ * Allocation-free tap tracing. Spans are fixed-size records written into a ring buffer from any task,
+ * the buffer can be downloaded in Chrome trace-event format (chrome://tracing, Perfetto) and summarized
+ * per phase as p50/p95/p99. Spans are tagged with the tap and reader they belong to, both passed in by
+ * the caller as several readers can be in a tap at once. Spans recorded outside a tap (e.g. NVS writes
+ * from pairing) carry tap 0 and `noReader`.
+ */
+struct tapTrace_t
+{
+  enum phase_t : uint8_t
+  {
+    ECP,
+    DETECT,
+    SELECT,
+    AUTH_CTX,
+    AUTH,
+    DISPATCH,
+    NVS,
+    GPIO,
+    MQTT,
+    TAP,
+    PHASES
+  };
+  static constexpr std::array<const char*, PHASES> phaseNames = { "ecp", "detect", "select", "auth_ctx", "auth", "dispatch", "nvs", "gpio", "mqtt", "tap" };
+  static constexpr uint8_t noReader = 255;
+  struct span_t
+  {
+    int64_t start;
+    uint32_t duration;
+    uint16_t tap;
+    phase_t phase;
+    uint8_t reader;
+  };
+  static constexpr size_t capacity = 256;
+  std::array<span_t, capacity> spans{};
+  std::atomic<uint32_t> head{ 0 };
+  std::atomic<uint16_t> lastTap{ 0 };
+
+  /* Returns the ID of a new tap, never 0 */
+  uint16_t beginTap() {
+    uint16_t tap = ++lastTap;
+    return tap ? tap : ++lastTap;
+  }
+  void record(phase_t phase, int64_t start, int64_t end, uint16_t tap = 0, uint8_t reader = noReader) {
+    uint32_t i = head.fetch_add(1) % capacity;
+    spans[i] = { start, uint32_t(end - start), tap, phase, reader };
+  }
+  /* Copies the spans currently in the buffer, oldest first */
+  size_t snapshot(std::array<span_t, capacity>& out) const {
+    uint32_t end = head.load();
+    size_t count = std::min<uint32_t>(end, capacity);
+    for (size_t i = 0; i < count; i++) {
+      out[i] = spans[(end - count + i) % capacity];
+    }
+    return count;
+  }
+  json summary() const;
+};
+
+extern tapTrace_t tapTrace;
+
+/**
+ * Records a span for the lifetime of the object.
+ */
+struct traceScope_t
+{
+  tapTrace_t::phase_t phase;
+  uint16_t tap;
+  uint8_t reader;
+  int64_t start = esp_timer_get_time();
+  traceScope_t(tapTrace_t::phase_t phase, uint16_t tap = 0, uint8_t reader = tapTrace_t::noReader) : phase(phase), tap(tap), reader(reader) {}
+  ~traceScope_t() { tapTrace.record(phase, start, esp_timer_get_time(), tap, reader); }
+};
@@ -0,0 +1,240 @@
+#define JSON_NOEXCEPTION 1
+#include "uidAllowlist.h"
+#include <HomeKey.h>
+
+static const char* TAG = "uidAllowlist";
+
+uidAllowlist_t uidAllowlist;
+
+void uidAllowlist_t::load() {
+  std::fill(bloom.begin(), bloom.end(), 0);
+  fence.clear();
+  count = 0;
+  File file = LittleFS.open(path, "r");
+  if (!file) return;
+  count = file.size() / sizeof(uint64_t);
+  std::array<uint64_t, stride> block;
+  for (size_t i = 0; i < count; i += stride) {
+    size_t n = std::min(stride, count - i);
+    file.read(reinterpret_cast<uint8_t*>(block.data()), n * sizeof(uint64_t));
+    fence.push_back(block[0]);
+    for (size_t j = 0; j < n; j++) {
+      bloomBits(block[j], [this](uint32_t bit) { bloom[bit / 32] |= 1u << (bit % 32); });
+    }
+  }
+  file.close();
+}
+
+void uidAllowlist_t::begin() {
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  load();
+  xSemaphoreGive(mutex);
+  LOG(I, "UID allowlist: %d entries", count);
+}
+
+bool uidAllowlist_t::contains(const uint8_t* uid, size_t len) {
+  uint64_t key = makeKey(uid, len);
+  bool maybe = true;
+  bloomBits(key, [&](uint32_t bit) { maybe &= (bloom[bit / 32] >> (bit % 32)) & 1; });
+  if (!maybe) return false;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  bool found = false;
+  auto it = std::upper_bound(fence.begin(), fence.end(), key);
+  if (it != fence.begin()) {
+    size_t first = (std::distance(fence.begin(), it) - 1) * stride;
+    size_t n = std::min(stride, count - first);
+    std::array<uint64_t, stride> block;
+    File file = LittleFS.open(path, "r");
+    if (file && file.seek(first * sizeof(uint64_t)) && file.read(reinterpret_cast<uint8_t*>(block.data()), n * sizeof(uint64_t)) == n * sizeof(uint64_t)) {
+      found = std::binary_search(block.begin(), block.begin() + n, key);
+    }
+    file.close();
+  }
+  xSemaphoreGive(mutex);
+  return found;
+}
+
+uint32_t uidAllowlist_t::stageBegin() {
+  if (xSemaphoreTake(stageMutex, 0) != pdTRUE) return 0;
+  int64_t now = esp_timer_get_time();
+  if (activeLoad != 0 && now - loadActive < int64_t(UID_ALLOWLIST_LOAD_TIMEOUT) * 1000000) {
+    xSemaphoreGive(stageMutex);
+    return 0;
+  }
+  if (activeLoad != 0) LOG(W, "UID allowlist load %u idle, dropping it", unsigned(activeLoad));
+  if (++lastLoad == 0) lastLoad = 1;
+  activeLoad = lastLoad;
+  loadActive = now;
+  staging.clear();
+  runs.clear();
+  LittleFS.remove(runsPath);
+  staged = 0;
+  stageFailed = false;
+  partial.clear();
+  rejected = 0;
+  xSemaphoreGive(stageMutex);
+  return lastLoad;
+}
+
+void uidAllowlist_t::stageAbort(uint32_t id) {
+  if (id == 0 || activeLoad != id) return;
+  xSemaphoreTake(stageMutex, portMAX_DELAY);
+  if (activeLoad == id) {
+    std::vector<uint64_t>().swap(staging);
+    runs.clear();
+    LittleFS.remove(runsPath);
+    partial.clear();
+    activeLoad = 0;
+  }
+  xSemaphoreGive(stageMutex);
+}
+
+void uidAllowlist_t::flushRun() {
+  if (staging.empty()) return;
+  std::sort(staging.begin(), staging.end());
+  staging.erase(std::unique(staging.begin(), staging.end()), staging.end());
+  File file = LittleFS.open(runsPath, runs.empty() ? "w" : "a", true);
+  if (file && file.write(reinterpret_cast<const uint8_t*>(staging.data()), staging.size() * sizeof(uint64_t)) == staging.size() * sizeof(uint64_t)) {
+    runs.push_back(staging.size());
+  } else {
+    stageFailed = true;
+  }
+  file.close();
+  staging.clear();
+}
+
+bool uidAllowlist_t::mergeRuns(const char* out) {
+  struct cursor_t
+  {
+    size_t offset;
+    size_t end;
+    size_t pos = 0;
+    size_t len = 0;
+    std::array<uint64_t, 32> block;
+  };
+  File in = LittleFS.open(runsPath, "r");
+  File file = LittleFS.open(out, "w", true);
+  if (!file || (!runs.empty() && !in)) return false;
+  std::vector<cursor_t> cursors(runs.size());
+  size_t offset = 0;
+  for (size_t i = 0; i < runs.size(); i++) {
+    cursors[i].offset = offset;
+    cursors[i].end = offset += runs[i];
+  }
+  bool ok = true;
+  auto refill = [&](cursor_t& c) {
+    if (c.pos < c.len) return true;
+    if (c.offset == c.end) return false;
+    size_t n = std::min(c.block.size(), c.end - c.offset);
+    if (!in.seek(c.offset * sizeof(uint64_t)) || in.read(reinterpret_cast<uint8_t*>(c.block.data()), n * sizeof(uint64_t)) != n * sizeof(uint64_t)) {
+      ok = false;
+      c.offset = c.end;
+      return false;
+    }
+    c.offset += n;
+    c.pos = 0;
+    c.len = n;
+    return true;
+  };
+  std::array<uint64_t, stride> block;
+  size_t blockLen = 0;
+  uint64_t last = 0;
+  bool any = false;
+  while (ok) {
+    cursor_t* next = nullptr;
+    for (auto&& c : cursors) {
+      if (refill(c) && (next == nullptr || c.block[c.pos] < next->block[next->pos])) next = &c;
+    }
+    if (next == nullptr) break;
+    uint64_t key = next->block[next->pos++];
+    if (any && key == last) continue;
+    last = key;
+    any = true;
+    block[blockLen++] = key;
+    if (blockLen == block.size()) {
+      ok &= file.write(reinterpret_cast<const uint8_t*>(block.data()), sizeof(block)) == sizeof(block);
+      blockLen = 0;
+    }
+  }
+  ok = ok && file.write(reinterpret_cast<const uint8_t*>(block.data()), blockLen * sizeof(uint64_t)) == blockLen * sizeof(uint64_t);
+  file.close();
+  if (in) in.close();
+  return ok;
+}
+
+void uidAllowlist_t::stageLine(const std::string& line) {
+  uint8_t uid[10];
+  size_t len = 0;
+  int nibble = -1;
+  for (char c : line) {
+    int v = isdigit(c) ? c - '0' : isxdigit(c) ? (tolower(c) - 'a' + 10) : -1;
+    if (v < 0) continue;
+    if (nibble < 0) {
+      nibble = v;
+    } else {
+      if (len == sizeof(uid)) {
+        rejected++;
+        return;
+      }
+      uid[len++] = (nibble << 4) | v;
+      nibble = -1;
+    }
+  }
+  if (len == 0 && nibble < 0) return;
+  if (len < 4 || nibble >= 0 || staged >= UID_ALLOWLIST_MAX_ENTRIES) {
+    rejected++;
+    return;
+  }
+  if (staging.capacity() == 0) staging.reserve(UID_ALLOWLIST_RUN_SIZE);
+  staging.push_back(makeKey(uid, len));
+  staged++;
+  if (staging.size() >= UID_ALLOWLIST_RUN_SIZE) flushRun();
+}
+
+void uidAllowlist_t::stageText(uint32_t id, const char* data, size_t len) {
+  if (id == 0 || activeLoad != id) return;
+  xSemaphoreTake(stageMutex, portMAX_DELAY);
+  if (activeLoad == id) {
+    loadActive = esp_timer_get_time();
+    for (size_t i = 0; i < len; i++) {
+      if (data[i] == '\n' || data[i] == ',') {
+        stageLine(partial);
+        partial.clear();
+      } else partial.push_back(data[i]);
+    }
+  }
+  xSemaphoreGive(stageMutex);
+}
+
+size_t uidAllowlist_t::stageCommit(uint32_t id) {
+  if (id == 0 || activeLoad != id) {
+    if (id != 0) LOG(W, "UID allowlist load %u was dropped, not committing it", unsigned(id));
+    return 0;
+  }
+  // held through the merge so no other load can start staging over the runs
+  xSemaphoreTake(stageMutex, portMAX_DELAY);
+  if (activeLoad != id) {
+    xSemaphoreGive(stageMutex);
+    return 0;
+  }
+  stageLine(partial);
+  partial.clear();
+  flushRun();
+  std::vector<uint64_t>().swap(staging);
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  bool written = !stageFailed && mergeRuns("/allowlist.tmp");
+  LittleFS.remove(runsPath);
+  runs.clear();
+  if (written) {
+    LittleFS.remove(path);
+    LittleFS.rename("/allowlist.tmp", path);
+    load();
+  } else {
+    LOG(E, "Could not write the UID allowlist");
+  }
+  xSemaphoreGive(mutex);
+  activeLoad = 0;
+  xSemaphoreGive(stageMutex);
+  LOG(I, "UID allowlist loaded: %d entries, %d rejected", count, rejected);
+  return written ? count : 0;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <esp_timer.h>
+#include <freertos/semphr.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "config.h"
+
+/**
+ * Local allowlist of non-HomeKey UIDs, so known tags can operate the lock without a round trip to
+ * Home Assistant and while the network is down.
+ *
+ * UIDs are reduced to 64-bit keys: the UID length in the top byte and the UID itself below it, UIDs
+ * longer than 7 bytes are hashed into the lower 56 bits instead. The keys are kept sorted in a LittleFS
+ * file, while RAM only holds a Bloom filter and every 64th key as a sparse index, so a lookup that passes
+ * the Bloom filter costs a single 512 byte read followed by a binary search.
+ *
+ * The list is replaced as a whole: `stageBegin`, any number of `stageText` chunks with one hex UID per
+ * line, then `stageCommit`, which is how both the HTTP and MQTT bulk loads feed it. The whole list
+ * doesn't fit in RAM next to everything else, staged keys are sorted `UID_ALLOWLIST_RUN_SIZE` at a time
+ * into runs appended to a LittleFS file, which `stageCommit` merges into the new list.
+ *
+ * One load stages at a time: `stageBegin` hands out a load ID, or 0 while another load is running, and
+ * the other calls only act for that ID. A load the HTTP client or the MQTT publisher abandoned halfway
+ * is taken over once it has been idle for `UID_ALLOWLIST_LOAD_TIMEOUT`.
+ */
+struct uidAllowlist_t
+{
+  static constexpr const char* path = "/allowlist.bin";
+  static constexpr const char* runsPath = "/allowlist.runs";
+  static constexpr size_t stride = 64;
+  std::vector<uint64_t> fence;
+  std::vector<uint32_t> bloom = std::vector<uint32_t>(UID_ALLOWLIST_BLOOM_BITS / 32);
+  size_t count = 0;
+  SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+  // guards the staging state below, held by the load staging or merging
+  SemaphoreHandle_t stageMutex = xSemaphoreCreateMutex();
+  std::atomic<uint32_t> activeLoad{ 0 }; // ID of the load owning the staging state, 0 when none
+  uint32_t lastLoad = 0;
+  int64_t loadActive = 0; // esp_timer_get_time() of the last call of that load
+  std::vector<uint64_t> staging;
+  std::vector<size_t> runs; // length of every run in `runsPath`, in order
+  size_t staged = 0;
+  bool stageFailed = false;
+  std::string partial;
+  size_t rejected = 0;
+
+  static uint64_t makeKey(const uint8_t* uid, size_t len) {
+    uint64_t key = uint64_t(len) << 56;
+    if (len <= 7) {
+      for (size_t i = 0; i < len; i++) key |= uint64_t(uid[i]) << (8 * (6 - i));
+    } else {
+      uint64_t hash = 0xcbf29ce484222325ull;
+      for (size_t i = 0; i < len; i++) hash = (hash ^ uid[i]) * 0x100000001b3ull;
+      key |= hash & 0x00FFFFFFFFFFFFFFull;
+    }
+    return key;
+  }
+  template <typename F>
+  static void bloomBits(uint64_t key, F&& visit) {
+    // the UID sits in the upper bytes of the key, mix them all into the bits the modulo keeps
+    uint64_t h = key;
+    h = (h ^ (h >> 33)) * 0xFF51AFD7ED558CCDull;
+    h = (h ^ (h >> 33)) * 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    uint32_t h1 = h, h2 = (h >> 32) | 1;
+    for (uint32_t i = 0; i < 3; i++) visit((h1 + i * h2) % UID_ALLOWLIST_BLOOM_BITS);
+  }
+  /* Rebuilds the Bloom filter and sparse index from the file, call with the mutex held */
+  void load();
+  void begin();
+  bool contains(const uint8_t* uid, size_t len);
+  /* Starts a load and returns its ID, 0 while another one is staging or merging */
+  uint32_t stageBegin();
+  /* Drops the keys staged by load `id` and frees the staging state for the next one */
+  void stageAbort(uint32_t id);
+  /* Sorts the staged keys and appends them to `runsPath` as one run */
+  void flushRun();
+  /**
+   * Merges the runs into a single sorted list without duplicates at `out`. Every run is read through
+   * a small block of its own, so RAM use depends on the number of runs only.
+   */
+  bool mergeRuns(const char* out);
+  void stageLine(const std::string& line);
+  void stageText(uint32_t id, const char* data, size_t len);
+  /**
+   * Merges the keys staged by load `id` and swaps them in as the new list, returns the number of
+   * entries, 0 if the list couldn't be written or `id` no longer owns the staging state.
+   */
+  size_t stageCommit(uint32_t id);
+};
+
+extern uidAllowlist_t uidAllowlist;
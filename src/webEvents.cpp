@@ -0,0 +1,106 @@
+#define JSON_NOEXCEPTION 1
+#include "webEvents.h"
+#include <WiFi.h>
+#include <utils.h>
+
+static const char* TAG = "webEvents";
+
+webEvents_t webEvents;
+
+void webEvents_t::publish(const char* event, const json& data) {
+  char buffer[frameSize];
+  std::string payload = data.dump();
+  int len = snprintf(buffer, frameSize, "event: %s\ndata: %s\n\n", event, payload.c_str());
+  if (len < 0 || size_t(len) >= frameSize) {
+    LOG(W, "Dropping %s event of %d bytes", event, len);
+    return;
+  }
+  uint32_t ticket = head.load(std::memory_order_relaxed);
+  frame_t& frame = frames[ticket % capacity];
+  frame.seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(frame.data, buffer, len);
+  frame.len = len;
+  frame.seq.store(ticket + 1, std::memory_order_release);
+  head.store(ticket + 1, std::memory_order_release);
+}
+
+size_t webEvents_t::fill(stream_t& stream, uint8_t* buffer, size_t maxLen) {
+  uint32_t end = head.load(std::memory_order_acquire);
+  if (end - stream.cursor > capacity) {
+    dropped++;
+    return 0;
+  }
+  size_t written = 0;
+  while (stream.cursor != end) {
+    frame_t& frame = frames[stream.cursor % capacity];
+    uint32_t seq = frame.seq.load(std::memory_order_acquire);
+    if (seq != stream.cursor + 1 || written + frame.len > maxLen) break;
+    memcpy(buffer + written, frame.data, frame.len);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (frame.seq.load(std::memory_order_relaxed) != seq) {
+      dropped++;
+      return 0;
+    }
+    written += frame.len;
+    stream.cursor++;
+  }
+  return written ? written : RESPONSE_TRY_AGAIN;
+}
+
+void webEvents_t::publishTap(const busEvent_t& event) {
+  json tap;
+  tap["reader"] = event.reader;
+  tap["tap"] = event.tap;
+  tap["homekey"] = event.type != busEvent_t::TAG;
+  tap["allowed"] = event.type == busEvent_t::HOMEKEY_SUCCESS || event.allowed;
+  if (event.type == busEvent_t::HOMEKEY_SUCCESS) {
+    tap["issuerId"] = utils::bufToHexString(event.issuerId.data(), event.issuerId.size(), true);
+  }
+  if (event.idLen) {
+    tap["id"] = utils::bufToHexString(event.id.data(), event.idLen, true);
+  }
+  if (event.detected) {
+    tap["latency_ms"] = (event.posted - event.detected) / 1000;
+  }
+  publish("tap", tap);
+}
+
+void webEvents_t::publishStats() {
+  json stats;
+  stats["rssi"] = WiFi.RSSI();
+  stats["heap"] = ESP.getFreeHeap();
+  stats["minHeap"] = ESP.getMinFreeHeap();
+  stats["clients"] = clients.load();
+  stats["dropped"] = dropped.load();
+  publish("stats", stats);
+}
+
+void webEvents_t::task_entry(void* arg) {
+  webEvents_t& events = *static_cast<webEvents_t*>(arg);
+  eventBus_t::subscriber_t* sub = eventBus.subscribe();
+  busEvent_t event;
+  TickType_t lastStats = xTaskGetTickCount();
+  while (1) {
+    while (eventBus.next(*sub, event)) {
+      if (events.clients == 0) continue;
+      if (event.type == busEvent_t::LOCK_STATE) {
+        json lock;
+        lock["state"] = event.lockState;
+        lock["customState"] = event.customState;
+        events.publish("lock", lock);
+      } else {
+        events.publishTap(event);
+      }
+    }
+    if (xTaskGetTickCount() - lastStats >= pdMS_TO_TICKS(WEB_EVENTS_STATS_INTERVAL)) {
+      lastStats = xTaskGetTickCount();
+      if (events.clients) events.publishStats();
+    }
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(WEB_EVENTS_STATS_INTERVAL));
+  }
+}
+
+void webEvents_t::begin() {
+  xTaskCreate(task_entry, "web_events", 4096, this, 1, &task);
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <Arduino.h>
+#include <HomeKey.h>
+#include <ESPAsyncWebServer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <array>
+#include <atomic>
+#include "config.h"
+#include "eventBus.h"
+
+/**
+ * Live event stream served on `/events` as Server-Sent Events: tap results, lock state changes and
+ * periodic Wi-Fi and heap stats as small JSON frames.
+ *
+ * `web_events` is the only producer, it turns bus events into ready to send frames in a broadcast
+ * ring. Every client is a chunked response that copies frames from its own cursor whenever its
+ * connection can take more data, so the producer never waits on a client. A client that falls a
+ * full ring behind has lost frames and its stream is ended instead, the browser reconnects and
+ * continues from the current frame.
+ */
+struct webEvents_t
+{
+  static constexpr size_t capacity = WEB_EVENTS_BUFFER;
+  static constexpr size_t frameSize = 224;
+  struct frame_t
+  {
+    std::atomic<uint32_t> seq{ 0 };
+    uint16_t len = 0;
+    char data[frameSize];
+  };
+  /* Per client state, lives as long as the client's response */
+  struct stream_t
+  {
+    webEvents_t& events;
+    uint32_t cursor;
+    stream_t(webEvents_t& events) : events(events), cursor(events.head.load()) { events.clients++; }
+    ~stream_t() { events.clients--; }
+  };
+  std::array<frame_t, capacity> frames;
+  std::atomic<uint32_t> head{ 0 };
+  std::atomic<uint8_t> clients{ 0 };
+  std::atomic<uint32_t> dropped{ 0 };
+  TaskHandle_t task = nullptr;
+
+  /**
+   * Appends an event to the ring, only ever called from the web events task. The frame is formatted
+   * off the ring so an oversize event leaves the slot untouched, and the slot's seq is cleared before
+   * its bytes change so a client copying it concurrently sees the mismatch and drops the stream.
+   */
+  void publish(const char* event, const json& data);
+  /**
+   * Copies the frames after `stream.cursor` that fit into `buffer`. Returns RESPONSE_TRY_AGAIN when
+   * the client is caught up and 0, ending the stream, when frames it hasn't sent were overwritten.
+   */
+  size_t fill(stream_t& stream, uint8_t* buffer, size_t maxLen);
+  void publishTap(const busEvent_t& event);
+  void publishStats();
+  static void task_entry(void* arg);
+  void begin();
+};
+
+extern webEvents_t webEvents;
@@ -0,0 +1,136 @@
+#define JSON_NOEXCEPTION 1
+#include "webJobs.h"
+#include <HomeSpan.h>
+#include "configRegistry.h"
+#include "uidAllowlist.h"
+
+static const char* TAG = "webJobs";
+
+webJobs_t webJobs;
+
+uint16_t webJobs_t::post(job_t::kind_t kind) {
+  if (queue == nullptr) return 0;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  if (++nextId == 0) nextId = 1;
+  job_t job{ kind, nextId };
+  history[job.id % history.size()] = { job.id, kind, status_t::QUEUED, "" };
+  xSemaphoreGive(mutex);
+  if (xQueueSend(queue, &job, 0) != pdTRUE) {
+    LOG(W, "Web job queue full, dropping %s", kindNames[kind]);
+    update(job.id, status_t::FAILED, "Busy, try again");
+    return 0;
+  }
+  return job.id;
+}
+
+void webJobs_t::update(uint16_t id, status_t::state_t state, std::string message) {
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  status_t& status = history[id % history.size()];
+  if (status.id == id) {
+    status.state = state;
+    status.message = std::move(message);
+  }
+  xSemaphoreGive(mutex);
+}
+
+bool webJobs_t::status(uint16_t id, json& result) {
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  const status_t& status = history[id % history.size()];
+  bool found = id && status.id == id;
+  if (found) {
+    result["id"] = status.id;
+    result["kind"] = kindNames[status.kind];
+    result["state"] = stateNames[status.state];
+    result["message"] = status.message;
+  }
+  xSemaphoreGive(mutex);
+  return found;
+}
+
+void webJobs_t::restart() {
+  // leave the client time to fetch the outcome
+  vTaskDelay(pdMS_TO_TICKS(1000));
+  ESP.restart();
+}
+
+void webJobs_t::run(const job_t& job) {
+  update(job.id, status_t::RUNNING);
+  switch (job.kind) {
+  case job_t::MQTT_CONFIG: {
+    swapIn(mqttStaged, espConfig::mqttData);
+    mqtt_config_save();
+    bool changed = mqtt_config_apply(mqttApplied);
+    mqttApplied = espConfig::mqttData;
+    update(job.id, status_t::DONE, changed ? "Config Saved, applied without restart" : "Config Saved, nothing changed");
+    break;
+  }
+  case job_t::MISC_CONFIG:
+  case job_t::ACTIONS_CONFIG: {
+    swapIn(miscStaged, espConfig::miscConfig);
+    misc_config_save();
+    if (job.kind == job_t::ACTIONS_CONFIG) {
+      actions_config_apply();
+    }
+    misc_config_apply(miscApplied);
+    std::vector<const char*> reasons = misc_config_restart_reasons(miscApplied, espConfig::miscConfig);
+    miscApplied = espConfig::miscConfig;
+    if (reasons.empty()) {
+      update(job.id, status_t::DONE, "Config Saved, applied without restart");
+      break;
+    }
+    std::string msg = "Config Saved, Restarting to apply: ";
+    for (size_t i = 0; i < reasons.size(); i++) {
+      msg.append(i ? ", " : "").append(reasons[i]);
+    }
+    update(job.id, status_t::DONE, msg);
+    restart();
+    break;
+  }
+  case job_t::REBOOT:
+    update(job.id, status_t::DONE, "Rebooting the device...");
+    restart();
+    break;
+  case job_t::RESET_HOMEKIT:
+    update(job.id, status_t::DONE, "Erasing HomeKit pairings and restarting...");
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    deleteReaderData();
+    homeSpan.processSerialCommand("H");
+    break;
+  case job_t::RESET_WIFI:
+    update(job.id, status_t::DONE, "Erasing WiFi credentials and restarting, AP will start on boot...");
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    homeSpan.processSerialCommand("X");
+    break;
+  case job_t::ALLOWLIST: {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint32_t load = allowlistLoad;
+    allowlistLoad = 0;
+    xSemaphoreGive(mutex);
+    if (load == 0 || uidAllowlist.activeLoad != load) {
+      update(job.id, status_t::FAILED, "Upload timed out, try again");
+      break;
+    }
+    uidAllowlist.stageCommit(load);
+    update(job.id, status_t::DONE, "Allowlist loaded: " + std::to_string(uidAllowlist.count) + " entries, " + std::to_string(uidAllowlist.rejected) + " rejected");
+    break;
+  }
+  }
+}
+
+void webJobs_t::task_entry(void* arg) {
+  webJobs_t& jobs = *static_cast<webJobs_t*>(arg);
+  job_t job;
+  while (1) {
+    if (xQueueReceive(jobs.queue, &job, portMAX_DELAY) == pdTRUE) {
+      jobs.run(job);
+    }
+  }
+}
+
+void webJobs_t::begin() {
+  mqttApplied = espConfig::mqttData;
+  miscApplied = espConfig::miscConfig;
+  mutex = xSemaphoreCreateMutex();
+  queue = xQueueCreate(WEB_JOBS_QUEUE, sizeof(job_t));
+  xTaskCreate(task_entry, "web_jobs", 6144, this, 1, &task);
+}
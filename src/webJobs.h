@@ -0,0 +1,124 @@
+#pragma once
+#include <Arduino.h>
+#include <HomeKey.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <array>
+#include <memory>
+#include <string>
+#include "config.h"
+#include "espConfig.h"
+
+// run by the jobs, defined next to the web handlers in main.cpp
+void mqtt_config_save();
+bool mqtt_config_apply(const espConfig::mqttConfig_t& previous);
+void misc_config_save();
+void misc_config_apply(const espConfig::misc_config_t& previous);
+void actions_config_apply();
+void deleteReaderData(const char* buf = "");
+
+/**
+ * Executor for the slow parts of the web handlers: NVS commits, MQTT reconnects, HAP calls and the
+ * pause before a restart. A handler validates the request, `stage`s the new config and `post`s a
+ * job, then answers 202 with the job ID right away so the AsyncTCP task never waits on flash or the
+ * network. `web_jobs` runs the jobs in order and keeps the outcome of the last few for
+ * `GET /api/jobs`. It is the only task replacing `espConfig::mqttData` and `espConfig::miscConfig`,
+ * config jobs swap the staged config in under `espConfig::mutex` and apply whatever changed since the
+ * previous one, measured against the config as it was last applied, so back to back saves collapse
+ * into one reconnect or restart. Allowlist uploads are merged here too, a full list takes seconds of
+ * LittleFS traffic.
+ */
+struct webJobs_t
+{
+  struct job_t
+  {
+    enum kind_t : uint8_t
+    {
+      MQTT_CONFIG,
+      MISC_CONFIG,
+      ACTIONS_CONFIG,
+      REBOOT,
+      RESET_HOMEKIT,
+      RESET_WIFI,
+      ALLOWLIST
+    };
+    kind_t kind;
+    uint16_t id;
+  };
+  struct status_t
+  {
+    enum state_t : uint8_t
+    {
+      QUEUED,
+      RUNNING,
+      DONE,
+      FAILED
+    };
+    uint16_t id = 0;
+    job_t::kind_t kind;
+    state_t state;
+    std::string message;
+  };
+  static constexpr const char* kindNames[] = { "mqtt-config", "misc-config", "actions-config", "reboot", "reset-homekit", "reset-wifi", "allowlist" };
+  static constexpr const char* stateNames[] = { "queued", "running", "done", "failed" };
+  QueueHandle_t queue = nullptr;
+  TaskHandle_t task = nullptr;
+  SemaphoreHandle_t mutex = nullptr;
+  uint16_t nextId = 0;
+  std::array<status_t, WEB_JOBS_HISTORY> history;
+  espConfig::mqttConfig_t mqttApplied;
+  espConfig::misc_config_t miscApplied;
+  // configs accepted by a handler and not swapped in yet, guarded by `mutex`
+  std::unique_ptr<espConfig::mqttConfig_t> mqttStaged;
+  std::unique_ptr<espConfig::misc_config_t> miscStaged;
+  // allowlist load uploaded and waiting for its merge, guarded by `mutex`
+  uint32_t allowlistLoad = 0;
+
+  /**
+   * Runs `edit` on a copy of the newest config, the one staged by an earlier request if its job
+   * hasn't run yet, and stages the copy if `edit` accepts it.
+   */
+  template <class T, class F>
+  bool stage(std::unique_ptr<T>& staged, const T& applied, F&& edit) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    std::unique_ptr<T> next;
+    if (staged) {
+      next = std::make_unique<T>(*staged);
+    } else {
+      espConfig::lock_t lock;
+      next = std::make_unique<T>(applied);
+    }
+    bool accepted = edit(*next);
+    if (accepted) staged = std::move(next);
+    xSemaphoreGive(mutex);
+    return accepted;
+  }
+  /* Swaps the staged config, if any, into `config` */
+  template <class T>
+  void swapIn(std::unique_ptr<T>& staged, T& config) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    std::unique_ptr<T> next = std::move(staged);
+    xSemaphoreGive(mutex);
+    if (!next) return;
+    espConfig::lock_t lock;
+    config = std::move(*next);
+  }
+
+  /**
+   * Queues a job of `kind` and returns its ID, 0 if the queue is full.
+   */
+  uint16_t post(job_t::kind_t kind);
+  void update(uint16_t id, status_t::state_t state, std::string message = "");
+  /**
+   * Writes the status of job `id` to `result`, false once it dropped out of the history.
+   */
+  bool status(uint16_t id, json& result);
+  void restart();
+  void run(const job_t& job);
+  static void task_entry(void* arg);
+  void begin();
+};
+
+extern webJobs_t webJobs;
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <esp_log.h>
+#include <nlohmann/json.hpp>
+
+// Types of HK-HomeKit-Lib's HomeKey.h and its LOG macro
+
+using json = nlohmann::json;
+
+#define LOG(x, format, ...) ESP_LOG##x(TAG, "%s(%d) > " format, __FUNCTION__, __LINE__, ##__VA_ARGS__)
+
+typedef enum
+{
+  kFlowFAST = 0x00,
+  kFlowSTANDARD = 0x01,
+  kFlowATTESTATION = 0x02,
+  kFlowNEXT,
+  kFlowFailed = 0xFF
+} KeyFlow;
+
+struct hkEndpoint_t
+{
+  std::vector<uint8_t> endpoint_id;
+  uint32_t last_used_at = 0;
+  int counter = 0;
+  std::vector<uint8_t> endpoint_key_x;
+  std::vector<uint8_t> endpoint_pk;
+  std::vector<uint8_t> endpoint_pk_x;
+  std::vector<uint8_t> endpoint_prst_k;
+  NLOHMANN_DEFINE_TYPE_INTRUSIVE(hkEndpoint_t, endpoint_id, last_used_at, counter, endpoint_key_x, endpoint_pk, endpoint_pk_x, endpoint_prst_k)
+};
+
+struct hkIssuer_t
+{
+  std::vector<uint8_t> issuer_id;
+  std::vector<uint8_t> issuer_pk;
+  std::vector<uint8_t> issuer_pk_x;
+  std::vector<hkEndpoint_t> endpoints;
+  NLOHMANN_DEFINE_TYPE_INTRUSIVE(hkIssuer_t, issuer_id, issuer_pk, issuer_pk_x, endpoints)
+};
+
+struct readerData_t
+{
+  std::vector<uint8_t> reader_sk;
+  std::vector<uint8_t> reader_pk;
+  std::vector<uint8_t> reader_pk_x;
+  std::vector<uint8_t> reader_gid;
+  std::vector<uint8_t> reader_id;
+  std::vector<hkIssuer_t> issuers;
+  NLOHMANN_DEFINE_TYPE_INTRUSIVE(readerData_t, reader_sk, reader_pk, reader_pk_x, reader_gid, reader_id, issuers)
+};
@@ -0,0 +1,146 @@
+#include <LittleFS.h>
+#include <cstring>
+#include <map>
+#include <vector>
+#include "sim.h"
+
+LittleFSFS LittleFS;
+
+namespace
+{
+  using data_t = std::shared_ptr<std::vector<uint8_t>>;
+  std::map<std::string, data_t>& files() {
+    static std::map<std::string, data_t> f;
+    return f;
+  }
+};
+
+struct fs::File::impl_t
+{
+  std::string path;
+  data_t data;
+  size_t pos = 0;
+  bool readable = false;
+  bool writable = false;
+  bool append = false;
+  bool open = true;
+};
+
+sim::io_t& sim::littlefs() {
+  static sim::io_t io;
+  return io;
+}
+
+fs::File::operator bool() const {
+  return impl && impl->open;
+}
+
+size_t fs::File::write(const uint8_t* buf, size_t size) {
+  if (!*this || !impl->writable) return 0;
+  auto&& data = *impl->data;
+  if (impl->append) impl->pos = data.size();
+  if (data.size() < impl->pos + size) data.resize(impl->pos + size);
+  memcpy(data.data() + impl->pos, buf, size);
+  impl->pos += size;
+  sim::littlefs().writes++;
+  sim::littlefs().bytesWritten += size;
+  return size;
+}
+
+size_t fs::File::read(uint8_t* buf, size_t size) {
+  if (!*this || !impl->readable) return 0;
+  auto&& data = *impl->data;
+  size_t n = impl->pos < data.size() ? std::min(size, data.size() - impl->pos) : 0;
+  memcpy(buf, data.data() + impl->pos, n);
+  impl->pos += n;
+  sim::littlefs().reads++;
+  sim::littlefs().bytesRead += n;
+  return n;
+}
+
+int fs::File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int fs::File::available() {
+  return *this ? impl->data->size() - std::min(impl->pos, impl->data->size()) : 0;
+}
+
+bool fs::File::seek(uint32_t pos, SeekMode mode) {
+  if (!*this) return false;
+  size_t base = mode == SeekSet ? 0 : mode == SeekCur ? impl->pos : impl->data->size();
+  if (base + pos > impl->data->size()) return false;
+  impl->pos = base + pos;
+  return true;
+}
+
+size_t fs::File::position() const {
+  return impl ? impl->pos : 0;
+}
+
+size_t fs::File::size() const {
+  return impl ? impl->data->size() : 0;
+}
+
+void fs::File::flush() {
+}
+
+void fs::File::close() {
+  if (impl) impl->open = false;
+}
+
+const char* fs::File::path() const {
+  return impl ? impl->path.c_str() : nullptr;
+}
+
+fs::File fs::FS::open(const char* path, const char* mode, const bool create) {
+  auto&& all = files();
+  auto it = all.find(path);
+  std::string m(mode);
+  bool plus = m.find('+') != std::string::npos;
+  auto file = std::make_shared<File::impl_t>();
+  file->path = path;
+  if (m[0] == 'r') {
+    if (it == all.end()) return File();
+    file->data = it->second;
+    file->readable = true;
+    file->writable = plus;
+  } else {
+    if (it == all.end() || m[0] == 'w') it = all.insert_or_assign(path, std::make_shared<std::vector<uint8_t>>()).first;
+    file->data = it->second;
+    file->writable = true;
+    file->readable = plus;
+    file->append = m[0] == 'a';
+  }
+  return File(file);
+}
+
+bool fs::FS::exists(const char* path) {
+  return files().count(path);
+}
+
+bool fs::FS::remove(const char* path) {
+  return files().erase(path);
+}
+
+bool fs::FS::rename(const char* pathFrom, const char* pathTo) {
+  auto&& all = files();
+  auto it = all.find(pathFrom);
+  if (it == all.end()) return false;
+  data_t data = it->second;
+  all.erase(it);
+  all[pathTo] = data;
+  return true;
+}
+
+bool LittleFSFS::format() {
+  files().clear();
+  return true;
+}
+
+size_t LittleFSFS::usedBytes() {
+  size_t used = 0;
+  for (auto&& file : files()) used += file.second->size();
+  return used;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// In-memory LittleFS with the Arduino-ESP32 FS API, reads and writes are counted in `sim::littlefs()`
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs
+{
+  enum SeekMode
+  {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+  };
+
+  class File
+  {
+  public:
+    struct impl_t;
+    File(std::shared_ptr<impl_t> impl = nullptr) : impl(impl) {}
+    operator bool() const;
+    size_t write(const uint8_t* buf, size_t size);
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t read(uint8_t* buf, size_t size);
+    int read();
+    int available();
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    void flush();
+    void close();
+    const char* path() const;
+    bool isDirectory() const { return false; }
+
+  private:
+    std::shared_ptr<impl_t> impl;
+  };
+
+  class FS
+  {
+  public:
+    File open(const char* path, const char* mode = FILE_READ, const bool create = false);
+    File open(const std::string& path, const char* mode = FILE_READ, const bool create = false) { return open(path.c_str(), mode, create); }
+    bool exists(const char* path);
+    bool remove(const char* path);
+    bool rename(const char* pathFrom, const char* pathTo);
+    bool mkdir(const char* path) { return true; }
+  };
+};
+
+using fs::File;
+using fs::FS;
+
+class LittleFSFS : public fs::FS
+{
+public:
+  bool begin(bool formatOnFail = false, const char* basePath = "/littlefs", uint8_t maxOpenFiles = 10, const char* partitionLabel = "spiffs") { return true; }
+  bool format();
+  size_t totalBytes() { return 1536 * 1024; }
+  size_t usedBytes();
+  void end() {}
+};
+
+extern LittleFSFS LittleFS;
@@ -0,0 +1,144 @@
+#include "PN532.h"
+#include <algorithm>
+#include <cstring>
+
+PN532::PN532(PN532Interface& interface) : _interface(&interface) {}
+
+void PN532::begin() {
+  _interface->begin();
+  _interface->wakeup();
+}
+
+uint32_t PN532::getFirmwareVersion(void) {
+  pn532_packetbuffer[0] = PN532_COMMAND_GETFIRMWAREVERSION;
+  if (_interface->writeCommand(pn532_packetbuffer, 1)) {
+    return 0;
+  }
+  int16_t status = _interface->readResponse(pn532_packetbuffer, sizeof(pn532_packetbuffer));
+  if (status < 4) {
+    return 0;
+  }
+  return uint32_t(pn532_packetbuffer[0]) << 24 | uint32_t(pn532_packetbuffer[1]) << 16 | uint32_t(pn532_packetbuffer[2]) << 8 | pn532_packetbuffer[3];
+}
+
+uint32_t PN532::readRegister(uint16_t reg) {
+  pn532_packetbuffer[0] = PN532_COMMAND_READREGISTER;
+  pn532_packetbuffer[1] = (reg >> 8) & 0xFF;
+  pn532_packetbuffer[2] = reg & 0xFF;
+  if (_interface->writeCommand(pn532_packetbuffer, 3)) {
+    return 0;
+  }
+  if (_interface->readResponse(pn532_packetbuffer, sizeof(pn532_packetbuffer)) < 1) {
+    return 0;
+  }
+  return pn532_packetbuffer[0];
+}
+
+uint32_t PN532::writeRegister(uint16_t reg, uint8_t val, bool ignore_log) {
+  pn532_packetbuffer[0] = PN532_COMMAND_WRITEREGISTER;
+  pn532_packetbuffer[1] = (reg >> 8) & 0xFF;
+  pn532_packetbuffer[2] = reg & 0xFF;
+  pn532_packetbuffer[3] = val;
+  if (_interface->writeCommand(pn532_packetbuffer, 4, 0, 0, ignore_log)) {
+    return 0;
+  }
+  return _interface->readResponse(pn532_packetbuffer, sizeof(pn532_packetbuffer), 1000, ignore_log) >= 0;
+}
+
+bool PN532::SAMConfig(void) {
+  pn532_packetbuffer[0] = PN532_COMMAND_SAMCONFIGURATION;
+  pn532_packetbuffer[1] = 0x01; // normal mode
+  pn532_packetbuffer[2] = 0x14; // timeout 50ms * 20 = 1 second
+  pn532_packetbuffer[3] = 0x01; // use IRQ pin
+  if (_interface->writeCommand(pn532_packetbuffer, 4)) {
+    return false;
+  }
+  return _interface->readResponse(pn532_packetbuffer, sizeof(pn532_packetbuffer)) >= 0;
+}
+
+bool PN532::setPassiveActivationRetries(uint8_t maxRetries) {
+  pn532_packetbuffer[0] = PN532_COMMAND_RFCONFIGURATION;
+  pn532_packetbuffer[1] = 5;    // Config item 5 (MaxRetries)
+  pn532_packetbuffer[2] = 0xFF; // MxRtyATR (default = 0xFF)
+  pn532_packetbuffer[3] = 0x01; // MxRtyPSL (default = 0x01)
+  pn532_packetbuffer[4] = maxRetries;
+  if (_interface->writeCommand(pn532_packetbuffer, 5)) {
+    return false;
+  }
+  return _interface->readResponse(pn532_packetbuffer, sizeof(pn532_packetbuffer)) >= 0;
+}
+
+bool PN532::setRFField(uint8_t autoRF, uint8_t rFOnOff) {
+  pn532_packetbuffer[0] = PN532_COMMAND_RFCONFIGURATION;
+  pn532_packetbuffer[1] = 1; // Config item 1 (RF Field)
+  pn532_packetbuffer[2] = 0x00 | autoRF | rFOnOff;
+  if (_interface->writeCommand(pn532_packetbuffer, 3)) {
+    return false;
+  }
+  return _interface->readResponse(pn532_packetbuffer, sizeof(pn532_packetbuffer)) >= 0;
+}
+
+bool PN532::inDataExchange(uint8_t* send, uint8_t sendLength, uint8_t* response, uint16_t* responseLength, bool ignore_log) {
+  pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+  pn532_packetbuffer[1] = inListedTag;
+  if (_interface->writeCommand(pn532_packetbuffer, 2, send, sendLength, ignore_log)) {
+    return false;
+  }
+  int16_t status = _interface->readResponse(pn532_packetbuffer, sizeof(pn532_packetbuffer), 1000, ignore_log);
+  if (status < 1 || (pn532_packetbuffer[0] & 0x3f) != 0) {
+    return false;
+  }
+  uint16_t length = std::min<uint16_t>(status - 1, *responseLength);
+  memcpy(response, pn532_packetbuffer + 1, length);
+  *responseLength = length;
+  return true;
+}
+
+bool PN532::inCommunicateThru(uint8_t* send, uint8_t sendLength, uint8_t* response, uint16_t* responseLength, uint16_t timeout, bool ignore_log) {
+  pn532_packetbuffer[0] = PN532_COMMAND_INCOMMUNICATETHRU;
+  if (_interface->writeCommand(pn532_packetbuffer, 1, send, sendLength, ignore_log)) {
+    return false;
+  }
+  int16_t status = _interface->readResponse(pn532_packetbuffer, sizeof(pn532_packetbuffer), timeout, ignore_log);
+  if (status < 1 || (pn532_packetbuffer[0] & 0x3f) != 0) {
+    return false;
+  }
+  uint16_t length = std::min<uint16_t>(status - 1, *responseLength);
+  memcpy(response, pn532_packetbuffer + 1, length);
+  *responseLength = length;
+  return true;
+}
+
+bool PN532::readPassiveTargetID(uint8_t cardbaudrate, uint8_t* uid, uint8_t* uidLength, uint8_t* atqa, uint8_t* sak, uint16_t timeout, bool inlist, bool ignore_log) {
+  pn532_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
+  pn532_packetbuffer[1] = 1; // max 1 cards at once
+  pn532_packetbuffer[2] = cardbaudrate;
+  if (_interface->writeCommand(pn532_packetbuffer, 3, 0, 0, ignore_log)) {
+    return false;
+  }
+  if (_interface->readResponse(pn532_packetbuffer, sizeof(pn532_packetbuffer), timeout, ignore_log) < 1) {
+    return false;
+  }
+  // NbTg, Tg, SENS_RES(2), SEL_RES, NFCIDLength, NFCID
+  if (pn532_packetbuffer[0] != 1) {
+    return false;
+  }
+  atqa[0] = pn532_packetbuffer[2];
+  atqa[1] = pn532_packetbuffer[3];
+  sak[0] = pn532_packetbuffer[4];
+  *uidLength = pn532_packetbuffer[5];
+  memcpy(uid, pn532_packetbuffer + 6, pn532_packetbuffer[5]);
+  if (inlist) {
+    inListedTag = pn532_packetbuffer[1];
+  }
+  return true;
+}
+
+bool PN532::inRelease(const uint8_t relevantTarget) {
+  pn532_packetbuffer[0] = PN532_COMMAND_INRELEASE;
+  pn532_packetbuffer[1] = relevantTarget;
+  if (_interface->writeCommand(pn532_packetbuffer, 2)) {
+    return false;
+  }
+  return _interface->readResponse(pn532_packetbuffer, sizeof(pn532_packetbuffer)) >= 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include "PN532Interface.h"
+
+// The host controller commands of the rednblkx/PN532 library the firmware and the authentication context use
+
+#define PN532_COMMAND_DIAGNOSE (0x00)
+#define PN532_COMMAND_GETFIRMWAREVERSION (0x02)
+#define PN532_COMMAND_READREGISTER (0x06)
+#define PN532_COMMAND_WRITEREGISTER (0x08)
+#define PN532_COMMAND_SAMCONFIGURATION (0x14)
+#define PN532_COMMAND_RFCONFIGURATION (0x32)
+#define PN532_COMMAND_INDATAEXCHANGE (0x40)
+#define PN532_COMMAND_INCOMMUNICATETHRU (0x42)
+#define PN532_COMMAND_INLISTPASSIVETARGET (0x4A)
+#define PN532_COMMAND_INRELEASE (0x52)
+
+#define PN532_MIFARE_ISO14443A (0x00)
+
+class PN532
+{
+public:
+  PN532(PN532Interface& interface);
+
+  void begin(void);
+  uint32_t getFirmwareVersion(void);
+  uint32_t readRegister(uint16_t reg);
+  uint32_t writeRegister(uint16_t reg, uint8_t val, bool ignore_log = false);
+  bool SAMConfig(void);
+  bool setPassiveActivationRetries(uint8_t maxRetries);
+  bool setRFField(uint8_t autoRF, uint8_t rFOnOff);
+
+  bool inDataExchange(uint8_t* send, uint8_t sendLength, uint8_t* response, uint16_t* responseLength, bool ignore_log = false);
+  bool inCommunicateThru(uint8_t* send, uint8_t sendLength, uint8_t* response, uint16_t* responseLength, uint16_t timeout = 1000, bool ignore_log = false);
+  bool readPassiveTargetID(uint8_t cardbaudrate, uint8_t* uid, uint8_t* uidLength, uint8_t* atqa, uint8_t* sak, uint16_t timeout = 1000, bool inlist = false, bool ignore_log = false);
+  bool inRelease(const uint8_t relevantTarget = 0);
+
+private:
+  uint8_t inListedTag = 0;
+  uint8_t pn532_packetbuffer[255];
+  PN532Interface* _interface;
+};
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+
+// PN532Interface of the rednblkx/PN532 library, the only transport in the native build is PN532_SPI
+
+#define PN532_PREAMBLE (0x00)
+#define PN532_STARTCODE1 (0x00)
+#define PN532_STARTCODE2 (0xFF)
+#define PN532_POSTAMBLE (0x00)
+#define PN532_HOSTTOPN532 (0xD4)
+#define PN532_PN532TOHOST (0xD5)
+#define PN532_ACK_WAIT_TIME (10) // ms, timeout of waiting for ACK
+#define PN532_INVALID_ACK (-1)
+#define PN532_TIMEOUT (-2)
+#define PN532_INVALID_FRAME (-3)
+#define PN532_NO_SPACE (-4)
+
+class PN532Interface
+{
+public:
+  virtual void begin() = 0;
+  virtual void wakeup() = 0;
+  virtual int8_t writeCommand(const uint8_t* header, uint8_t hlen, const uint8_t* body = 0, uint8_t blen = 0, bool ignore_log = false) = 0;
+  virtual int16_t readResponse(uint8_t buf[], uint8_t len, uint16_t timeout = 1000, bool ignore_log = false) = 0;
+  virtual ~PN532Interface() = default;
+};
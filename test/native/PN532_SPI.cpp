@@ -0,0 +1,62 @@
+#include "PN532_SPI.h"
+#include <Arduino.h>
+#include "virtualPn532.h"
+
+// preamble, start codes, LEN, LCS, TFI, DCS and postamble around the data, plus the SPI data write/read byte
+static constexpr int64_t frameOverhead = 9;
+
+PN532_SPI::PN532_SPI(uint8_t ss, uint8_t sck, uint8_t miso, uint8_t mosi) : _ss(ss), device(virtualPn532_t::at(ss)) {}
+
+void PN532_SPI::begin() {
+  pinMode(_ss, OUTPUT);
+}
+
+void PN532_SPI::wakeup() {
+  digitalWrite(_ss, LOW);
+  delay(2);
+  digitalWrite(_ss, HIGH);
+}
+
+bool PN532_SPI::isReady(bool ack) {
+  device.statusReads[device.pending.command.empty() ? 0 : device.pending.command[0]]++;
+  return ack ? device.ackReady() : device.responseReady();
+}
+
+int8_t PN532_SPI::writeCommand(const uint8_t* header, uint8_t hlen, const uint8_t* body, uint8_t blen, bool ignore_log) {
+  std::vector<uint8_t> command(header, header + hlen);
+  command.insert(command.end(), body, body + blen);
+  sim::busy(int64_t(command.size() + frameOverhead) * virtualPn532_t::spiByteUs);
+  device.receive(command);
+
+  uint8_t timeout = PN532_ACK_WAIT_TIME;
+  while (!isReady(true)) {
+    delay(1);
+    timeout--;
+    if (0 == timeout) {
+      return PN532_TIMEOUT;
+    }
+  }
+  // status byte and the 6 bytes of the ACK frame
+  sim::busy(7 * virtualPn532_t::spiByteUs);
+  device.ackRead();
+  return 0;
+}
+
+int16_t PN532_SPI::readResponse(uint8_t buf[], uint8_t len, uint16_t timeout, bool ignore_log) {
+  uint16_t time = 0;
+  while (!isReady(false)) {
+    delay(1);
+    time++;
+    if (timeout > 0 && time > timeout) {
+      return PN532_TIMEOUT;
+    }
+  }
+  std::vector<uint8_t> response = device.responseRead();
+  // the response frame also carries TFI and the response code
+  sim::busy(int64_t(response.size() + 2 + frameOverhead) * virtualPn532_t::spiByteUs);
+  if (response.size() > len) {
+    return PN532_NO_SPACE;
+  }
+  std::copy(response.begin(), response.end(), buf);
+  return response.size();
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "PN532Interface.h"
+
+struct virtualPn532_t;
+
+/**
+ * Stand-in for the SPI transport of the PN532 library. Frames go to the `virtualPn532_t` wired to the
+ * same SS pin instead of the SPI bus; the status polling (1ms `delay` between checks) and the ACK
+ * handling follow the library so the host side waits exactly as long as it would on the device.
+ */
+class PN532_SPI : public PN532Interface
+{
+public:
+  PN532_SPI(uint8_t ss, uint8_t sck, uint8_t miso, uint8_t mosi);
+  void begin() override;
+  void wakeup() override;
+  int8_t writeCommand(const uint8_t* header, uint8_t hlen, const uint8_t* body = 0, uint8_t blen = 0, bool ignore_log = false) override;
+  int16_t readResponse(uint8_t buf[], uint8_t len, uint16_t timeout = 1000, bool ignore_log = false) override;
+
+private:
+  uint8_t _ss;
+  bool isReady(bool ack);
+  virtualPn532_t& device;
+};
@@ -0,0 +1,95 @@
+#include <Arduino.h>
+#include <cstdarg>
+#include <mqtt_client.h>
+#include "sim.h"
+
+static std::map<std::string, esp_log_level_t>& log_levels() {
+  static std::map<std::string, esp_log_level_t> levels = { {"*", ESP_LOG_WARN} };
+  return levels;
+}
+
+void esp_log_level_set(const char* tag, esp_log_level_t level) {
+  log_levels()[tag] = level;
+}
+
+esp_log_level_t esp_log_level_get(const char* tag) {
+  auto&& levels = log_levels();
+  auto it = levels.find(tag);
+  return it != levels.end() ? it->second : levels["*"];
+}
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...) {
+  if (level > esp_log_level_get(tag)) return;
+  printf("%c (%lld) %s: ", "NEWIDV"[level], (long long)(sim::now() / 1000), tag);
+  va_list args;
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+  printf("\n");
+}
+
+void esp_log_buffer_hex_internal(const char* tag, const void* buffer, uint16_t len, esp_log_level_t level) {
+  if (level > esp_log_level_get(tag)) return;
+  const uint8_t* bytes = static_cast<const uint8_t*>(buffer);
+  for (uint16_t i = 0; i < len; i += 16) {
+    std::string line;
+    char hex[4];
+    for (uint16_t j = i; j < len && j < i + 16; j++) {
+      snprintf(hex, sizeof(hex), "%02x ", bytes[j]);
+      line += hex;
+    }
+    esp_log_write(level, tag, "%s", line.c_str());
+  }
+}
+
+const char* esp_err_to_name(esp_err_t code) {
+  switch (code) {
+  case ESP_OK: return "ESP_OK";
+  case ESP_FAIL: return "ESP_FAIL";
+  case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+  case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+  case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+  case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+  case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+  case ESP_ERR_NVS_NOT_INITIALIZED: return "ESP_ERR_NVS_NOT_INITIALIZED";
+  case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+  case ESP_ERR_NVS_INVALID_HANDLE: return "ESP_ERR_NVS_INVALID_HANDLE";
+  case ESP_ERR_NVS_INVALID_LENGTH: return "ESP_ERR_NVS_INVALID_LENGTH";
+  default: return "UNKNOWN ERROR";
+  }
+}
+
+esp_err_t esp_read_mac(uint8_t* mac, esp_mac_type_t type) {
+  static constexpr uint8_t base[6] = { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01 };
+  memcpy(mac, base, sizeof(base));
+  mac[5] += type;
+  return ESP_OK;
+}
+
+// xorshift32 with a fixed seed, so every run of a test sees the same "random" keys and identifiers
+uint32_t esp_random() {
+  static uint32_t state = 0x2545F491;
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+void esp_fill_random(void* buf, size_t len) {
+  uint8_t* bytes = static_cast<uint8_t*>(buf);
+  for (size_t i = 0; i < len; i++) bytes[i] = esp_random();
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len) {
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; i++) {
+    crc ^= buf[i];
+    for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char* topic, int qos) {
+  client->subscriptions.push_back({ topic, qos });
+  return client->subscriptions.size();
+}
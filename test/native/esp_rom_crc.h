@@ -0,0 +1,5 @@
+#pragma once
+#include <cstdint>
+
+// CRC-32 as computed by the ESP32 ROM (IEEE 802.3, same as zlib's crc32)
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len);
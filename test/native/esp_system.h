@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+
+typedef enum
+{
+  ESP_MAC_WIFI_STA,
+  ESP_MAC_WIFI_SOFTAP,
+  ESP_MAC_BT,
+  ESP_MAC_ETH
+} esp_mac_type_t;
+
+// the simulated chip has the MAC 24:0A:C4:00:00:01
+esp_err_t esp_read_mac(uint8_t* mac, esp_mac_type_t type);
+uint32_t esp_random();
+void esp_fill_random(void* buf, size_t len);
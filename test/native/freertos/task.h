@@ -0,0 +1,13 @@
+#pragma once
+#include "FreeRTOS.h"
+
+BaseType_t xTaskCreate(TaskFunction_t entry, const char* name, uint32_t stackDepth, void* arg, UBaseType_t priority, TaskHandle_t* handle);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t entry, const char* name, uint32_t stackDepth, void* arg, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higherPriorityTaskWoken);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
@@ -0,0 +1,140 @@
+#include "hkAuthContext.h"
+#include <esp_system.h>
+#include <esp_timer.h>
+#include "hkEndpointSim.h"
+#include "sim.h"
+
+static const char* TAG = "HKAuthCtx";
+
+HKAuthenticationContext::HKAuthenticationContext(PN532& nfc, readerData_t& readerData, nvs_handle& savedData) : nfc(nfc), readerData(readerData), savedData(savedData), readerEphemeral(65), transactionId(16) {
+  sim::busy(keygenUs);
+  esp_fill_random(readerEphemeral.data(), readerEphemeral.size());
+  readerEphemeral[0] = 0x04;
+  esp_fill_random(transactionId.data(), transactionId.size());
+}
+
+bool HKAuthenticationContext::transceive(const std::vector<uint8_t>& apdu, std::vector<uint8_t>& response) {
+  std::vector<uint8_t> command(apdu);
+  response.clear();
+  while (1) {
+    uint8_t buffer[256];
+    uint16_t length = sizeof(buffer);
+    if (!nfc.inDataExchange(command.data(), command.size(), buffer, &length) || length < 2) {
+      return false;
+    }
+    response.insert(response.end(), buffer, buffer + length - 2);
+    uint8_t sw1 = buffer[length - 2];
+    uint8_t sw2 = buffer[length - 1];
+    if (sw1 == 0x90 && sw2 == 0x00) return true;
+    if (sw1 != 0x61) {
+      LOG(W, "APDU %02x failed with %02x%02x", apdu[1], sw1, sw2);
+      return false;
+    }
+    command = { 0x00, 0xC0, 0x00, 0x00, sw2 };
+  }
+}
+
+void HKAuthenticationContext::control(bool success) {
+  std::vector<uint8_t> response;
+  transceive({ 0x80, 0x3C, uint8_t(success ? 0x01 : 0x00), uint8_t(success ? 0x01 : 0x00), 0x00 }, response);
+}
+
+void HKAuthenticationContext::save() {
+  std::vector<uint8_t> data = json::to_msgpack(readerData);
+  nvs_set_blob(savedData, "READERDATA", data.data(), data.size());
+  nvs_commit(savedData);
+}
+
+std::tuple<std::vector<uint8_t>, std::vector<uint8_t>, KeyFlow> HKAuthenticationContext::authenticate(KeyFlow flow) {
+  std::vector<uint8_t> response;
+  std::vector<uint8_t> auth0 = { 0x80, 0x80, 0x01, 0x00, 0x00 };
+  hkSim::tlv(auth0, 0x5C, { 0x02, 0x00 });
+  hkSim::tlv(auth0, 0x87, readerEphemeral);
+  hkSim::tlv(auth0, 0x4C, transactionId);
+  std::vector<uint8_t> readerIdentifier(readerData.reader_gid);
+  readerIdentifier.insert(readerIdentifier.end(), readerData.reader_id.begin(), readerData.reader_id.end());
+  hkSim::tlv(auth0, 0x4D, readerIdentifier);
+  auth0[4] = auth0.size() - 5;
+  auth0.push_back(0x00);
+  if (!transceive(auth0, response)) {
+    return { {}, {}, kFlowFailed };
+  }
+  std::vector<uint8_t> cryptogram = hkSim::find(response, 0x9D);
+  std::vector<uint8_t> info(transactionId);
+  info.insert(info.end(), readerEphemeral.begin(), readerEphemeral.end());
+
+  if (flow == kFlowFAST) {
+    if (cryptogram.empty()) {
+      LOG(I, "Endpoint sent no cryptogram, FAST flow not possible");
+      return { {}, {}, kFlowFailed };
+    }
+    for (auto&& issuer : readerData.issuers) {
+      for (auto&& endpoint : issuer.endpoints) {
+        if (endpoint.endpoint_prst_k.empty()) continue;
+        sim::busy(kdfUs);
+        if (hkSim::derive(endpoint.endpoint_prst_k, info, 64) == cryptogram) {
+          endpoint.counter++;
+          endpoint.last_used_at = esp_timer_get_time() / 1000000;
+          control(true);
+          save();
+          return { issuer.issuer_id, endpoint.endpoint_id, kFlowFAST };
+        }
+      }
+    }
+    LOG(I, "No endpoint matches the FAST cryptogram");
+    return { {}, {}, kFlowFailed };
+  }
+
+  sim::busy(ecdhUs + signUs);
+  std::vector<uint8_t> auth1 = { 0x80, 0x81, 0x00, 0x00, 0x00 };
+  hkSim::tlv(auth1, 0x9E, hkSim::derive(readerData.reader_sk, transactionId, 64));
+  auth1[4] = auth1.size() - 5;
+  auth1.push_back(0x00);
+  if (!transceive(auth1, response)) {
+    return { {}, {}, kFlowFailed };
+  }
+  std::vector<uint8_t> pk_x = hkSim::find(response, 0x5A);
+  for (auto&& issuer : readerData.issuers) {
+    for (auto&& endpoint : issuer.endpoints) {
+      if (endpoint.endpoint_pk_x != pk_x) continue;
+      sim::busy(verifyUs);
+      endpoint.endpoint_prst_k = hkSim::derive(pk_x, transactionId, 32);
+      endpoint.counter++;
+      endpoint.last_used_at = esp_timer_get_time() / 1000000;
+      control(true);
+      save();
+      return { issuer.issuer_id, endpoint.endpoint_id, kFlowSTANDARD };
+    }
+  }
+  if (flow < kFlowATTESTATION) {
+    LOG(I, "Endpoint not enrolled, attestation needed");
+    return { {}, {}, kFlowFailed };
+  }
+
+  std::vector<uint8_t> exchange = { 0x80, 0xC9, 0x00, 0x00, 0x00 };
+  hkSim::tlv(exchange, 0xC0, transactionId);
+  exchange[4] = exchange.size() - 5;
+  exchange.push_back(0x00);
+  if (!transceive(exchange, response)) {
+    return { {}, {}, kFlowFailed };
+  }
+  sim::busy(verifyUs);
+  std::vector<uint8_t> issuerId = hkSim::find(response, 0xC0);
+  for (auto&& issuer : readerData.issuers) {
+    if (issuer.issuer_id != issuerId) continue;
+    hkEndpoint_t endpoint;
+    endpoint.endpoint_id = hkSim::find(response, 0xC1);
+    endpoint.last_used_at = esp_timer_get_time() / 1000000;
+    endpoint.endpoint_key_x = pk_x;
+    endpoint.endpoint_pk = hkSim::find(response, 0xC2);
+    endpoint.endpoint_pk_x = pk_x;
+    endpoint.endpoint_prst_k = hkSim::derive(pk_x, transactionId, 32);
+    issuer.endpoints.push_back(endpoint);
+    control(true);
+    save();
+    return { issuer.issuer_id, endpoint.endpoint_id, kFlowATTESTATION };
+  }
+  LOG(W, "Attestation from an unknown issuer");
+  control(false);
+  return { {}, {}, kFlowFailed };
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <HomeKey.h>
+#include <PN532.h>
+#include <nvs.h>
+#include <tuple>
+
+/**
+ * Stand-in for the HomeKey library's authentication context. It goes through the same APDUs as the
+ * library (AUTH0 with the FAST cryptogram, AUTH1, the attestation exchange and the control flow) over
+ * `PN532::inDataExchange`, looks endpoints up by scanning `readerData`, enrolls attested endpoints and
+ * stores the whole reader data under `READERDATA` through `savedData` after every success.
+ *
+ * The cryptography is replaced by `hkSim::derive`, its cost on the ESP32 is charged with `sim::busy`
+ * using the constants below (mbedTLS on one 240 MHz core), so the benchmark sees the right order of
+ * magnitude without computing any of it. Encoding the reader data for `READERDATA` isn't charged.
+ */
+class HKAuthenticationContext
+{
+public:
+  static constexpr int64_t keygenUs = 35000; // reader ephemeral P-256 key pair
+  static constexpr int64_t kdfUs = 1500;     // HKDF of the FAST cryptogram key, per enrolled endpoint tried
+  static constexpr int64_t ecdhUs = 38000;   // shared secret with the endpoint ephemeral key
+  static constexpr int64_t signUs = 42000;   // reader signature sent with AUTH1
+  static constexpr int64_t verifyUs = 80000; // endpoint signature, or the issuer signature of an attestation
+
+  HKAuthenticationContext(PN532& nfc, readerData_t& readerData, nvs_handle& savedData);
+  /* Runs `flow` and the flows below it that it needs, returns the issuer and endpoint IDs and the flow that succeeded */
+  std::tuple<std::vector<uint8_t>, std::vector<uint8_t>, KeyFlow> authenticate(KeyFlow flow);
+
+private:
+  PN532& nfc;
+  readerData_t& readerData;
+  nvs_handle& savedData;
+  std::vector<uint8_t> readerEphemeral;
+  std::vector<uint8_t> transactionId;
+
+  /* Sends `apdu`, follows 61 xx with GET RESPONSE and returns the response without its status word if it ended with 90 00 */
+  bool transceive(const std::vector<uint8_t>& apdu, std::vector<uint8_t>& response);
+  void control(bool success);
+  void save();
+};
@@ -0,0 +1,149 @@
+#include "hkEndpointSim.h"
+
+namespace hkSim
+{
+  std::vector<uint8_t> derive(const std::vector<uint8_t>& key, const std::vector<uint8_t>& info, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (uint8_t b : key) h = (h ^ b) * 0x100000001b3ull;
+    h = (h ^ 0xFF) * 0x100000001b3ull;
+    for (uint8_t b : info) h = (h ^ b) * 0x100000001b3ull;
+    std::vector<uint8_t> out(len);
+    for (size_t i = 0; i < len; i++) {
+      h ^= h << 13;
+      h ^= h >> 7;
+      h ^= h << 17;
+      out[i] = h >> 24;
+    }
+    return out;
+  }
+
+  void tlv(std::vector<uint8_t>& out, uint8_t tag, const std::vector<uint8_t>& value) {
+    out.push_back(tag);
+    if (value.size() > 0x7F) {
+      out.push_back(0x82);
+      out.push_back(value.size() >> 8);
+    }
+    out.push_back(value.size() & 0xFF);
+    out.insert(out.end(), value.begin(), value.end());
+  }
+
+  std::vector<uint8_t> find(const std::vector<uint8_t>& data, uint8_t tag, size_t offset) {
+    size_t i = offset;
+    while (i + 2 <= data.size()) {
+      uint8_t t = data[i++];
+      size_t len = data[i++];
+      if (len == 0x82 && i + 2 <= data.size()) {
+        len = data[i] << 8 | data[i + 1];
+        i += 2;
+      }
+      if (i + len > data.size()) break;
+      if (t == tag) return std::vector<uint8_t>(data.begin() + i, data.begin() + i + len);
+      i += len;
+    }
+    return {};
+  }
+};
+
+hkEndpointSim_t::hkEndpointSim_t(uint8_t seed, const std::vector<uint8_t>& issuerId) : issuerId(issuerId) {
+  std::vector<uint8_t> s = { seed };
+  // phones present a random 4 byte UID starting with 08
+  uid = hkSim::derive(s, { 'u', 'i', 'd' }, 4);
+  uid[0] = 0x08;
+  sak = 0x20;
+  needsEcp = true;
+  pk_x = hkSim::derive(s, { 'p', 'k' }, 32);
+  pk = { 0x04 };
+  pk.insert(pk.end(), pk_x.begin(), pk_x.end());
+  std::vector<uint8_t> y = hkSim::derive(pk_x, { 'y' }, 32);
+  pk.insert(pk.end(), y.begin(), y.end());
+  endpointId = hkSim::derive(pk_x, { 'i', 'd' }, 6);
+}
+
+hkEndpoint_t hkEndpointSim_t::enrolled() const {
+  hkEndpoint_t endpoint;
+  endpoint.endpoint_id = endpointId;
+  endpoint.endpoint_key_x = pk_x;
+  endpoint.endpoint_pk = pk;
+  endpoint.endpoint_pk_x = pk_x;
+  endpoint.endpoint_prst_k = persistentKey;
+  return endpoint;
+}
+
+void hkEndpointSim_t::reset() {
+  selected = false;
+  authenticated = false;
+  transactionId.clear();
+  readerEphemeral.clear();
+  outgoing.clear();
+}
+
+void hkEndpointSim_t::send(std::vector<uint8_t>& response) {
+  size_t n = std::min(outgoing.size(), chunkSize);
+  response.assign(outgoing.begin(), outgoing.begin() + n);
+  outgoing.erase(outgoing.begin(), outgoing.begin() + n);
+  if (outgoing.empty()) {
+    response.insert(response.end(), { 0x90, 0x00 });
+  } else {
+    response.insert(response.end(), { 0x61, uint8_t(std::min<size_t>(outgoing.size(), 0xFF)) });
+  }
+}
+
+bool hkEndpointSim_t::apdu(const std::vector<uint8_t>& command, std::vector<uint8_t>& response, int64_t& processingUs) {
+  if (command.size() < 4) return false;
+  uint8_t cla = command[0];
+  uint8_t ins = command[1];
+  apdus[ins]++;
+  processingUs = controlUs;
+  if (cla == 0x00 && ins == 0xA4) {
+    static const std::vector<uint8_t> aid = { 0xA0, 0x00, 0x00, 0x08, 0x58, 0x01, 0x01 };
+    reset();
+    selected = command.size() >= 12 && std::equal(aid.begin(), aid.end(), command.begin() + 5);
+    processingUs = selectUs;
+    response = selected ? std::vector<uint8_t>{ 0x5C, 0x02, 0x02, 0x00, 0x90, 0x00 } : std::vector<uint8_t>{ 0x6A, 0x82 };
+    return true;
+  }
+  if (!selected) {
+    response = { 0x69, 0x85 };
+    return true;
+  }
+  if (cla == 0x80 && ins == 0x80) { // AUTH0
+    processingUs = auth0Us;
+    readerEphemeral = hkSim::find(command, 0x87, 5);
+    transactionId = hkSim::find(command, 0x4C, 5);
+    std::vector<uint8_t> info(transactionId);
+    info.insert(info.end(), readerEphemeral.begin(), readerEphemeral.end());
+    response.clear();
+    hkSim::tlv(response, 0x86, hkSim::derive(pk, info, 65));
+    if (!persistentKey.empty()) {
+      hkSim::tlv(response, 0x9D, hkSim::derive(persistentKey, info, 64));
+    }
+    response.insert(response.end(), { 0x90, 0x00 });
+  } else if (cla == 0x80 && ins == 0x81 && !transactionId.empty()) { // AUTH1
+    processingUs = auth1Us;
+    authenticated = true;
+    persistentKey = hkSim::derive(pk_x, transactionId, 32);
+    response.clear();
+    hkSim::tlv(response, 0x5A, pk_x);
+    hkSim::tlv(response, 0x9E, hkSim::derive(pk, transactionId, 64));
+    response.insert(response.end(), { 0x90, 0x00 });
+  } else if (cla == 0x80 && ins == 0xC9 && authenticated) { // attestation exchange
+    processingUs = attestationUs;
+    outgoing.clear();
+    hkSim::tlv(outgoing, 0xC0, issuerId);
+    hkSim::tlv(outgoing, 0xC1, endpointId);
+    hkSim::tlv(outgoing, 0xC2, pk);
+    hkSim::tlv(outgoing, 0xC3, pk_x);
+    // the issuer signature and the certificate chain it is verified with
+    hkSim::tlv(outgoing, 0xC4, hkSim::derive(issuerId, pk, attestationSize - outgoing.size() - 4));
+    send(response);
+  } else if (cla == 0x00 && ins == 0xC0 && !outgoing.empty()) { // GET RESPONSE
+    processingUs = attestationUs;
+    send(response);
+  } else if (cla == 0x80 && ins == 0x3C) { // control flow
+    controlFlows.push_back(command[2]);
+    response = { 0x90, 0x00 };
+  } else {
+    response = { 0x6D, 0x00 };
+  }
+  return true;
+}
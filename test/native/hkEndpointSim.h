@@ -0,0 +1,59 @@
+#pragma once
+#include <HomeKey.h>
+#include "virtualPn532.h"
+
+/**
+ * Stand-in cryptography shared by `HKAuthenticationContext` and `hkEndpointSim_t`. `derive` is a
+ * deterministic mix of its inputs, enough for both sides to agree on cryptograms and persistent keys
+ * and to disagree when the keys don't match, it is not a KDF.
+ */
+namespace hkSim
+{
+  std::vector<uint8_t> derive(const std::vector<uint8_t>& key, const std::vector<uint8_t>& info, size_t len);
+  void tlv(std::vector<uint8_t>& out, uint8_t tag, const std::vector<uint8_t>& value);
+  /* Value of the first TLV tagged `tag` in `data` from `offset` on, empty if there is none */
+  std::vector<uint8_t> find(const std::vector<uint8_t>& data, uint8_t tag, size_t offset = 0);
+};
+
+/**
+ * A phone or watch with a HomeKey provisioned by the issuer `issuerId`, answering the SELECT, AUTH0,
+ * AUTH1, attestation exchange and control flow APDUs the way the HomeKey applet does, including the
+ * FAST cryptogram once it shares a persistent key with the reader. Like a device in Express Mode it
+ * only answers a target search after an ECP frame.
+ *
+ * The processing times are nominal values for a phone; the attestation package is returned in chunks
+ * with 61 xx like the applet does for responses larger than one frame.
+ */
+struct hkEndpointSim_t : public nfcTargetSim_t
+{
+  static constexpr int64_t selectUs = 5000;
+  static constexpr int64_t auth0Us = 25000;
+  static constexpr int64_t auth1Us = 60000;
+  static constexpr int64_t attestationUs = 15000; // per chunk of the attestation package
+  static constexpr int64_t controlUs = 3000;
+  static constexpr size_t chunkSize = 240;
+  static constexpr size_t attestationSize = 920;
+
+  std::vector<uint8_t> issuerId;
+  std::vector<uint8_t> endpointId;
+  std::vector<uint8_t> pk;
+  std::vector<uint8_t> pk_x;
+  // shared with the reader after a STANDARD or ATTESTATION flow, FAST fails while it is empty or stale
+  std::vector<uint8_t> persistentKey;
+  std::map<uint8_t, uint32_t> apdus;
+  std::vector<uint8_t> controlFlows;
+
+  hkEndpointSim_t(uint8_t seed, const std::vector<uint8_t>& issuerId);
+  /* The endpoint as the reader stores it once enrolled */
+  hkEndpoint_t enrolled() const;
+  bool apdu(const std::vector<uint8_t>& command, std::vector<uint8_t>& response, int64_t& processingUs) override;
+  void reset() override;
+
+private:
+  bool selected = false;
+  bool authenticated = false;
+  std::vector<uint8_t> transactionId;
+  std::vector<uint8_t> readerEphemeral;
+  std::vector<uint8_t> outgoing;
+  void send(std::vector<uint8_t>& response);
+};
@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "esp_err.h"
+
+// The parts of the ESP-MQTT client the firmware modules call, subscriptions are only recorded
+
+struct esp_mqtt_client
+{
+  struct subscription_t
+  {
+    std::string topic;
+    int qos;
+  };
+  std::vector<subscription_t> subscriptions;
+};
+typedef esp_mqtt_client* esp_mqtt_client_handle_t;
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char* topic, int qos);
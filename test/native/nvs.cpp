@@ -0,0 +1,113 @@
+#include <nvs.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstring>
+#include "sim.h"
+
+static constexpr int64_t nvsEntryUs = 60;
+
+namespace
+{
+  using namespace_t = std::map<std::string, std::vector<uint8_t>>;
+  struct store_t
+  {
+    std::map<std::string, namespace_t> namespaces;
+    std::vector<std::string> handles = { "" }; // handle 0 is never handed out
+    std::map<std::string, sim::io_t> io;
+  };
+  store_t& store() {
+    static store_t s;
+    return s;
+  }
+  namespace_t* find(nvs_handle_t handle) {
+    auto&& s = store();
+    if (handle == 0 || handle >= s.handles.size()) return nullptr;
+    return &s.namespaces[s.handles[handle]];
+  }
+  esp_err_t set(nvs_handle_t handle, const char* key, const void* value, size_t length) {
+    namespace_t* ns = find(handle);
+    if (ns == nullptr) return ESP_ERR_NVS_INVALID_HANDLE;
+    const uint8_t* bytes = static_cast<const uint8_t*>(value);
+    (*ns)[key].assign(bytes, bytes + length);
+    sim::io_t& io = store().io[store().handles[handle]];
+    io.writes++;
+    io.bytesWritten += length;
+    sim::busy(int64_t(1 + (length + 31) / 32) * nvsEntryUs);
+    return ESP_OK;
+  }
+  esp_err_t get(nvs_handle_t handle, const char* key, void* out, size_t* length) {
+    namespace_t* ns = find(handle);
+    if (ns == nullptr) return ESP_ERR_NVS_INVALID_HANDLE;
+    auto it = ns->find(key);
+    if (it == ns->end()) return ESP_ERR_NVS_NOT_FOUND;
+    if (out == nullptr) {
+      *length = it->second.size();
+      return ESP_OK;
+    }
+    if (*length < it->second.size()) return ESP_ERR_NVS_INVALID_LENGTH;
+    memcpy(out, it->second.data(), it->second.size());
+    *length = it->second.size();
+    sim::io_t& io = store().io[store().handles[handle]];
+    io.reads++;
+    io.bytesRead += *length;
+    return ESP_OK;
+  }
+};
+
+sim::io_t& sim::nvs(const std::string& ns) {
+  return store().io[ns];
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle) {
+  auto&& handles = store().handles;
+  handles.push_back(name);
+  *out_handle = handles.size() - 1;
+  return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length) {
+  return set(handle, key, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length) {
+  return get(handle, key, out_value, length);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char* key, uint8_t value) {
+  return set(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char* key, uint8_t* out_value) {
+  size_t length = sizeof(*out_value);
+  return get(handle, key, out_value, &length);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char* key, uint32_t value) {
+  return set(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char* key, uint32_t* out_value) {
+  size_t length = sizeof(*out_value);
+  return get(handle, key, out_value, &length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key) {
+  namespace_t* ns = find(handle);
+  if (ns == nullptr) return ESP_ERR_NVS_INVALID_HANDLE;
+  return ns->erase(key) ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+  namespace_t* ns = find(handle);
+  if (ns == nullptr) return ESP_ERR_NVS_INVALID_HANDLE;
+  ns->clear();
+  return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+  return find(handle) ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+}
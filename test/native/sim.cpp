@@ -0,0 +1,565 @@
+#include "sim.h"
+#include <Arduino.h>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+struct tskTaskControlBlock
+{
+  std::string name;
+  TaskFunction_t entry = nullptr;
+  void* arg = nullptr;
+  UBaseType_t priority = 0;
+  std::thread thread;
+  std::condition_variable cv;
+  uint32_t notified = 0;
+  // set while the task is blocked
+  const std::function<bool()>* ready = nullptr;
+  int64_t deadline = INT64_MAX;
+  bool blocked = false;
+  bool started = false;
+  bool killed = false;
+  bool dead = false;
+  uint64_t lastRun = 0;
+};
+
+struct QueueDefinition
+{
+  enum kind_t
+  {
+    QUEUE,
+    MUTEX,
+    RECURSIVE_MUTEX,
+    COUNTING
+  };
+  kind_t kind = QUEUE;
+  size_t length = 0;
+  size_t itemSize = 0;
+  std::deque<std::vector<uint8_t>> items;
+  UBaseType_t count = 0;
+  UBaseType_t maxCount = 1;
+  TaskHandle_t holder = nullptr;
+  UBaseType_t depth = 0;
+};
+
+struct esp_timer
+{
+  esp_timer_cb_t callback;
+  void* arg;
+  const char* name;
+  uint64_t period = 0;
+  bool active = false;
+  sim::event_id_t event = 0;
+};
+
+namespace
+{
+  // thrown into a task that is deleted or stopped by `sim::end`, caught by `task_main`
+  struct killed_t
+  {
+  };
+  struct event_t
+  {
+    sim::event_id_t id;
+    std::function<void()> callback;
+  };
+  struct isr_t
+  {
+    void (*handler)(void*) = nullptr;
+    void* arg = nullptr;
+    int mode = 0;
+  };
+
+  /**
+   * Only the task in `running` executes, every other task thread waits on its own condition variable,
+   * so the state below is only ever touched by one thread at a time and `m` is only needed to hand
+   * `running` over. Allocated once and never freed as task threads may outlive the static destructors.
+   */
+  struct kernel_t
+  {
+    std::mutex m;
+    std::vector<TaskHandle_t> tasks;
+    TaskHandle_t main;
+    TaskHandle_t running;
+    int64_t now = 1000000;
+    uint64_t switches = 0;
+    sim::event_id_t nextEvent = 1;
+    std::multimap<int64_t, event_t> events;
+    bool inEvent = false;
+    bool ending = false;
+    std::vector<QueueHandle_t> semaphores;
+    std::array<int, 64> levels{};
+    std::array<isr_t, 64> isrs{};
+    std::vector<sim::write_t> writes;
+
+    kernel_t() {
+      main = new tskTaskControlBlock;
+      main->name = "main";
+      main->priority = 1;
+      main->started = true;
+      tasks.push_back(main);
+      running = main;
+    }
+  };
+
+  kernel_t& kernel() {
+    static kernel_t* k = new kernel_t;
+    return *k;
+  }
+
+  int64_t deadline(TickType_t ticks) {
+    return ticks == portMAX_DELAY ? INT64_MAX : kernel().now + int64_t(ticks) * 1000;
+  }
+
+  bool runnable(TaskHandle_t t) {
+    if (t->dead) return false;
+    if (!t->started) return true;
+    return t->blocked && (t->killed || kernel().now >= t->deadline || (*t->ready)());
+  }
+
+  /* Picks the task to run next, moving the clock forward and firing events until one can run */
+  TaskHandle_t pick() {
+    kernel_t& k = kernel();
+    while (1) {
+      TaskHandle_t best = nullptr;
+      for (TaskHandle_t t : k.tasks) {
+        if (!runnable(t)) continue;
+        if (best == nullptr || t->priority > best->priority || (t->priority == best->priority && t->lastRun < best->lastRun)) best = t;
+      }
+      if (best != nullptr) {
+        best->started = true;
+        best->lastRun = ++k.switches;
+        return best;
+      }
+      int64_t next = k.events.empty() ? INT64_MAX : k.events.begin()->first;
+      for (TaskHandle_t t : k.tasks) {
+        if (t->blocked && !t->dead) next = std::min(next, t->deadline);
+      }
+      if (next == INT64_MAX) {
+        fprintf(stderr, "sim: every task is blocked forever\n%s", sim::describe().c_str());
+        abort();
+      }
+      k.now = std::max(k.now, next);
+      while (!k.events.empty() && k.events.begin()->first <= k.now) {
+        auto node = k.events.extract(k.events.begin());
+        k.inEvent = true;
+        node.mapped().callback();
+        k.inEvent = false;
+      }
+    }
+  }
+
+  void switch_to(TaskHandle_t self, TaskHandle_t next) {
+    kernel_t& k = kernel();
+    std::unique_lock<std::mutex> lock(k.m);
+    k.running = next;
+    next->cv.notify_one();
+    while (k.running != self) self->cv.wait(lock);
+  }
+
+  /* Blocks the running task until `ready` holds or `until` is reached, returns `ready()` */
+  bool block(const std::function<bool()>& ready, int64_t until) {
+    kernel_t& k = kernel();
+    TaskHandle_t self = k.running;
+    while (1) {
+      if (self->killed) throw killed_t();
+      if (ready()) return true;
+      if (k.now >= until) return false;
+      if (k.inEvent) {
+        fprintf(stderr, "sim: blocking call from a timer or ISR callback\n");
+        abort();
+      }
+      self->ready = &ready;
+      self->deadline = until;
+      self->blocked = true;
+      TaskHandle_t next = pick();
+      if (next != self) switch_to(self, next);
+      self->blocked = false;
+      self->ready = nullptr;
+    }
+  }
+
+  void release(TaskHandle_t t) {
+    for (QueueHandle_t q : kernel().semaphores) {
+      if (q->holder == t) {
+        q->holder = nullptr;
+        q->depth = 0;
+      }
+    }
+  }
+
+  void task_main(TaskHandle_t self) {
+    kernel_t& k = kernel();
+    {
+      std::unique_lock<std::mutex> lock(k.m);
+      while (k.running != self) self->cv.wait(lock);
+    }
+    try {
+      if (!self->killed) self->entry(self->arg);
+    } catch (killed_t&) {
+    }
+    self->dead = true;
+    release(self);
+    TaskHandle_t next = k.ending ? k.main : pick();
+    std::unique_lock<std::mutex> lock(k.m);
+    k.running = next;
+    next->cv.notify_one();
+  }
+
+  QueueHandle_t semaphore(QueueDefinition::kind_t kind, UBaseType_t maxCount, UBaseType_t count) {
+    QueueHandle_t q = new QueueDefinition;
+    q->kind = kind;
+    q->maxCount = maxCount;
+    q->count = count;
+    kernel().semaphores.push_back(q);
+    return q;
+  }
+
+  const std::function<bool()> never = [] { return false; };
+};
+
+namespace sim
+{
+  int64_t now() {
+    return kernel().now;
+  }
+
+  event_id_t at(int64_t at, std::function<void()> callback) {
+    kernel_t& k = kernel();
+    event_id_t id = k.nextEvent++;
+    k.events.emplace(at, event_t{ id, std::move(callback) });
+    return id;
+  }
+
+  void cancel(event_id_t id) {
+    auto&& events = kernel().events;
+    for (auto it = events.begin(); it != events.end(); it++) {
+      if (it->second.id == id) {
+        events.erase(it);
+        return;
+      }
+    }
+  }
+
+  void busy(int64_t us) {
+    block(never, kernel().now + us);
+  }
+
+  bool run_until(const std::function<bool()>& ready, int64_t timeoutUs) {
+    return block(ready, kernel().now + timeoutUs);
+  }
+
+  void end() {
+    kernel_t& k = kernel();
+    k.ending = true;
+    for (TaskHandle_t t : k.tasks) {
+      if (t == k.main || t->dead) continue;
+      t->killed = true;
+      t->started = true;
+      switch_to(k.main, t);
+    }
+    for (TaskHandle_t t : k.tasks) {
+      if (t->thread.joinable()) t->thread.join();
+    }
+    k.events.clear();
+    k.ending = false;
+  }
+
+  int pin(uint8_t gpio) {
+    return kernel().levels[gpio];
+  }
+
+  void drive(uint8_t gpio, int level) {
+    kernel_t& k = kernel();
+    int previous = k.levels[gpio];
+    k.levels[gpio] = level;
+    isr_t& isr = k.isrs[gpio];
+    if (isr.handler == nullptr || previous == level) return;
+    if (isr.mode == CHANGE || (isr.mode == FALLING && level == LOW) || (isr.mode == RISING && level == HIGH)) {
+      bool nested = k.inEvent;
+      k.inEvent = true;
+      isr.handler(isr.arg);
+      k.inEvent = nested;
+    }
+  }
+
+  const std::vector<write_t>& writes() {
+    return kernel().writes;
+  }
+
+  std::string describe() {
+    std::string out;
+    char line[160];
+    for (TaskHandle_t t : kernel().tasks) {
+      const char* state = t->dead ? "dead" : !t->started ? "new" : t->blocked ? "blocked" : "running";
+      snprintf(line, sizeof(line), "  %-16s prio %u %-8s deadline %lld notified %u\n", t->name.c_str(), t->priority, state, (long long)(t->deadline == INT64_MAX ? -1 : t->deadline), t->notified);
+      out += line;
+    }
+    return out;
+  }
+};
+
+BaseType_t xTaskCreate(TaskFunction_t entry, const char* name, uint32_t stackDepth, void* arg, UBaseType_t priority, TaskHandle_t* handle) {
+  TaskHandle_t t = new tskTaskControlBlock;
+  t->name = name;
+  t->entry = entry;
+  t->arg = arg;
+  t->priority = priority;
+  kernel().tasks.push_back(t);
+  t->thread = std::thread(task_main, t);
+  if (handle != nullptr) *handle = t;
+  return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t entry, const char* name, uint32_t stackDepth, void* arg, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+  return xTaskCreate(entry, name, stackDepth, arg, priority, handle);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  kernel_t& k = kernel();
+  if (task == nullptr || task == k.running) throw killed_t();
+  task->killed = true;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  block(never, deadline(ticks));
+}
+
+TickType_t xTaskGetTickCount() {
+  return kernel().now / 1000;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return kernel().running;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+  TaskHandle_t self = kernel().running;
+  block([self] { return self->notified > 0; }, deadline(ticks));
+  uint32_t value = self->notified;
+  if (value) self->notified = clearOnExit ? 0 : value - 1;
+  return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  if (task != nullptr && !task->dead) task->notified++;
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higherPriorityTaskWoken) {
+  xTaskNotifyGive(task);
+  if (higherPriorityTaskWoken != nullptr) *higherPriorityTaskWoken = pdTRUE;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  return 1024;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  QueueHandle_t q = new QueueDefinition;
+  q->length = length;
+  q->itemSize = itemSize;
+  return q;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+  auto&& semaphores = kernel().semaphores;
+  semaphores.erase(std::remove(semaphores.begin(), semaphores.end(), queue), semaphores.end());
+  delete queue;
+}
+
+static BaseType_t queue_send(QueueHandle_t queue, const void* item, TickType_t ticks, bool front) {
+  if (!block([queue] { return queue->items.size() < queue->length; }, deadline(ticks))) return pdFALSE;
+  const uint8_t* bytes = static_cast<const uint8_t*>(item);
+  std::vector<uint8_t> copy(bytes, bytes + queue->itemSize);
+  if (front) queue->items.push_front(std::move(copy));
+  else queue->items.push_back(std::move(copy));
+  return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks) {
+  return queue_send(queue, item, ticks, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void* item, TickType_t ticks) {
+  return queue_send(queue, item, ticks, true);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* higherPriorityTaskWoken) {
+  return queue_send(queue, item, 0, false);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void* item) {
+  queue->items.clear();
+  return queue_send(queue, item, 0, false);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+  if (!block([queue] { return !queue->items.empty(); }, deadline(ticks))) return pdFALSE;
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  return pdTRUE;
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t ticks) {
+  if (!block([queue] { return !queue->items.empty(); }, deadline(ticks))) return pdFALSE;
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+  queue->items.clear();
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  return queue->kind == QueueDefinition::QUEUE ? queue->items.size() : queue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return semaphore(QueueDefinition::MUTEX, 1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+  return semaphore(QueueDefinition::RECURSIVE_MUTEX, 1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  return semaphore(QueueDefinition::COUNTING, 1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+  return semaphore(QueueDefinition::COUNTING, maxCount, initialCount);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+  TaskHandle_t self = kernel().running;
+  switch (semaphore->kind) {
+  case QueueDefinition::COUNTING:
+    if (!block([semaphore] { return semaphore->count > 0; }, deadline(ticks))) return pdFALSE;
+    semaphore->count--;
+    return pdTRUE;
+  case QueueDefinition::RECURSIVE_MUTEX:
+    if (!block([semaphore, self] { return semaphore->holder == nullptr || semaphore->holder == self; }, deadline(ticks))) return pdFALSE;
+    break;
+  default:
+    if (semaphore->holder == self && ticks == portMAX_DELAY) {
+      fprintf(stderr, "sim: task %s takes a mutex it already holds\n", self->name.c_str());
+      abort();
+    }
+    if (!block([semaphore] { return semaphore->holder == nullptr; }, deadline(ticks))) return pdFALSE;
+  }
+  semaphore->holder = self;
+  semaphore->depth++;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  if (semaphore->kind == QueueDefinition::COUNTING) {
+    if (semaphore->count >= semaphore->maxCount) return pdFALSE;
+    semaphore->count++;
+    return pdTRUE;
+  }
+  if (semaphore->holder != kernel().running) return pdFALSE;
+  if (--semaphore->depth == 0) semaphore->holder = nullptr;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks) {
+  return xSemaphoreTake(semaphore, ticks);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore) {
+  return xSemaphoreGive(semaphore);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* higherPriorityTaskWoken) {
+  return xSemaphoreGive(semaphore);
+}
+
+int64_t esp_timer_get_time() {
+  return kernel().now;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+  *handle = new esp_timer{ args->callback, args->arg, args->name };
+  return ESP_OK;
+}
+
+static void timer_fire(esp_timer_handle_t timer) {
+  if (timer->period) {
+    timer->event = sim::at(kernel().now + timer->period, [timer] { timer_fire(timer); });
+  } else {
+    timer->active = false;
+  }
+  timer->callback(timer->arg);
+}
+
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t us, uint64_t period) {
+  if (timer->active) return ESP_ERR_INVALID_STATE;
+  timer->active = true;
+  timer->period = period;
+  timer->event = sim::at(kernel().now + us, [timer] { timer_fire(timer); });
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs) {
+  return timer_start(timer, timeoutUs, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs) {
+  return timer_start(timer, periodUs, periodUs);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  if (!timer->active) return ESP_ERR_INVALID_STATE;
+  sim::cancel(timer->event);
+  timer->active = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  if (timer->active) return ESP_ERR_INVALID_STATE;
+  delete timer;
+  return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+  return timer->active;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (mode == INPUT_PULLUP) kernel().levels[pin] = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  kernel_t& k = kernel();
+  k.levels[pin] = val;
+  k.writes.push_back({ k.now, pin, val });
+}
+
+int digitalRead(uint8_t pin) {
+  return kernel().levels[pin];
+}
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode) {
+  kernel().isrs[pin] = { handler, arg, mode };
+}
+
+void detachInterrupt(uint8_t pin) {
+  kernel().isrs[pin] = {};
+}
+
+unsigned long millis() {
+  return kernel().now / 1000;
+}
+
+unsigned long micros() {
+  return kernel().now;
+}
+
+void delay(uint32_t ms) {
+  vTaskDelay(ms);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Discrete-event stand-in for FreeRTOS, esp_timer and the GPIO matrix used by the native build.
+ *
+ * Every FreeRTOS task is a host thread, but only one of them runs at a time, like tasks sharing a
+ * single core. A task runs until it blocks (delay, notification, queue, semaphore, or `busy` while it
+ * waits on a modelled transfer), then the highest priority task that can continue runs next. Time is
+ * virtual: it only moves forward when every task is blocked, jumping straight to the next timer, ISR
+ * or wake-up, so `esp_timer_get_time` reads the same on every run regardless of the host. Code between
+ * two blocking calls takes no virtual time at all, costs of the hardware and of the crypto are charged
+ * explicitly by the models with `busy`.
+ *
+ * The thread running the test is the `main` task (priority 1). Other tasks only run while it is
+ * blocked, typically in `run_for` or `run_until`.
+ */
+namespace sim
+{
+  using event_id_t = uint64_t;
+
+  /* Current virtual time in microseconds, starts at 1s */
+  int64_t now();
+  /* Runs `callback` at `at` from the timer/ISR context, which must never block */
+  event_id_t at(int64_t at, std::function<void()> callback);
+  void cancel(event_id_t id);
+
+  /* Blocks the calling task for `us` of virtual time, other tasks run meanwhile */
+  void busy(int64_t us);
+  /* Blocks the calling task until `ready` holds or `timeoutUs` passed, returns `ready()` */
+  bool run_until(const std::function<bool()>& ready, int64_t timeoutUs);
+  inline void run_for(int64_t us) { busy(us); }
+
+  /* Stops every task but `main` and releases what they held, call before the test binary exits */
+  void end();
+
+  /* Level of a GPIO as last written by the firmware or a model */
+  int pin(uint8_t gpio);
+  /* Drives an input GPIO from a model, edges trigger the ISR attached with `attachInterruptArg` */
+  void drive(uint8_t gpio, int level);
+  struct write_t
+  {
+    int64_t at;
+    uint8_t gpio;
+    int level;
+  };
+  /* Every `digitalWrite` so far, in order */
+  const std::vector<write_t>& writes();
+
+  struct io_t
+  {
+    uint32_t reads = 0;
+    uint64_t bytesRead = 0;
+    uint32_t writes = 0;
+    uint64_t bytesWritten = 0;
+  };
+  /* File operations on the LittleFS stand-in so far */
+  io_t& littlefs();
+  /* Blob reads and writes that reached the NVS stand-in so far, per namespace */
+  io_t& nvs(const std::string& ns);
+
+  /* Names of the tasks created so far, with their state, for failure messages */
+  std::string describe();
+};
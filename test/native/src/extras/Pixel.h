@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+
+// HomeSpan's Pixel driver, only remembers the last colors pushed
+
+typedef const uint8_t* pixelType_t;
+
+namespace PixelType
+{
+  inline constexpr uint8_t RGB[] = { 0, 1, 2, 3 };
+  inline constexpr uint8_t RBG[] = { 0, 2, 1, 3 };
+  inline constexpr uint8_t BRG[] = { 1, 2, 0, 3 };
+  inline constexpr uint8_t BGR[] = { 2, 1, 0, 3 };
+  inline constexpr uint8_t GBR[] = { 2, 0, 1, 3 };
+  inline constexpr uint8_t GRB[] = { 1, 0, 2, 3 };
+};
+
+class Pixel
+{
+public:
+  struct Color
+  {
+    uint8_t r = 0;
+    uint8_t g = 0;
+    uint8_t b = 0;
+    uint8_t w = 0;
+    Color RGB(uint8_t red, uint8_t green, uint8_t blue, uint8_t white = 0) {
+      r = red;
+      g = green;
+      b = blue;
+      w = white;
+      return *this;
+    }
+  };
+  static Color RGB(uint8_t red, uint8_t green, uint8_t blue, uint8_t white = 0) {
+    return Color().RGB(red, green, blue, white);
+  }
+  Pixel(int pin, pixelType_t pixelType = PixelType::GRB) : pin(pin) {}
+  void set(Color color, int nPixels = 1) { last = color; }
+  void set(Color* color, int nPixels, bool multiColor = true) { last = color[0]; }
+  void setPixelType(pixelType_t pixelType) {}
+  int pin;
+  Color last;
+};
@@ -0,0 +1,12 @@
+#include <utils.h>
+
+std::string utils::bufToHexString(const uint8_t* buf, size_t len, bool ignoreLevel) {
+  static constexpr char digits[] = "0123456789abcdef";
+  std::string hex;
+  hex.reserve(len * 2);
+  for (size_t i = 0; i < len; i++) {
+    hex.push_back(digits[buf[i] >> 4]);
+    hex.push_back(digits[buf[i] & 0x0F]);
+  }
+  return hex;
+}
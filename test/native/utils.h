@@ -0,0 +1,11 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// The helpers of HK-HomeKit-Lib's utils.h the firmware uses
+
+namespace utils
+{
+  std::string bufToHexString(const uint8_t* buf, size_t len, bool ignoreLevel = false);
+};
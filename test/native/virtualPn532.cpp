@@ -0,0 +1,208 @@
+#include "virtualPn532.h"
+#include <Arduino.h>
+
+// ATS of the HomeKey endpoints: FSCI 8 (256 bytes), FWI 7, SFGI 0
+static const std::vector<uint8_t> isoDepAts = { 0x05, 0x78, 0x80, 0x70, 0x02 };
+
+virtualPn532_t& virtualPn532_t::at(uint8_t ss) {
+  static std::map<uint8_t, virtualPn532_t*> devices;
+  virtualPn532_t*& device = devices[ss];
+  if (device == nullptr) device = new virtualPn532_t;
+  return *device;
+}
+
+void virtualPn532_t::wire(uint8_t gpio) {
+  irqPin = gpio;
+  updateIrq();
+}
+
+void virtualPn532_t::place(nfcTargetSim_t& target, int64_t enter, int64_t durationUs) {
+  enter = std::max(enter, sim::now());
+  field.push_back(std::make_unique<presence_t>(presence_t{ &target, enter, enter + durationUs }));
+  uint8_t command = pending.command.empty() ? 0 : pending.command[0];
+  // a search still running may find the new target, its outcome up to now can't change as the target wasn't there yet
+  if ((command == 0x4A || command == 0x60) && !pending.read && sim::now() < pending.readyAt) {
+    evaluate();
+    scheduleIrq();
+  }
+}
+
+void virtualPn532_t::clear() {
+  if (active != nullptr) active->target->reset();
+  active = nullptr;
+  pending.activates = nullptr;
+  field.clear();
+}
+
+void virtualPn532_t::receive(const std::vector<uint8_t>& command) {
+  commands[command[0]]++;
+  pending = pending_t();
+  pending.command = command;
+  pending.received = sim::now();
+  pending.ackAt = sim::now() + ackUs;
+  pending.acked = false;
+  pending.read = false;
+  evaluate();
+  scheduleIrq();
+  updateIrq();
+}
+
+void virtualPn532_t::ackRead() {
+  pending.acked = true;
+  updateIrq();
+}
+
+const std::vector<uint8_t>& virtualPn532_t::responseRead() {
+  pending.read = true;
+  if (pending.activates != nullptr) {
+    if (active != nullptr) active->target->reset();
+    active = pending.activates;
+    active->target->reset();
+  }
+  updateIrq();
+  return pending.response;
+}
+
+int64_t virtualPn532_t::search(int64_t start, int64_t step, uint32_t attempts, presence_t** found) const {
+  int64_t best = INT64_MAX;
+  if (!rfOn) return best;
+  for (auto&& p : field) {
+    if (p->target->needsEcp && p->ecpAt < 0) continue;
+    int64_t from = std::max({ start, p->enter, p->ecpAt });
+    int64_t k = (from - start + step - 1) / step;
+    if (k >= attempts) continue;
+    int64_t attempt = start + k * step;
+    if (attempt + activationUs <= p->leave && attempt < best) {
+      best = attempt;
+      *found = p.get();
+    }
+  }
+  return best;
+}
+
+void virtualPn532_t::answer(std::vector<uint8_t> response, int64_t at) {
+  pending.response = std::move(response);
+  pending.readyAt = at;
+}
+
+void virtualPn532_t::searched(presence_t* found, int64_t foundAt, int64_t exhaustedAt, bool autoPoll) {
+  pending.activates = nullptr;
+  if (found == nullptr) {
+    answer({ 0x00 }, exhaustedAt);
+    return;
+  }
+  nfcTargetSim_t& t = *found->target;
+  std::vector<uint8_t> target = { 0x01, t.atqa[0], t.atqa[1], t.sak, uint8_t(t.uid.size()) };
+  target.insert(target.end(), t.uid.begin(), t.uid.end());
+  if (t.sak & 0x20) target.insert(target.end(), isoDepAts.begin(), isoDepAts.end());
+  std::vector<uint8_t> response = { 0x01 };
+  if (autoPoll) {
+    // Type 0x20 is a passive ISO/IEC14443-4 target, 0x10 a Mifare card
+    response.push_back(t.sak & 0x20 ? 0x20 : 0x10);
+    response.push_back(target.size());
+  }
+  response.insert(response.end(), target.begin(), target.end());
+  pending.activates = found;
+  answer(response, foundAt + activationUs);
+}
+
+void virtualPn532_t::exchange(const std::vector<uint8_t>& data) {
+  int64_t arrived = pending.received + rfUs(data.size());
+  std::vector<uint8_t> response;
+  int64_t processingUs = 0;
+  if (active == nullptr || !present(active, arrived) || !active->target->apdu(data, response, processingUs)) {
+    answer({ 0x01 }, arrived + fwtUs);
+    return;
+  }
+  int64_t done = arrived + processingUs + rfUs(response.size());
+  if (!present(active, done)) {
+    answer({ 0x01 }, arrived + std::max(processingUs, fwtUs));
+    return;
+  }
+  response.insert(response.begin(), 0x00);
+  answer(response, done);
+}
+
+void virtualPn532_t::evaluate() {
+  const std::vector<uint8_t>& cmd = pending.command;
+  int64_t received = pending.received;
+  std::vector<uint8_t> data(cmd.begin() + 1, cmd.end());
+  switch (cmd[0]) {
+    case 0x02: // GetFirmwareVersion: IC, Ver, Rev, Support
+      answer({ 0x32, 0x01, 0x06, 0x07 }, received + commandUs);
+      break;
+    case 0x06: // ReadRegister, every register reads 0
+      answer(std::vector<uint8_t>(data.size() / 2, 0x00), received + commandUs);
+      break;
+    case 0x32: // RFConfiguration
+      if (data.size() >= 2 && data[0] == 0x01) {
+        rfOn = data[1] & 0x01;
+        if (!rfOn && active != nullptr) {
+          active->target->reset();
+          active = nullptr;
+        }
+      } else if (data.size() >= 4 && data[0] == 0x05) {
+        retries = data[3];
+      }
+      answer({}, received + commandUs);
+      break;
+    case 0x4A: { // InListPassiveTarget, MaxTg, BrTy
+      int64_t start = received + ackUs;
+      uint32_t attempts = retries == 0xFF ? UINT32_MAX : retries + 1u;
+      presence_t* found = nullptr;
+      int64_t foundAt = search(start, searchUs, attempts, &found);
+      searched(found, foundAt, retries == 0xFF ? INT64_MAX : start + attempts * searchUs, false);
+      break;
+    }
+    case 0x60: { // InAutoPoll, PollNr, Period, Type
+      int64_t start = received + ackUs;
+      int64_t step = std::max<int64_t>(data[1], 1) * autoPollUs;
+      uint32_t attempts = data[0] == 0xFF ? UINT32_MAX : data[0];
+      presence_t* found = nullptr;
+      int64_t foundAt = search(start, step, attempts, &found);
+      searched(found, foundAt, data[0] == 0xFF ? INT64_MAX : start + attempts * step, true);
+      break;
+    }
+    case 0x42: // InCommunicateThru, nothing answers an ECP frame so it always ends with a timeout
+      if (!data.empty() && data[0] == 0x6A) {
+        for (auto&& p : field) {
+          if (present(p.get(), received) && p->ecpAt < 0) p->ecpAt = received;
+        }
+      }
+      answer({ 0x01 }, received + rfUs(data.size()) + rfTimeoutUs);
+      break;
+    case 0x40: // InDataExchange, Tg, DataOut
+      exchange(std::vector<uint8_t>(data.begin() + 1, data.end()));
+      break;
+    case 0x00: // Diagnose, only the attention request (NumTst 0x06) is modelled
+      if (active != nullptr && present(active, received + 2 * rfUs(1))) {
+        answer({ 0x00 }, received + 2 * rfUs(1));
+      } else {
+        answer({ 0x01 }, received + rfUs(1) + fwtUs);
+      }
+      break;
+    case 0x52: // InRelease
+      if (active != nullptr) {
+        active->target->reset();
+        active = nullptr;
+      }
+      answer({ 0x00 }, received + commandUs + rfUs(1));
+      break;
+    default: // SAMConfiguration, WriteRegister
+      answer({}, received + commandUs);
+      break;
+  }
+}
+
+void virtualPn532_t::updateIrq() {
+  if (irqPin == 255) return;
+  sim::drive(irqPin, ackReady() || responseReady() ? LOW : HIGH);
+}
+
+void virtualPn532_t::scheduleIrq() {
+  for (sim::event_id_t id : irqEvents) sim::cancel(id);
+  irqEvents.clear();
+  if (irqPin == 255) return;
+  irqEvents.push_back(sim::at(pending.ackAt, [this] { updateIrq(); }));
+  if (pending.readyAt != INT64_MAX) irqEvents.push_back(sim::at(pending.readyAt, [this] { updateIrq(); }));
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+#include "sim.h"
+
+/**
+ * Something that can be put in front of a reader: a plain ISO14443A tag, or a phone or watch running
+ * the HomeKey applet (see `hkEndpointSim_t`).
+ */
+struct nfcTargetSim_t
+{
+  std::vector<uint8_t> uid;
+  std::array<uint8_t, 2> atqa{ 0x04, 0x00 };
+  uint8_t sak = 0x08;
+  // Express Mode devices only answer a target search once an ECP frame reached them in the field
+  bool needsEcp = false;
+
+  virtual ~nfcTargetSim_t() = default;
+  /* Handles an APDU, returns `false` if the target doesn't answer. `processingUs` is how long the target needs before it answers */
+  virtual bool apdu(const std::vector<uint8_t>& command, std::vector<uint8_t>& response, int64_t& processingUs) { return false; }
+  /* The target was activated again, released or lost the field */
+  virtual void reset() {}
+};
+
+/**
+ * Model of a PN532 in the host controller mode used by the firmware, bound to the SS pin the SPI
+ * transport selects it with. It answers the commands sent by `PN532` and the NFC task (firmware
+ * version, SAM and RF configuration, registers, InListPassiveTarget, InAutoPoll, InCommunicateThru,
+ * InDataExchange, InRelease and the Diagnose attention request) with the frames of the datasheet,
+ * drives its IRQ line low whenever a frame waits to be read, and searches the targets placed in its
+ * field with `place`.
+ *
+ * The timing constants are nominal values for a PN532 at 106 kbps behind a 1 MHz SPI bus, they set
+ * the absolute numbers the benchmark prints; what a change to the firmware does to them is what the
+ * benchmark is for.
+ */
+struct virtualPn532_t
+{
+  static constexpr int64_t spiByteUs = 8;         // SPI clock of the PN532 transport, 1 MHz
+  static constexpr int64_t ackUs = 300;           // command frame received to ACK frame ready
+  static constexpr int64_t commandUs = 600;       // commands the PN532 handles without RF traffic
+  static constexpr int64_t rfByteUs = 85;         // 106 kbps with parity bits
+  static constexpr int64_t rfFrameUs = 400;       // frame delay time, SOF/EOF and CRC around every RF frame
+  static constexpr int64_t activationUs = 5000;   // REQA, anticollision, SELECT and RATS of a target
+  static constexpr int64_t searchUs = 3000;       // one passive activation attempt with nobody answering
+  static constexpr int64_t rfTimeoutUs = 51200;   // how long the PN532 waits for a frame nobody answers
+  static constexpr int64_t fwtUs = 38700;         // frame waiting time of ISO-DEP targets, FWI 7 in the ATS below
+  static constexpr int64_t autoPollUs = 150000;   // InAutoPoll period unit
+
+  struct presence_t
+  {
+    nfcTargetSim_t* target;
+    int64_t enter;
+    int64_t leave;
+    int64_t ecpAt = -1;
+  };
+  struct pending_t
+  {
+    std::vector<uint8_t> command;
+    int64_t received = 0;
+    int64_t ackAt = 0;
+    int64_t readyAt = INT64_MAX;
+    // nothing pending until the first command
+    bool acked = true;
+    bool read = true;
+    std::vector<uint8_t> response;
+    presence_t* activates = nullptr;
+  };
+
+  uint8_t irqPin = 255;
+  std::vector<std::unique_ptr<presence_t>> field;
+  presence_t* active = nullptr;
+  pending_t pending;
+  bool rfOn = false;
+  uint8_t retries = 0xFF;
+  std::map<uint8_t, uint32_t> commands;
+  // status bytes the host read while waiting on a command, per command
+  std::map<uint8_t, uint32_t> statusReads;
+  std::vector<sim::event_id_t> irqEvents;
+
+  /* The PN532 wired to `ss`, created on first use */
+  static virtualPn532_t& at(uint8_t ss);
+  /* Wires the IRQ line to `gpio`, 255 leaves it unconnected */
+  void wire(uint8_t gpio);
+  /* Puts `target` in the field from `enter` until `enter + durationUs` */
+  void place(nfcTargetSim_t& target, int64_t enter, int64_t durationUs);
+  /* Takes every target out of the field */
+  void clear();
+  bool present(const presence_t* p, int64_t t) const { return rfOn && p->enter <= t && t < p->leave; }
+
+  // transport side
+  void receive(const std::vector<uint8_t>& command);
+  bool ackReady() const { return !pending.acked && sim::now() >= pending.ackAt; }
+  void ackRead();
+  bool responseReady() const { return pending.acked && !pending.read && sim::now() >= pending.readyAt; }
+  const std::vector<uint8_t>& responseRead();
+
+private:
+  static int64_t rfUs(size_t bytes) { return rfFrameUs + int64_t(bytes) * rfByteUs; }
+  /* First attempt on the grid `start + k * step` that activates a target, INT64_MAX if none does within `attempts` */
+  int64_t search(int64_t start, int64_t step, uint32_t attempts, presence_t** found) const;
+  /* Works out the response to the pending command and when it is ready */
+  void evaluate();
+  void searched(presence_t* found, int64_t foundAt, int64_t exhaustedAt, bool autoPoll);
+  void exchange(const std::vector<uint8_t>& data);
+  void answer(std::vector<uint8_t> response, int64_t at);
+  void updateIrq();
+  void scheduleIrq();
+};
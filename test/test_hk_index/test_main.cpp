@@ -0,0 +1,133 @@
+#include <unity.h>
+#include <chrono>
+#include <hkEndpointSim.h>
+#include "hkIndex.h"
+
+/**
+ * `hkIndex` lookups from 10 to 2000 enrolled endpoints, against the nested linear scan over
+ * `readerData` it replaced. Probe lengths are checked exactly; the timings are host time and only
+ * compared with each other.
+ */
+
+static constexpr size_t sizes[] = { 10, 100, 500, 1000, 2000 };
+static constexpr size_t issuers = 8;
+static constexpr int rounds = 20000;
+
+static readerData_t makeReaderData(size_t endpoints) {
+  readerData_t data;
+  for (size_t i = 0; i < issuers; i++) {
+    hkIssuer_t issuer;
+    issuer.issuer_id = hkSim::derive({ uint8_t(i) }, { 'i', 's', 's' }, 8);
+    data.issuers.push_back(issuer);
+  }
+  for (size_t i = 0; i < endpoints; i++) {
+    hkEndpoint_t endpoint;
+    endpoint.endpoint_id = hkSim::derive({ uint8_t(i), uint8_t(i >> 8) }, { 'e', 'p' }, 6);
+    data.issuers[i % issuers].endpoints.push_back(endpoint);
+  }
+  return data;
+}
+
+static hkEndpoint_t* linearFind(readerData_t& data, const std::vector<uint8_t>& id) {
+  for (auto&& issuer : data.issuers) {
+    for (auto&& endpoint : issuer.endpoints) {
+      if (std::equal(endpoint.endpoint_id.begin(), endpoint.endpoint_id.end(), id.begin())) return &endpoint;
+    }
+  }
+  return nullptr;
+}
+
+/* Best of 5 runs of `rounds` calls to `lookup`, in ns per call */
+template <typename F>
+static double timeLookups(F&& lookup) {
+  double best = 1e18;
+  for (int run = 0; run < 5; run++) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) lookup(i);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count() / rounds);
+  }
+  return best;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_every_entry_found(void) {
+  readerData_t data = makeReaderData(2000);
+  hkIndex.rebuild(data);
+  TEST_ASSERT_EQUAL(2000, hkIndex.endpoints);
+  uint16_t ordinal = 0;
+  for (auto&& issuer : data.issuers) {
+    TEST_ASSERT_TRUE(hkIndex.findIssuer(data, issuer.issuer_id.data(), issuer.issuer_id.size()) == &issuer);
+    for (auto&& endpoint : issuer.endpoints) {
+      hkIssuer_t* owner = nullptr;
+      TEST_ASSERT_TRUE(hkIndex.findEndpoint(data, endpoint.endpoint_id.data(), endpoint.endpoint_id.size(), &owner) == &endpoint);
+      TEST_ASSERT_TRUE(owner == &issuer);
+      TEST_ASSERT_EQUAL(ordinal++, hkIndex.endpointOrdinal(hkIndex_t::makeKey(endpoint.endpoint_id.data(), endpoint.endpoint_id.size())));
+    }
+  }
+  std::vector<uint8_t> unknown = hkSim::derive({ 0xFF, 0xFF }, { 'e', 'p' }, 6);
+  TEST_ASSERT_NULL(hkIndex.findEndpoint(data, unknown.data(), unknown.size()));
+  // an issuer ID never matches an endpoint lookup and the other way around
+  TEST_ASSERT_NULL(hkIndex.findEndpoint(data, data.issuers[0].issuer_id.data(), 8));
+  auto&& endpointId = data.issuers[0].endpoints[0].endpoint_id;
+  TEST_ASSERT_NULL(hkIndex.findIssuer(data, endpointId.data(), endpointId.size()));
+}
+
+void test_probe_length_flat(void) {
+  for (size_t endpoints : sizes) {
+    readerData_t data = makeReaderData(endpoints);
+    hkIndex.rebuild(data);
+    size_t mask = hkIndex.table.size() - 1;
+    size_t probes = 0;
+    size_t longest = 0;
+    size_t entries = 0;
+    for (size_t i = 0; i < hkIndex.table.size(); i++) {
+      auto&& entry = hkIndex.table[i];
+      if (entry.issuer == hkIndex_t::NONE) continue;
+      size_t distance = (i - hkIndex.slot(entry.key)) & mask;
+      probes += distance + 1;
+      longest = std::max(longest, distance + 1);
+      entries++;
+    }
+    TEST_ASSERT_EQUAL(endpoints + issuers, entries);
+    // at most half full
+    TEST_ASSERT_GREATER_OR_EQUAL(2 * entries, hkIndex.table.size());
+    double average = double(probes) / entries;
+    printf("%5zu endpoints: %5zu slots, %.2f probes on average, %zu at most\n", endpoints, hkIndex.table.size(), average, longest);
+    TEST_ASSERT_TRUE_MESSAGE(average < 2.0, "average probe length grew with the endpoint count");
+  }
+}
+
+void test_lookup_cost_flat(void) {
+  double first = 0;
+  for (size_t endpoints : sizes) {
+    readerData_t data = makeReaderData(endpoints);
+    hkIndex.rebuild(data);
+    std::vector<std::vector<uint8_t>> ids;
+    for (auto&& issuer : data.issuers) {
+      for (auto&& endpoint : issuer.endpoints) ids.push_back(endpoint.endpoint_id);
+    }
+    size_t found = 0;
+    double indexed = timeLookups([&](int i) {
+      auto&& id = ids[i % ids.size()];
+      found += hkIndex.findEndpoint(data, id.data(), id.size()) != nullptr;
+    });
+    double linear = timeLookups([&](int i) { found += linearFind(data, ids[i % ids.size()]) != nullptr; });
+    TEST_ASSERT_EQUAL(size_t(10) * rounds, found);
+    printf("%5zu endpoints: index %7.1f ns, linear scan %9.1f ns per lookup\n", endpoints, indexed, linear);
+    if (first == 0) first = indexed;
+    else TEST_ASSERT_TRUE_MESSAGE(indexed < 4 * first, "index lookup cost grew with the endpoint count");
+    if (endpoints >= 500) TEST_ASSERT_TRUE(indexed < linear);
+  }
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_every_entry_found);
+  RUN_TEST(test_probe_length_flat);
+  RUN_TEST(test_lookup_cost_flat);
+  return UNITY_END();
+}
@@ -0,0 +1,142 @@
+#include <unity.h>
+#include <LittleFS.h>
+#include <sim.h>
+#include <virtualPn532.h>
+#include <hkEndpointSim.h>
+#include "actionsEngine.h"
+#include "eventBus.h"
+#include "hkIndex.h"
+#include "nfcReader.h"
+#include "readerStore.h"
+#include "uidAllowlist.h"
+
+/**
+ * Interrupt-driven detection (`nfcIrqPin`): the virtual PN532 pulls its IRQ line low whenever a frame
+ * is ready, which fires `nfc_irq_isr` through `attachInterruptArg` like the GPIO matrix would.
+ */
+
+static constexpr uint8_t irqPin = 27;
+static constexpr int64_t dwellUs = 1500000;
+static constexpr int64_t settleUs = 400000;
+
+static const std::vector<uint8_t> issuerId = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88 };
+static hkEndpointSim_t phone(1, issuerId);
+static eventBus_t::subscriber_t* sub;
+
+static virtualPn532_t& pn532() {
+  return virtualPn532_t::at(espConfig::miscConfig.nfcGpioPins[0]);
+}
+
+static void boot() {
+  espConfig::miscConfig.nfcIrqPin = irqPin;
+  nvs_open("SAVED_DATA", NVS_READWRITE, &savedData);
+  readerStore.begin();
+  readerData.reader_sk = hkSim::derive({ 0x01 }, { 's', 'k' }, 32);
+  readerData.reader_gid = { 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8 };
+  readerData.reader_id = { 0xB1, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8 };
+  hkIssuer_t issuer;
+  issuer.issuer_id = issuerId;
+  phone.persistentKey = hkSim::derive(phone.pk_x, { 0xFF }, 32);
+  issuer.endpoints.push_back(phone.enrolled());
+  readerData.issuers.push_back(issuer);
+  readerStore.save();
+  hkIndex.rebuild(readerData);
+
+  pn532().wire(irqPin);
+  nfcReaders.emplace_back(std::make_unique<nfcReader_t>(0, espConfig::miscConfig.nfcGpioPins[0], espConfig::miscConfig.nfcIrqPin));
+  LittleFS.begin(true);
+  actionsEngine.begin();
+  memcpy(ecpData + 8, readerData.reader_gid.data(), readerData.reader_gid.size());
+  with_crc16(ecpData, 16, ecpData + 16);
+  uidAllowlist.begin();
+  sub = eventBus.subscribe();
+  nfcReader_t* reader = nfcReaders[0].get();
+  reader->authPool.begin(reader->pn532, reader->workingData);
+  xTaskCreate(nfc_thread_entry, "nfc_task_0", 8192, reader, 1, &reader->task);
+  sim::run_for(1000000);
+}
+
+/* Puts `target` in the field `offsetUs` from now, returns the time from entering to detection or -1 */
+static int64_t tap(nfcTargetSim_t& target, int64_t offsetUs, busEvent_t& event) {
+  int64_t enter = sim::now() + offsetUs;
+  pn532().place(target, enter, dwellUs);
+  bool posted = sim::run_until([] { return eventBus.head.load() != sub->cursor; }, offsetUs + dwellUs);
+  if (posted) eventBus.next(*sub, event);
+  sim::run_for(enter + dwellUs + settleUs - sim::now());
+  return posted ? int64_t(uint32_t(event.detected - uint32_t(enter))) : -1;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_reader_armed_with_autopoll(void) {
+  TEST_ASSERT_GREATER_THAN(0, pn532().commands[0x60]);
+  TEST_ASSERT_EQUAL(0, pn532().commands[0x4A]);
+  TEST_ASSERT_EQUAL(HIGH, sim::pin(irqPin));
+}
+
+void test_task_sleeps_while_searching(void) {
+  uint32_t polls = pn532().commands[0x60];
+  uint32_t reads = pn532().statusReads[0x60];
+  sim::run_for(5000000);
+  polls = pn532().commands[0x60] - polls;
+  reads = pn532().statusReads[0x60] - reads;
+  printf("idle 5s: %u InAutoPoll, %u status reads while they ran (%u ms of searching)\n", polls, reads, polls * 150);
+  TEST_ASSERT_GREATER_THAN(20, polls);
+  // ACK wait and the read after the IRQ, instead of one status read per millisecond of searching
+  TEST_ASSERT_LESS_OR_EQUAL(3 * polls, reads);
+}
+
+void test_irq_wakes_task_on_detection(void) {
+  std::vector<int64_t> latencies;
+  for (int i = 0; i < 10; i++) {
+    busEvent_t event;
+    int64_t latency = tap(phone, (i * 7919) % 200000, event);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, latency);
+    TEST_ASSERT_EQUAL(busEvent_t::HOMEKEY_SUCCESS, event.type);
+    latencies.push_back(latency);
+  }
+  std::sort(latencies.begin(), latencies.end());
+  printf("phone detect p50 %.1f max %.1f ms\n", latencies[latencies.size() / 2] / 1000.0, latencies.back() / 1000.0);
+  // phones need the ECP frame, which goes out again once the InAutoPoll in progress ends
+  TEST_ASSERT_LESS_THAN(260000, latencies.back());
+  TEST_ASSERT_EQUAL(0, pn532().commands[0x4A]);
+}
+
+void test_tag_detected_mid_search(void) {
+  // a card doesn't wait for the ECP frame, the PN532 finds it within the InAutoPoll already armed
+  nfcTargetSim_t card;
+  card.uid = { 0xDE, 0xAD, 0xBE, 0xEF };
+  busEvent_t event;
+  int64_t latency = tap(card, 100000, event);
+  TEST_ASSERT_EQUAL(busEvent_t::TAG, event.type);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, latency);
+  TEST_ASSERT_LESS_THAN(int64_t(virtualPn532_t::autoPollUs + virtualPn532_t::activationUs + 10000), latency);
+}
+
+void test_missing_irq_falls_back_to_timeout(void) {
+  // IRQ line not connected: the task sleeps the whole InAutoPoll and reads the response afterwards
+  pn532().wire(255);
+  sim::drive(irqPin, HIGH);
+  nfcTargetSim_t card;
+  card.uid = { 0x01, 0x02, 0x03, 0x04 };
+  busEvent_t event;
+  int64_t latency = tap(card, 0, event);
+  pn532().wire(irqPin);
+  TEST_ASSERT_EQUAL(busEvent_t::TAG, event.type);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, latency);
+}
+
+int main(int argc, char** argv) {
+  boot();
+  UNITY_BEGIN();
+  RUN_TEST(test_reader_armed_with_autopoll);
+  RUN_TEST(test_task_sleeps_while_searching);
+  RUN_TEST(test_irq_wakes_task_on_detection);
+  RUN_TEST(test_tag_detected_mid_search);
+  RUN_TEST(test_missing_irq_falls_back_to_timeout);
+  int failures = UNITY_END();
+  sim::end();
+  return failures;
+}
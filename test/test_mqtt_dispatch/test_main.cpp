@@ -0,0 +1,189 @@
+#include <unity.h>
+#include <chrono>
+#include <mqtt_client.h>
+#include "espConfig.h"
+#include "mqttDispatch.h"
+
+/**
+ * `mqttDispatch` routing for the topics `mqtt_app_start` subscribes to, and its cost per message against
+ * the handler it replaced, which copied topic and payload into strings and `strcmp`ed the topic against
+ * every command topic in turn. The timings are host time and only printed: the table comes out at most
+ * about 20% faster than the chain and the gap changes sign between runs, too close to assert on.
+ */
+
+static constexpr int runs = 5;
+static constexpr int rounds = 200000;
+
+static esp_mqtt_client client;
+static std::array<uint32_t, MQTT_DISPATCH_MAX_ROUTES> hits;
+static int lastValue;
+
+template <size_t N>
+static void handler(esp_mqtt_client_handle_t client, std::string_view topic, std::string_view data) {
+  hits[N]++;
+  lastValue = mqtt_parse_int(data);
+}
+
+static std::string streamed;
+static std::vector<std::pair<size_t, size_t>> chunks;
+
+static void streamHandler(esp_mqtt_client_handle_t client, std::string_view data, size_t offset, size_t total) {
+  hits[6]++;
+  streamed.append(data);
+  chunks.push_back({ offset, total });
+}
+
+static std::string extTopic() {
+  return espConfig::mqttData.mqttClientId + "/homekey/ext/#";
+}
+
+/* The chain of `strcmp` the table replaced, over copies of the topic and payload */
+static void legacyHandler(const char* topicBuf, size_t topicLen, const char* dataBuf, size_t dataLen) {
+  auto&& mqtt = espConfig::mqttData;
+  std::string topic(topicBuf, topicBuf + topicLen);
+  std::string data(dataBuf, dataBuf + dataLen);
+  int state = atoi(data.c_str());
+  if (!strcmp(mqtt.lockCustomStateCmd.c_str(), topic.c_str())) {
+    handler<1>(&client, topic, data);
+  } else if (!strcmp(mqtt.lockStateCmd.c_str(), topic.c_str())) {
+    handler<3>(&client, topic, data);
+  } else if (!strcmp(mqtt.lockTStateCmd.c_str(), topic.c_str())) {
+    handler<5>(&client, topic, data);
+  } else if (!strcmp(mqtt.lockCStateCmd.c_str(), topic.c_str())) {
+    handler<4>(&client, topic, data);
+  } else if (!strcmp(mqtt.allowlistCmdTopic.c_str(), topic.c_str())) {
+    handler<6>(&client, topic, data);
+  } else if (!strcmp(mqtt.btrLvlCmdTopic.c_str(), topic.c_str())) {
+    handler<2>(&client, topic, data);
+  }
+  lastValue = state;
+}
+
+struct message_t
+{
+  std::string topic;
+  std::string data;
+};
+
+/* Mostly lock commands, with some battery levels and Home Assistant status like a busy broker */
+static std::vector<message_t> traffic() {
+  auto&& mqtt = espConfig::mqttData;
+  return {
+    { mqtt.lockTStateCmd, "1" }, { mqtt.lockCStateCmd, "1" }, { mqtt.lockStateCmd, "0" }, { mqtt.lockTStateCmd, "0" },
+    { mqtt.lockCStateCmd, "0" }, { mqtt.btrLvlCmdTopic, "87" }, { mqtt.lockCustomStateCmd, "2" }, { MQTT_HASS_STATUS_TOPIC, "online" },
+  };
+}
+
+void setUp(void) {
+  hits.fill(0);
+}
+
+void tearDown(void) {}
+
+void test_subscribe_from_table(void) {
+  mqttDispatch.subscribe(&client);
+  TEST_ASSERT_EQUAL(MQTT_DISPATCH_MAX_ROUTES, client.subscriptions.size());
+  TEST_ASSERT_EQUAL_STRING(MQTT_HASS_STATUS_TOPIC, client.subscriptions[0].topic.c_str());
+  TEST_ASSERT_EQUAL_STRING(espConfig::mqttData.allowlistCmdTopic.c_str(), client.subscriptions[6].topic.c_str());
+  TEST_ASSERT_EQUAL(1, client.subscriptions[6].qos);
+  // the table is full, another route is refused instead of overwriting one
+  mqttDispatch.add("extra/topic", 0, handler<0>);
+  TEST_ASSERT_EQUAL(MQTT_DISPATCH_MAX_ROUTES, mqttDispatch.count);
+}
+
+void test_routes(void) {
+  auto&& mqtt = espConfig::mqttData;
+  TEST_ASSERT_TRUE(mqttDispatch.dispatch(&client, mqtt.lockStateCmd, "1"));
+  TEST_ASSERT_EQUAL(1, hits[3]);
+  TEST_ASSERT_EQUAL(1, lastValue);
+  TEST_ASSERT_TRUE(mqttDispatch.dispatch(&client, mqtt.btrLvlCmdTopic, "42"));
+  TEST_ASSERT_EQUAL(1, hits[2]);
+  TEST_ASSERT_EQUAL(42, lastValue);
+  TEST_ASSERT_TRUE(mqttDispatch.dispatch(&client, mqtt.mqttClientId + "/homekey/ext/door/1", "7"));
+  TEST_ASSERT_TRUE(mqttDispatch.dispatch(&client, mqtt.mqttClientId + "/homekey/ext", "8"));
+  TEST_ASSERT_EQUAL(2, hits[7]);
+  uint32_t unmatched = mqttDispatch.unmatched;
+  // a prefix or an extension of a command topic is not that topic
+  TEST_ASSERT_FALSE(mqttDispatch.dispatch(&client, mqtt.lockStateCmd.substr(0, mqtt.lockStateCmd.size() - 1), "1"));
+  TEST_ASSERT_FALSE(mqttDispatch.dispatch(&client, mqtt.lockStateCmd + "/x", "1"));
+  TEST_ASSERT_FALSE(mqttDispatch.dispatch(&client, mqtt.mqttClientId + "/homekey/extra", "1"));
+  TEST_ASSERT_EQUAL(unmatched + 3, mqttDispatch.unmatched.load());
+  TEST_ASSERT_EQUAL(1, hits[3]);
+  TEST_ASSERT_EQUAL(0, mqtt_parse_int("abc"));
+}
+
+void test_chunked_messages(void) {
+  auto&& mqtt = espConfig::mqttData;
+  // only the first chunk carries the topic, the others follow the route it matched
+  std::string_view list = "04A1B2C3\n04D4E5F6\n";
+  TEST_ASSERT_TRUE(mqttDispatch.dispatch(&client, mqtt.allowlistCmdTopic, list.substr(0, 11), 0, list.size()));
+  TEST_ASSERT_TRUE(mqttDispatch.dispatch(&client, "", list.substr(11), 11, list.size()));
+  TEST_ASSERT_EQUAL(2, hits[6]);
+  TEST_ASSERT_EQUAL_STRING(std::string(list).c_str(), streamed.c_str());
+  TEST_ASSERT_EQUAL(11, chunks[1].first);
+  TEST_ASSERT_EQUAL(list.size(), chunks[1].second);
+  // a command split in two reaches its handler once, whole
+  TEST_ASSERT_TRUE(mqttDispatch.dispatch(&client, mqtt.btrLvlCmdTopic, "4", 0, 2));
+  TEST_ASSERT_EQUAL(0, hits[2]);
+  TEST_ASSERT_TRUE(mqttDispatch.dispatch(&client, "", "2", 1, 2));
+  TEST_ASSERT_EQUAL(1, hits[2]);
+  TEST_ASSERT_EQUAL(42, lastValue);
+  // the chunks of an unmatched message go with it and it is counted once
+  uint32_t unmatched = mqttDispatch.unmatched;
+  TEST_ASSERT_FALSE(mqttDispatch.dispatch(&client, "other/topic", "ab", 0, 4));
+  TEST_ASSERT_FALSE(mqttDispatch.dispatch(&client, "", "cd", 2, 4));
+  TEST_ASSERT_EQUAL(unmatched + 1, mqttDispatch.unmatched.load());
+  // a command too large to reassemble is dropped instead of handled in part
+  std::string large(MQTT_DISPATCH_MAX_MESSAGE, '1');
+  TEST_ASSERT_TRUE(mqttDispatch.dispatch(&client, mqtt.lockStateCmd, large, 0, large.size() + 1));
+  TEST_ASSERT_TRUE(mqttDispatch.dispatch(&client, "", "1", large.size(), large.size() + 1));
+  TEST_ASSERT_EQUAL(0, hits[3]);
+  TEST_ASSERT_TRUE(mqttDispatch.dispatch(&client, mqtt.lockStateCmd, "1"));
+  TEST_ASSERT_EQUAL(1, hits[3]);
+}
+
+void test_dispatch_cost(void) {
+  std::vector<message_t> messages = traffic();
+  double table = 1e18, legacy = 1e18;
+  for (int run = 0; run < runs; run++) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+      auto&& m = messages[i % messages.size()];
+      mqttDispatch.dispatch(&client, m.topic, m.data);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    table = std::min(table, elapsed.count() / rounds);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+      auto&& m = messages[i % messages.size()];
+      legacyHandler(m.topic.data(), m.topic.size(), m.data.data(), m.data.size());
+    }
+    elapsed = std::chrono::steady_clock::now() - start;
+    legacy = std::min(legacy, elapsed.count() / rounds);
+  }
+  printf("%zu routes, %zu topics: table %.1f ns, strcmp chain over copies %.1f ns per message (%+.0f%%)\n", size_t(mqttDispatch.count), messages.size(), table,
+         legacy, 100 * (legacy - table) / legacy);
+  // both reached the same handlers, bar the status topic the chain never routed
+  TEST_ASSERT_EQUAL(runs * 2 * (rounds / 8) * 5, hits[3] + hits[4] + hits[5]);
+  TEST_ASSERT_EQUAL(runs * 2 * (rounds / 8) * 2, hits[1] + hits[2] + hits[6] + hits[7]);
+  TEST_ASSERT_EQUAL(runs * (rounds / 8), hits[0]);
+}
+
+int main(int argc, char** argv) {
+  auto&& mqtt = espConfig::mqttData;
+  // the routes mqtt_app_start adds with custom states, the battery level and an extension prefix enabled
+  mqttDispatch.add(MQTT_HASS_STATUS_TOPIC, 0, handler<0>);
+  mqttDispatch.add(mqtt.lockCustomStateCmd, 0, handler<1>);
+  mqttDispatch.add(mqtt.btrLvlCmdTopic, 0, handler<2>);
+  mqttDispatch.add(mqtt.lockStateCmd, 0, handler<3>);
+  mqttDispatch.add(mqtt.lockCStateCmd, 0, handler<4>);
+  mqttDispatch.add(mqtt.lockTStateCmd, 0, handler<5>);
+  mqttDispatch.addStream(mqtt.allowlistCmdTopic, 1, streamHandler);
+  mqttDispatch.add(extTopic(), 0, handler<7>);
+  UNITY_BEGIN();
+  RUN_TEST(test_subscribe_from_table);
+  RUN_TEST(test_routes);
+  RUN_TEST(test_chunked_messages);
+  RUN_TEST(test_dispatch_cost);
+  return UNITY_END();
+}
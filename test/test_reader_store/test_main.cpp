@@ -0,0 +1,162 @@
+#include <unity.h>
+#include <chrono>
+#include <sim.h>
+#include <hkEndpointSim.h>
+#include "espConfig.h"
+#include "readerStore.h"
+
+/**
+ * NVS traffic of `readerStore` from 1 to 200 enrolled endpoints, against the `READERDATA` blob the HomeKey
+ * library rewrites whole after every change. Records and bytes are counted exactly, the save times are
+ * host time and only printed.
+ */
+
+static constexpr size_t sizes[] = { 1, 10, 50, 100, 200 };
+static constexpr size_t endpointsPerIssuer = 5;
+static constexpr int taps = 200;
+
+static hkEndpoint_t makeEndpoint(size_t i) {
+  std::vector<uint8_t> seed = { uint8_t(i), uint8_t(i >> 8) };
+  hkEndpoint_t endpoint;
+  endpoint.endpoint_id = hkSim::derive(seed, { 'i', 'd' }, 6);
+  endpoint.endpoint_key_x = hkSim::derive(seed, { 'k', 'x' }, 32);
+  endpoint.endpoint_pk = hkSim::derive(seed, { 'p', 'k' }, 65);
+  endpoint.endpoint_pk_x = hkSim::derive(seed, { 'p', 'x' }, 32);
+  endpoint.endpoint_prst_k = hkSim::derive(seed, { 'p', 's' }, 32);
+  return endpoint;
+}
+
+/* `endpoints` endpoints, `endpointsPerIssuer` per issuer like the devices of one Home member */
+static void enroll(size_t endpoints) {
+  readerData = readerData_t();
+  readerData.reader_sk = hkSim::derive({ 0x01 }, { 's', 'k' }, 32);
+  readerData.reader_pk = hkSim::derive({ 0x01 }, { 'p', 'k' }, 65);
+  readerData.reader_pk_x = hkSim::derive({ 0x01 }, { 'p', 'x' }, 32);
+  readerData.reader_gid = { 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8 };
+  readerData.reader_id = { 0xB1, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8 };
+  for (size_t i = 0; i < endpoints; i++) {
+    if (i % endpointsPerIssuer == 0) {
+      hkIssuer_t issuer;
+      issuer.issuer_id = hkSim::derive({ uint8_t(i), uint8_t(i >> 8) }, { 'i', 's' }, 8);
+      issuer.issuer_pk = hkSim::derive(issuer.issuer_id, { 'p', 'k' }, 32);
+      issuer.issuer_pk_x = issuer.issuer_pk;
+      readerData.issuers.push_back(issuer);
+    }
+    readerData.issuers.back().endpoints.push_back(makeEndpoint(i));
+  }
+}
+
+static size_t blobSize() {
+  return json::to_msgpack(json(readerData)).size();
+}
+
+struct written_t
+{
+  uint32_t records;
+  uint32_t bytes;
+  uint32_t nvsBytes;
+};
+
+/* Runs `change` and returns what reached NVS */
+template <typename F>
+static written_t measure(F&& change) {
+  uint32_t records = readerStore.recordsWritten;
+  uint32_t bytes = readerStore.bytesWritten;
+  uint64_t nvsBytes = sim::nvs("HK_READER").bytesWritten;
+  change();
+  return { readerStore.recordsWritten - records, readerStore.bytesWritten - bytes, uint32_t(sim::nvs("HK_READER").bytesWritten - nvsBytes) };
+}
+
+void setUp(void) {
+  readerStore.clear();
+}
+
+void tearDown(void) {}
+
+void test_write_amplification(void) {
+  printf("endpoints   blob | enroll all | tap: records bytes amplification   time | add one | remove one\n");
+  for (size_t endpoints : sizes) {
+    readerStore.clear();
+    enroll(endpoints);
+    size_t issuers = readerData.issuers.size();
+    written_t all = measure([] { TEST_ASSERT_TRUE(readerStore.save()); });
+    // reader, issuers, endpoints and the manifest
+    TEST_ASSERT_EQUAL(2 + issuers + endpoints, all.records);
+    TEST_ASSERT_EQUAL(all.bytes, all.nvsBytes);
+
+    // a tap bumps the counter of one endpoint and saves its issuer only
+    hkIssuer_t& issuer = readerData.issuers[issuers / 2];
+    hkEndpoint_t& endpoint = issuer.endpoints.back();
+    written_t tap{};
+    std::chrono::duration<double, std::micro> elapsed{};
+    for (int i = 0; i < taps; i++) {
+      endpoint.counter++;
+      endpoint.last_used_at = 1700000000 + i;
+      auto start = std::chrono::steady_clock::now();
+      written_t one = measure([&] { TEST_ASSERT_TRUE(readerStore.save(&issuer.issuer_id)); });
+      elapsed += std::chrono::steady_clock::now() - start;
+      // the record of that endpoint whatever the number enrolled
+      TEST_ASSERT_EQUAL(1, one.records);
+      TEST_ASSERT_EQUAL(json::to_msgpack(json(endpoint)).size(), one.bytes);
+      TEST_ASSERT_EQUAL(one.bytes, one.nvsBytes);
+      tap.records += one.records;
+      tap.bytes += one.bytes;
+    }
+    double tapBytes = double(tap.bytes) / taps;
+    written_t unchanged = measure([&] { TEST_ASSERT_TRUE(readerStore.save(&issuer.issuer_id)); });
+    TEST_ASSERT_EQUAL(0, unchanged.records);
+
+    // an enrollment writes the new endpoint and the manifest, a removal the manifest only
+    written_t added = measure([&] {
+      issuer.endpoints.push_back(makeEndpoint(1000));
+      TEST_ASSERT_TRUE(readerStore.save());
+    });
+    TEST_ASSERT_EQUAL(2, added.records);
+    written_t removed = measure([&] {
+      issuer.endpoints.pop_back();
+      TEST_ASSERT_TRUE(readerStore.save());
+    });
+    TEST_ASSERT_EQUAL(1, removed.records);
+
+    size_t blob = blobSize();
+    printf("%9zu %6zu | %10u | %12.1f %5.1f %12.1fx %5.1fus | %7u | %10u\n", endpoints, blob, all.bytes, double(tap.records) / taps, tapBytes, blob / tapBytes,
+           elapsed.count() / taps, added.bytes, removed.bytes);
+    if (endpoints >= 10) TEST_ASSERT_TRUE(blob > 10 * tapBytes);
+  }
+}
+
+void test_reload_matches(void) {
+  enroll(sizes[std::size(sizes) - 1]);
+  readerData.issuers[3].endpoints[2].counter = 42;
+  TEST_ASSERT_TRUE(readerStore.save());
+  json saved = readerData;
+  readerData = readerData_t();
+  readerStore.issuerSlots.clear();
+  readerStore.endpointSlots.clear();
+  readerStore.stored.clear();
+  TEST_ASSERT_TRUE(readerStore.loadShards());
+  TEST_ASSERT_TRUE(saved == json(readerData));
+  // slots and CRCs were restored, so saving the loaded data writes nothing
+  written_t again = measure([] { TEST_ASSERT_TRUE(readerStore.save()); });
+  TEST_ASSERT_EQUAL(0, again.records);
+}
+
+void test_library_blob_purged(void) {
+  // the library writes its blob through the handle it was given, the next save erases it
+  std::vector<uint8_t> blob = json::to_msgpack(json(readerData));
+  TEST_ASSERT_EQUAL(ESP_OK, nvs_set_blob(readerDataSink, "READERDATA", blob.data(), blob.size()));
+  size_t len = 0;
+  TEST_ASSERT_EQUAL(ESP_OK, nvs_get_blob(readerDataSink, "READERDATA", NULL, &len));
+  TEST_ASSERT_TRUE(readerStore.save());
+  TEST_ASSERT_EQUAL(ESP_ERR_NVS_NOT_FOUND, nvs_get_blob(readerDataSink, "READERDATA", NULL, &len));
+}
+
+int main(int argc, char** argv) {
+  nvs_open("SAVED_DATA", NVS_READWRITE, &savedData);
+  readerStore.begin();
+  UNITY_BEGIN();
+  RUN_TEST(test_write_amplification);
+  RUN_TEST(test_reload_matches);
+  RUN_TEST(test_library_blob_purged);
+  return UNITY_END();
+}
@@ -0,0 +1,145 @@
+#include <unity.h>
+#include <chrono>
+#include "readerStore.h"
+#include "tapPayload.h"
+
+/**
+ * Tap events on the binary topic (`tapBatch`, msgpack) against the JSON published on the `hkTopic`
+ * (`tap_event_json`): bytes on the wire are counted exactly, the encode times are host time and only
+ * compared with each other.
+ */
+
+static constexpr int rounds = 20000;
+
+using events_t = std::vector<std::pair<busEvent_t, uint32_t>>;
+
+static busEvent_t homekeyEvent(uint16_t tap) {
+  busEvent_t event{};
+  event.type = busEvent_t::HOMEKEY_SUCCESS;
+  event.tap = tap;
+  event.idLen = 6;
+  for (uint8_t i = 0; i < 8; i++) event.issuerId[i] = 0x10 + i;
+  for (uint8_t i = 0; i < 6; i++) event.id[i] = 0xE0 + i + tap;
+  event.atqa = { 0x04, 0x00 };
+  event.sak = 0x20;
+  return event;
+}
+
+static busEvent_t tagEvent(uint16_t tap) {
+  busEvent_t event{};
+  event.type = busEvent_t::TAG;
+  event.reader = 1;
+  event.tap = tap;
+  event.idLen = 7;
+  for (uint8_t i = 0; i < 7; i++) event.id[i] = 0x04 + i * 17 + tap;
+  event.atqa = { 0x44, 0x00 };
+  event.sak = 0x08;
+  event.allowed = true;
+  return event;
+}
+
+/* Three HomeKey taps to one tag, the first half live and the rest replayed from the journal */
+static events_t events(size_t n) {
+  events_t result;
+  for (size_t i = 0; i < n; i++) {
+    busEvent_t event = i % 4 == 3 ? tagEvent(i) : homekeyEvent(i);
+    result.push_back({ event, i < n / 2 ? 0 : uint32_t(1000 + i) });
+  }
+  return result;
+}
+
+struct cost_t
+{
+  double bytes;
+  double ns;
+};
+
+/* Bytes and best-of-5 host time per event to encode `list` with `encode` */
+template <typename F>
+static cost_t measure(const events_t& list, F&& encode) {
+  size_t bytes = encode(list);
+  double best = 1e18;
+  for (int run = 0; run < 5; run++) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) bytes = encode(list);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count() / rounds);
+  }
+  return { double(bytes) / list.size(), best / list.size() };
+}
+
+/* One publish per event on the `hkTopic` */
+static size_t encodeJson(const events_t& list) {
+  size_t bytes = 0;
+  for (auto&& [event, seq] : list) bytes += tap_event_json(event, seq).dump().size();
+  return bytes;
+}
+
+/* One publish every `batch` events on the binary topic */
+static size_t encodeBatch(const events_t& list, size_t batch) {
+  size_t bytes = 0;
+  for (size_t i = 0; i < list.size(); i++) {
+    tapBatch.add(list[i].first, list[i].second);
+    if ((i + 1) % batch == 0 || i + 1 == list.size()) bytes += tapBatch.flush().size();
+  }
+  return bytes;
+}
+
+static std::vector<uint8_t> bytes(const json& value) {
+  return value.get_binary();
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_batch_round_trip(void) {
+  auto list = events(MQTT_BINARY_BATCH);
+  for (auto&& [event, seq] : list) tapBatch.add(event, seq);
+  TEST_ASSERT_EQUAL(0, tapBatch.remaining(esp_timer_get_time()));
+  TEST_ASSERT_TRUE(tapBatch.replayed);
+  json payload = json::from_msgpack(tapBatch.flush());
+  TEST_ASSERT_FALSE(tapBatch.pending());
+  TEST_ASSERT_FALSE(tapBatch.replayed);
+  TEST_ASSERT_EQUAL(tapBatch_t::version, payload["v"].get<int>());
+  TEST_ASSERT_TRUE(bytes(payload["r"]) == readerData.reader_id);
+  TEST_ASSERT_EQUAL(list.size(), payload["e"].size());
+  for (size_t i = 0; i < list.size(); i++) {
+    auto&& [event, seq] = list[i];
+    auto&& entry = payload["e"][i];
+    TEST_ASSERT_EQUAL(9, entry.size());
+    TEST_ASSERT_EQUAL(event.type, entry[0].get<int>());
+    TEST_ASSERT_EQUAL(event.reader, entry[1].get<int>());
+    TEST_ASSERT_EQUAL(event.tap, entry[2].get<int>());
+    TEST_ASSERT_EQUAL(seq, entry[3].get<uint32_t>());
+    TEST_ASSERT_TRUE(bytes(entry[4]) == std::vector<uint8_t>(event.id.begin(), event.id.begin() + event.idLen));
+    if (event.type == busEvent_t::HOMEKEY_SUCCESS) {
+      TEST_ASSERT_TRUE(bytes(entry[5]) == std::vector<uint8_t>(event.issuerId.begin(), event.issuerId.end()));
+    } else {
+      TEST_ASSERT_TRUE(entry[5].is_null());
+    }
+    TEST_ASSERT_EQUAL(event.sak, entry[7].get<int>());
+    TEST_ASSERT_EQUAL(event.allowed, entry[8].get<bool>());
+  }
+}
+
+void test_encode_cost(void) {
+  events_t list = events(MQTT_BINARY_BATCH);
+  cost_t json = measure(list, encodeJson);
+  printf("%-22s %6.1f bytes %8.1f ns per event\n", "JSON, 1 per publish", json.bytes, json.ns);
+  for (size_t batch : { size_t(1), size_t(MQTT_BINARY_BATCH) }) {
+    cost_t packed = measure(list, [batch](const events_t& list) { return encodeBatch(list, batch); });
+    printf("msgpack, %zu per publish %6.1f bytes %8.1f ns per event\n", batch, packed.bytes, packed.ns);
+    // raw bytes instead of hex and positions instead of keys
+    TEST_ASSERT_TRUE(packed.bytes < json.bytes / 2);
+    if (batch > 1) TEST_ASSERT_TRUE(packed.ns < json.ns);
+  }
+}
+
+int main(int argc, char** argv) {
+  readerData.reader_id = { 0xB1, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8 };
+  UNITY_BEGIN();
+  RUN_TEST(test_batch_round_trip);
+  RUN_TEST(test_encode_cost);
+  return UNITY_END();
+}
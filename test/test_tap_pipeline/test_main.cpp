@@ -0,0 +1,298 @@
+#include <unity.h>
+#include <LittleFS.h>
+#include <sim.h>
+#include <virtualPn532.h>
+#include <hkEndpointSim.h>
+#include "actionsEngine.h"
+#include "eventBus.h"
+#include "hkFlowEngine.h"
+#include "hkIndex.h"
+#include "nfcReader.h"
+#include "readerStore.h"
+#include "tapPayload.h"
+#include "uidAllowlist.h"
+
+/**
+ * Tap-to-unlock pipeline on the host: the NFC task, the authentication context pool, the reader data
+ * store and the actions engine run unmodified on top of sim.h, against a virtual PN532 with a HomeKey
+ * endpoint put in its field. Latencies are virtual time from the endpoint entering the field, so they
+ * only depend on the firmware and the timing model and every run prints the same numbers.
+ *
+ * The test task stands in for the MQTT bus task, it builds the payloads of every tap event.
+ */
+
+static constexpr uint8_t successPin = 2;
+static constexpr uint8_t failPin = 15;
+static constexpr int taps = 20;
+// how long a phone is held against the reader, then how long the reader gets to notice it left
+static constexpr int64_t dwellUs = 1500000;
+static constexpr int64_t settleUs = 400000;
+
+static const std::vector<uint8_t> issuerId = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88 };
+static hkEndpointSim_t phone(1, issuerId);
+static eventBus_t::subscriber_t* sub;
+static std::vector<std::string> payloads;
+
+struct tap_t
+{
+  int64_t enter = 0;
+  bool posted = false;
+  busEvent_t event{};
+  int64_t gpio = -1;
+  int64_t total() const { return uint32_t(event.posted - uint32_t(enter)); }
+  int64_t detect() const { return uint32_t(event.detected - uint32_t(enter)); }
+};
+
+struct stats_t
+{
+  std::vector<int64_t> values;
+  int64_t at(double q) {
+    std::sort(values.begin(), values.end());
+    return values[size_t(q * (values.size() - 1))];
+  }
+};
+
+static virtualPn532_t& pn532() {
+  return virtualPn532_t::at(espConfig::miscConfig.nfcGpioPins[0]);
+}
+
+static void boot() {
+  espConfig::miscConfig.nfcSuccessPin = successPin;
+  espConfig::miscConfig.nfcSuccessTime = 100;
+  espConfig::miscConfig.nfcFailPin = failPin;
+  espConfig::miscConfig.nfcFailTime = 100;
+  espConfig::miscConfig.hkAuthPoolSize = 2;
+  nvs_open("SAVED_DATA", NVS_READWRITE, &savedData);
+  readerStore.begin();
+  readerData.reader_sk = hkSim::derive({ 0x01 }, { 's', 'k' }, 32);
+  readerData.reader_pk_x = hkSim::derive(readerData.reader_sk, { 'p', 'k' }, 32);
+  readerData.reader_pk = { 0x04 };
+  readerData.reader_pk.insert(readerData.reader_pk.end(), readerData.reader_pk_x.begin(), readerData.reader_pk_x.end());
+  readerData.reader_pk.resize(65, 0x5A);
+  readerData.reader_gid = { 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8 };
+  readerData.reader_id = { 0xB1, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8 };
+  hkIssuer_t issuer;
+  issuer.issuer_id = issuerId;
+  issuer.issuer_pk = hkSim::derive(issuerId, { 'p', 'k' }, 32);
+  issuer.issuer_pk_x = issuer.issuer_pk;
+  // other members of the household, enrolled before the phone so FAST tries their keys first
+  for (uint8_t i = 0; i < 10; i++) {
+    hkEndpointSim_t other(100 + i, issuerId);
+    other.persistentKey = hkSim::derive(other.pk_x, { i }, 32);
+    issuer.endpoints.push_back(other.enrolled());
+  }
+  phone.persistentKey = hkSim::derive(phone.pk_x, { 0xFF }, 32);
+  issuer.endpoints.push_back(phone.enrolled());
+  readerData.issuers.push_back(issuer);
+  readerStore.save();
+  hkIndex.rebuild(readerData);
+
+  nfcReaders.emplace_back(std::make_unique<nfcReader_t>(0, espConfig::miscConfig.nfcGpioPins[0], espConfig::miscConfig.nfcIrqPin));
+  pinMode(successPin, OUTPUT);
+  digitalWrite(successPin, !espConfig::miscConfig.nfcSuccessHL);
+  pinMode(failPin, OUTPUT);
+  digitalWrite(failPin, !espConfig::miscConfig.nfcFailHL);
+  LittleFS.begin(true);
+  actionsEngine.begin();
+  memcpy(ecpData + 8, readerData.reader_gid.data(), readerData.reader_gid.size());
+  with_crc16(ecpData, 16, ecpData + 16);
+  uidAllowlist.begin();
+  sub = eventBus.subscribe();
+  for (auto&& reader : nfcReaders) {
+    reader->authPool.begin(reader->pn532, reader->workingData);
+    std::string taskName = "nfc_task_" + std::to_string(reader->id);
+    xTaskCreate(nfc_thread_entry, taskName.c_str(), 8192, reader.get(), 1, &reader->task);
+  }
+  // let the reader come up and the pool fill before the first tap
+  sim::run_for(1000000);
+}
+
+/* Puts `target` in the field `offsetUs` from now and waits for the tap event and the feedback GPIO */
+static tap_t tap(nfcTargetSim_t& target, int64_t offsetUs) {
+  tap_t result;
+  result.enter = sim::now() + offsetUs;
+  pn532().place(target, result.enter, dwellUs);
+  result.posted = sim::run_until([] { return eventBus.head.load() != sub->cursor; }, offsetUs + dwellUs);
+  if (result.posted) {
+    eventBus.next(*sub, result.event);
+    payloads.push_back(tap_event_json(result.event, 0).dump());
+    tapBatch.add(result.event, 0);
+  }
+  sim::run_for(result.enter + dwellUs + settleUs - sim::now());
+  uint8_t pin = result.event.type == busEvent_t::HOMEKEY_SUCCESS || result.event.allowed ? successPin : failPin;
+  for (auto&& write : sim::writes()) {
+    if (write.gpio == pin && write.level == HIGH && write.at >= result.enter) {
+      result.gpio = write.at - result.enter;
+      break;
+    }
+  }
+  if (tapBatch.pending()) tapBatch.flush();
+  return result;
+}
+
+static void removePhone() {
+  xSemaphoreTake(readerDataMutex, portMAX_DELAY);
+  auto&& endpoints = readerData.issuers[0].endpoints;
+  endpoints.erase(std::remove_if(endpoints.begin(), endpoints.end(), [](const hkEndpoint_t& e) { return e.endpoint_pk_x == phone.pk_x; }), endpoints.end());
+  hkIndex.rebuild(readerData);
+  xSemaphoreGive(readerDataMutex);
+  readerStore.save();
+}
+
+static std::map<KeyFlow, stats_t> totals;
+
+/* Taps the phone `taps` times with `floor` as the lowest flow, arrivals spread over a polling cycle */
+static void benchmark(KeyFlow floor, KeyFlow expected, const char* name) {
+  hkFlow = floor;
+  uint32_t successes = hkFlowEngine.flows[expected].successes;
+  uint32_t hits = nfcReaders[0]->authPool.hits;
+  uint32_t recordsBefore = readerStore.recordsWritten;
+  stats_t detect, total, gpio;
+  for (int i = 0; i < taps; i++) {
+    if (expected == kFlowATTESTATION) removePhone();
+    tap_t t = tap(phone, (i * 7919) % 70000);
+    TEST_ASSERT_TRUE_MESSAGE(t.posted, name);
+    TEST_ASSERT_EQUAL_MESSAGE(busEvent_t::HOMEKEY_SUCCESS, t.event.type, name);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(issuerId.data(), t.event.issuerId.data(), issuerId.size());
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(phone.endpointId.data(), t.event.id.data(), phone.endpointId.size());
+    TEST_ASSERT_GREATER_OR_EQUAL_MESSAGE(0, t.gpio, "no feedback pulse");
+    detect.values.push_back(t.detect());
+    total.values.push_back(t.total());
+    gpio.values.push_back(t.gpio);
+  }
+  TEST_ASSERT_EQUAL_UINT32_MESSAGE(successes + taps, hkFlowEngine.flows[expected].successes, name);
+  TEST_ASSERT_EQUAL_UINT32_MESSAGE(hits + taps, nfcReaders[0]->authPool.hits, "contexts should come from the pool");
+  // the library's READERDATA blob is purged by the save after the tap, which is persisted as readerStore records
+  size_t len;
+  TEST_ASSERT_EQUAL(ESP_ERR_NVS_NOT_FOUND, nvs_get_blob(readerDataSink, "READERDATA", NULL, &len));
+  TEST_ASSERT_GREATER_THAN(recordsBefore, readerStore.recordsWritten);
+  printf("%-12s taps %2d | detect p50 %6.1f p95 %6.1f max %6.1f | event p50 %6.1f p95 %6.1f max %6.1f | gpio p50 %6.1f p95 %6.1f max %6.1f ms\n", name, taps,
+         detect.at(0.5) / 1000.0, detect.at(0.95) / 1000.0, detect.at(1) / 1000.0, total.at(0.5) / 1000.0, total.at(0.95) / 1000.0, total.at(1) / 1000.0,
+         gpio.at(0.5) / 1000.0, gpio.at(0.95) / 1000.0, gpio.at(1) / 1000.0);
+  totals[expected] = total;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_fast_flow(void) {
+  benchmark(kFlowFAST, kFlowFAST, "FAST");
+  TEST_ASSERT_EQUAL_UINT32(0, phone.apdus[0x81]);
+}
+
+void test_standard_flow(void) {
+  benchmark(kFlowSTANDARD, kFlowSTANDARD, "STANDARD");
+}
+
+void test_attestation_flow(void) {
+  benchmark(kFlowATTESTATION, kFlowATTESTATION, "ATTESTATION");
+  TEST_ASSERT_NOT_NULL(hkIndex.findEndpoint(readerData, phone.endpointId.data(), phone.endpointId.size()));
+}
+
+void test_flows_ordered(void) {
+  TEST_ASSERT_EQUAL_MESSAGE(3, totals.size(), "every flow benchmark has to pass first");
+  TEST_ASSERT_LESS_THAN(totals[kFlowSTANDARD].at(0.5), totals[kFlowFAST].at(0.95));
+  TEST_ASSERT_LESS_THAN(totals[kFlowATTESTATION].at(0.5), totals[kFlowSTANDARD].at(0.95));
+}
+
+void test_fast_escalates_to_standard(void) {
+  hkFlow = kFlowFAST;
+  // a phone restored from a backup lost its persistent key, FAST fails and the same tap goes on with STANDARD
+  phone.persistentKey.clear();
+  uint32_t escalations = hkFlowEngine.escalations;
+  uint32_t selects = phone.apdus[0xA4];
+  tap_t t = tap(phone, 0);
+  TEST_ASSERT_TRUE(t.posted);
+  TEST_ASSERT_EQUAL(busEvent_t::HOMEKEY_SUCCESS, t.event.type);
+  TEST_ASSERT_EQUAL_UINT32(escalations + 1, hkFlowEngine.escalations);
+  TEST_ASSERT_EQUAL_UINT32(selects + 2, phone.apdus[0xA4]);
+  // STANDARD handed out a new persistent key, the next tap is FAST again
+  TEST_ASSERT_FALSE(phone.persistentKey.empty());
+  uint32_t fast = hkFlowEngine.flows[kFlowFAST].successes;
+  t = tap(phone, 0);
+  TEST_ASSERT_TRUE(t.posted);
+  TEST_ASSERT_EQUAL_UINT32(fast + 1, hkFlowEngine.flows[kFlowFAST].successes);
+}
+
+void test_unknown_tag_published(void) {
+  nfcTargetSim_t card;
+  card.uid = { 0xDE, 0xAD, 0xBE, 0xEF };
+  tap_t t = tap(card, 0);
+  TEST_ASSERT_TRUE(t.posted);
+  TEST_ASSERT_EQUAL(busEvent_t::TAG, t.event.type);
+  TEST_ASSERT_FALSE(t.event.allowed);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(card.uid.data(), t.event.id.data(), card.uid.size());
+  TEST_ASSERT_GREATER_OR_EQUAL_MESSAGE(0, t.gpio, "no fail pulse");
+  TEST_ASSERT_TRUE(payloads.back().find("\"uid\":\"DEADBEEF\"") != std::string::npos);
+}
+
+void test_reader_data_free_during_auth(void) {
+  hkFlow = kFlowSTANDARD;
+  int counter = hkIndex.findEndpoint(readerData, phone.endpointId.data(), phone.endpointId.size())->counter;
+  uint32_t auth1 = phone.apdus[0x81];
+  int64_t enter = sim::now();
+  pn532().place(phone, enter, dwellUs);
+  TEST_ASSERT_TRUE(sim::run_until([auth1] { return phone.apdus[0x81] != auth1; }, dwellUs));
+  // the phone is still working on AUTH1, yet HomeKit can change the reader data meanwhile
+  TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(readerDataMutex, 0));
+  hkEndpoint_t added;
+  added.endpoint_id = { 0xAD, 0xDE, 0xD0, 0x00, 0x00, 0x01 };
+  readerData.issuers[0].endpoints.push_back(added);
+  hkIndex.rebuild(readerData);
+  xSemaphoreGive(readerDataMutex);
+  TEST_ASSERT_TRUE(sim::run_until([] { return eventBus.head.load() != sub->cursor; }, dwellUs));
+  busEvent_t event;
+  eventBus.next(*sub, event);
+  TEST_ASSERT_EQUAL(busEvent_t::HOMEKEY_SUCCESS, event.type);
+  sim::run_for(enter + dwellUs + settleUs - sim::now());
+  // both the endpoint added during the tap and the update made by the tap are kept
+  TEST_ASSERT_NOT_NULL(hkIndex.findEndpoint(readerData, added.endpoint_id.data(), added.endpoint_id.size()));
+  TEST_ASSERT_EQUAL(counter + 1, hkIndex.findEndpoint(readerData, phone.endpointId.data(), phone.endpointId.size())->counter);
+}
+
+void test_disabled_pool_counts_nothing(void) {
+  // with hkAuthPoolSize 0 every tap builds its context on demand, which isn't a pool miss
+  uint8_t size = espConfig::miscConfig.hkAuthPoolSize;
+  espConfig::miscConfig.hkAuthPoolSize = 0;
+  hkAuthPool_t pool;
+  pool.begin(nfcReaders[0]->pn532, nfcReaders[0]->workingData);
+  TEST_ASSERT_NOT_NULL(pool.take().get());
+  espConfig::miscConfig.hkAuthPoolSize = size;
+  TEST_ASSERT_EQUAL_UINT32(0, pool.hits);
+  TEST_ASSERT_EQUAL_UINT32(0, pool.misses);
+}
+
+void test_feedback_pulse(void) {
+  // every success pulse is reverted after nfcSuccessTime by the actions engine timer
+  int64_t high = -1;
+  int pulses = 0;
+  for (auto&& write : sim::writes()) {
+    if (write.gpio != successPin) continue;
+    if (write.level == HIGH) high = write.at;
+    else if (high >= 0) {
+      TEST_ASSERT_EQUAL(int64_t(espConfig::miscConfig.nfcSuccessTime) * 1000, write.at - high);
+      high = -1;
+      pulses++;
+    }
+  }
+  // the flow benchmarks, the two escalation taps and test_reader_data_free_during_auth
+  TEST_ASSERT_EQUAL(3 * taps + 3, pulses);
+}
+
+int main(int argc, char** argv) {
+  boot();
+  UNITY_BEGIN();
+  RUN_TEST(test_fast_flow);
+  RUN_TEST(test_standard_flow);
+  RUN_TEST(test_attestation_flow);
+  RUN_TEST(test_flows_ordered);
+  RUN_TEST(test_fast_escalates_to_standard);
+  RUN_TEST(test_unknown_tag_published);
+  RUN_TEST(test_reader_data_free_during_auth);
+  RUN_TEST(test_disabled_pool_counts_nothing);
+  RUN_TEST(test_feedback_pulse);
+  int failures = UNITY_END();
+  sim::end();
+  return failures;
+}
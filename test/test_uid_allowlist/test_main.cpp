@@ -0,0 +1,166 @@
+#include <unity.h>
+#include <chrono>
+#include <LittleFS.h>
+#include <sim.h>
+#include "uidAllowlist.h"
+
+/**
+ * A full `UID_ALLOWLIST_MAX_ENTRIES` allowlist loaded through the staged runs, then looked up for every
+ * entry and as many unknown UIDs. LittleFS traffic is counted exactly, the timings are host time.
+ */
+
+static constexpr size_t entries = UID_ALLOWLIST_MAX_ENTRIES;
+
+/* Distinct 4 and 7 byte UIDs, `i` in the first bytes so `salt` keeps lists apart */
+static std::vector<uint8_t> makeUid(size_t i, uint8_t salt) {
+  std::vector<uint8_t> uid = { uint8_t(i), uint8_t(i >> 8), salt, uint8_t(i * 31) };
+  if (i % 3 == 0) uid.insert(uid.end(), { 0x04, uint8_t(i >> 4), 0x80 });
+  return uid;
+}
+
+static std::string hex(const std::vector<uint8_t>& uid) {
+  std::string text;
+  char b[3];
+  for (uint8_t v : uid) {
+    snprintf(b, sizeof(b), "%02X", v);
+    text += b;
+  }
+  return text;
+}
+
+static std::string list;
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_duplicates_merged(void) {
+  // every UID staged twice, a whole run apart, so only the merge can drop the repeats
+  std::string text;
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t i = 0; i < 2 * UID_ALLOWLIST_RUN_SIZE; i++) text += hex(makeUid(i, 0x11)) + "\n";
+  }
+  uint32_t load = uidAllowlist.stageBegin();
+  uidAllowlist.stageText(load, text.data(), text.size());
+  TEST_ASSERT_EQUAL(2 * UID_ALLOWLIST_RUN_SIZE, uidAllowlist.stageCommit(load));
+  TEST_ASSERT_EQUAL(0, uidAllowlist.rejected);
+}
+
+void test_load_full_list(void) {
+  // listed in descending order so every run overlaps the key range of the others
+  for (size_t i = entries; i-- > 0;) list += hex(makeUid(i, 0xA5)) + "\n";
+  list += "12\nnot a uid\n";
+  sim::io_t before = sim::littlefs();
+  auto start = std::chrono::steady_clock::now();
+  uint32_t load = uidAllowlist.stageBegin();
+  // fed in 1 KB chunks like the HTTP upload, lines split across chunks
+  for (size_t i = 0; i < list.size(); i += 1024) uidAllowlist.stageText(load, list.data() + i, std::min<size_t>(1024, list.size() - i));
+  size_t runs = uidAllowlist.runs.size() + !uidAllowlist.staging.empty();
+  size_t count = uidAllowlist.stageCommit(load);
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  sim::io_t io = sim::littlefs();
+  printf("loaded %zu entries from %zu runs in %.1f ms: %u writes (%llu bytes), %u reads (%llu bytes)\n", count, runs, elapsed.count(), io.writes - before.writes,
+         (unsigned long long)(io.bytesWritten - before.bytesWritten), io.reads - before.reads, (unsigned long long)(io.bytesRead - before.bytesRead));
+  TEST_ASSERT_EQUAL(entries, count);
+  TEST_ASSERT_EQUAL(2, uidAllowlist.rejected);
+  TEST_ASSERT_GREATER_THAN(1, runs);
+  TEST_ASSERT_EQUAL(entries * sizeof(uint64_t), LittleFS.open(uidAllowlist_t::path, "r").size());
+  TEST_ASSERT_FALSE(LittleFS.exists(uidAllowlist_t::runsPath));
+  TEST_ASSERT_EQUAL((entries + uidAllowlist_t::stride - 1) / uidAllowlist_t::stride, uidAllowlist.fence.size());
+}
+
+void test_merged_list_sorted(void) {
+  File file = LittleFS.open(uidAllowlist_t::path, "r");
+  std::vector<uint64_t> keys(entries);
+  TEST_ASSERT_EQUAL(keys.size() * sizeof(uint64_t), file.read(reinterpret_cast<uint8_t*>(keys.data()), keys.size() * sizeof(uint64_t)));
+  file.close();
+  for (size_t i = 1; i < keys.size(); i++) TEST_ASSERT_TRUE(keys[i - 1] < keys[i]);
+}
+
+void test_lookups(void) {
+  std::vector<std::vector<uint8_t>> known, unknown;
+  for (size_t i = 0; i < entries; i++) {
+    known.push_back(makeUid(i, 0xA5));
+    unknown.push_back(makeUid(i, 0x5A));
+  }
+  sim::io_t before = sim::littlefs();
+  auto start = std::chrono::steady_clock::now();
+  size_t found = 0;
+  for (auto&& uid : known) found += uidAllowlist.contains(uid.data(), uid.size());
+  std::chrono::duration<double, std::nano> knownTime = std::chrono::steady_clock::now() - start;
+  uint32_t knownReads = sim::littlefs().reads - before.reads;
+  start = std::chrono::steady_clock::now();
+  size_t falsePositives = 0;
+  for (auto&& uid : unknown) falsePositives += uidAllowlist.contains(uid.data(), uid.size());
+  std::chrono::duration<double, std::nano> unknownTime = std::chrono::steady_clock::now() - start;
+  uint32_t unknownReads = sim::littlefs().reads - before.reads - knownReads;
+  printf("%zu listed UIDs: %.0f ns and %.2f file reads per lookup\n", known.size(), knownTime.count() / known.size(), double(knownReads) / known.size());
+  printf("%zu unknown UIDs: %.0f ns and %.3f file reads per lookup (Bloom filter passes)\n", unknown.size(), unknownTime.count() / unknown.size(),
+         double(unknownReads) / unknown.size());
+  TEST_ASSERT_EQUAL(entries, found);
+  TEST_ASSERT_EQUAL(0, falsePositives);
+  // one block read per listed UID, 3 hashes into 64 Kbit let about 5% of the unknown ones through
+  TEST_ASSERT_EQUAL(entries, knownReads);
+  TEST_ASSERT_LESS_THAN(entries / 10, unknownReads);
+}
+
+void test_reload_from_file(void) {
+  std::vector<uint64_t> fence = uidAllowlist.fence;
+  std::vector<uint32_t> bloom = uidAllowlist.bloom;
+  uidAllowlist.begin();
+  TEST_ASSERT_EQUAL(entries, uidAllowlist.count);
+  TEST_ASSERT_TRUE(fence == uidAllowlist.fence);
+  TEST_ASSERT_TRUE(bloom == uidAllowlist.bloom);
+}
+
+void test_overflow_rejected(void) {
+  uint32_t load = uidAllowlist.stageBegin();
+  std::string extra = list + hex(makeUid(entries, 0xA5)) + "\n";
+  uidAllowlist.stageText(load, extra.data(), extra.size());
+  TEST_ASSERT_EQUAL(entries, uidAllowlist.stageCommit(load));
+  TEST_ASSERT_EQUAL(3, uidAllowlist.rejected);
+  std::vector<uint8_t> last = makeUid(entries, 0xA5);
+  TEST_ASSERT_FALSE(uidAllowlist.contains(last.data(), last.size()));
+}
+
+void test_one_load_at_a_time(void) {
+  std::string first = hex(makeUid(1, 0x33)) + "\n" + hex(makeUid(2, 0x33)) + "\n";
+  std::string second = hex(makeUid(3, 0x44)) + "\n";
+  uint32_t http = uidAllowlist.stageBegin();
+  TEST_ASSERT_NOT_EQUAL(0, http);
+  uidAllowlist.stageText(http, first.data(), 10);
+  // a second loader is turned away and its chunks don't land in the first load
+  uint32_t mqtt = uidAllowlist.stageBegin();
+  TEST_ASSERT_EQUAL(0, mqtt);
+  uidAllowlist.stageText(mqtt, second.data(), second.size());
+  uidAllowlist.stageText(http, first.data() + 10, first.size() - 10);
+  TEST_ASSERT_EQUAL(0, uidAllowlist.stageCommit(mqtt));
+  TEST_ASSERT_EQUAL(2, uidAllowlist.stageCommit(http));
+  TEST_ASSERT_EQUAL(0, uidAllowlist.rejected);
+  // a load abandoned halfway holds the staging state until it times out
+  uint32_t abandoned = uidAllowlist.stageBegin();
+  uidAllowlist.stageText(abandoned, second.data(), second.size());
+  sim::run_for(int64_t(UID_ALLOWLIST_LOAD_TIMEOUT) * 1000000 - 1);
+  TEST_ASSERT_EQUAL(0, uidAllowlist.stageBegin());
+  sim::run_for(1);
+  uint32_t next = uidAllowlist.stageBegin();
+  TEST_ASSERT_NOT_EQUAL(0, next);
+  TEST_ASSERT_EQUAL(0, uidAllowlist.stageCommit(abandoned));
+  uidAllowlist.stageText(next, first.data(), first.size());
+  TEST_ASSERT_EQUAL(2, uidAllowlist.stageCommit(next));
+  std::vector<uint8_t> uid = makeUid(3, 0x44);
+  TEST_ASSERT_FALSE(uidAllowlist.contains(uid.data(), uid.size()));
+}
+
+int main(int argc, char** argv) {
+  LittleFS.begin(true);
+  UNITY_BEGIN();
+  RUN_TEST(test_duplicates_merged);
+  RUN_TEST(test_load_full_list);
+  RUN_TEST(test_merged_list_sorted);
+  RUN_TEST(test_lookups);
+  RUN_TEST(test_reload_from_file);
+  RUN_TEST(test_overflow_rejected);
+  RUN_TEST(test_one_load_at_a_time);
+  return UNITY_END();
+}